@@ -0,0 +1,80 @@
+#include <log.h>
+#include <procyon.h>
+#include <time.h>
+
+#define STARTUP_RUN_COUNT 16
+
+typedef struct bench_state_t {
+  procy_window_t* window;
+  double first_frame_time;
+} bench_state_t;
+
+static double get_time(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+void on_draw(procy_state_t* state, double time) {
+  bench_state_t* data = (bench_state_t*)state->data;
+
+  // the first frame has been reached; that's all we're measuring
+  if (data->first_frame_time == 0.0) {
+    data->first_frame_time = get_time();
+  }
+
+  procy_draw_string(data->window, 0, 0, 0, procy_create_color(255, 255, 255),
+                    procy_create_color(0, 0, 0), "Startup Benchmark");
+  procy_close_window(data->window);
+}
+
+int main(int argc, const char** argv) {
+  double create_total = 0.0;
+  double create_min = -1.0;
+  double frame_total = 0.0;
+  double frame_min = -1.0;
+
+  for (int i = 0; i < STARTUP_RUN_COUNT; ++i) {
+    bench_state_t data = {NULL, 0.0};
+    procy_state_t* state = procy_create_callback_state(
+        NULL, NULL, on_draw, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+    state->data = &data;
+
+    // window creation covers context setup, shader programs and the glyph
+    // texture upload
+    double start = get_time();
+    data.window = procy_create_window(800, 600, "Startup Benchmark", state);
+    double created = get_time();
+
+    if (data.window == NULL) {
+      log_error("Failed to create window");
+      procy_destroy_state(state);
+      return -1;
+    }
+
+    procy_begin_loop(data.window);
+    procy_destroy_window(data.window);
+    procy_destroy_state(state);
+
+    double create_time = created - start;
+    double frame_time = data.first_frame_time - start;
+    create_total += create_time;
+    frame_total += frame_time;
+    if (create_min < 0.0 || create_time < create_min) {
+      create_min = create_time;
+    }
+    if (frame_min < 0.0 || frame_time < frame_min) {
+      frame_min = frame_time;
+    }
+
+    log_info("(Run %d) window created in %.2f ms, first frame at %.2f ms",
+             i + 1, create_time * 1000.0, frame_time * 1000.0);
+  }
+
+  log_info("Window creation => avg. %.2f ms, min. %.2f ms",
+           create_total / STARTUP_RUN_COUNT * 1000.0, create_min * 1000.0);
+  log_info("First frame => avg. %.2f ms, min. %.2f ms",
+           frame_total / STARTUP_RUN_COUNT * 1000.0, frame_min * 1000.0);
+
+  return 0;
+}
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "color.h"
 
@@ -17,7 +18,7 @@ typedef struct procy_draw_op_text_t {
   procy_color_t color;
   procy_color_t background;
   int x, y, z;
-  unsigned char character;
+  uint32_t codepoint;
   bool bold;
 } procy_draw_op_text_t;
 
@@ -66,6 +67,70 @@ void procy_draw_string_bold(struct procy_window_t *window, int x, int y,
                             int z, procy_color_t color,
                             procy_color_t background, const char *contents);
 
+/*
+ * Draws a UTF-8 encoded string.  Characters outside of CP437 are drawn from
+ * the font loaded with procy_load_glyph_font, or as '?' if there is none.
+ */
+void procy_draw_string_utf8(struct procy_window_t *window, int x, int y,
+                            int z, procy_color_t color,
+                            procy_color_t background, const char *contents);
+
+void procy_draw_string_utf8_bold(struct procy_window_t *window, int x, int y,
+                                 int z, procy_color_t color,
+                                 procy_color_t background,
+                                 const char *contents);
+
+void procy_draw_codepoint(struct procy_window_t *window, int x, int y, int z,
+                          procy_color_t color, procy_color_t background,
+                          uint32_t codepoint);
+
+void procy_draw_codepoint_bold(struct procy_window_t *window, int x, int y,
+                               int z, procy_color_t color,
+                               procy_color_t background, uint32_t codepoint);
+
+/*
+ * Loads a TrueType font from which glyphs that aren't part of the built-in
+ * CP437 set are rasterized on demand
+ */
+bool procy_load_glyph_font(struct procy_window_t *window, const char *path);
+
+bool procy_load_glyph_font_mem(struct procy_window_t *window,
+                               const unsigned char *buffer, size_t length);
+
+/*
+ * Decodes the UTF-8 sequence at the start of `contents`, returning the number
+ * of bytes consumed.  Invalid sequences decode to U+FFFD one byte at a time.
+ */
+size_t procy_decode_utf8(const char *contents, size_t length,
+                         uint32_t *codepoint);
+
+/*
+ * Steps through a string one drawn character at a time, applying the inline
+ * modifiers understood by `pr.draw.string` along the way: `%b` toggles bold,
+ * `%i` swaps the colors and `%%` is a literal '%'.  When `utf8` is false,
+ * each byte is a CP437 character.
+ */
+typedef struct procy_text_cursor_t {
+  const char *contents;
+  size_t length, position;
+  bool utf8;
+
+  // the style of the most recently returned character
+  procy_color_t color, background;
+  bool bold;
+} procy_text_cursor_t;
+
+procy_text_cursor_t procy_create_text_cursor(const char *contents,
+                                             size_t length, bool utf8,
+                                             procy_color_t color,
+                                             procy_color_t background);
+
+/*
+ * Advances to the next character to be drawn, returning false once there are
+ * none left
+ */
+bool procy_next_text_glyph(procy_text_cursor_t *cursor, uint32_t *codepoint);
+
 void procy_draw_rect(struct procy_window_t *window, int x, int y, int z,
                      int width, int height, procy_color_t color);
 
@@ -85,6 +150,10 @@ procy_draw_op_text_t procy_create_draw_op_char_colored(int x, int y,
                                                        procy_color_t background,
                                                        char c, bool bold);
 
+procy_draw_op_text_t procy_create_draw_op_codepoint_colored(
+    int x, int y, int z, procy_color_t color, procy_color_t background,
+    uint32_t codepoint, bool bold);
+
 procy_draw_op_rect_t procy_create_draw_op_rect(int x, int y, int z,
                                                int width, int height,
                                                procy_color_t color);
@@ -0,0 +1,111 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// number of glyph cells along each side of an atlas page
+#define PROCY_GLYPH_PAGE_CELLS 16
+#define PROCY_GLYPHS_PER_PAGE (PROCY_GLYPH_PAGE_CELLS * PROCY_GLYPH_PAGE_CELLS)
+
+// the largest valid Unicode codepoint; anything above it is drawn as '?'
+#define PROCY_MAX_CODEPOINT 0x10FFFF
+
+struct stbtt_fontinfo;
+
+typedef enum procy_glyph_lookup_t {
+  PROCY_GLYPH_FOUND,
+  PROCY_GLYPH_RASTERIZED,
+  PROCY_GLYPH_MISSING
+} procy_glyph_lookup_t;
+
+typedef struct procy_glyph_cache_stats_t {
+  // lookups and texture uploads performed during the last frame
+  unsigned long hits, misses, evictions;
+  size_t upload_bytes;
+
+  // lookups performed over the lifetime of the cache
+  unsigned long total_hits, total_misses;
+  float hit_rate;
+} procy_glyph_cache_stats_t;
+
+typedef struct procy_glyph_slot_t {
+  uint32_t key;
+  int prev, next;
+  unsigned long frame;
+  bool occupied;
+} procy_glyph_slot_t;
+
+typedef struct procy_glyph_cache_t {
+  struct {
+    uint32_t key;
+    int value;
+  } * glyphs, *cp437;
+  procy_glyph_slot_t *slots;
+  int slot_count, lru_head, lru_tail, first_layer;
+  int glyph_width, glyph_height;
+  struct stbtt_fontinfo *font;
+  unsigned char *font_data, *bitmap, *scratch;
+  float scale;
+  int ascent, descent;
+  unsigned long frame;
+
+  // bumped whenever cached glyphs are evicted or dropped, so that geometry
+  // built from earlier lookups can tell that it may be stale
+  unsigned long generation;
+  procy_glyph_cache_stats_t stats;
+} procy_glyph_cache_t;
+
+/*
+ * Creates a cache of `pages` atlas pages, each holding a 16x16 grid of glyphs
+ * of the given size.  Pages are expected to live in texture array layers
+ * beginning at `first_layer`, following the regular and bold CP437 layers.
+ */
+procy_glyph_cache_t *procy_create_glyph_cache(int glyph_width, int glyph_height,
+                                              int pages, int first_layer);
+
+void procy_destroy_glyph_cache(procy_glyph_cache_t *cache);
+
+/*
+ * Sets the TrueType font from which glyphs outside of CP437 are rasterized.
+ * The buffer is copied.  Any glyphs cached from a previous font are dropped.
+ */
+bool procy_set_glyph_cache_font(procy_glyph_cache_t *cache,
+                                const unsigned char *buffer, size_t length);
+
+/*
+ * Resets the per-frame statistics and marks the start of a new frame for the
+ * purposes of LRU eviction
+ */
+void procy_glyph_cache_begin_frame(procy_glyph_cache_t *cache);
+
+/*
+ * Finds the texture layer and cell index of a codepoint's glyph.
+ *
+ * Codepoints that have an equivalent in CP437 always resolve to the built-in
+ * glyphs.  Others are rasterized into a cache page on first use, in which case
+ * PROCY_GLYPH_RASTERIZED is returned and the cell's pixels are left in
+ * `cache->bitmap` to be uploaded.  If that required evicting a glyph that was
+ * already drawn this frame, `evicted_in_use` is set.  Codepoints that can't be
+ * rasterized, or that aren't valid Unicode, resolve to the CP437 '?' glyph
+ * and return PROCY_GLYPH_MISSING.
+ */
+procy_glyph_lookup_t procy_glyph_cache_get(procy_glyph_cache_t *cache,
+                                           uint32_t codepoint, bool bold,
+                                           int *layer, int *cell,
+                                           bool *evicted_in_use);
+
+/*
+ * Marks a cached glyph, given by the layer and cell that
+ * `procy_glyph_cache_get` returned for it, as drawn this frame without looking
+ * it up again.  Built-in glyphs are ignored.
+ */
+void procy_glyph_cache_touch(procy_glyph_cache_t *cache, int layer, int cell);
+
+/*
+ * Returns the Unicode codepoint equivalent to a CP437 character
+ */
+uint32_t procy_cp437_to_codepoint(unsigned char c);
+
+#endif
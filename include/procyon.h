@@ -22,9 +22,12 @@ extern "C" {
 
 #include "color.h"
 #include "drawing.h"
+#include "glyph_cache.h"
 #include "keys.h"
 #include "mouse.h"
+#include "resource.h"
 #include "state.h"
+#include "text_run.h"
 #include "window.h"
 
 #ifdef PROCYON_EXPORT_LOGGING
@@ -0,0 +1,31 @@
+#ifndef RESOURCE_H
+#define RESOURCE_H
+
+#include <stddef.h>
+
+typedef struct procy_embedded_resource_t {
+  const char *name;
+  const unsigned char *data;
+  size_t length;
+} procy_embedded_resource_t;
+
+/*
+ * Finds an embedded resource by its file name (e.g. "glyph.vert").  Bundles
+ * registered with procy_register_embedded_resources are searched before the
+ * library's own resources, most recently registered first.  Returns NULL if
+ * no resource by that name exists.
+ *
+ * Resource data is always followed by a null terminator that is not counted
+ * in its length.
+ */
+const procy_embedded_resource_t *procy_get_embedded_resource(const char *name);
+
+/*
+ * Makes a bundle produced by `genhexer --bundle` available to
+ * procy_get_embedded_resource.  Entries must be sorted by name, which
+ * genhexer does already.
+ */
+void procy_register_embedded_resources(
+    const procy_embedded_resource_t *resources, size_t count);
+
+#endif
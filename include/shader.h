@@ -21,7 +21,18 @@ bool procy_compile_vert_shader(const char *data, unsigned int *index);
 bool procy_link_shader_program(unsigned int vert, unsigned int frag,
                                unsigned int *index);
 
+/*
+ * Compiles and links a shader program, reusing a previously-linked program
+ * binary from the shader cache directory when the driver accepts it
+ */
 bool procy_compile_and_link_shader(procy_shader_program_t *program,
                                    const char *vert, const char *frag);
 
+/*
+ * Overrides the directory in which linked shader program binaries are cached
+ * between runs.  Passing NULL disables the cache.  By default binaries are
+ * stored in the user's cache directory (e.g. ~/.cache/procyon).
+ */
+void procy_set_shader_cache_dir(const char *path);
+
 #endif
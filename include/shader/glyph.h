@@ -4,11 +4,14 @@
 #include "shader.h"
 
 struct procy_draw_op_text_t;
+struct procy_draw_op_text_run_t;
+struct procy_glyph_cache_t;
 
 typedef struct procy_glyph_shader_program_t {
   procy_shader_program_t program;
   void *vertex_batch_buffer, *index_batch_buffer;
   unsigned int u_ortho, u_sampler, font_texture;
+  struct procy_glyph_cache_t *cache;
   struct {
     int width, height;
   } texture_bounds;
@@ -26,11 +29,12 @@ procy_glyph_shader_program_t *procy_create_glyph_shader();
 
 /*
  * Builds and executes a draw call on the GPU, consisting of vertex data built
- * from all of the `GLYPH` type draw operations
+ * from all of the `GLYPH` type draw operations and queued text runs
  */
 void procy_draw_glyph_shader(procy_glyph_shader_program_t *shader,
                              struct procy_window_t *window,
-                             struct procy_draw_op_text_t *draw_ops);
+                             struct procy_draw_op_text_t *draw_ops,
+                             struct procy_draw_op_text_run_t *run_ops);
 
 /*
  * Computes glyph bounds in pixels
@@ -38,6 +42,13 @@ void procy_draw_glyph_shader(procy_glyph_shader_program_t *shader,
 void procy_get_glyph_bounds(procy_glyph_shader_program_t *shader, int *width,
                             int *height);
 
+/*
+ * Sets the TrueType font used to rasterize glyphs that aren't part of the
+ * built-in CP437 set
+ */
+bool procy_set_glyph_shader_font(procy_glyph_shader_program_t *shader,
+                                 const unsigned char *buffer, size_t length);
+
 /*
  * Disposes of a glyph shader program and deletes its bound resources from
  * the OpenGL context
@@ -0,0 +1,69 @@
+#ifndef TEXT_RUN_H
+#define TEXT_RUN_H
+
+#include <stdbool.h>
+
+#include "color.h"
+
+struct procy_window_t;
+struct procy_draw_op_text_t;
+struct procy_glyph_vertex_t;
+
+typedef struct procy_text_run_t {
+  // pre-parsed glyphs, with `x` holding each glyph's column within the run
+  struct procy_draw_op_text_t *glyphs;
+
+  // geometry built by the glyph shader the first time the run is drawn,
+  // relative to the run's origin, along with the glyph cache generation it
+  // was built against and the atlas cells (layer * PROCY_GLYPHS_PER_PAGE +
+  // cell) it takes from the cache
+  struct procy_glyph_vertex_t *vertices;
+  unsigned long generation;
+  int *cached_cells;
+
+  char *contents;
+  procy_color_t color, background;
+  int columns, pending;
+  bool utf8, destroyed;
+} procy_text_run_t;
+
+typedef struct procy_draw_op_text_run_t {
+  procy_text_run_t *run;
+  int x, y, z;
+} procy_draw_op_text_run_t;
+
+/*
+ * Parses a string into a text run that can be drawn repeatedly without being
+ * parsed again.  The same inline modifiers as the Lua `pr.draw.string` are
+ * supported: `%b` toggles bold, `%i` swaps the colors and `%%` is a literal
+ * '%'.  When `utf8` is false, each byte is a CP437 character.
+ */
+procy_text_run_t *procy_create_text_run(const char *contents,
+                                        procy_color_t color,
+                                        procy_color_t background, bool utf8);
+
+/*
+ * Updates the contents and colors of a text run, re-parsing it only if they
+ * have changed.  Returns true if the run was rebuilt.
+ */
+bool procy_set_text_run(procy_text_run_t *run, const char *contents,
+                        procy_color_t color, procy_color_t background);
+
+/*
+ * Queues a text run to be drawn this frame as a single draw op
+ */
+void procy_draw_text_run(struct procy_window_t *window, procy_text_run_t *run,
+                         int x, int y, int z);
+
+/*
+ * Destroys a text run.  If it's still queued to be drawn, it's freed once
+ * the frame has been drawn instead.
+ */
+void procy_destroy_text_run(procy_text_run_t *run);
+
+/*
+ * Signals that a queued draw of the text run has been handled
+ */
+void procy_release_text_run(procy_text_run_t *run);
+
+#endif
@@ -18,7 +18,9 @@ struct procy_draw_op_text_t;
 struct procy_draw_op_rect_t;
 struct procy_draw_op_sprite_t;
 struct procy_draw_op_line_t;
+struct procy_draw_op_text_run_t;
 struct procy_draw_op_sprite_bucket_t;
+struct procy_glyph_cache_stats_t;
 struct GLFWwindow;
 
 typedef struct procy_window_t {
@@ -38,6 +40,7 @@ typedef struct procy_window_t {
   float ortho[4][4];
   bool quitting, high_fps;
   struct procy_draw_op_text_t *draw_ops_text;
+  struct procy_draw_op_text_run_t *draw_ops_text_run;
   struct procy_draw_op_rect_t *draw_ops_rect;
   struct procy_draw_op_line_t *draw_ops_line;
   struct procy_draw_op_sprite_bucket_t *draw_ops_sprite;
@@ -56,6 +59,15 @@ void procy_begin_loop(procy_window_t *window);
 void procy_append_draw_op_text(procy_window_t *window,
                                struct procy_draw_op_text_t *op);
 
+/*
+ * Ensures there's room for at least `count` more text draw ops, so that large
+ * batches can be appended without repeatedly growing the list
+ */
+void procy_reserve_draw_ops_text(procy_window_t *window, size_t count);
+
+void procy_append_draw_op_text_run(procy_window_t *window,
+                                   struct procy_draw_op_text_run_t *op);
+
 void procy_append_draw_op_rect(procy_window_t *window,
                                struct procy_draw_op_rect_t *op);
 
@@ -72,6 +84,12 @@ void procy_get_window_size(procy_window_t *window, int *width, int *height);
 
 void procy_get_glyph_size(procy_window_t *window, int *width, int *height);
 
+/*
+ * Retrieves glyph cache statistics for the most recently drawn frame
+ */
+void procy_get_glyph_cache_stats(procy_window_t *window,
+                                 struct procy_glyph_cache_stats_t *stats);
+
 void procy_set_clear_color(procy_color_t c);
 
 void procy_set_window_title(procy_window_t *window, const char *title);
@@ -80,6 +98,12 @@ void procy_close_window(procy_window_t *window);
 
 void procy_set_high_fps_mode(procy_window_t *window, bool high_fps);
 
+/*
+ * Returns the number of seconds since the main loop began, with a resolution
+ * fine enough to time parts of a frame
+ */
+double procy_get_time(void);
+
 void procy_set_scale(procy_window_t *window, float x, float y);
 
 void procy_reset_scale(procy_window_t *window);
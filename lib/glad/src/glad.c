@@ -7,6 +7,7 @@
     APIs: gl=3.3
     Profile: core
     Extensions:
+        GL_ARB_get_program_binary,
         GL_ARB_texture_storage,
         GL_EXT_texture_array
     Loader: True
@@ -15,9 +16,9 @@
     Reproducible: False
 
     Commandline:
-        --profile="core" --api="gl=3.3" --generator="c" --spec="gl" --extensions="GL_ARB_texture_storage,GL_EXT_texture_array"
+        --profile="core" --api="gl=3.3" --generator="c" --spec="gl" --extensions="GL_ARB_get_program_binary,GL_ARB_texture_storage,GL_EXT_texture_array"
     Online:
-        https://glad.dav1d.de/#profile=core&language=c&specification=gl&loader=on&api=gl%3D3.3&extensions=GL_ARB_texture_storage&extensions=GL_EXT_texture_array
+        https://glad.dav1d.de/#profile=core&language=c&specification=gl&loader=on&api=gl%3D3.3&extensions=GL_ARB_get_program_binary&extensions=GL_ARB_texture_storage&extensions=GL_EXT_texture_array
 */
 
 #include <stdio.h>
@@ -642,8 +643,12 @@ PFNGLVERTEXP4UIPROC glad_glVertexP4ui = NULL;
 PFNGLVERTEXP4UIVPROC glad_glVertexP4uiv = NULL;
 PFNGLVIEWPORTPROC glad_glViewport = NULL;
 PFNGLWAITSYNCPROC glad_glWaitSync = NULL;
+int GLAD_GL_ARB_get_program_binary = 0;
 int GLAD_GL_ARB_texture_storage = 0;
 int GLAD_GL_EXT_texture_array = 0;
+PFNGLGETPROGRAMBINARYPROC glad_glGetProgramBinary = NULL;
+PFNGLPROGRAMBINARYPROC glad_glProgramBinary = NULL;
+PFNGLPROGRAMPARAMETERIPROC glad_glProgramParameteri = NULL;
 PFNGLTEXSTORAGE1DPROC glad_glTexStorage1D = NULL;
 PFNGLTEXSTORAGE2DPROC glad_glTexStorage2D = NULL;
 PFNGLTEXSTORAGE3DPROC glad_glTexStorage3D = NULL;
@@ -1061,6 +1066,12 @@ static void load_GL_VERSION_3_3(GLADloadproc load) {
 	glad_glSecondaryColorP3ui = (PFNGLSECONDARYCOLORP3UIPROC)load("glSecondaryColorP3ui");
 	glad_glSecondaryColorP3uiv = (PFNGLSECONDARYCOLORP3UIVPROC)load("glSecondaryColorP3uiv");
 }
+static void load_GL_ARB_get_program_binary(GLADloadproc load) {
+	if(!GLAD_GL_ARB_get_program_binary) return;
+	glad_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+	glad_glProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+	glad_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+}
 static void load_GL_ARB_texture_storage(GLADloadproc load) {
 	if(!GLAD_GL_ARB_texture_storage) return;
 	glad_glTexStorage1D = (PFNGLTEXSTORAGE1DPROC)load("glTexStorage1D");
@@ -1073,6 +1084,7 @@ static void load_GL_EXT_texture_array(GLADloadproc load) {
 }
 static int find_extensionsGL(void) {
 	if (!get_exts()) return 0;
+	GLAD_GL_ARB_get_program_binary = has_ext("GL_ARB_get_program_binary");
 	GLAD_GL_ARB_texture_storage = has_ext("GL_ARB_texture_storage");
 	GLAD_GL_EXT_texture_array = has_ext("GL_EXT_texture_array");
 	free_exts();
@@ -1153,6 +1165,7 @@ int gladLoadGLLoader(GLADloadproc load) {
 	load_GL_VERSION_3_3(load);
 
 	if (!find_extensionsGL()) return 0;
+	load_GL_ARB_get_program_binary(load);
 	load_GL_ARB_texture_storage(load);
 	load_GL_EXT_texture_array(load);
 	return GLVersion.major != 0 || GLVersion.minor != 0;
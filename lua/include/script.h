@@ -8,11 +8,33 @@ struct procy_window_t;
 struct script_env_t;
 struct procy_state_t;
 
+typedef enum script_gc_mode_t {
+  SCRIPT_GC_BUDGETED,
+  SCRIPT_GC_INCREMENTAL,
+  SCRIPT_GC_FULL,
+  SCRIPT_GC_MANUAL
+} script_gc_mode_t;
+
+/*
+ * How the Lua garbage collector is run between frames, and how long it has
+ * taken
+ */
+typedef struct script_gc_t {
+  script_gc_mode_t mode;
+  double budget;  // seconds of collection per frame, when budgeted
+  bool idle;      // whether a cycle has finished and another isn't due yet
+  int start_kb, limit_kb;
+  double pause, max_pause;
+  unsigned long cycles, overruns;
+} script_gc_t;
+
 typedef struct script_env_t {
   struct lua_State *L;
   struct procy_window_t *window;
   struct procy_state_t *state;
   bool reload;  // when true, restart the in main after main loop ends
+  script_gc_t gc;
+  double draw_time;  // seconds spent in the last call to on_draw
 } script_env_t;
 
 script_env_t *create_script_env(struct procy_window_t *window,
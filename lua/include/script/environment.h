@@ -26,6 +26,8 @@ void add_window(lua_State *L, script_env_t *env);
 void add_utilities(lua_State *L);
 void add_noise(lua_State *L);
 void add_plane(lua_State *L);
+void add_jobs(lua_State *L);
+void add_ffi(lua_State *L);
 
 /*
  * Utility methods available to script-setup logic
@@ -35,6 +37,13 @@ void push_color(lua_State *L, float r, float g, float b);
 
 procy_color_t get_color(lua_State *L, int index);
 
+/*
+ * Converts either a packed 0xRRGGBB color or a handle returned by
+ * `pr.color.palette` to a color, returning false (with the color set to
+ * black) if the handle isn't valid
+ */
+bool unpack_color(long long value, procy_color_t *color);
+
 #ifdef _WIN32
 #define PROCY_SCRIPT_PATH_SEPARATOR '\\'
 #else
@@ -0,0 +1,18 @@
+/*
+ * Input events, which are queued as they arrive and delivered to the script
+ * once per frame
+ */
+
+#ifndef SCRIPT_INPUT_H
+#define SCRIPT_INPUT_H
+
+typedef struct lua_State lua_State;
+
+/*
+ * Calls the script's input handlers for every event queued since the last
+ * call, and makes them available to `pr.input.poll`.  Called at the start of
+ * each frame.
+ */
+void dispatch_input(lua_State *L);
+
+#endif
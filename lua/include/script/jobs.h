@@ -0,0 +1,65 @@
+/*
+ * Native work run in the background with `pr.jobs.submit`, for the modules
+ * that provide kinds of job
+ */
+
+#ifndef SCRIPT_JOBS_H
+#define SCRIPT_JOBS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct lua_State lua_State;
+
+/*
+ * A kind of job, named by the `op` passed to `pr.jobs.submit`.  Each job has
+ * `state_size` bytes of state, which start zeroed and are passed to each of
+ * the functions below in turn.
+ */
+typedef struct job_op_t {
+  const char *name;
+  size_t state_size;
+
+  /*
+   * Called on the main thread with the job's arguments on the stack, starting
+   * at `index`.  Copies whatever the job needs out of the Lua state, and
+   * returns false (after logging an error) if the arguments aren't valid.
+   */
+  bool (*prepare)(lua_State *L, int index, void *state);
+
+  /*
+   * Called on a background thread to do the work.  Mustn't touch the Lua
+   * state.
+   */
+  void (*run)(void *state);
+
+  /*
+   * Called on the main thread at the start of the frame after `run` returns.
+   * Pushes the job's results, returning how many there are.
+   */
+  int (*finish)(lua_State *L, void *state);
+
+  /*
+   * Frees whatever the state holds, whether or not the job was finished.  `L`
+   * is NULL if the Lua state is being closed, in which case references to it
+   * needn't be released.
+   */
+  void (*destroy)(lua_State *L, void *state);
+} job_op_t;
+
+extern const job_op_t plane_encode_job;
+extern const job_op_t plane_decode_job;
+extern const job_op_t plane_import_job;
+extern const job_op_t plane_export_job;
+extern const job_op_t plane_save_job;
+extern const job_op_t plane_load_job;
+extern const job_op_t plane_fill_noise_job;
+extern const job_op_t plane_dijkstra_map_job;
+
+/*
+ * Delivers the results of every job that has finished since the last call,
+ * calling their callbacks.  Called at the start of each frame.
+ */
+void complete_jobs(lua_State *L);
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Helpers for splitting work on large buffers (such as planes) across
+ * threads
+ */
+
+#ifndef SCRIPT_PARALLEL_H
+#define SCRIPT_PARALLEL_H
+
+#include <stdbool.h>
+
+/*
+ * Processes the rows in [first, last)
+ */
+typedef void (*parallel_rows_fn)(void *context, int first, int last);
+
+/*
+ * Calls `func` on contiguous bands of `rows` rows, each at least `min_rows`
+ * long, spread across the calling thread and the pool used by
+ * parallel_submit.  Returns once every row has been processed.  `func` must be
+ * safe to call from multiple threads at once, and mustn't touch the Lua state.
+ * This may be called from within a task.
+ */
+void parallel_for_rows(int rows, int min_rows, parallel_rows_fn func,
+                       void *context);
+
+/*
+ * A task run in the background by parallel_submit
+ */
+typedef void (*parallel_task_fn)(void *context);
+
+/*
+ * Queues `func` to be called on one of a pool of background threads, which is
+ * started the first time this is called.  Each thread has its own queue of
+ * tasks, and steals from the others' when its own is empty.  Returns false if
+ * the task couldn't be queued (e.g. where threads aren't available), in which
+ * case `func` won't be called.  As with parallel_for_rows, `func` mustn't
+ * touch the Lua state.
+ */
+bool parallel_submit(parallel_task_fn func, void *context);
+
+/*
+ * Returns the number of threads that parallel_for_rows will use at most, which
+ * is also the number of threads in the pool used by parallel_submit
+ */
+int get_parallel_thread_count(void);
+
+#endif
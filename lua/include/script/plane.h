@@ -0,0 +1,312 @@
+/*
+ * Plane data shared between the scripting modules that operate on planes
+ * directly, rather than through the `pr.plane` Lua API.
+ */
+
+#ifndef SCRIPT_PLANE_H
+#define SCRIPT_PLANE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TBL_PLANE_META "procyon_plane_meta"
+
+typedef struct lua_State lua_State;
+
+/*
+ * The type of each element in a plane.  Values stored in the narrower types
+ * are truncated to fit, and any non-zero value stored in a bit plane is 1.
+ */
+typedef enum plane_type_t {
+  PLANE_I32,
+  PLANE_U16,
+  PLANE_U8,
+  PLANE_BIT
+} plane_type_t;
+
+/*
+ * Names of the plane types as they're given in Lua, indexed by type
+ */
+extern const char *const plane_type_names[];
+
+typedef struct plane_t {
+  // bit planes are packed eight elements to a byte, lowest bit first
+  union {
+    int *buffer;
+    uint16_t *u16;
+    uint8_t *u8;
+    uint8_t *bits;
+    void *data;
+  };
+  int width;
+  int height;
+  plane_type_t type;
+  // element (x, y) is stored at index `offset + y * stride + x`; views share
+  // their parent's elements, and other planes have an offset of zero and a
+  // stride equal to their width
+  size_t offset;
+  int stride;
+} plane_t;
+
+/*
+ * A table mapping plane values to other values, stored densely over the range
+ * of its keys
+ */
+typedef struct plane_lut_t {
+  int min, length;
+  int *values;
+  bool *present;
+} plane_lut_t;
+
+typedef enum blit_mode_t {
+  BLIT_COPY,
+  BLIT_MAX,
+  BLIT_MIN,
+  BLIT_ADD,
+  BLIT_XOR
+} blit_mode_t;
+
+/*
+ * How plane:blit combines the elements of a source plane with those of its
+ * destination
+ */
+typedef struct blit_options_t {
+  blit_mode_t mode;
+  bool has_transparent;
+  int transparent;
+  plane_t *mask;
+} blit_options_t;
+
+/*
+ * Converts the Lua value at `index` to a lookup table value, returning whether
+ * it could be converted
+ */
+typedef bool (*plane_lut_value_fn)(lua_State *L, int index, int *value);
+
+/*
+ * Returns whether the value at `index` is a plane table
+ */
+bool is_plane(lua_State *L, int index);
+
+/*
+ * Retrieves the plane data from the plane table at `index`, or NULL (after
+ * logging an error) if it isn't a valid plane
+ */
+plane_t *get_plane(lua_State *L, int index);
+
+/*
+ * Pushes a new plane table onto the stack and returns its data.  The buffer
+ * is left uninitialized.
+ */
+plane_t *push_new_plane(int width, int height, size_t *len, lua_State *L);
+
+/*
+ * As with `push_new_plane`, but for a plane holding elements of `type`
+ */
+plane_t *push_new_typed_plane(int width, int height, plane_type_t type,
+                              size_t *len, lua_State *L);
+
+/*
+ * Returns the number of bytes needed to store `length` elements of `type`
+ */
+size_t get_plane_buffer_size(plane_type_t type, size_t length);
+
+/*
+ * Returns `value` as it would be read back after being stored in a plane of
+ * `type`
+ */
+static inline int narrow_plane_value(plane_type_t type, int value) {
+  switch (type) {
+    case PLANE_U16:
+      return (uint16_t)value;
+    case PLANE_U8:
+      return (uint8_t)value;
+    case PLANE_BIT:
+      return value != 0;
+    default:
+      return value;
+  }
+}
+
+/*
+ * Returns whether the plane's rows are stored one after another, which is
+ * true of every plane except views narrower than their parents
+ */
+static inline bool is_plane_contiguous(const plane_t *plane) {
+  return plane->stride == plane->width;
+}
+
+/*
+ * Returns the index at which the element `index` (i.e. `y * width + x`) is
+ * stored
+ */
+static inline size_t get_plane_index(const plane_t *plane, size_t index) {
+  if (is_plane_contiguous(plane)) {
+    return plane->offset + index;
+  }
+
+  size_t width = (size_t)plane->width;
+  return plane->offset + index / width * (size_t)plane->stride + index % width;
+}
+
+static inline int get_plane_value(const plane_t *plane, size_t index) {
+  index = get_plane_index(plane, index);
+  switch (plane->type) {
+    case PLANE_U16:
+      return plane->u16[index];
+    case PLANE_U8:
+      return plane->u8[index];
+    case PLANE_BIT:
+      return (plane->bits[index >> 3] >> (index & 7)) & 1;
+    default:
+      return plane->buffer[index];
+  }
+}
+
+static inline void set_plane_value(plane_t *plane, size_t index, int value) {
+  index = get_plane_index(plane, index);
+  switch (plane->type) {
+    case PLANE_U16:
+      plane->u16[index] = (uint16_t)value;
+      break;
+    case PLANE_U8:
+      plane->u8[index] = (uint8_t)value;
+      break;
+    case PLANE_BIT:
+      if (value != 0) {
+        plane->bits[index >> 3] |= (uint8_t)(1 << (index & 7));
+      } else {
+        plane->bits[index >> 3] &= (uint8_t)~(1 << (index & 7));
+      }
+      break;
+    default:
+      plane->buffer[index] = value;
+      break;
+  }
+}
+
+/*
+ * Copies `length` consecutive elements of the plane, starting with the one at
+ * `first`, into `values`
+ */
+void read_plane_values(const plane_t *plane, size_t first, size_t length,
+                       int *values);
+
+/*
+ * Stores `length` values in consecutive elements of the plane, starting with
+ * the one at `first`
+ */
+void write_plane_values(plane_t *plane, size_t first, size_t length,
+                        const int *values);
+
+/*
+ * Copies every element of `source` into `target`, which must have the same
+ * dimensions
+ */
+void copy_plane_elements(plane_t *target, const plane_t *source);
+
+/*
+ * Returns whether the planes may share elements, as a view does with its
+ * parent or with an overlapping view of the same parent.  Only the span of
+ * storage each one covers is compared, so side-by-side views of the same rows
+ * are also reported as overlapping.
+ */
+bool planes_overlap(const plane_t *a, const plane_t *b);
+
+/*
+ * Returns every element of the plane as an int, for code that only works on
+ * ints.  For contiguous i32 planes this is the plane's own buffer; for the
+ * others it's a widened or gathered copy.  Either way, it must be passed to
+ * `release_plane_ints` once it's no longer needed.  Returns NULL (after
+ * logging an error) if the copy couldn't be allocated.
+ */
+int *acquire_plane_ints(lua_State *L, const plane_t *plane);
+
+/*
+ * Releases the ints returned by `acquire_plane_ints`, first storing them back
+ * into the plane if `modified` is true
+ */
+void release_plane_ints(plane_t *plane, int *ints, bool modified);
+
+/*
+ * Returns a copy of every element of the plane as an int, which the caller
+ * frees, or NULL (after logging an error) if it couldn't be allocated.  Used
+ * to hand a plane's elements to work done in the background.
+ */
+int *copy_plane_ints(lua_State *L, const plane_t *plane);
+
+/*
+ * Reads the Lua table at `index`, which must have integer keys, into a lookup
+ * table.  The lookup table should be freed with `free_plane_lut` even if this
+ * fails.
+ */
+bool read_plane_lut(lua_State *L, int index, plane_lut_value_fn get_value,
+                    plane_lut_t *lut);
+
+bool plane_lut_find(const plane_lut_t *lut, int key, int *value);
+
+void free_plane_lut(plane_lut_t *lut);
+
+/*
+ * Reads the options table given to plane:blit at `index`, which may be nil.
+ * The mask plane, if any, must be the same size as `src`.
+ */
+bool get_blit_options(lua_State *L, int index, const plane_t *src,
+                      blit_options_t *options);
+
+/*
+ * Combines `length` source elements onto as many destination elements, as
+ * plane:blit does.  `mask` may be NULL.
+ */
+void blit_row(int *dest, const int *src, const int *mask, size_t length,
+              const blit_options_t *options);
+
+/*
+ * Adds the native plane operators (plane:add, plane:clamp, etc.) to the table
+ * at `index`
+ */
+void add_plane_ops(lua_State *L, int index);
+
+/*
+ * Adds the native plane filters (plane:step_automaton and plane:convolve) to
+ * the table at `index`
+ */
+void add_plane_filters(lua_State *L, int index);
+
+/*
+ * Adds the native region functions (plane:flood_fill and
+ * plane:label_components) to the table at `index`
+ */
+void add_plane_regions(lua_State *L, int index);
+
+/*
+ * Adds the native pathfinding functions (plane:dijkstra_map and plane:astar)
+ * to the table at `index`
+ */
+void add_plane_paths(lua_State *L, int index);
+
+/*
+ * Adds the native field of view functions (plane:fov and plane:light_map) to
+ * the table at `index`
+ */
+void add_plane_fov(lua_State *L, int index);
+
+/*
+ * Adds plane.chunked, which creates unbounded planes stored as 64x64 chunks
+ * that are only allocated once written to, to the table at `index`
+ */
+void add_chunked_plane(lua_State *L, int index);
+
+/*
+ * Adds plane:save to the table at `index`
+ */
+void add_plane_file_methods(lua_State *L, int index);
+
+/*
+ * Adds plane.load and plane.open, which read planes from files written by
+ * plane:save, to the table at `index`
+ */
+void add_plane_files(lua_State *L, int index);
+
+#endif
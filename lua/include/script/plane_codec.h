@@ -0,0 +1,55 @@
+/*
+ * Compression of blocks of plane elements, with the codec chosen separately
+ * for each block
+ */
+
+#ifndef SCRIPT_PLANE_CODEC_H
+#define SCRIPT_PLANE_CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The ways in which a block can be compressed
+ */
+typedef enum block_codec_t {
+  BLOCK_RAW,            // little-endian 32-bit values
+  BLOCK_RLE,            // little-endian pairs of (run length, value)
+  BLOCK_PACKED,         // values bitpacked with simdcomp, all to the same width
+  BLOCK_DELTA,          // zigzagged differences between values, bitpacked
+  BLOCK_GROUPED,        // as with BLOCK_PACKED, with a width per 128 values
+  BLOCK_GROUPED_DELTA,  // as with BLOCK_DELTA, with a width per 128 values
+  BLOCK_DICTIONARY      // up to 256 distinct values, and grouped indexes
+} block_codec_t;
+
+/*
+ * A block's codec is stored in the lowest byte of its format, and the bit
+ * width of its packed values (if any) in the byte above that
+ */
+#define BLOCK_FORMAT(codec, bits) ((uint32_t)(codec) | (uint32_t)(bits) << 8)
+#define BLOCK_FORMAT_CODEC(format) ((block_codec_t)((format) & 0xFF))
+#define BLOCK_FORMAT_BITS(format) (((format) >> 8) & 0xFF)
+
+/*
+ * Returns the number of bytes that `compress_block` may write for `length`
+ * values
+ */
+size_t get_block_bound(size_t length);
+
+/*
+ * Compresses `length` values into `out`, returning the number of bytes
+ * written.  The codec is chosen by estimating the size of each from a sample
+ * of the values, and is stored in `format`.
+ */
+size_t compress_block(const int *values, size_t length, uint8_t *out,
+                      uint32_t *format);
+
+/*
+ * Decompresses the `size` bytes at `in`, compressed with `format`, into
+ * `length` values.  Returns false if the data isn't valid for the format.
+ */
+bool decompress_block(const uint8_t *in, size_t size, uint32_t format,
+                      size_t length, int *values);
+
+#endif
@@ -0,0 +1,92 @@
+-- Flat drawing API for LuaJIT's FFI.
+--
+-- Calls made through this module go straight into the engine without passing
+-- through the Lua C API, so loops that draw through it can be JIT-compiled
+-- in their entirety.  Colors are packed 0xRRGGBB integers (see `rgb`).
+
+local ffi = require('ffi')
+local bit = require('bit')
+
+local window_ptr = ...
+
+ffi.cdef [[
+typedef struct procy_window_t procy_window_t;
+
+void procy_ffi_draw_char(procy_window_t *window, int x, int y, int z,
+                         int color, int background, uint32_t codepoint,
+                         bool bold);
+void procy_ffi_draw_string(procy_window_t *window, int x, int y, int z,
+                           int color, int background, const char *contents,
+                           size_t length);
+void procy_ffi_draw_rect(procy_window_t *window, int x, int y, int z,
+                         int width, int height, int color);
+void procy_ffi_draw_line(procy_window_t *window, int x1, int y1, int x2,
+                         int y2, int z, int color);
+int procy_ffi_get_glyph_width(procy_window_t *window);
+int procy_ffi_get_glyph_height(procy_window_t *window);
+]]
+
+local C = ffi.C
+local window = ffi.cast('procy_window_t *', window_ptr)
+local floor = math.floor
+local bor, lshift = bit.bor, bit.lshift
+
+local WHITE = 0xFFFFFF
+local BLACK = 0x000000
+
+-- the layer is tracked here rather than read back from the engine on every
+-- call; set_layer keeps pr.draw's layer in sync as well
+local layer = 1
+
+local M = {
+  WHITE = WHITE,
+  BLACK = BLACK
+}
+
+function M.rgb(r, g, b)
+  return bor(lshift(floor(r * 255), 16), lshift(floor(g * 255), 8),
+             floor(b * 255))
+end
+
+function M.from_color(color)
+  if type(color) == "number" then
+    return color
+  end
+
+  return M.rgb(color.r, color.g, color.b)
+end
+
+function M.set_layer(z)
+  layer = z
+  pr.draw.set_layer(z)
+end
+
+function M.char(x, y, value, color, background)
+  C.procy_ffi_draw_char(window, x, y, layer, color or WHITE,
+                        background or BLACK, value, false)
+end
+
+function M.char_bold(x, y, value, color, background)
+  C.procy_ffi_draw_char(window, x, y, layer, color or WHITE,
+                        background or BLACK, value, true)
+end
+
+function M.string(x, y, contents, color, background)
+  C.procy_ffi_draw_string(window, x, y, layer, color or WHITE,
+                          background or BLACK, contents, #contents)
+end
+
+function M.rect(x, y, width, height, color)
+  C.procy_ffi_draw_rect(window, x, y, layer, width, height, color or WHITE)
+end
+
+function M.line(x1, y1, x2, y2, color)
+  C.procy_ffi_draw_line(window, x1, y1, x2, y2, layer, color or WHITE)
+end
+
+function M.get_glyph_size()
+  return C.procy_ffi_get_glyph_width(window),
+         C.procy_ffi_get_glyph_height(window)
+end
+
+return M
@@ -41,6 +41,6 @@ pr.input.on_mouse_pressed = function()
     and offset_x < base_plane.width
     and offset_y >= 0
     and offset_y < base_plane.height then
-    base_plane:blit(offset_x, offset_y, stamp_plane)
+    base_plane:blit(offset_x, offset_y, stamp_plane, {transparent = 0})
   end
 end
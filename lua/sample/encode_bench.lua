@@ -0,0 +1,76 @@
+-- Compares the size of encoded planes against their raw size, and times
+-- plane:encode(), pr.plane.decode() and plane:decode_into(), on a few kinds
+-- of generated map.
+
+local SIZE = 512
+local ROUNDS = 20
+
+local maps = {
+  {
+    name = 'flat',
+    create = function()
+      return pr.plane.from(SIZE, SIZE, 1)
+    end
+  },
+  {
+    name = 'terrain (noise)',
+    create = function()
+      return pr.plane.from(SIZE, SIZE, 0)
+        :fill_noise({ kind = 'fbm', scale = 0.02, bias = 1, quantize = 4 })
+    end
+  },
+  {
+    name = 'gradient',
+    create = function()
+      return pr.plane.from(SIZE, SIZE, function(x, y) return x * 3 + y end)
+    end
+  },
+  {
+    name = 'sparse tiles',
+    create = function()
+      local tiles = { 0, 0, 0, 0, 0, 0, 0, 35, 46, 179, 219, 1000 }
+      return pr.plane.from(SIZE, SIZE, function()
+        return tiles[math.random(#tiles)]
+      end)
+    end
+  },
+  {
+    name = 'random',
+    create = function()
+      return pr.plane.from(SIZE, SIZE, function()
+        return math.random(0, 0x7FFFFFFF)
+      end)
+    end
+  }
+}
+
+local function time(func)
+  local start = os.clock()
+  for _ = 1, ROUNDS do
+    func()
+  end
+  return (os.clock() - start) / ROUNDS * 1000.0
+end
+
+pr.window.on_load = function()
+  local raw_size = SIZE * SIZE * 4
+
+  for _, map in ipairs(maps) do
+    local plane = map.create()
+    local encoded = plane:encode()
+
+    -- base-64 stores 3 bytes in every 4 characters
+    local size = math.floor(#encoded * 3 / 4)
+    local encode_ms = time(function() plane:encode() end)
+    local decode_ms = time(function() pr.plane.decode(encoded) end)
+    local decode_into_ms = time(function() plane:decode_into(encoded) end)
+
+    pr.log.info(string.format(
+      '%s: %d bytes (%.1f%% of raw), encode %.2f ms, decode %.2f ms, ' ..
+        'decode_into %.2f ms',
+      map.name, size, size / raw_size * 100.0, encode_ms, decode_ms,
+      decode_into_ms))
+  end
+
+  pr.window.close()
+end
@@ -0,0 +1,72 @@
+-- Compares the classic pr.draw bindings against the procyon.ffi module by
+-- drawing 10,000 characters per frame with each, and timing only the Lua
+-- side of the drawing work.
+
+local fast = require('procyon.ffi')
+
+local CHAR_COUNT = 10000
+local FRAMES_PER_MODE = 300
+local WARMUP_FRAMES = 30
+
+local modes = {
+  {
+    name = 'pr.draw (Lua C API)',
+    draw = function(columns, gw, gh)
+      local fg = pr.color.from_rgb(1.0, 0.66, 0.12)
+      local bg = pr.color.from_rgb(0.0, 0.0, 0.0)
+      for i = 0, CHAR_COUNT - 1 do
+        pr.draw.char((i % columns) * gw, math.floor(i / columns) * gh,
+                     33 + i % 94, fg, bg)
+      end
+    end
+  },
+  {
+    name = 'procyon.ffi',
+    draw = function(columns, gw, gh)
+      local fg = fast.rgb(1.0, 0.66, 0.12)
+      local bg = fast.BLACK
+      for i = 0, CHAR_COUNT - 1 do
+        fast.char((i % columns) * gw, math.floor(i / columns) * gh,
+                  33 + i % 94, fg, bg)
+      end
+    end
+  }
+}
+
+local mode_index = 1
+local frame = 0
+local elapsed = 0.0
+
+pr.window.on_load = function()
+  pr.window.set_high_fps(true)
+end
+
+pr.window.on_draw = function()
+  local mode = modes[mode_index]
+  if mode == nil then
+    pr.window.close()
+    return
+  end
+
+  local w, _ = pr.window.get_size()
+  local gw, gh = pr.window.get_glyph_size()
+  local columns = math.max(1, math.floor(w / gw))
+
+  local start = os.clock()
+  mode.draw(columns, gw, gh)
+  local duration = os.clock() - start
+
+  frame = frame + 1
+  if frame > WARMUP_FRAMES then
+    elapsed = elapsed + duration
+  end
+
+  if frame == WARMUP_FRAMES + FRAMES_PER_MODE then
+    pr.log.info(string.format('%s: %d chars/frame => avg. %.3f ms/frame',
+                              mode.name, CHAR_COUNT,
+                              elapsed / FRAMES_PER_MODE * 1000.0))
+    mode_index = mode_index + 1
+    frame = 0
+    elapsed = 0.0
+  end
+end
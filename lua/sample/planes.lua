@@ -7,17 +7,9 @@ end
 
 pr.window.on_draw = function(seconds)
   offset = offset + seconds * 0.05
-  text_buffer:fill(function(x, y, c)
-    local value = math.floor((pr.noise.ridge(tonumber(x) * 0.1, tonumber(y) * 0.1, offset) + 0.5) * 6 + 41)
-    return value
-  end)
+  text_buffer:fill_noise{kind = "ridge", scale = 0.1, z = offset, bias = 0.5, quantize = 6}:add(41)
 
-  local gw, gh = pr.window.get_glyph_size()
-  for y = 0, text_buffer.height - 1 do
-    for x = 0, text_buffer.width - 1 do
-      pr.draw.char(x * gh, y * gh, text_buffer:at(x, y))
-    end
-  end
+  pr.draw.plane(text_buffer, 0, 0)
   pr.draw.string(0, 0, "%b%iFPS: "..tostring(math.floor(1.0 / seconds)))
 end
 
@@ -104,9 +104,12 @@ bool load_scripts(script_env_t *env, char *path) {
   add_drawing(L, env);
   add_plane(L);
   add_noise(L);
+  add_jobs(L);
 
   lua_setglobal(L, TBL_LIBRARY);
 
+  add_ffi(L);
+
   if (luaL_dofile(L, path)) {
     log_error("Error loading file %s: %s", path, lua_tostring(L, -1));
     return false;
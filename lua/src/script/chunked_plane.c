@@ -0,0 +1,679 @@
+#include <lauxlib.h>
+#include <log.h>
+#include <lua.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "script/environment.h"
+#include "script/plane.h"
+
+#define TBL_CHUNKED_PLANE_META "procyon_chunked_plane_meta"
+
+#define FUNC_PLANE_CHUNKED "chunked"
+#define FUNC_CHUNKED_AT "at"
+#define FUNC_CHUNKED_SET "set"
+#define FUNC_CHUNKED_FILL "fill"
+#define FUNC_CHUNKED_BLIT "blit"
+#define FUNC_CHUNKED_SUB "sub"
+#define FUNC_CHUNKED_GET_STATS "get_stats"
+#define FIELD_CHUNKED_DEFAULT "default"
+#define FIELD_CHUNKED_MAX_RESIDENT "max_resident"
+#define FIELD_STATS_CHUNKS "chunks"
+#define FIELD_STATS_RESIDENT "resident"
+#define FIELD_STATS_PACKED "packed"
+#define FIELD_STATS_PACKED_BYTES "packed_bytes"
+
+#define CHUNK_SIZE 64
+#define CHUNK_CELLS (CHUNK_SIZE * CHUNK_SIZE)
+
+#define MIN_SLOT_COUNT 64
+
+// Chunks are allocated the first time one of their cells is written.  Each
+// chunk is either resident, with its cells ready to use, or packed, with its
+// cells run-length encoded until they're next accessed.
+typedef struct chunk_t {
+  int chunk_x, chunk_y;
+  int *cells;
+  int *packed;
+  size_t packed_length;
+  struct chunk_t *newer, *older;
+} chunk_t;
+
+// chunks are found through an open-addressed hash table, and resident chunks
+// are kept in a list from the most to the least recently used
+typedef struct chunked_plane_t {
+  chunk_t **slots;
+  size_t slot_count, chunk_count;
+  chunk_t *newest, *oldest;
+  chunk_t *last_used;
+  size_t resident_count, max_resident;
+  int default_value;
+} chunked_plane_t;
+
+static inline int floor_div(int value) {
+  return value >= 0 ? value / CHUNK_SIZE : -((-(value + 1)) / CHUNK_SIZE) - 1;
+}
+
+static inline size_t hash_chunk(int chunk_x, int chunk_y, size_t slot_count) {
+  uint32_t hash =
+      (uint32_t)chunk_x * 0x9E3779B1u ^ (uint32_t)chunk_y * 0x85EBCA77u;
+  hash ^= hash >> 15;
+  return hash & (slot_count - 1);
+}
+
+static size_t find_slot(const chunked_plane_t *plane, int chunk_x,
+                        int chunk_y) {
+  size_t slot = hash_chunk(chunk_x, chunk_y, plane->slot_count);
+  while (plane->slots[slot] != NULL &&
+         (plane->slots[slot]->chunk_x != chunk_x ||
+          plane->slots[slot]->chunk_y != chunk_y)) {
+    slot = (slot + 1) & (plane->slot_count - 1);
+  }
+
+  return slot;
+}
+
+static bool grow_slots(chunked_plane_t *plane) {
+  size_t slot_count =
+      plane->slot_count == 0 ? MIN_SLOT_COUNT : plane->slot_count * 2;
+  chunk_t **slots = calloc(slot_count, sizeof(chunk_t *));
+  if (slots == NULL) {
+    return false;
+  }
+
+  chunk_t **old_slots = plane->slots;
+  size_t old_count = plane->slot_count;
+  plane->slots = slots;
+  plane->slot_count = slot_count;
+  for (size_t i = 0; i < old_count; ++i) {
+    if (old_slots[i] != NULL) {
+      slots[find_slot(plane, old_slots[i]->chunk_x, old_slots[i]->chunk_y)] =
+          old_slots[i];
+    }
+  }
+
+  free(old_slots);
+
+  return true;
+}
+
+static void remove_slot(chunked_plane_t *plane, size_t slot) {
+  plane->slots[slot] = NULL;
+  --plane->chunk_count;
+
+  // move later chunks in the same run back into the gap, so that lookups
+  // don't stop short of them
+  size_t mask = plane->slot_count - 1;
+  size_t gap = slot;
+  for (size_t next = (slot + 1) & mask; plane->slots[next] != NULL;
+       next = (next + 1) & mask) {
+    chunk_t *chunk = plane->slots[next];
+    size_t home = hash_chunk(chunk->chunk_x, chunk->chunk_y, plane->slot_count);
+    if (((next - home) & mask) >= ((next - gap) & mask)) {
+      plane->slots[gap] = chunk;
+      plane->slots[next] = NULL;
+      gap = next;
+    }
+  }
+}
+
+static void unlink_resident(chunked_plane_t *plane, chunk_t *chunk) {
+  if (chunk->newer != NULL) {
+    chunk->newer->older = chunk->older;
+  } else {
+    plane->newest = chunk->older;
+  }
+
+  if (chunk->older != NULL) {
+    chunk->older->newer = chunk->newer;
+  } else {
+    plane->oldest = chunk->newer;
+  }
+
+  chunk->newer = chunk->older = NULL;
+}
+
+static void link_resident(chunked_plane_t *plane, chunk_t *chunk) {
+  chunk->newer = NULL;
+  chunk->older = plane->newest;
+  if (plane->newest != NULL) {
+    plane->newest->newer = chunk;
+  } else {
+    plane->oldest = chunk;
+  }
+
+  plane->newest = chunk;
+}
+
+static void free_chunk(chunk_t *chunk) {
+  free(chunk->cells);
+  free(chunk->packed);
+  free(chunk);
+}
+
+static void remove_chunk(chunked_plane_t *plane, chunk_t *chunk) {
+  if (chunk->cells != NULL) {
+    unlink_resident(plane, chunk);
+    --plane->resident_count;
+  }
+
+  if (plane->last_used == chunk) {
+    plane->last_used = NULL;
+  }
+
+  remove_slot(plane, find_slot(plane, chunk->chunk_x, chunk->chunk_y));
+  free_chunk(chunk);
+}
+
+// packs the cells of the least recently used chunk, or drops the chunk
+// entirely if every cell holds the default value
+static void evict_chunk(chunked_plane_t *plane, chunk_t *chunk) {
+  const int *cells = chunk->cells;
+  size_t runs = 1;
+  for (size_t i = 1; i < CHUNK_CELLS; ++i) {
+    runs += cells[i] != cells[i - 1];
+  }
+
+  if (runs == 1 && cells[0] == plane->default_value) {
+    remove_chunk(plane, chunk);
+    return;
+  }
+
+  // runs are stored as (length, value) pairs, unless that would take more
+  // space than the cells themselves
+  size_t length = runs * 2 < CHUNK_CELLS ? runs * 2 : CHUNK_CELLS;
+  int *packed = malloc(sizeof(int) * length);
+  if (packed == NULL) {
+    log_debug("Failed to pack a plane chunk, leaving it resident");
+    return;
+  }
+
+  if (length == CHUNK_CELLS) {
+    memcpy(packed, cells, sizeof(int) * CHUNK_CELLS);
+  } else {
+    size_t run = 0;
+    packed[0] = 1;
+    packed[1] = cells[0];
+    for (size_t i = 1; i < CHUNK_CELLS; ++i) {
+      if (cells[i] == packed[run + 1]) {
+        ++packed[run];
+      } else {
+        run += 2;
+        packed[run] = 1;
+        packed[run + 1] = cells[i];
+      }
+    }
+  }
+
+  unlink_resident(plane, chunk);
+  --plane->resident_count;
+  free(chunk->cells);
+  chunk->cells = NULL;
+  chunk->packed = packed;
+  chunk->packed_length = length;
+}
+
+static bool unpack_chunk(chunk_t *chunk) {
+  int *cells = malloc(sizeof(int) * CHUNK_CELLS);
+  if (cells == NULL) {
+    return false;
+  }
+
+  if (chunk->packed_length == CHUNK_CELLS) {
+    memcpy(cells, chunk->packed, sizeof(int) * CHUNK_CELLS);
+  } else {
+    size_t cell = 0;
+    for (size_t run = 0; run < chunk->packed_length; run += 2) {
+      for (int i = 0; i < chunk->packed[run]; ++i) {
+        cells[cell++] = chunk->packed[run + 1];
+      }
+    }
+  }
+
+  free(chunk->packed);
+  chunk->packed = NULL;
+  chunk->packed_length = 0;
+  chunk->cells = cells;
+
+  return true;
+}
+
+// Returns the resident chunk at the chunk coordinates given, marking it as
+// the most recently used.  Missing chunks are created (filled with the
+// default value) if `create` is set, or otherwise NULL is returned.
+static chunk_t *get_chunk(chunked_plane_t *plane, int chunk_x, int chunk_y,
+                          bool create) {
+  chunk_t *chunk = plane->last_used;
+  if (chunk != NULL && chunk->chunk_x == chunk_x &&
+      chunk->chunk_y == chunk_y) {
+    return chunk;
+  }
+
+  chunk = NULL;
+  if (plane->slot_count > 0) {
+    chunk = plane->slots[find_slot(plane, chunk_x, chunk_y)];
+  }
+
+  if (chunk == NULL) {
+    if (!create) {
+      return NULL;
+    }
+
+    // keep the table at most half full
+    if ((plane->chunk_count + 1) * 2 > plane->slot_count &&
+        !grow_slots(plane)) {
+      return NULL;
+    }
+
+    chunk = calloc(1, sizeof(chunk_t));
+    int *cells = malloc(sizeof(int) * CHUNK_CELLS);
+    if (chunk == NULL || cells == NULL) {
+      free(chunk);
+      free(cells);
+      return NULL;
+    }
+
+    for (size_t i = 0; i < CHUNK_CELLS; ++i) {
+      cells[i] = plane->default_value;
+    }
+
+    chunk->chunk_x = chunk_x;
+    chunk->chunk_y = chunk_y;
+    chunk->cells = cells;
+    plane->slots[find_slot(plane, chunk_x, chunk_y)] = chunk;
+    ++plane->chunk_count;
+    ++plane->resident_count;
+    link_resident(plane, chunk);
+  } else if (chunk->cells == NULL) {
+    if (!unpack_chunk(chunk)) {
+      return NULL;
+    }
+
+    ++plane->resident_count;
+    link_resident(plane, chunk);
+  } else {
+    unlink_resident(plane, chunk);
+    link_resident(plane, chunk);
+  }
+
+  plane->last_used = chunk;
+
+  // the chunk that was just used is the newest, so it's never evicted here
+  while (plane->max_resident > 0 &&
+         plane->resident_count > plane->max_resident &&
+         plane->oldest != chunk) {
+    size_t resident = plane->resident_count;
+    evict_chunk(plane, plane->oldest);
+    if (plane->resident_count == resident) {
+      break;
+    }
+  }
+
+  return chunk;
+}
+
+static void clear_chunks(chunked_plane_t *plane) {
+  for (size_t i = 0; i < plane->slot_count; ++i) {
+    if (plane->slots[i] != NULL) {
+      free_chunk(plane->slots[i]);
+      plane->slots[i] = NULL;
+    }
+  }
+
+  plane->chunk_count = 0;
+  plane->resident_count = 0;
+  plane->newest = plane->oldest = plane->last_used = NULL;
+}
+
+static chunked_plane_t *check_chunked_plane(lua_State *L, int index) {
+  return (chunked_plane_t *)luaL_checkudata(L, index, TBL_CHUNKED_PLANE_META);
+}
+
+// reads `length` cells of a row, starting at (x, y), into `values`
+static void read_chunked_row(chunked_plane_t *plane, int x, int y,
+                             size_t length, int *values) {
+  int chunk_y = floor_div(y);
+  int local_y = y - chunk_y * CHUNK_SIZE;
+  size_t done = 0;
+  while (done < length) {
+    int column = x + (int)done;
+    int chunk_x = floor_div(column);
+    int local_x = column - chunk_x * CHUNK_SIZE;
+    size_t count = (size_t)(CHUNK_SIZE - local_x);
+    count = count > length - done ? length - done : count;
+
+    chunk_t *chunk = get_chunk(plane, chunk_x, chunk_y, false);
+    if (chunk == NULL) {
+      for (size_t i = 0; i < count; ++i) {
+        values[done + i] = plane->default_value;
+      }
+    } else {
+      memcpy(&values[done], &chunk->cells[local_y * CHUNK_SIZE + local_x],
+             sizeof(int) * count);
+    }
+
+    done += count;
+  }
+}
+
+// plane.chunked([{ default = 0, max_resident = 0 }])
+static int plane_chunked(lua_State *L) {
+  lua_settop(L, 1);
+
+  int default_value = 0;
+  lua_Integer max_resident = 0;
+  if (lua_istable(L, 1)) {
+    lua_getfield(L, 1, FIELD_CHUNKED_DEFAULT);
+    default_value = (int)luaL_optinteger(L, -1, 0);
+    lua_getfield(L, 1, FIELD_CHUNKED_MAX_RESIDENT);
+    max_resident = luaL_optinteger(L, -1, 0);
+    lua_pop(L, 2);
+  }
+
+  chunked_plane_t *plane = lua_newuserdata(L, sizeof(chunked_plane_t));
+  memset(plane, 0, sizeof(chunked_plane_t));
+  plane->default_value = default_value;
+  plane->max_resident = max_resident > 0 ? (size_t)max_resident : 0;
+  luaL_setmetatable(L, TBL_CHUNKED_PLANE_META);
+
+  return 1;
+}
+
+static int chunked_gc(lua_State *L) {
+  chunked_plane_t *plane = check_chunked_plane(L, 1);
+  clear_chunks(plane);
+  free(plane->slots);
+  plane->slots = NULL;
+  plane->slot_count = 0;
+
+  return 0;
+}
+
+// plane:at(x, y)
+static int chunked_at(lua_State *L) {
+  chunked_plane_t *plane = check_chunked_plane(L, 1);
+  int x = (int)luaL_checkinteger(L, 2);
+  int y = (int)luaL_checkinteger(L, 3);
+
+  int chunk_x = floor_div(x);
+  int chunk_y = floor_div(y);
+  chunk_t *chunk = get_chunk(plane, chunk_x, chunk_y, false);
+  if (chunk == NULL) {
+    lua_pushinteger(L, plane->default_value);
+  } else {
+    int local_x = x - chunk_x * CHUNK_SIZE;
+    int local_y = y - chunk_y * CHUNK_SIZE;
+    lua_pushinteger(L, chunk->cells[local_y * CHUNK_SIZE + local_x]);
+  }
+
+  return 1;
+}
+
+// plane:set(x, y, n)
+static int chunked_set(lua_State *L) {
+  lua_settop(L, 4);
+
+  chunked_plane_t *plane = check_chunked_plane(L, 1);
+  int x = (int)luaL_checkinteger(L, 2);
+  int y = (int)luaL_checkinteger(L, 3);
+  int value = (int)luaL_checkinteger(L, 4);
+
+  int chunk_x = floor_div(x);
+  int chunk_y = floor_div(y);
+
+  // writing the default value to a missing chunk changes nothing
+  chunk_t *chunk =
+      get_chunk(plane, chunk_x, chunk_y, value != plane->default_value);
+  if (chunk != NULL) {
+    chunk->cells[(y - chunk_y * CHUNK_SIZE) * CHUNK_SIZE + x -
+                 chunk_x * CHUNK_SIZE] = value;
+  } else if (value != plane->default_value) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate a plane chunk");
+    return 0;
+  }
+
+  lua_settop(L, 1);
+
+  return 1;
+}
+
+// plane:fill(n)
+// plane:fill(x, y, w, h, n)
+static int chunked_fill(lua_State *L) {
+  chunked_plane_t *plane = check_chunked_plane(L, 1);
+
+  if (lua_gettop(L) <= 2) {
+    // filling the whole plane just changes the value of unwritten cells
+    plane->default_value = (int)luaL_checkinteger(L, 2);
+    clear_chunks(plane);
+    lua_settop(L, 1);
+    return 1;
+  }
+
+  int x = (int)luaL_checkinteger(L, 2);
+  int y = (int)luaL_checkinteger(L, 3);
+  int width = (int)luaL_checkinteger(L, 4);
+  int height = (int)luaL_checkinteger(L, 5);
+  int value = (int)luaL_checkinteger(L, 6);
+  if (width <= 0 || height <= 0) {
+    lua_settop(L, 1);
+    return 1;
+  }
+
+  int first_chunk_x = floor_div(x);
+  int first_chunk_y = floor_div(y);
+  int last_chunk_x = floor_div(x + width - 1);
+  int last_chunk_y = floor_div(y + height - 1);
+  for (int chunk_y = first_chunk_y; chunk_y <= last_chunk_y; ++chunk_y) {
+    int top = chunk_y * CHUNK_SIZE;
+    int first_row = y > top ? y - top : 0;
+    int last_row = y + height - top < CHUNK_SIZE ? y + height - top
+                                                 : CHUNK_SIZE;
+    for (int chunk_x = first_chunk_x; chunk_x <= last_chunk_x; ++chunk_x) {
+      int left = chunk_x * CHUNK_SIZE;
+      int first_column = x > left ? x - left : 0;
+      int last_column = x + width - left < CHUNK_SIZE ? x + width - left
+                                                      : CHUNK_SIZE;
+      bool whole = first_row == 0 && first_column == 0 &&
+                   last_row == CHUNK_SIZE && last_column == CHUNK_SIZE;
+
+      // whole chunks of the default value don't need to be stored at all
+      if (whole && value == plane->default_value) {
+        chunk_t *chunk = plane->slot_count == 0
+                             ? NULL
+                             : plane->slots[find_slot(plane, chunk_x, chunk_y)];
+        if (chunk != NULL) {
+          remove_chunk(plane, chunk);
+        }
+        continue;
+      }
+
+      chunk_t *chunk = get_chunk(plane, chunk_x, chunk_y,
+                                 value != plane->default_value);
+      if (chunk == NULL) {
+        if (value != plane->default_value) {
+          LOG_SCRIPT_ERROR(L, "Failed to allocate a plane chunk");
+          return 0;
+        }
+        continue;
+      }
+
+      for (int row = first_row; row < last_row; ++row) {
+        int *cells = &chunk->cells[row * CHUNK_SIZE];
+        for (int column = first_column; column < last_column; ++column) {
+          cells[column] = value;
+        }
+      }
+    }
+  }
+
+  lua_settop(L, 1);
+
+  return 1;
+}
+
+// plane:blit(x, y, src [, { mode = "copy"|"max"|"min"|"add"|"xor",
+//                            transparent = n, mask = plane }])
+static int chunked_blit(lua_State *L) {
+  lua_settop(L, 5);
+
+  chunked_plane_t *plane = check_chunked_plane(L, 1);
+  int x = (int)luaL_checkinteger(L, 2);
+  int y = (int)luaL_checkinteger(L, 3);
+
+  plane_t *src = get_plane(L, 4);
+  if (src == NULL) {
+    return 0;
+  }
+
+  blit_options_t options;
+  if (!get_blit_options(L, 5, src, &options)) {
+    return 0;
+  }
+
+  bool plain_copy = options.mode == BLIT_COPY && !options.has_transparent &&
+                    options.mask == NULL;
+  int *rows = malloc(sizeof(int) * (size_t)src->width * 2);
+  if (rows == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate blit rows");
+    return 0;
+  }
+
+  int *src_row = rows;
+  int *mask_row = options.mask == NULL ? NULL : rows + src->width;
+  bool failed = false;
+  for (int row = 0; row < src->height && !failed; ++row) {
+    size_t offset = (size_t)row * src->width;
+    read_plane_values(src, offset, src->width, src_row);
+    if (mask_row != NULL) {
+      read_plane_values(options.mask, offset, src->width, mask_row);
+    }
+
+    // each row is split where it crosses into the next chunk
+    int chunk_y = floor_div(y + row);
+    int local_y = y + row - chunk_y * CHUNK_SIZE;
+    for (int done = 0; done < src->width;) {
+      int chunk_x = floor_div(x + done);
+      int local_x = x + done - chunk_x * CHUNK_SIZE;
+      int count = CHUNK_SIZE - local_x;
+      count = count > src->width - done ? src->width - done : count;
+
+      chunk_t *chunk = get_chunk(plane, chunk_x, chunk_y, true);
+      if (chunk == NULL) {
+        failed = true;
+        break;
+      }
+
+      int *cells = &chunk->cells[local_y * CHUNK_SIZE + local_x];
+      if (plain_copy) {
+        memcpy(cells, &src_row[done], sizeof(int) * count);
+      } else {
+        blit_row(cells, &src_row[done],
+                 mask_row == NULL ? NULL : &mask_row[done], count, &options);
+      }
+
+      done += count;
+    }
+  }
+
+  free(rows);
+
+  if (failed) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate a plane chunk");
+    return 0;
+  }
+
+  lua_settop(L, 1);
+
+  return 1;
+}
+
+// plane:sub(x, y, w, h [, type])
+static int chunked_sub(lua_State *L) {
+  lua_settop(L, 6);
+
+  chunked_plane_t *plane = check_chunked_plane(L, 1);
+  int x = (int)luaL_checkinteger(L, 2);
+  int y = (int)luaL_checkinteger(L, 3);
+  int width = (int)luaL_checkinteger(L, 4);
+  int height = (int)luaL_checkinteger(L, 5);
+  plane_type_t type = (plane_type_t)luaL_checkoption(
+      L, 6, plane_type_names[PLANE_I32], plane_type_names);
+
+  plane_t *target = push_new_typed_plane(width, height, type, NULL, L);
+  if (target == NULL) {
+    return 0;
+  }
+
+  // i32 rows are read straight into the new plane
+  int *row = type == PLANE_I32 ? NULL : malloc(sizeof(int) * width);
+  if (type != PLANE_I32 && row == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate a plane row");
+    return 0;
+  }
+
+  for (int i = 0; i < height; ++i) {
+    size_t offset = (size_t)i * width;
+    if (row == NULL) {
+      read_chunked_row(plane, x, y + i, width, &target->buffer[offset]);
+    } else {
+      read_chunked_row(plane, x, y + i, width, row);
+      write_plane_values(target, offset, width, row);
+    }
+  }
+
+  free(row);
+
+  return 1;
+}
+
+// plane:get_stats()
+// { chunks = n, resident = n, packed = n, packed_bytes = n }
+static int chunked_get_stats(lua_State *L) {
+  chunked_plane_t *plane = check_chunked_plane(L, 1);
+
+  size_t packed_bytes = 0;
+  for (size_t i = 0; i < plane->slot_count; ++i) {
+    if (plane->slots[i] != NULL) {
+      packed_bytes += plane->slots[i]->packed_length * sizeof(int);
+    }
+  }
+
+  lua_createtable(L, 0, 4);
+
+  lua_pushinteger(L, (lua_Integer)plane->chunk_count);
+  lua_setfield(L, -2, FIELD_STATS_CHUNKS);
+
+  lua_pushinteger(L, (lua_Integer)plane->resident_count);
+  lua_setfield(L, -2, FIELD_STATS_RESIDENT);
+
+  lua_pushinteger(L, (lua_Integer)(plane->chunk_count - plane->resident_count));
+  lua_setfield(L, -2, FIELD_STATS_PACKED);
+
+  lua_pushinteger(L, (lua_Integer)packed_bytes);
+  lua_setfield(L, -2, FIELD_STATS_PACKED_BYTES);
+
+  return 1;
+}
+
+void add_chunked_plane(lua_State *L, int index) {
+  lua_pushcfunction(L, plane_chunked);
+  lua_setfield(L, index, FUNC_PLANE_CHUNKED);
+
+  if (luaL_newmetatable(L, TBL_CHUNKED_PLANE_META)) {
+    luaL_Reg index_methods[] = {{FUNC_CHUNKED_AT, chunked_at},
+                                {FUNC_CHUNKED_SET, chunked_set},
+                                {FUNC_CHUNKED_FILL, chunked_fill},
+                                {FUNC_CHUNKED_BLIT, chunked_blit},
+                                {FUNC_CHUNKED_SUB, chunked_sub},
+                                {FUNC_CHUNKED_GET_STATS, chunked_get_stats},
+                                {NULL, NULL}};
+    luaL_newlib(L, index_methods);
+    lua_setfield(L, -2, "__index");
+
+    lua_pushcfunction(L, chunked_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_pop(L, 1);
+}
@@ -4,9 +4,11 @@
 #include <log.h>
 #include <lua.h>
 #include <math.h>
+#include <stdlib.h>
 
 #include "procyon.h"
 #include "script/environment.h"
+#include "script/plane.h"
 #include "shader/sprite.h"
 
 #define GLOBAL_LAYER "procyon_layer"
@@ -16,13 +18,23 @@
 #define TBL_SPRITESHEET "spritesheet"
 #define TBL_SPRITE_META "procyon_sprite_meta"
 #define TBL_SPRITESHEET_META "procyon_spritesheet_meta"
+#define TBL_TEXT_RUN_META "procyon_text_run_meta"
 
 #define FUNC_DRAWSTRING "string"
 #define FUNC_DRAWCHAR "char"
+#define FUNC_DRAWPLANE "plane"
+#define FUNC_DRAWUTF8 "utf8"
+#define FUNC_LOADFONT "load_font"
+#define FUNC_GLYPHSTATS "glyph_stats"
+#define FUNC_TEXTRUN "text_run"
+#define FUNC_TEXTRUN_DRAW "draw"
+#define FUNC_TEXTRUN_SET "set"
 #define FUNC_DRAWRECT "rect"
 #define FUNC_DRAWLINE "line"
 #define FUNC_DRAWPOLY "poly"
 #define FUNC_FROMRGB "from_rgb"
+#define FUNC_RGB "rgb"
+#define FUNC_PALETTE "palette"
 #define FUNC_LOADSPRITESHEET "load"
 #define FUNC_CREATESPRITE "sprite"
 #define FUNC_DRAWSPRITE "draw"
@@ -39,6 +51,16 @@
 #define FIELD_SPRITE_DATA "_data"
 #define FIELD_RAWDATA_LENGTH "length"
 #define FIELD_RAWDATA_BUFFER "buffer"
+#define FIELD_GLYPH_STATS_HITS "hits"
+#define FIELD_GLYPH_STATS_MISSES "misses"
+#define FIELD_GLYPH_STATS_EVICTIONS "evictions"
+#define FIELD_GLYPH_STATS_UPLOAD_BYTES "upload_bytes"
+#define FIELD_GLYPH_STATS_HIT_RATE "hit_rate"
+#define FIELD_PLANE_OPTS_CHARS "chars"
+#define FIELD_PLANE_OPTS_COLOR "color"
+#define FIELD_PLANE_OPTS_BACKGROUND "background"
+#define FIELD_PLANE_OPTS_TRANSPARENT "transparent"
+#define FIELD_PLANE_OPTS_BOLD "bold"
 
 #define WHITE_RGB_FLOAT 1.0F, 1.0F, 1.0F
 #define BLACK_RGB_FLOAT 0.0F, 0.0F, 0.0F
@@ -59,7 +81,28 @@
 #define FIELD_COLOR_G "g"
 #define FIELD_COLOR_B "b"
 
-procy_color_t get_color(lua_State *L, int index) {
+#define PALETTE_MAX_COLORS 65536
+
+// colors registered with pr.color.palette, referred to by the handles -1, -2,
+// and so on, so that they can't be mistaken for packed colors
+static struct {
+  procy_color_t *colors;
+  int count, capacity;
+} palette;
+
+bool unpack_color(long long value, procy_color_t *color) {
+  if (value >= 0) {
+    color->value = (int)(value & 0xFFFFFF);
+    return true;
+  }
+
+  bool valid = value >= -(long long)palette.count;
+  color->value = valid ? palette.colors[-value - 1].value : 0;
+
+  return valid;
+}
+
+static procy_color_t get_table_color(lua_State *L, int index) {
   lua_getfield(L, index, FIELD_COLOR_R);
   double r = luaL_optnumber(L, -1, 0.0F);
   lua_pop(L, 1);
@@ -77,6 +120,20 @@ procy_color_t get_color(lua_State *L, int index) {
                             (unsigned char)floor(b * 255.0));
 }
 
+procy_color_t get_color(lua_State *L, int index) {
+  if (lua_type(L, index) != LUA_TNUMBER) {
+    return get_table_color(L, index);
+  }
+
+  procy_color_t color;
+  if (!unpack_color(lua_tointeger(L, index), &color)) {
+    LOG_SCRIPT_ERROR(L, "Invalid palette handle %ld",
+                     (long)lua_tointeger(L, index));
+  }
+
+  return color;
+}
+
 void push_color(lua_State *L, float r, float g, float b) {
   lua_newtable(L);
 
@@ -89,7 +146,7 @@ void push_color(lua_State *L, float r, float g, float b) {
   lua_pushnumber(L, b);
   lua_setfield(L, -2, FIELD_COLOR_B);
 }
-static int draw_string(lua_State *L) {
+static int draw_text(lua_State *L, bool utf8) {
   lua_settop(L, 5);
 
   size_t length = 0;
@@ -109,51 +166,123 @@ static int draw_string(lua_State *L) {
   int glyph_h = 0;
   procy_get_glyph_size(window, &glyph_w, &glyph_h);
 
-  bool bold = false;
-  procy_draw_op_text_t op;
-  for (size_t i = 0; i < length; i++) {
-    // check for inline modifiers such as %b or %i
-    if (contents[i] == '%' && i < length - 1) {
-      // define the number of characters that will be skipped
-      // note: this is used both for incrementing the character index (i +=
-      // offset - 1), as well as for shifting text following the modifiers to
-      // thz, e by (offset * glyph width) in order to compensate for non-drawn
-      // modifier characters
-      int offset = 2;
-
-      switch (contents[i + 1]) {
-        case 'b':
-          bold = !bold;
-          break;
-        case 'i': {
-          procy_color_t tmp = forecolor;
-          forecolor = backcolor;
-          backcolor = tmp;
-        } break;
-        case '%':
-          // escape the following '%' by skipping only the current one
-          offset = 1;
-          break;
-        default:
-          goto no_mod;
-      }
+  procy_text_cursor_t cursor =
+      procy_create_text_cursor(contents, length, utf8, forecolor, backcolor);
+  uint32_t codepoint;
+  for (int column = 0; procy_next_text_glyph(&cursor, &codepoint); ++column) {
+    procy_draw_op_text_t op = procy_create_draw_op_codepoint_colored(
+        x + column * glyph_w, y, z, cursor.color, cursor.background,
+        codepoint, cursor.bold);
+    procy_append_draw_op_text(window, &op);
+  }
 
-      // offset the position in order to compensate for the
-      // characters that are not being drawn
-      x = (int)((x - (glyph_w * offset)));
+  return 0;
+}
 
-      // skip the modifier char which follows '%'
-      i += offset - 1;
-      continue;
-    }
+static int draw_string(lua_State *L) { return draw_text(L, false); }
 
-  no_mod:
-    op = procy_create_draw_op_char_colored((int)((x + i * glyph_w)), y, z,
-                                           forecolor, backcolor, contents[i],
-                                           bold);
-    procy_append_draw_op_text(window, &op);
+static int draw_utf8(lua_State *L) { return draw_text(L, true); }
+
+static int load_font(lua_State *L) {
+  lua_settop(L, 1);
+
+  const char *path = luaL_checkstring(L, 1);
+
+  lua_getfield(L, LUA_REGISTRYINDEX, GLOBAL_WINDOW_PTR);
+  procy_window_t *window = (procy_window_t *)lua_touserdata(L, -1);
+
+  lua_pushboolean(L, procy_load_glyph_font(window, path));
+
+  return 1;
+}
+
+static int get_glyph_stats(lua_State *L) {
+  lua_getfield(L, LUA_REGISTRYINDEX, GLOBAL_WINDOW_PTR);
+  procy_window_t *window = (procy_window_t *)lua_touserdata(L, -1);
+
+  procy_glyph_cache_stats_t stats;
+  procy_get_glyph_cache_stats(window, &stats);
+
+  lua_createtable(L, 0, 5);
+
+  lua_pushinteger(L, (lua_Integer)stats.hits);
+  lua_setfield(L, -2, FIELD_GLYPH_STATS_HITS);
+
+  lua_pushinteger(L, (lua_Integer)stats.misses);
+  lua_setfield(L, -2, FIELD_GLYPH_STATS_MISSES);
+
+  lua_pushinteger(L, (lua_Integer)stats.evictions);
+  lua_setfield(L, -2, FIELD_GLYPH_STATS_EVICTIONS);
+
+  lua_pushinteger(L, (lua_Integer)stats.upload_bytes);
+  lua_setfield(L, -2, FIELD_GLYPH_STATS_UPLOAD_BYTES);
+
+  lua_pushnumber(L, stats.hit_rate);
+  lua_setfield(L, -2, FIELD_GLYPH_STATS_HIT_RATE);
+
+  return 1;
+}
+
+static int create_text_run(lua_State *L) {
+  lua_settop(L, 4);
+
+  const char *contents = luaL_checkstring(L, 1);
+  procy_color_t forecolor = luaL_opt(L, get_color, 2, WHITE);
+  procy_color_t backcolor = luaL_opt(L, get_color, 3, BLACK);
+  bool utf8 = lua_toboolean(L, 4);
+
+  procy_text_run_t *run =
+      procy_create_text_run(contents, forecolor, backcolor, utf8);
+  if (run == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to create a text run");
+    return 0;
   }
 
+  procy_text_run_t **data = lua_newuserdata(L, sizeof(procy_text_run_t *));
+  *data = run;
+  luaL_setmetatable(L, TBL_TEXT_RUN_META);
+
+  return 1;
+}
+
+static int draw_text_run(lua_State *L) {
+  lua_settop(L, 3);
+
+  procy_text_run_t **run = luaL_checkudata(L, 1, TBL_TEXT_RUN_META);
+  int x = (int)(lua_tointeger(L, 2));
+  int y = (int)(lua_tointeger(L, 3));
+
+  lua_getfield(L, LUA_REGISTRYINDEX, GLOBAL_LAYER);
+  int z = (int)(lua_tointeger(L, -1));
+
+  lua_getfield(L, LUA_REGISTRYINDEX, GLOBAL_WINDOW_PTR);
+  procy_window_t *window = (procy_window_t *)lua_touserdata(L, -1);
+
+  procy_draw_text_run(window, *run, x, y, z);
+
+  return 0;
+}
+
+static int set_text_run(lua_State *L) {
+  lua_settop(L, 4);
+
+  procy_text_run_t **run = luaL_checkudata(L, 1, TBL_TEXT_RUN_META);
+  const char *contents = luaL_checkstring(L, 2);
+
+  // colors are left as they were unless new ones are provided
+  procy_color_t forecolor = luaL_opt(L, get_color, 3, (*run)->color);
+  procy_color_t backcolor = luaL_opt(L, get_color, 4, (*run)->background);
+
+  lua_pushboolean(L, procy_set_text_run(*run, contents, forecolor, backcolor));
+
+  return 1;
+}
+
+static int destroy_text_run(lua_State *L) {
+  procy_text_run_t **run = luaL_checkudata(L, 1, TBL_TEXT_RUN_META);
+  procy_destroy_text_run(*run);
+  *run = NULL;
+
   return 0;
 }
 
@@ -168,12 +297,23 @@ static int set_layer(lua_State *L) {
   return 0;
 }
 
+static uint32_t value_to_codepoint(lua_Integer value) {
+  // values that fit in a byte are CP437, anything larger is a codepoint, and
+  // anything that's neither is drawn as '?'
+  if (value < 0 || value > PROCY_MAX_CODEPOINT) {
+    return '?';
+  }
+
+  return value <= UCHAR_MAX ? procy_cp437_to_codepoint((unsigned char)value)
+                            : (uint32_t)value;
+}
+
 static int draw_char(lua_State *L) {
   lua_settop(L, 5);
 
   int x = (int)(lua_tointeger(L, 1));
   int y = (int)(lua_tointeger(L, 2));
-  unsigned char value = lua_tointeger(L, 3) % UCHAR_MAX;
+  lua_Integer value = lua_tointeger(L, 3);
   procy_color_t forecolor = luaL_opt(L, get_color, 4, WHITE);
   procy_color_t backcolor = luaL_opt(L, get_color, 5, BLACK);
 
@@ -182,13 +322,225 @@ static int draw_char(lua_State *L) {
 
   lua_getfield(L, LUA_REGISTRYINDEX, GLOBAL_WINDOW_PTR);
   procy_window_t *window = (procy_window_t *)lua_touserdata(L, -1);
-  procy_draw_op_text_t op = procy_create_draw_op_char_colored(
-      x, y, z, forecolor, backcolor, (char)value, false);
+  procy_draw_op_text_t op = procy_create_draw_op_codepoint_colored(
+      x, y, z, forecolor, backcolor, value_to_codepoint(value), false);
   procy_append_draw_op_text(window, &op);
 
   return 0;
 }
 
+typedef enum cell_source_kind_t {
+  CELL_SOURCE_DEFAULT,
+  CELL_SOURCE_CONSTANT,
+  CELL_SOURCE_PLANE,
+  CELL_SOURCE_LUT
+} cell_source_kind_t;
+
+// where the glyph or a color of each cell drawn by pr.draw.plane comes from
+typedef struct cell_source_t {
+  cell_source_kind_t kind;
+  int constant;
+  const plane_t *plane;
+  plane_lut_t lut;
+} cell_source_t;
+
+// converts an entry in a lookup table, or an option given directly, to either
+// a codepoint or a packed color
+static bool get_cell_value(lua_State *L, int index, bool glyph, int *value) {
+  if (glyph && lua_type(L, index) == LUA_TSTRING) {
+    size_t length = 0;
+    const char *contents = lua_tolstring(L, index, &length);
+    uint32_t codepoint = 0;
+    procy_decode_utf8(contents, length, &codepoint);
+    *value = (int)codepoint;
+  } else if (lua_type(L, index) == LUA_TNUMBER) {
+    *value = glyph ? (int)value_to_codepoint(lua_tointeger(L, index))
+                   : get_color(L, index).value;
+  } else if (!glyph && lua_istable(L, index)) {
+    *value = get_color(L, index).value;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+static bool get_glyph_value(lua_State *L, int index, int *value) {
+  return get_cell_value(L, index, true, value);
+}
+
+static bool get_color_value(lua_State *L, int index, int *value) {
+  return get_cell_value(L, index, false, value);
+}
+
+static bool is_color(lua_State *L, int index) {
+  lua_getfield(L, index, FIELD_COLOR_R);
+  bool result = !lua_isnil(L, -1);
+  lua_pop(L, 1);
+
+  return result;
+}
+
+static bool get_cell_source(lua_State *L, int opts, const char *field,
+                            const plane_t *plane, bool glyph,
+                            cell_source_t *source) {
+  memset(source, 0, sizeof(cell_source_t));
+  if (!lua_istable(L, opts)) {
+    return true;
+  }
+
+  lua_getfield(L, opts, field);
+  int index = lua_gettop(L);
+
+  bool result = true;
+  if (lua_isnil(L, index)) {
+    source->kind = CELL_SOURCE_DEFAULT;
+  } else if (is_plane(L, index)) {
+    const plane_t *values = get_plane(L, index);
+    if (values == NULL || values->width != plane->width ||
+        values->height != plane->height) {
+      LOG_SCRIPT_ERROR(L, "The \"%s\" plane must match the drawn plane's size",
+                       field);
+      result = false;
+    } else {
+      source->kind = CELL_SOURCE_PLANE;
+      source->plane = values;
+    }
+  } else if (lua_istable(L, index) && (glyph || !is_color(L, index))) {
+    source->kind = CELL_SOURCE_LUT;
+    result = read_plane_lut(
+        L, index, glyph ? get_glyph_value : get_color_value, &source->lut);
+  } else if (get_cell_value(L, index, glyph, &source->constant)) {
+    source->kind = CELL_SOURCE_CONSTANT;
+  } else {
+    LOG_SCRIPT_ERROR(L, "Invalid \"%s\" option", field);
+    result = false;
+  }
+
+  lua_settop(L, index - 1);
+
+  return result;
+}
+
+static void free_cell_source(cell_source_t *source) {
+  if (source->kind == CELL_SOURCE_LUT) {
+    free_plane_lut(&source->lut);
+  }
+}
+
+static inline int get_cell_color(const cell_source_t *source, size_t i,
+                                 int value, int fallback) {
+  int color = fallback;
+  switch (source->kind) {
+    case CELL_SOURCE_CONSTANT:
+      color = source->constant;
+      break;
+    case CELL_SOURCE_PLANE:
+      color = get_plane_value(source->plane, i);
+      if (color < 0) {
+        procy_color_t unpacked;
+        unpack_color(color, &unpacked);
+        color = unpacked.value;
+      } else {
+        color &= 0xFFFFFF;
+      }
+      break;
+    case CELL_SOURCE_LUT:
+      plane_lut_find(&source->lut, value, &color);
+      break;
+    default:
+      break;
+  }
+
+  return color;
+}
+
+// pr.draw.plane(plane, x, y, { chars = ..., color = ..., background = ...,
+//                              transparent = n, bold = b })
+static int draw_plane(lua_State *L) {
+  lua_settop(L, 4);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  int x = (int)(lua_tointeger(L, 2));
+  int y = (int)(lua_tointeger(L, 3));
+
+  bool has_transparent = false;
+  int transparent = 0;
+  bool bold = false;
+  if (lua_istable(L, 4)) {
+    lua_getfield(L, 4, FIELD_PLANE_OPTS_TRANSPARENT);
+    has_transparent = lua_isnumber(L, -1);
+    transparent = (int)lua_tointeger(L, -1);
+    lua_getfield(L, 4, FIELD_PLANE_OPTS_BOLD);
+    bold = lua_toboolean(L, -1);
+    lua_pop(L, 2);
+  }
+
+  cell_source_t chars, colors, backgrounds;
+  bool valid =
+      get_cell_source(L, 4, FIELD_PLANE_OPTS_CHARS, plane, true, &chars);
+  valid = get_cell_source(L, 4, FIELD_PLANE_OPTS_COLOR, plane, false,
+                          &colors) && valid;
+  valid = get_cell_source(L, 4, FIELD_PLANE_OPTS_BACKGROUND, plane, false,
+                          &backgrounds) && valid;
+
+  if (valid) {
+    lua_getfield(L, LUA_REGISTRYINDEX, GLOBAL_LAYER);
+    int z = (int)(lua_tointeger(L, -1));
+
+    lua_getfield(L, LUA_REGISTRYINDEX, GLOBAL_WINDOW_PTR);
+    procy_window_t *window = (procy_window_t *)lua_touserdata(L, -1);
+
+    int glyph_w = 0;
+    int glyph_h = 0;
+    procy_get_glyph_size(window, &glyph_w, &glyph_h);
+
+    procy_reserve_draw_ops_text(window,
+                                (size_t)plane->width * (size_t)plane->height);
+
+    const int white = WHITE.value;
+    const int black = BLACK.value;
+    procy_draw_op_text_t op = {.z = z, .bold = bold};
+    size_t i = 0;
+    for (int row = 0; row < plane->height; ++row) {
+      op.y = y + row * glyph_h;
+      for (int column = 0; column < plane->width; ++column, ++i) {
+        int value = get_plane_value(plane, i);
+        if (has_transparent && value == transparent) {
+          continue;
+        }
+
+        int codepoint;
+        if (chars.kind == CELL_SOURCE_CONSTANT) {
+          codepoint = chars.constant;
+        } else if (chars.kind != CELL_SOURCE_LUT ||
+                   !plane_lut_find(&chars.lut, value, &codepoint)) {
+          // cells without a mapped glyph are drawn as their own value
+          codepoint = (int)value_to_codepoint(
+              chars.kind == CELL_SOURCE_PLANE ? get_plane_value(chars.plane, i)
+                                              : value);
+        }
+
+        op.x = x + column * glyph_w;
+        op.codepoint = (uint32_t)codepoint;
+        op.color.value = get_cell_color(&colors, i, value, white);
+        op.background.value = get_cell_color(&backgrounds, i, value, black);
+        procy_append_draw_op_text(window, &op);
+      }
+    }
+  }
+
+  free_cell_source(&chars);
+  free_cell_source(&colors);
+  free_cell_source(&backgrounds);
+
+  return 0;
+}
+
 static int draw_rect(lua_State *L) {
   lua_settop(L, 5);
 
@@ -276,6 +628,72 @@ static int from_rgb(lua_State *L) {
   return 1;
 }
 
+static unsigned char component_to_byte(double value) {
+  return (unsigned char)floor(
+      (value < 0.0 ? 0.0 : (value > 1.0 ? 1.0 : value)) * 255.0);
+}
+
+static int rgb(lua_State *L) {
+  lua_settop(L, 3);
+
+  procy_color_t color =
+      procy_create_color(component_to_byte(luaL_optnumber(L, 1, 0.0)),
+                         component_to_byte(luaL_optnumber(L, 2, 0.0)),
+                         component_to_byte(luaL_optnumber(L, 3, 0.0)));
+  lua_pushinteger(L, color.value);
+
+  return 1;
+}
+
+// pr.color.palette(colors) -> a table with the same keys as `colors`, holding
+// a handle for each of its colors
+static int create_palette(lua_State *L) {
+  lua_settop(L, 1);
+  luaL_checktype(L, 1, LUA_TTABLE);
+
+  lua_newtable(L);
+
+  lua_pushnil(L);
+  while (lua_next(L, 1) != 0) {
+    if (palette.count == PALETTE_MAX_COLORS) {
+      LOG_SCRIPT_ERROR(L, "Palettes may hold at most %d colors in total",
+                       PALETTE_MAX_COLORS);
+      return 0;
+    }
+
+    if (lua_type(L, -1) != LUA_TNUMBER && !lua_istable(L, -1)) {
+      LOG_SCRIPT_ERROR(L, "Palette entries must be colors");
+      return 0;
+    }
+
+    // read before anything is added, since a bad color raises an error
+    procy_color_t color = get_color(L, lua_gettop(L));
+
+    if (palette.count == palette.capacity) {
+      int capacity = palette.capacity == 0 ? 16 : palette.capacity * 2;
+      procy_color_t *colors =
+          realloc(palette.colors, sizeof(procy_color_t) * capacity);
+      if (colors == NULL) {
+        LOG_SCRIPT_ERROR(L, "Failed to allocate the palette");
+        return 0;
+      }
+
+      palette.colors = colors;
+      palette.capacity = capacity;
+    }
+
+    palette.colors[palette.count] = color;
+    ++palette.count;
+
+    lua_pop(L, 1);
+    lua_pushvalue(L, -1);
+    lua_pushinteger(L, -palette.count);
+    lua_settable(L, 2);
+  }
+
+  return 1;
+}
+
 static int draw_sprite(lua_State *L) {
   lua_settop(L, 5);
   lua_getfield(L, LUA_REGISTRYINDEX, GLOBAL_WINDOW_PTR);
@@ -429,6 +847,20 @@ static void add_sprite(lua_State *L) {
   }
 }
 
+static void add_text_run(lua_State *L) {
+  if (luaL_newmetatable(L, TBL_TEXT_RUN_META)) {
+    luaL_Reg index[] = {{FUNC_TEXTRUN_DRAW, draw_text_run},
+                        {FUNC_TEXTRUN_SET, set_text_run},
+                        {NULL, NULL}};
+    luaL_newlib(L, index);
+    lua_setfield(L, -2, "__index");
+
+    lua_pushcfunction(L, destroy_text_run);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
+  }
+}
+
 static void add_spritesheet(lua_State *L) {
   luaL_Reg methods[] = {{FUNC_LOADSPRITESHEET, load_spritesheet}, {NULL, NULL}};
   luaL_newlib(L, methods);
@@ -448,6 +880,11 @@ static void add_draw_ops(lua_State *L) {
                         {FUNC_DRAWLINE, draw_line},
                         {FUNC_DRAWPOLY, draw_polygon},
                         {FUNC_DRAWCHAR, draw_char},
+                        {FUNC_DRAWPLANE, draw_plane},
+                        {FUNC_DRAWUTF8, draw_utf8},
+                        {FUNC_LOADFONT, load_font},
+                        {FUNC_GLYPHSTATS, get_glyph_stats},
+                        {FUNC_TEXTRUN, create_text_run},
                         {FUNC_SETLAYER, set_layer},
                         {NULL, NULL}};
   luaL_newlib(L, methods);
@@ -458,9 +895,15 @@ static void add_draw_ops(lua_State *L) {
 }
 
 static void add_color(lua_State *L) {
-  luaL_Reg methods[] = {{FUNC_FROMRGB, from_rgb}, {NULL, NULL}};
+  luaL_Reg methods[] = {{FUNC_FROMRGB, from_rgb},
+                        {FUNC_RGB, rgb},
+                        {FUNC_PALETTE, create_palette},
+                        {NULL, NULL}};
   luaL_newlib(L, methods);
   lua_setfield(L, 1, TBL_COLOR);
+
+  // handles from a previous run of the script are no longer valid
+  palette.count = 0;
 }
 
 void add_drawing(lua_State *L, script_env_t *env) {
@@ -468,4 +911,5 @@ void add_drawing(lua_State *L, script_env_t *env) {
   add_color(L);
   add_spritesheet(L);
   add_sprite(L);
+  add_text_run(L);
 }
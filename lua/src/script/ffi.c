@@ -0,0 +1,133 @@
+#include <lauxlib.h>
+#include <limits.h>
+#include <log.h>
+#include <lua.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gen/lua_embed.h"
+#include "procyon.h"
+#include "script/environment.h"
+
+#define MODULE_FFI "procyon.ffi"
+#define MODULE_FFI_FILE "ffi.lua"
+
+// the flat drawing API is looked up by LuaJIT at runtime through `ffi.C`, so
+// it has to be exported from the executable and kept by the linker
+#ifdef _WIN32
+#define PROCY_FFI_EXPORT __declspec(dllexport) __attribute__((used))
+#else
+#define PROCY_FFI_EXPORT __attribute__((visibility("default"), used))
+#endif
+
+// packed colors are passed through as they are, and palette handles looked up
+static inline procy_color_t to_color(int value) {
+  procy_color_t color = {value};
+  if (value < 0) {
+    unpack_color(value, &color);
+  }
+
+  return color;
+}
+
+/*
+ * Flat drawing functions, taking the window, layer and packed colors
+ * directly so that calls from JIT-compiled traces involve no Lua C API calls
+ * or struct arguments
+ */
+
+PROCY_FFI_EXPORT void procy_ffi_draw_char(procy_window_t *window, int x,
+                                          int y, int z, int color,
+                                          int background, uint32_t codepoint,
+                                          bool bold) {
+  // values that fit in a byte are CP437, as with pr.draw.char
+  if (codepoint <= UCHAR_MAX) {
+    codepoint = procy_cp437_to_codepoint((unsigned char)codepoint);
+  }
+
+  procy_draw_op_text_t op = procy_create_draw_op_codepoint_colored(
+      x, y, z, to_color(color), to_color(background), codepoint, bold);
+  procy_append_draw_op_text(window, &op);
+}
+
+PROCY_FFI_EXPORT void procy_ffi_draw_string(procy_window_t *window, int x,
+                                            int y, int z, int color,
+                                            int background,
+                                            const char *contents,
+                                            size_t length) {
+  int glyph_w = 0;
+  procy_get_glyph_size(window, &glyph_w, NULL);
+
+  // modifiers are parsed just as they are by pr.draw.string
+  procy_text_cursor_t cursor = procy_create_text_cursor(
+      contents, length, false, to_color(color), to_color(background));
+  uint32_t codepoint;
+  for (int column = 0; procy_next_text_glyph(&cursor, &codepoint); ++column) {
+    procy_draw_op_text_t op = procy_create_draw_op_codepoint_colored(
+        x + column * glyph_w, y, z, cursor.color, cursor.background,
+        codepoint, cursor.bold);
+    procy_append_draw_op_text(window, &op);
+  }
+}
+
+PROCY_FFI_EXPORT void procy_ffi_draw_rect(procy_window_t *window, int x, int y,
+                                          int z, int width, int height,
+                                          int color) {
+  procy_draw_op_rect_t op = procy_create_draw_op_rect(
+      x, y, z, width, height, to_color(color));
+  procy_append_draw_op_rect(window, &op);
+}
+
+PROCY_FFI_EXPORT void procy_ffi_draw_line(procy_window_t *window, int x1,
+                                          int y1, int x2, int y2, int z,
+                                          int color) {
+  procy_draw_op_line_t op =
+      procy_create_draw_op_line(x1, y1, x2, y2, z, to_color(color));
+  procy_append_draw_op_line(window, &op);
+}
+
+PROCY_FFI_EXPORT int procy_ffi_get_glyph_width(procy_window_t *window) {
+  int glyph_w = 0;
+  procy_get_glyph_size(window, &glyph_w, NULL);
+  return glyph_w;
+}
+
+PROCY_FFI_EXPORT int procy_ffi_get_glyph_height(procy_window_t *window) {
+  int glyph_h = 0;
+  procy_get_glyph_size(window, NULL, &glyph_h);
+  return glyph_h;
+}
+
+static int load_ffi_module(lua_State *L) {
+  const procy_embedded_resource_t *module =
+      procy_get_embedded_resource(MODULE_FFI_FILE);
+  if (module == NULL) {
+    return luaL_error(L, "The %s module is missing", MODULE_FFI);
+  }
+
+  if (luaL_loadbuffer(L, (const char *)module->data, module->length,
+                      "=" MODULE_FFI) != 0) {
+    return lua_error(L);
+  }
+
+  // the module is passed the window pointer, which it casts for itself
+  lua_getfield(L, LUA_REGISTRYINDEX, GLOBAL_WINDOW_PTR);
+  lua_call(L, 1, 1);
+
+  return 1;
+}
+
+void add_ffi(lua_State *L) {
+  static bool registered = false;
+  if (!registered) {
+    procy_register_embedded_resources(lua_embed_index, lua_embed_count);
+    registered = true;
+  }
+
+  // make the module available via `require` without touching the filesystem
+  lua_getglobal(L, "package");
+  lua_getfield(L, -1, "preload");
+  lua_pushcfunction(L, load_ffi_module);
+  lua_setfield(L, -2, MODULE_FFI);
+  lua_pop(L, 2);
+}
@@ -1,5 +1,9 @@
+#include "script/input.h"
+
+#include <lauxlib.h>
 #include <log.h>
 #include <lua.h>
+#include <string.h>
 
 #include "procyon.h"
 #include "script.h"
@@ -13,6 +17,7 @@
 #define FUNC_EVENTS_MOUSE_MOVED "on_mouse_moved"
 #define FUNC_EVENTS_MOUSE_PRESS "on_mouse_pressed"
 #define FUNC_EVENTS_MOUSE_RELEASE "on_mouse_released"
+#define FUNC_POLL "poll"
 
 #define FIELD_KEY_VALUE "value"
 #define FIELD_KEY_CTRL "ctrl"
@@ -24,8 +29,105 @@
 #define FIELD_MOUSE_SHIFT "shift"
 #define FIELD_MOUSE_ALT "alt"
 
+#define FIELD_EVENT_TYPE "type"
+#define FIELD_EVENT_TIME "time"
+#define FIELD_EVENT_VALUE "value"
+#define FIELD_EVENT_X "x"
+#define FIELD_EVENT_Y "y"
+#define FIELD_EVENT_CTRL "ctrl"
+#define FIELD_EVENT_SHIFT "shift"
+#define FIELD_EVENT_ALT "alt"
+
 #define CHAR_MAX_CODEPOINT 255
 
+// the most events that can be queued between frames; past this, the oldest
+// are dropped
+#define INPUT_QUEUE_CAPACITY 512
+
+typedef enum input_event_type_t {
+  INPUT_KEY_PRESSED,
+  INPUT_KEY_RELEASED,
+  INPUT_CHAR_ENTERED,
+  INPUT_MOUSE_MOVED,
+  INPUT_MOUSE_PRESSED,
+  INPUT_MOUSE_RELEASED,
+  INPUT_EVENT_TYPE_COUNT
+} input_event_type_t;
+
+typedef struct input_event_t {
+  input_event_type_t type;
+  int value;  // a key, a mouse button or a character
+  bool shift, ctrl, alt;
+  double time, x, y;  // x and y are where the cursor was at the time
+} input_event_t;
+
+// indexed by input_event_type_t: the name of each event's handler, and the
+// type given to pr.input.poll's events
+static const char *handler_names[] = {
+    FUNC_EVENTS_KEYPRESS,    FUNC_EVENTS_KEYRELEASE,
+    FUNC_EVENTS_CHAR,        FUNC_EVENTS_MOUSE_MOVED,
+    FUNC_EVENTS_MOUSE_PRESS, FUNC_EVENTS_MOUSE_RELEASE};
+static const char *event_names[] = {"key_pressed",   "key_released",
+                                    "char_entered",  "mouse_moved",
+                                    "mouse_pressed", "mouse_released"};
+
+// Events are recorded by the window's callbacks as they arrive, and handed to
+// the script all at once at the start of the next frame.  `queue` is a ring
+// buffer of the events still to be delivered, and `frame` holds those
+// delivered at the start of the current frame, for pr.input.poll.
+static struct {
+  input_event_t queue[INPUT_QUEUE_CAPACITY];
+  size_t first, count;
+  unsigned int dropped;
+
+  input_event_t frame[INPUT_QUEUE_CAPACITY];
+  size_t frame_count;
+  bool polled;  // whether the events of this frame have been polled yet
+
+  double x, y;
+
+  // the handlers assigned to pr.input, kept as references rather than in the
+  // table itself so that they're found without looking them up by name
+  int handlers[INPUT_EVENT_TYPE_COUNT];
+
+  // the table returned by pr.input.poll, and the event tables it's filled
+  // with, which are reused from frame to frame
+  int events_ref, pool_ref;
+  size_t events_count;
+} input;
+
+static void queue_event(input_event_type_t type, int value, bool shift,
+                        bool ctrl, bool alt) {
+  // a run of mouse movements is coalesced into the last of them, since only
+  // the cursor's latest position matters
+  if (type == INPUT_MOUSE_MOVED && input.count > 0) {
+    input_event_t *last =
+        &input.queue[(input.first + input.count - 1) % INPUT_QUEUE_CAPACITY];
+    if (last->type == INPUT_MOUSE_MOVED) {
+      last->time = procy_get_time();
+      last->x = input.x;
+      last->y = input.y;
+      return;
+    }
+  }
+
+  if (input.count == INPUT_QUEUE_CAPACITY) {
+    input.first = (input.first + 1) % INPUT_QUEUE_CAPACITY;
+    --input.count;
+    ++input.dropped;
+  }
+
+  input.queue[(input.first + input.count++) % INPUT_QUEUE_CAPACITY] =
+      (input_event_t){.type = type,
+                      .value = value,
+                      .shift = shift,
+                      .ctrl = ctrl,
+                      .alt = alt,
+                      .time = procy_get_time(),
+                      .x = input.x,
+                      .y = input.y};
+}
+
 static void push_key_arg(lua_State *L, procy_key_info_t *key, bool shift,
                          bool ctrl, bool alt) {
   lua_newtable(L);
@@ -62,38 +164,12 @@ static void push_mouse_button_arg(lua_State *L, procy_mouse_button_t button,
 
 static void key_pressed(procy_state_t *state, procy_key_info_t key, bool shift,
                         bool ctrl, bool alt) {
-  lua_State *L = ((script_env_t *)state->data)->L;
-
-  push_library_table(L);
-  lua_getfield(L, -1, TBL_INPUT);
-  lua_getfield(L, -1, FUNC_EVENTS_KEYPRESS);
-  if (lua_isfunction(L, -1)) {
-    push_key_arg(L, &key, shift, ctrl, alt);
-    if (lua_pcall(L, 1, 0, 0) == LUA_ERRRUN) {
-      LOG_SCRIPT_ERROR(L, "Error calling %s.%s: %s", TBL_INPUT,
-                       FUNC_EVENTS_KEYPRESS, lua_tostring(L, -1));
-    }
-  }
-
-  lua_pop(L, lua_gettop(L));
+  queue_event(INPUT_KEY_PRESSED, key.value, shift, ctrl, alt);
 }
 
 static void key_released(procy_state_t *state, procy_key_info_t key, bool shift,
                          bool ctrl, bool alt) {
-  lua_State *L = ((script_env_t *)state->data)->L;
-
-  push_library_table(L);
-  lua_getfield(L, -1, TBL_INPUT);
-  lua_getfield(L, -1, FUNC_EVENTS_KEYRELEASE);
-  if (lua_isfunction(L, -1)) {
-    push_key_arg(L, &key, shift, ctrl, alt);
-    if (lua_pcall(L, 1, 0, 0) == LUA_ERRRUN) {
-      LOG_SCRIPT_ERROR(L, "Error calling %s.%s: %s", TBL_INPUT,
-                       FUNC_EVENTS_KEYRELEASE, lua_tostring(L, -1));
-    }
-  }
-
-  lua_pop(L, lua_gettop(L));
+  queue_event(INPUT_KEY_RELEASED, key.value, shift, ctrl, alt);
 }
 
 static void char_entered(procy_state_t *state, unsigned int codepoint) {
@@ -103,81 +179,225 @@ static void char_entered(procy_state_t *state, unsigned int codepoint) {
     return;
   }
 
-  lua_State *L = ((script_env_t *)state->data)->L;
+  queue_event(INPUT_CHAR_ENTERED, (int)codepoint, false, false, false);
+}
 
-  push_library_table(L);
-  lua_getfield(L, -1, TBL_INPUT);
-  lua_getfield(L, -1, FUNC_EVENTS_CHAR);
-  if (lua_isfunction(L, -1)) {
-    char buffer[2] = {(char)codepoint,
-                      '\0'};  // pass the truncated codepoint, followed by a
-                              // null-terminator as a two-byte string
-    lua_pushstring(L, &buffer[0]);
-    if (lua_pcall(L, 1, 0, 0) == LUA_ERRRUN) {
-      LOG_SCRIPT_ERROR(L, "Error calling %s.%s: %s", TBL_INPUT,
-                       FUNC_EVENTS_CHAR, lua_tostring(L, -1));
+static void mouse_moved(procy_state_t *state, double x, double y) {
+  input.x = x;
+  input.y = y;
+  queue_event(INPUT_MOUSE_MOVED, 0, false, false, false);
+}
+
+static void mouse_released(procy_state_t *state, procy_mouse_button_t button,
+                           bool shift, bool ctrl, bool alt) {
+  queue_event(INPUT_MOUSE_RELEASED, button, shift, ctrl, alt);
+}
+
+static void mouse_pressed(procy_state_t *state, procy_mouse_button_t button,
+                          bool shift, bool ctrl, bool alt) {
+  queue_event(INPUT_MOUSE_PRESSED, button, shift, ctrl, alt);
+}
+
+static void push_char_arg(lua_State *L, int codepoint) {
+  // pass the truncated codepoint as a one-character string
+  char buffer = (char)codepoint;
+  lua_pushlstring(L, &buffer, 1);
+}
+
+// pushes the arguments that an event's handler is called with, returning how
+// many there are
+static int push_handler_args(lua_State *L, const input_event_t *event) {
+  switch (event->type) {
+    case INPUT_KEY_PRESSED:
+    case INPUT_KEY_RELEASED: {
+      procy_key_info_t key = {.value = event->value};
+      push_key_arg(L, &key, event->shift, event->ctrl, event->alt);
+      return 1;
     }
+    case INPUT_CHAR_ENTERED:
+      push_char_arg(L, event->value);
+      return 1;
+    case INPUT_MOUSE_MOVED:
+      lua_pushnumber(L, event->x);
+      lua_pushnumber(L, event->y);
+      return 2;
+    default:
+      push_mouse_button_arg(L, (procy_mouse_button_t)event->value,
+                            event->shift, event->ctrl, event->alt);
+      return 1;
   }
-
-  lua_pop(L, lua_gettop(L));
 }
 
-static void mouse_moved(procy_state_t *state, double x, double y) {
-  lua_State *L = ((script_env_t *)state->data)->L;
+static void call_handler(lua_State *L, const input_event_t *event) {
+  int ref = input.handlers[event->type];
+  if (ref == LUA_NOREF || ref == LUA_REFNIL) {
+    return;
+  }
 
-  push_library_table(L);
-  lua_getfield(L, -1, TBL_INPUT);
-  lua_getfield(L, -1, FUNC_EVENTS_MOUSE_MOVED);
+  int top = lua_gettop(L);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
   if (lua_isfunction(L, -1)) {
-    lua_pushnumber(L, x);
-    lua_pushnumber(L, y);
-    if (lua_pcall(L, 2, 0, 0) == LUA_ERRRUN) {
+    if (lua_pcall(L, push_handler_args(L, event), 0, 0) == LUA_ERRRUN) {
       LOG_SCRIPT_ERROR(L, "Error calling %s.%s: %s", TBL_INPUT,
-                       FUNC_EVENTS_MOUSE_MOVED, lua_tostring(L, -1));
+                       handler_names[event->type], lua_tostring(L, -1));
     }
   }
 
-  lua_pop(L, lua_gettop(L));
+  lua_settop(L, top);
 }
 
-static void mouse_released(procy_state_t *state, procy_mouse_button_t button,
-                           bool shift, bool ctrl, bool alt) {
-  lua_State *L = ((script_env_t *)state->data)->L;
+void dispatch_input(lua_State *L) {
+  if (input.dropped > 0) {
+    log_debug("Dropped %u input events", input.dropped);
+    input.dropped = 0;
+  }
 
-  push_library_table(L);
-  lua_getfield(L, -1, TBL_INPUT);
-  lua_getfield(L, -1, FUNC_EVENTS_MOUSE_RELEASE);
-  if (lua_isfunction(L, -1)) {
-    push_mouse_button_arg(L, button, shift, ctrl, alt);
-    if (lua_pcall(L, 1, 0, 0) == LUA_ERRRUN) {
-      LOG_SCRIPT_ERROR(L, "Error calling %s.%s: %s", TBL_INPUT,
-                       FUNC_EVENTS_MOUSE_RELEASE, lua_tostring(L, -1));
-    }
+  for (size_t i = 0; i < input.count; ++i) {
+    input.frame[i] = input.queue[(input.first + i) % INPUT_QUEUE_CAPACITY];
   }
 
-  lua_pop(L, lua_gettop(L));
+  input.frame_count = input.count;
+  input.first = 0;
+  input.count = 0;
+  input.polled = false;
+
+  for (size_t i = 0; i < input.frame_count; ++i) {
+    call_handler(L, &input.frame[i]);
+  }
 }
 
-static void mouse_pressed(procy_state_t *state, procy_mouse_button_t button,
-                          bool shift, bool ctrl, bool alt) {
-  lua_State *L = ((script_env_t *)state->data)->L;
+static void set_event_fields(lua_State *L, const input_event_t *event) {
+  lua_pushstring(L, event_names[event->type]);
+  lua_setfield(L, -2, FIELD_EVENT_TYPE);
 
-  push_library_table(L);
-  lua_getfield(L, -1, TBL_INPUT);
-  lua_getfield(L, -1, FUNC_EVENTS_MOUSE_PRESS);
-  if (lua_isfunction(L, -1)) {
-    push_mouse_button_arg(L, button, shift, ctrl, alt);
-    if (lua_pcall(L, 1, 0, 0) == LUA_ERRRUN) {
-      LOG_SCRIPT_ERROR(L, "Error calling %s.%s: %s", TBL_INPUT,
-                       FUNC_EVENTS_MOUSE_PRESS, lua_tostring(L, -1));
+  lua_pushnumber(L, event->time);
+  lua_setfield(L, -2, FIELD_EVENT_TIME);
+
+  if (event->type == INPUT_CHAR_ENTERED) {
+    push_char_arg(L, event->value);
+  } else if (event->type == INPUT_MOUSE_MOVED) {
+    lua_pushnil(L);
+  } else {
+    lua_pushinteger(L, event->value);
+  }
+  lua_setfield(L, -2, FIELD_EVENT_VALUE);
+
+  lua_pushnumber(L, event->x);
+  lua_setfield(L, -2, FIELD_EVENT_X);
+
+  lua_pushnumber(L, event->y);
+  lua_setfield(L, -2, FIELD_EVENT_Y);
+
+  lua_pushboolean(L, event->shift);
+  lua_setfield(L, -2, FIELD_EVENT_SHIFT);
+
+  lua_pushboolean(L, event->ctrl);
+  lua_setfield(L, -2, FIELD_EVENT_CTRL);
+
+  lua_pushboolean(L, event->alt);
+  lua_setfield(L, -2, FIELD_EVENT_ALT);
+}
+
+// pr.input.poll() -> the events delivered at the start of this frame, and how
+// many there are.  the table and the events in it are reused by later calls.
+static int poll_input(lua_State *L) {
+  lua_settop(L, 0);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, input.events_ref);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, input.pool_ref);
+
+  if (!input.polled) {
+    input.polled = true;
+
+    for (size_t i = 0; i < input.frame_count; ++i) {
+      lua_rawgeti(L, 2, (int)i + 1);
+      if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_createtable(L, 0, 8);
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, 2, (int)i + 1);
+      }
+
+      set_event_fields(L, &input.frame[i]);
+      lua_rawseti(L, 1, (int)i + 1);
     }
+
+    // clear whatever was left from a busier frame
+    for (size_t i = input.frame_count; i < input.events_count; ++i) {
+      lua_pushnil(L);
+      lua_rawseti(L, 1, (int)i + 1);
+    }
+
+    input.events_count = input.frame_count;
   }
 
-  lua_pop(L, lua_gettop(L));
+  lua_settop(L, 1);
+  lua_pushinteger(L, (lua_Integer)input.frame_count);
+
+  return 2;
+}
+
+static int find_handler(lua_State *L, int index) {
+  if (lua_type(L, index) == LUA_TSTRING) {
+    const char *name = lua_tostring(L, index);
+    for (int i = 0; i < INPUT_EVENT_TYPE_COUNT; ++i) {
+      if (strcmp(name, handler_names[i]) == 0) {
+        return i;
+      }
+    }
+  }
+
+  return -1;
+}
+
+static int get_input_field(lua_State *L) {
+  int handler = find_handler(L, 2);
+  if (handler < 0) {
+    lua_pushnil(L);
+  } else {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, input.handlers[handler]);
+  }
+
+  return 1;
+}
+
+static int set_input_field(lua_State *L) {
+  lua_settop(L, 3);
+
+  int handler = find_handler(L, 2);
+  if (handler < 0) {
+    lua_rawset(L, 1);
+  } else {
+    luaL_unref(L, LUA_REGISTRYINDEX, input.handlers[handler]);
+    input.handlers[handler] = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  return 0;
 }
 
 static void add_event_handler_table(lua_State *L) {
+  // handlers and events from a previous run of the script are discarded
+  memset(&input, 0, sizeof(input));
+  for (int i = 0; i < INPUT_EVENT_TYPE_COUNT; ++i) {
+    input.handlers[i] = LUA_NOREF;
+  }
+
+  lua_newtable(L);
+  input.events_ref = luaL_ref(L, LUA_REGISTRYINDEX);
   lua_newtable(L);
+  input.pool_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  luaL_Reg methods[] = {{FUNC_POLL, poll_input}, {NULL, NULL}};
+  luaL_newlib(L, methods);
+
+  // the handlers are kept out of the table, so that assigning or reading one
+  // always goes through the metatable
+  lua_createtable(L, 0, 2);
+  lua_pushcfunction(L, get_input_field);
+  lua_setfield(L, -2, "__index");
+  lua_pushcfunction(L, set_input_field);
+  lua_setfield(L, -2, "__newindex");
+  lua_setmetatable(L, -2);
+
   lua_setfield(L, 1, TBL_INPUT);
 }
 
@@ -0,0 +1,436 @@
+#include "script/jobs.h"
+
+#include <lauxlib.h>
+#include <log.h>
+#include <lua.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "script/environment.h"
+#include "script/parallel.h"
+
+#define TBL_JOBS "jobs"
+#define TBL_JOB_META "procyon_job_meta"
+#define TBL_JOB_QUEUE_META "procyon_job_queue_meta"
+
+#define FUNC_JOBS_SUBMIT "submit"
+#define FUNC_JOBS_GETSTATS "get_stats"
+#define FUNC_JOB_ISDONE "is_done"
+#define FUNC_JOB_RESULT "result"
+#define FUNC_JOB_GETSTATS "get_stats"
+#define FIELD_JOB_QUEUE "procyon_job_queue"
+#define FIELD_STATS_SUBMITTED "submitted"
+#define FIELD_STATS_COMPLETED "completed"
+#define FIELD_STATS_PENDING "pending"
+#define FIELD_STATS_WAIT "wait_ms"
+#define FIELD_STATS_RUN "run_ms"
+#define FIELD_STATS_LATENCY "latency_ms"
+#define FIELD_STATS_AVERAGE_WAIT "average_wait_ms"
+#define FIELD_STATS_AVERAGE_RUN "average_run_ms"
+#define FIELD_STATS_MAX_RUN "max_run_ms"
+
+static const job_op_t *const job_ops[] = {&plane_encode_job,
+                                          &plane_decode_job,
+                                          &plane_import_job,
+                                          &plane_export_job,
+                                          &plane_save_job,
+                                          &plane_load_job,
+                                          &plane_fill_noise_job,
+                                          &plane_dijkstra_map_job,
+                                          NULL};
+
+// A submitted job, which is owned by the queue until its results are
+// delivered, by the thread running it until it's finished, and by its future
+// until that's collected.  It's freed once none of them need it.
+typedef struct job_t {
+  const job_op_t *op;
+  void *state;
+  atomic_int owners;
+  atomic_bool finished;
+
+  // the rest is only touched on the main thread, apart from the start and
+  // finish times, which are set before `finished`
+  struct job_t *next;
+  bool delivered;
+  int callback_ref, results_ref, result_count;
+  double submitted, started, completed, delivered_at;
+} job_t;
+
+// the jobs of one Lua state, in the order they were submitted
+typedef struct job_queue_t {
+  job_t *pending;
+  unsigned long submitted, completed;
+  double total_wait, total_run, max_run;
+} job_queue_t;
+
+// monotonic time in seconds, for timing jobs
+static double get_time(void) {
+#ifdef _WIN32
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+#endif
+}
+
+static job_queue_t *get_job_queue(lua_State *L) {
+  lua_getfield(L, LUA_REGISTRYINDEX, FIELD_JOB_QUEUE);
+  job_queue_t *queue = (job_queue_t *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  return queue;
+}
+
+static void release_job(lua_State *L, job_t *job) {
+  if (atomic_fetch_sub(&job->owners, 1) != 1) {
+    return;
+  }
+
+  if (job->state != NULL) {
+    job->op->destroy(L, job->state);
+    free(job->state);
+  }
+
+  if (L != NULL) {
+    luaL_unref(L, LUA_REGISTRYINDEX, job->callback_ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, job->results_ref);
+  }
+
+  free(job);
+}
+
+static void run_job(void *data) {
+  job_t *job = (job_t *)data;
+
+  job->started = get_time();
+  job->op->run(job->state);
+  job->completed = get_time();
+
+  atomic_store(&job->finished, true);
+  release_job(NULL, job);
+}
+
+static void push_results(lua_State *L, const job_t *job) {
+  lua_rawgeti(L, LUA_REGISTRYINDEX, job->results_ref);
+  for (int i = 1; i <= job->result_count; ++i) {
+    lua_rawgeti(L, -i, i);
+  }
+  lua_remove(L, -job->result_count - 1);
+}
+
+// keeps a finished job's results in a table, so that the future can return
+// them as many times as it's asked.  run as a protected call, since `finish`
+// may raise an error.
+static int store_job_results(lua_State *L) {
+  job_t *job = (job_t *)lua_touserdata(L, 1);
+
+  lua_newtable(L);
+  int count = job->op->finish(L, job->state);
+  for (int i = count; i > 0; --i) {
+    lua_rawseti(L, 2, i);
+  }
+  lua_settop(L, 2);
+
+  job->results_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  job->result_count = count;
+
+  return 0;
+}
+
+static void deliver_job(lua_State *L, job_queue_t *queue, job_t *job) {
+  int top = lua_gettop(L);
+
+  // a job that fails to finish is still delivered, without any results
+  lua_pushcfunction(L, store_job_results);
+  lua_pushlightuserdata(L, job);
+  bool stored = lua_pcall(L, 1, 0, 0) == 0;
+  if (!stored) {
+    LOG_SCRIPT_ERROR(L, "Error finishing a %s job: %s", job->op->name,
+                     lua_tostring(L, -1));
+    lua_settop(L, top);
+  }
+
+  job->op->destroy(L, job->state);
+  free(job->state);
+  job->state = NULL;
+
+  job->delivered = true;
+  job->delivered_at = get_time();
+
+  double wait = job->started - job->submitted;
+  double run = job->completed - job->started;
+  ++queue->completed;
+  queue->total_wait += wait;
+  queue->total_run += run;
+  queue->max_run = run > queue->max_run ? run : queue->max_run;
+
+  if (stored && job->callback_ref != LUA_NOREF) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, job->callback_ref);
+    push_results(L, job);
+    if (lua_pcall(L, job->result_count, 0, 0) != 0) {
+      LOG_SCRIPT_ERROR(L, "Error calling the callback of a %s job: %s",
+                       job->op->name, lua_tostring(L, -1));
+    }
+  }
+
+  lua_settop(L, top);
+}
+
+void complete_jobs(lua_State *L) {
+  job_queue_t *queue = get_job_queue(L);
+  if (queue == NULL) {
+    return;
+  }
+
+  // jobs that finish while callbacks are running (or that callbacks submit)
+  // wait for the next frame
+  job_t *finished = NULL, **finished_tail = &finished;
+  for (job_t **link = &queue->pending; *link != NULL;) {
+    job_t *job = *link;
+    if (atomic_load(&job->finished)) {
+      *link = job->next;
+      job->next = NULL;
+      *finished_tail = job;
+      finished_tail = &job->next;
+    } else {
+      link = &job->next;
+    }
+  }
+
+  while (finished != NULL) {
+    job_t *job = finished;
+    finished = job->next;
+
+    deliver_job(L, queue, job);
+    release_job(L, job);
+  }
+}
+
+static job_t *check_job(lua_State *L, int index) {
+  return *(job_t **)luaL_checkudata(L, index, TBL_JOB_META);
+}
+
+// pr.jobs.submit(op, {args...} [, callback])
+static int jobs_submit(lua_State *L) {
+  lua_settop(L, 3);
+
+  const char *name = luaL_checkstring(L, 1);
+  const job_op_t *op = NULL;
+  for (int i = 0; job_ops[i] != NULL && op == NULL; ++i) {
+    op = strcmp(job_ops[i]->name, name) == 0 ? job_ops[i] : NULL;
+  }
+
+  if (op == NULL) {
+    LOG_SCRIPT_ERROR(L, "Unknown job \"%s\"", name);
+    return 0;
+  }
+
+  if (!lua_isnoneornil(L, 2)) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+  }
+
+  if (!lua_isnoneornil(L, 3)) {
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+  }
+
+  job_queue_t *queue = get_job_queue(L);
+  if (queue == NULL) {
+    return 0;
+  }
+
+  // the future is made before the job is prepared, so that if preparing it
+  // raises an error, whatever it allocated is freed when the future is
+  // collected
+  job_t **future = lua_newuserdata(L, sizeof(job_t *));
+  *future = NULL;
+  luaL_setmetatable(L, TBL_JOB_META);
+
+  // the job's arguments are unpacked after the future, where the job can
+  // read them as it would a function's
+  int count = lua_istable(L, 2) ? (int)lua_objlen(L, 2) : 0;
+  luaL_checkstack(L, count, "too many job arguments");
+  for (int i = 1; i <= count; ++i) {
+    lua_rawgeti(L, 2, i);
+  }
+
+  job_t *job = calloc(1, sizeof(job_t));
+  void *state = calloc(1, op->state_size);
+  if (job == NULL || state == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate a %s job", name);
+    free(job);
+    free(state);
+    return 0;
+  }
+
+  job->op = op;
+  job->state = state;
+  job->callback_ref = LUA_NOREF;
+  job->results_ref = LUA_NOREF;
+  atomic_init(&job->owners, 1);
+  atomic_init(&job->finished, false);
+  *future = job;
+
+  if (!op->prepare(L, 5, state)) {
+    *future = NULL;
+    release_job(L, job);
+    return 0;
+  }
+
+  if (lua_isfunction(L, 3)) {
+    lua_pushvalue(L, 3);
+    job->callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  // owned by the queue, the future, and the thread that runs it
+  atomic_store(&job->owners, 3);
+
+  job_t **tail = &queue->pending;
+  while (*tail != NULL) {
+    tail = &(*tail)->next;
+  }
+  *tail = job;
+  ++queue->submitted;
+
+  lua_settop(L, 4);
+
+  // without background threads the job runs now, but its results are still
+  // delivered at the start of the next frame
+  job->submitted = get_time();
+  if (!parallel_submit(run_job, job)) {
+    run_job(job);
+  }
+
+  return 1;
+}
+
+// pr.jobs.get_stats()
+static int jobs_get_stats(lua_State *L) {
+  job_queue_t *queue = get_job_queue(L);
+  if (queue == NULL) {
+    return 0;
+  }
+
+  double completed = queue->completed > 0 ? (double)queue->completed : 1.0;
+
+  lua_newtable(L);
+  lua_pushinteger(L, (lua_Integer)queue->submitted);
+  lua_setfield(L, -2, FIELD_STATS_SUBMITTED);
+  lua_pushinteger(L, (lua_Integer)queue->completed);
+  lua_setfield(L, -2, FIELD_STATS_COMPLETED);
+  lua_pushinteger(L, (lua_Integer)(queue->submitted - queue->completed));
+  lua_setfield(L, -2, FIELD_STATS_PENDING);
+  lua_pushnumber(L, queue->total_wait / completed * 1000.0);
+  lua_setfield(L, -2, FIELD_STATS_AVERAGE_WAIT);
+  lua_pushnumber(L, queue->total_run / completed * 1000.0);
+  lua_setfield(L, -2, FIELD_STATS_AVERAGE_RUN);
+  lua_pushnumber(L, queue->max_run * 1000.0);
+  lua_setfield(L, -2, FIELD_STATS_MAX_RUN);
+
+  return 1;
+}
+
+// job:is_done()
+static int job_is_done(lua_State *L) {
+  lua_pushboolean(L, check_job(L, 1)->delivered);
+
+  return 1;
+}
+
+// job:result()
+static int job_result(lua_State *L) {
+  job_t *job = check_job(L, 1);
+  if (!job->delivered) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  push_results(L, job);
+
+  return job->result_count;
+}
+
+// job:get_stats()
+static int job_get_stats(lua_State *L) {
+  job_t *job = check_job(L, 1);
+  if (!job->delivered) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  lua_newtable(L);
+  lua_pushnumber(L, (job->started - job->submitted) * 1000.0);
+  lua_setfield(L, -2, FIELD_STATS_WAIT);
+  lua_pushnumber(L, (job->completed - job->started) * 1000.0);
+  lua_setfield(L, -2, FIELD_STATS_RUN);
+  lua_pushnumber(L, (job->delivered_at - job->submitted) * 1000.0);
+  lua_setfield(L, -2, FIELD_STATS_LATENCY);
+
+  return 1;
+}
+
+static int job_gc(lua_State *L) {
+  // futures of jobs that failed to be prepared hold nothing
+  job_t *job = *(job_t **)luaL_checkudata(L, 1, TBL_JOB_META);
+  if (job != NULL) {
+    release_job(L, job);
+  }
+
+  return 0;
+}
+
+static int job_queue_gc(lua_State *L) {
+  job_queue_t *queue =
+      (job_queue_t *)luaL_checkudata(L, 1, TBL_JOB_QUEUE_META);
+
+  // jobs that are still running are freed by their threads once they're
+  // finished
+  while (queue->pending != NULL) {
+    job_t *job = queue->pending;
+    queue->pending = job->next;
+    release_job(NULL, job);
+  }
+
+  return 0;
+}
+
+void add_jobs(lua_State *L) {
+  job_queue_t *queue = lua_newuserdata(L, sizeof(job_queue_t));
+  memset(queue, 0, sizeof(job_queue_t));
+
+  if (luaL_newmetatable(L, TBL_JOB_QUEUE_META)) {
+    lua_pushcfunction(L, job_queue_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+  lua_setfield(L, LUA_REGISTRYINDEX, FIELD_JOB_QUEUE);
+
+  luaL_Reg methods[] = {{FUNC_JOBS_SUBMIT, jobs_submit},
+                        {FUNC_JOBS_GETSTATS, jobs_get_stats},
+                        {NULL, NULL}};
+  luaL_newlib(L, methods);
+  lua_setfield(L, 1, TBL_JOBS);
+
+  if (luaL_newmetatable(L, TBL_JOB_META)) {
+    luaL_Reg index_methods[] = {{FUNC_JOB_ISDONE, job_is_done},
+                                {FUNC_JOB_RESULT, job_result},
+                                {FUNC_JOB_GETSTATS, job_get_stats},
+                                {NULL, NULL}};
+    luaL_newlib(L, index_methods);
+    lua_setfield(L, -2, "__index");
+
+    lua_pushcfunction(L, job_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_pop(L, 1);
+}
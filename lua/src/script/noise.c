@@ -1,11 +1,19 @@
 #include <lauxlib.h>
+#include <limits.h>
+#include <log.h>
 #include <lua.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define STB_PERLIN_IMPLEMENTATION
 #include <stb_perlin.h>
 
 #include "script.h"
 #include "script/environment.h"
+#include "script/jobs.h"
+#include "script/parallel.h"
+#include "script/plane.h"
 
 #define TBL_NOISE "noise"
 
@@ -13,11 +21,45 @@
 #define FUNC_NOISE_RIDGE "ridge"
 #define FUNC_NOISE_FBM "fbm"
 #define FUNC_NOISE_TURBULENCE "turbulence"
+#define FUNC_PLANE_FILL_NOISE "fill_noise"
+#define FIELD_NOISE_KIND "kind"
+#define FIELD_NOISE_X "x"
+#define FIELD_NOISE_Y "y"
+#define FIELD_NOISE_Z "z"
+#define FIELD_NOISE_SCALE "scale"
+#define FIELD_NOISE_LACUNARITY "lacunarity"
+#define FIELD_NOISE_GAIN "gain"
+#define FIELD_NOISE_OFFSET "offset"
+#define FIELD_NOISE_OCTAVES "octaves"
+#define FIELD_NOISE_SEED "seed"
+#define FIELD_NOISE_BIAS "bias"
+#define FIELD_NOISE_QUANTIZE "quantize"
 
 #define DEFAULT_LACUNARITY 2.0F
 #define DEFAULT_GAIN 0.5F
 #define DEFAULT_OFFSET 1.0F
 #define DEFAULT_OCTAVES 6
+#define DEFAULT_QUANTIZE 256.0
+
+// rows are split across threads in bands of at least this many
+#define FILL_NOISE_MIN_ROWS 8
+
+typedef enum noise_kind_t {
+  NOISE_PERLIN,
+  NOISE_RIDGE,
+  NOISE_FBM,
+  NOISE_TURBULENCE
+} noise_kind_t;
+
+typedef struct noise_fill_t {
+  int *buffer;
+  int width, height, stride;
+  noise_kind_t kind;
+  double x, y, scale, bias, quantize;
+  float z, lacunarity, gain, offset;
+  int octaves, seed;
+  bool seeded;
+} noise_fill_t;
 
 static int noise_perlin(lua_State *L) {
   lua_settop(L, 4);
@@ -86,6 +128,225 @@ static int noise_turbulence(lua_State *L) {
   return 1;
 }
 
+static inline float sample_noise(const noise_fill_t *fill, float x, float y) {
+  switch (fill->kind) {
+    case NOISE_RIDGE:
+      return stb_perlin_ridge_noise3(x, y, fill->z, fill->lacunarity,
+                                     fill->gain, fill->offset, fill->octaves);
+    case NOISE_FBM:
+      return stb_perlin_fbm_noise3(x, y, fill->z, fill->lacunarity, fill->gain,
+                                   fill->octaves);
+    case NOISE_TURBULENCE:
+      return stb_perlin_turbulence_noise3(x, y, fill->z, fill->lacunarity,
+                                          fill->gain, fill->octaves);
+    default:
+      return fill->seeded
+                 ? stb_perlin_noise3_seed(x, y, fill->z, 0, 0, 0, fill->seed)
+                 : stb_perlin_noise3(x, y, fill->z, 0, 0, 0);
+  }
+}
+
+static void fill_noise_rows(void *context, int first, int last) {
+  const noise_fill_t *fill = (const noise_fill_t *)context;
+
+  for (int row = first; row < last; ++row) {
+    // coordinates and quantization are computed with doubles and then
+    // narrowed, the same as when pr.noise.* is called from a Lua loop
+    float y = (float)((fill->y + row) * fill->scale);
+    int *buffer = &fill->buffer[(size_t)row * fill->stride];
+    for (int column = 0; column < fill->width; ++column) {
+      float x = (float)((fill->x + column) * fill->scale);
+      double value = floor(((double)sample_noise(fill, x, y) + fill->bias) *
+                           fill->quantize);
+      buffer[column] = value < INT_MIN   ? INT_MIN
+                       : value > INT_MAX ? INT_MAX
+                                         : (int)value;
+    }
+  }
+}
+
+static double get_number_field(lua_State *L, int index, const char *field,
+                               double fallback) {
+  lua_getfield(L, index, field);
+  double value = luaL_optnumber(L, -1, fallback);
+  lua_pop(L, 1);
+
+  return value;
+}
+
+// reads the options given to plane:fill_noise at `index`, which may be nil
+static bool get_noise_fill(lua_State *L, int index, noise_fill_t *fill) {
+  memset(fill, 0, sizeof(noise_fill_t));
+  fill->kind = NOISE_PERLIN;
+  fill->scale = 1.0;
+  fill->lacunarity = DEFAULT_LACUNARITY;
+  fill->gain = DEFAULT_GAIN;
+  fill->offset = DEFAULT_OFFSET;
+  fill->octaves = DEFAULT_OCTAVES;
+  fill->quantize = DEFAULT_QUANTIZE;
+
+  if (lua_isnoneornil(L, index)) {
+    return true;
+  }
+
+  luaL_checktype(L, index, LUA_TTABLE);
+
+  lua_getfield(L, index, FIELD_NOISE_KIND);
+  const char *kind = luaL_optstring(L, -1, FUNC_NOISE_PERLIN);
+  if (strcmp(kind, FUNC_NOISE_PERLIN) == 0) {
+    fill->kind = NOISE_PERLIN;
+  } else if (strcmp(kind, FUNC_NOISE_RIDGE) == 0) {
+    fill->kind = NOISE_RIDGE;
+  } else if (strcmp(kind, FUNC_NOISE_FBM) == 0) {
+    fill->kind = NOISE_FBM;
+  } else if (strcmp(kind, FUNC_NOISE_TURBULENCE) == 0) {
+    fill->kind = NOISE_TURBULENCE;
+  } else {
+    LOG_SCRIPT_ERROR(L, "Unknown noise kind \"%s\"", kind);
+    return false;
+  }
+  lua_pop(L, 1);
+
+  fill->x = get_number_field(L, index, FIELD_NOISE_X, 0.0);
+  fill->y = get_number_field(L, index, FIELD_NOISE_Y, 0.0);
+  fill->z = (float)get_number_field(L, index, FIELD_NOISE_Z, 0.0);
+  fill->scale = get_number_field(L, index, FIELD_NOISE_SCALE, 1.0);
+  fill->lacunarity = (float)get_number_field(L, index, FIELD_NOISE_LACUNARITY,
+                                             DEFAULT_LACUNARITY);
+  fill->gain =
+      (float)get_number_field(L, index, FIELD_NOISE_GAIN, DEFAULT_GAIN);
+  fill->offset =
+      (float)get_number_field(L, index, FIELD_NOISE_OFFSET, DEFAULT_OFFSET);
+  fill->octaves =
+      (int)get_number_field(L, index, FIELD_NOISE_OCTAVES, DEFAULT_OCTAVES);
+  fill->bias = get_number_field(L, index, FIELD_NOISE_BIAS, 0.0);
+  fill->quantize =
+      get_number_field(L, index, FIELD_NOISE_QUANTIZE, DEFAULT_QUANTIZE);
+
+  lua_getfield(L, index, FIELD_NOISE_SEED);
+  fill->seeded = !lua_isnil(L, -1);
+  fill->seed = (int)luaL_optinteger(L, -1, 0);
+  lua_pop(L, 1);
+
+  return true;
+}
+
+// plane:fill_noise{ kind = "perlin"|"ridge"|"fbm"|"turbulence", x = 0, y = 0,
+//                   z = 0, scale = 1, lacunarity = 2, gain = 0.5, offset = 1,
+//                   octaves = 6, seed = n, bias = 0, quantize = 256 }
+static int plane_fill_noise(lua_State *L) {
+  lua_settop(L, 2);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  noise_fill_t fill;
+  if (!get_noise_fill(L, 2, &fill)) {
+    return 0;
+  }
+
+  // narrower planes are filled through a buffer of ints, since their rows may
+  // share bytes and couldn't be written from separate threads; i32 views are
+  // written in place, a row at a time
+  size_t length = (size_t)plane->width * (size_t)plane->height;
+  bool in_place = plane->type == PLANE_I32;
+  fill.buffer = in_place ? &plane->buffer[plane->offset]
+                         : malloc(sizeof(int) * length);
+  fill.width = plane->width;
+  fill.height = plane->height;
+  fill.stride = in_place ? plane->stride : plane->width;
+  if (fill.buffer == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate the noise buffer");
+    return 0;
+  }
+
+  parallel_for_rows(plane->height, FILL_NOISE_MIN_ROWS, fill_noise_rows,
+                    &fill);
+  release_plane_ints(plane, fill.buffer, true);
+
+  // return the plane
+  lua_settop(L, 1);
+
+  return 1;
+}
+
+// In the background, noise is generated into a buffer of its own, and only
+// copied into the plane once it's finished.  The plane is kept alive by a
+// reference until then.
+typedef struct fill_noise_job_t {
+  noise_fill_t fill;
+  int plane_ref;
+} fill_noise_job_t;
+
+// pr.jobs.submit('fill_noise', {plane [, options]})
+static bool prepare_fill_noise_job(lua_State *L, int index, void *state) {
+  fill_noise_job_t *job = (fill_noise_job_t *)state;
+  job->plane_ref = LUA_NOREF;
+
+  plane_t *plane = get_plane(L, index);
+  if (plane == NULL || !get_noise_fill(L, index + 1, &job->fill)) {
+    return false;
+  }
+
+  job->fill.width = plane->width;
+  job->fill.height = plane->height;
+  job->fill.stride = plane->width;
+  job->fill.buffer =
+      malloc(sizeof(int) * (size_t)plane->width * (size_t)plane->height);
+  if (job->fill.buffer == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate the noise buffer");
+    return false;
+  }
+
+  lua_pushvalue(L, index);
+  job->plane_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  return true;
+}
+
+static void run_fill_noise_job(void *state) {
+  fill_noise_job_t *job = (fill_noise_job_t *)state;
+  parallel_for_rows(job->fill.height, FILL_NOISE_MIN_ROWS, fill_noise_rows,
+                    &job->fill);
+}
+
+static int finish_fill_noise_job(lua_State *L, void *state) {
+  fill_noise_job_t *job = (fill_noise_job_t *)state;
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, job->plane_ref);
+  plane_t *plane = get_plane(L, -1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  // the plane may have been given a new buffer while the job was running
+  if (plane->width != job->fill.width || plane->height != job->fill.height) {
+    LOG_SCRIPT_ERROR(L, "The plane was resized before its noise was filled");
+    return 0;
+  }
+
+  write_plane_values(plane, 0, (size_t)plane->width * (size_t)plane->height,
+                     job->fill.buffer);
+
+  // return the plane
+  return 1;
+}
+
+static void destroy_fill_noise_job(lua_State *L, void *state) {
+  fill_noise_job_t *job = (fill_noise_job_t *)state;
+  if (L != NULL) {
+    luaL_unref(L, LUA_REGISTRYINDEX, job->plane_ref);
+  }
+
+  free(job->fill.buffer);
+}
+
+const job_op_t plane_fill_noise_job = {
+    FUNC_PLANE_FILL_NOISE, sizeof(fill_noise_job_t), prepare_fill_noise_job,
+    run_fill_noise_job,    finish_fill_noise_job,    destroy_fill_noise_job};
+
 void add_noise(lua_State *L) {
   luaL_Reg methods[] = {{FUNC_NOISE_PERLIN, noise_perlin},
                         {FUNC_NOISE_RIDGE, noise_ridge},
@@ -94,4 +355,11 @@ void add_noise(lua_State *L) {
                         {NULL, NULL}};
   luaL_newlib(L, methods);
   lua_setfield(L, 1, TBL_NOISE);
+
+  // noise can also be generated straight into planes
+  luaL_getmetatable(L, TBL_PLANE_META);
+  lua_getfield(L, -1, "__index");
+  lua_pushcfunction(L, plane_fill_noise);
+  lua_setfield(L, -2, FUNC_PLANE_FILL_NOISE);
+  lua_pop(L, 2);
 }
@@ -0,0 +1,319 @@
+#include "script/parallel.h"
+
+#include <log.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifndef __EMSCRIPTEN__
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <unistd.h>
+#endif
+#endif
+
+#define MAX_THREADS 16
+
+// the initial number of tasks each worker's deque can hold before growing
+#define DEQUE_CAPACITY 64
+
+typedef struct task_t {
+  parallel_task_fn func;
+  void *context;
+} task_t;
+
+// a call to parallel_for_rows, whose bands are claimed one at a time by
+// whichever threads get to them first
+typedef struct band_set_t {
+  parallel_rows_fn func;
+  void *context;
+  int rows, bands;
+  atomic_int next, finished, references;
+} band_set_t;
+
+#ifndef __EMSCRIPTEN__
+// Each worker has its own deque of tasks, which is used as a ring buffer.
+// Workers take the newest task from the back of their own deque, since its
+// data is the most likely to still be cached, and when that's empty they
+// steal the oldest task from the front of another worker's.
+typedef struct worker_t {
+  pthread_mutex_t lock;
+  task_t *tasks;
+  size_t first, count, capacity;
+} worker_t;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  bool started;
+  int count;
+  worker_t workers[MAX_THREADS];
+  pthread_key_t worker_key;
+
+  // the number of tasks in every deque, and where the next task from a thread
+  // outside of the pool goes
+  atomic_int queued;
+  atomic_uint next_worker;
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER, .ready = PTHREAD_COND_INITIALIZER};
+#endif
+
+int get_parallel_thread_count(void) {
+#if defined(__EMSCRIPTEN__)
+  return 1;
+#else
+  static int count = 0;
+  if (count == 0) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long processors = (long)info.dwNumberOfProcessors;
+#else
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    count = processors < 1 ? 1
+                           : (processors > MAX_THREADS ? MAX_THREADS
+                                                       : (int)processors);
+  }
+
+  return count;
+#endif
+}
+
+#ifndef __EMSCRIPTEN__
+static bool push_task(worker_t *worker, task_t task) {
+  pthread_mutex_lock(&worker->lock);
+
+  if (worker->count == worker->capacity) {
+    size_t capacity =
+        worker->capacity == 0 ? DEQUE_CAPACITY : worker->capacity * 2;
+    task_t *tasks = malloc(sizeof(task_t) * capacity);
+    if (tasks == NULL) {
+      pthread_mutex_unlock(&worker->lock);
+      return false;
+    }
+
+    // unwrap the ring into the start of the new buffer
+    for (size_t i = 0; i < worker->count; ++i) {
+      tasks[i] = worker->tasks[(worker->first + i) % worker->capacity];
+    }
+
+    free(worker->tasks);
+    worker->tasks = tasks;
+    worker->first = 0;
+    worker->capacity = capacity;
+  }
+
+  worker->tasks[(worker->first + worker->count++) % worker->capacity] = task;
+  pthread_mutex_unlock(&worker->lock);
+
+  atomic_fetch_add(&pool.queued, 1);
+
+  // wake a sleeping worker to take it
+  pthread_mutex_lock(&pool.lock);
+  pthread_cond_signal(&pool.ready);
+  pthread_mutex_unlock(&pool.lock);
+
+  return true;
+}
+
+static bool pop_task(worker_t *worker, bool newest, task_t *task) {
+  pthread_mutex_lock(&worker->lock);
+
+  bool popped = worker->count > 0;
+  if (popped) {
+    if (newest) {
+      *task = worker->tasks[(worker->first + worker->count - 1) %
+                            worker->capacity];
+    } else {
+      *task = worker->tasks[worker->first];
+      worker->first = (worker->first + 1) % worker->capacity;
+    }
+
+    --worker->count;
+    atomic_fetch_sub(&pool.queued, 1);
+  }
+
+  pthread_mutex_unlock(&worker->lock);
+
+  return popped;
+}
+
+// takes a task from the worker's own deque, or else steals one from another
+static bool take_task(int self, task_t *task) {
+  if (pop_task(&pool.workers[self], true, task)) {
+    return true;
+  }
+
+  for (int i = 1; i < pool.count; ++i) {
+    if (pop_task(&pool.workers[(self + i) % pool.count], false, task)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void *run_pool_thread(void *data) {
+  int self = (int)(size_t)data;
+  pthread_setspecific(pool.worker_key, &pool.workers[self]);
+
+  while (true) {
+    task_t task;
+    if (take_task(self, &task)) {
+      task.func(task.context);
+      continue;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    while (atomic_load(&pool.queued) == 0) {
+      pthread_cond_wait(&pool.ready, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+  }
+
+  return NULL;
+}
+
+// starts the pool's threads the first time it's needed, returning whether
+// there are any.  they live for as long as the process does.
+static bool start_pool(void) {
+  pthread_mutex_lock(&pool.lock);
+
+  if (!pool.started) {
+    pool.started = true;
+
+    if (pthread_key_create(&pool.worker_key, NULL) == 0) {
+      for (int i = 0; i < get_parallel_thread_count(); ++i) {
+        pthread_mutex_init(&pool.workers[i].lock, NULL);
+      }
+
+      // every deque is used even if its thread fails to start, since its
+      // tasks can still be stolen by the others
+      pool.count = get_parallel_thread_count();
+      int started = 0;
+      for (int i = 0; i < pool.count; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, run_pool_thread,
+                           (void *)(size_t)i) == 0) {
+          pthread_detach(thread);
+          ++started;
+        }
+      }
+
+      if (started == 0) {
+        pool.count = 0;
+      }
+
+      log_debug("Started %d worker threads", started);
+    }
+  }
+
+  pthread_mutex_unlock(&pool.lock);
+
+  return pool.count > 0;
+}
+
+static void yield_thread(void) {
+#ifdef _WIN32
+  SwitchToThread();
+#else
+  sched_yield();
+#endif
+}
+#endif
+
+bool parallel_submit(parallel_task_fn func, void *context) {
+#ifdef __EMSCRIPTEN__
+  (void)func;
+  (void)context;
+  return false;
+#else
+  if (!start_pool()) {
+    return false;
+  }
+
+  // tasks queued from a worker go to its own deque, and the rest are spread
+  // between the workers in turn
+  worker_t *worker = pthread_getspecific(pool.worker_key);
+  if (worker == NULL) {
+    worker = &pool.workers[atomic_fetch_add(&pool.next_worker, 1) %
+                           (unsigned)pool.count];
+  }
+
+  return push_task(worker, (task_t){func, context});
+#endif
+}
+
+#ifndef __EMSCRIPTEN__
+static void run_bands(band_set_t *set) {
+  int band;
+  while ((band = atomic_fetch_add(&set->next, 1)) < set->bands) {
+    set->func(set->context, (int)((long long)set->rows * band / set->bands),
+              (int)((long long)set->rows * (band + 1) / set->bands));
+    atomic_fetch_add(&set->finished, 1);
+  }
+}
+
+static void release_band_set(band_set_t *set) {
+  if (atomic_fetch_sub(&set->references, 1) == 1) {
+    free(set);
+  }
+}
+
+static void run_band_task(void *data) {
+  band_set_t *set = (band_set_t *)data;
+  run_bands(set);
+  release_band_set(set);
+}
+#endif
+
+void parallel_for_rows(int rows, int min_rows, parallel_rows_fn func,
+                       void *context) {
+  if (rows <= 0) {
+    return;
+  }
+
+  int bands = get_parallel_thread_count();
+  if (min_rows > 0 && rows / min_rows < bands) {
+    bands = rows / min_rows > 0 ? rows / min_rows : 1;
+  }
+
+#ifndef __EMSCRIPTEN__
+  band_set_t *set =
+      bands > 1 && start_pool() ? malloc(sizeof(band_set_t)) : NULL;
+  if (set != NULL) {
+    set->func = func;
+    set->context = context;
+    set->rows = rows;
+    set->bands = bands;
+    atomic_init(&set->next, 0);
+    atomic_init(&set->finished, 0);
+    atomic_init(&set->references, 1);
+
+    // the set outlives this call if some of its tasks haven't been taken by
+    // the time every band is finished, and they find nothing left to do
+    for (int i = 1; i < bands; ++i) {
+      atomic_fetch_add(&set->references, 1);
+      if (!parallel_submit(run_band_task, set)) {
+        atomic_fetch_sub(&set->references, 1);
+      }
+    }
+
+    // the calling thread claims bands too, so that none are left waiting on
+    // workers that are busy with other tasks
+    run_bands(set);
+    while (atomic_load(&set->finished) < bands) {
+      yield_thread();
+    }
+
+    release_band_set(set);
+
+    return;
+  }
+#endif
+
+  func(context, 0, rows);
+}
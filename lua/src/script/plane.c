@@ -2,7 +2,10 @@
 #include <lauxlib.h>
 #include <log.h>
 #include <lua.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 
 #ifndef __EMSCRIPTEN__
 #include <simdbitpacking.h>
@@ -13,16 +16,38 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image.h>
 #include <stb_image_write.h>
+
+// wfc seeds and draws from rand(), whose state is shared between threads, so
+// each thread running it is given a generator of its own instead
+static _Thread_local uint64_t wfc_rand_state;
+
+static void wfc_srand(unsigned int seed) { wfc_rand_state = seed; }
+
+static int wfc_rand(void) {
+  wfc_rand_state = wfc_rand_state * 6364136223846793005ULL +
+                   1442695040888963407ULL;
+  return (int)((wfc_rand_state >> 33) % ((uint64_t)RAND_MAX + 1));
+}
+
+#define srand wfc_srand
+#define rand wfc_rand
 #define WFC_IMPLEMENTATION
 #include <wfc.h>
+#undef srand
+#undef rand
 
 #include "script/environment.h"
+#include "script/jobs.h"
+#include "script/parallel.h"
+#include "script/plane.h"
+#include "script/plane_codec.h"
 
 #define TBL_PLANE "plane"
-#define TBL_PLANE_META "procyon_plane_meta"
+#define TBL_WFC_FUTURE_META "procyon_wfc_future_meta"
 
 #define FUNC_PLANE_FROM "from"
 #define FUNC_PLANE_FROM_WFC "from_wfc"
+#define FUNC_PLANE_FROM_WFC_ASYNC "from_wfc_async"
 #define FUNC_PLANE_IMPORT "import"
 #define FUNC_PLANE_EXPORT "export"
 #define FUNC_PLANE_FILL "fill"
@@ -31,40 +56,63 @@
 #define FUNC_PLANE_SET "set"
 #define FUNC_PLANE_SUB "sub"
 #define FUNC_PLANE_COPY "copy"
-#define FUNC_PLANE_BLIT "blit"
 #define FUNC_PLANE_ENCODE "encode"
 #define FUNC_PLANE_DECODE "decode"
+#define FUNC_PLANE_DECODE_INTO "decode_into"
 #define FUNC_PLANE_FIND_FIRST "find_first"
 #define FUNC_PLANE_FIND_ALL "find_all"
 #define FUNC_PLANE_GETSIZE "get_size"
+#define FUNC_PLANE_GETTYPE "get_type"
+#define FUNC_PLANE_CONVERT "convert"
+#define FUNC_PLANE_VIEW "view"
 #define FIELD_PLANE_BUFFER "_buffer"
 #define FIELD_PLANE_DATA "_data"
 #define FIELD_PLANE_WIDTH "width"
 #define FIELD_PLANE_HEIGHT "height"
 
+#define FUNC_WFC_FUTURE_ISDONE "is_done"
+#define FUNC_WFC_FUTURE_RESULT "result"
+#define FUNC_WFC_FUTURE_GETPROGRESS "get_progress"
+#define FUNC_WFC_FUTURE_CANCEL "cancel"
+#define FIELD_WFC_FLIP_X "flipx"
+#define FIELD_WFC_FLIP_Y "flipy"
+#define FIELD_WFC_ROTATIONS "nrot"
+#define FIELD_WFC_TILE_WIDTH "tilew"
+#define FIELD_WFC_TILE_HEIGHT "tileh"
+#define FIELD_WFC_ATTEMPTS "attempts"
+#define FIELD_WFC_SEED "seed"
+
 #define WFC_DEFAULT_TILE_SIZE 3
 
-typedef struct plane_t {
-  int *buffer;
-  int width;
-  int height;
-} plane_t;
+// attempts made in the background check whether they're still needed after
+// collapsing each 1/WFC_STEP_DIVISOR of their cells
+#define WFC_STEP_DIVISOR 64
 
-static int plane_sub(lua_State *L);
+// the number of elements converted at a time when changing a plane's type
+#define CONVERT_CHUNK_SIZE 1024
 
-static inline int try_get(int x, int y, int width, int height,
-                          int *const buffer) {
-  return (x >= 0 && x < width && y >= 0 && y < height) ? buffer[y * width + x]
-                                                       : 0;
-}
+// encoded planes are split into blocks of this many elements, each compressed
+// with its own codec and preceded by a header holding its format and size
+#define ENCODE_BLOCK_LENGTH 4096
+#define ENCODE_BLOCK_HEADER_SIZE 16
+#define ENCODE_BLOCK_ALIGNMENT 16
+#define ENCODE_TRAILER_SIZE (3 * sizeof(int))
+#define ENCODE_VERSION 1
 
-static inline int get(int x, int y, int width, int *const buffer) {
-  return buffer[y * width + x];
+const char *const plane_type_names[] = {"i32", "u16", "u8", "bit", NULL};
+
+static int plane_sub(lua_State *L);
+
+static inline int try_get(int x, int y, const plane_t *plane) {
+  return (x >= 0 && x < plane->width && y >= 0 && y < plane->height)
+             ? get_plane_value(plane, (size_t)y * plane->width + x)
+             : 0;
 }
 
-static bool apply_func_to_buffer(lua_State *L, int func_index, int width,
-                                 int height, int *const buffer) {
-  for (size_t i = 0; i < (size_t)(width * height); ++i) {
+static bool apply_func_to_buffer(lua_State *L, int func_index,
+                                 plane_t *plane) {
+  int width = plane->width;
+  for (size_t i = 0; i < (size_t)width * plane->height; ++i) {
     // push a copy of the function to be called, since lua_pcall will pop it
     // after it's completed
     lua_pushvalue(L, func_index);
@@ -72,7 +120,7 @@ static bool apply_func_to_buffer(lua_State *L, int func_index, int width,
     // push (x, y, current) values
     lua_pushinteger(L, (int)(i % width));
     lua_pushinteger(L, (int)(i / width));
-    lua_pushinteger(L, (int)buffer[i]);
+    lua_pushinteger(L, get_plane_value(plane, i));
 
     if (lua_pcall(L, 3, 1, 0) != LUA_OK) {
       LOG_SCRIPT_ERROR(L, "%s", lua_tostring(L, -1));
@@ -81,7 +129,7 @@ static bool apply_func_to_buffer(lua_State *L, int func_index, int width,
 
     // if any value was returned, store it in the buffer
     if (lua_isnumber(L, -1)) {
-      buffer[i] = (int)lua_tointeger(L, -1);
+      set_plane_value(plane, i, (int)lua_tointeger(L, -1));
     }
 
     lua_pop(L, 1);
@@ -90,7 +138,255 @@ static bool apply_func_to_buffer(lua_State *L, int func_index, int width,
   return true;
 }
 
-static plane_t *get_plane(lua_State *L, int index) {
+// fills `length` stored elements, starting with the one stored at `first`
+static void fill_stored_values(plane_t *plane, size_t first, size_t length,
+                               int value) {
+  switch (plane->type) {
+    case PLANE_U16:
+      for (size_t i = first; i < first + length; ++i) {
+        plane->u16[i] = (uint16_t)value;
+      }
+      break;
+    case PLANE_U8:
+      memset(&plane->u8[first], (uint8_t)value, length);
+      break;
+    case PLANE_BIT:
+      for (size_t i = first; i < first + length; ++i) {
+        if (value != 0) {
+          plane->bits[i >> 3] |= (uint8_t)(1 << (i & 7));
+        } else {
+          plane->bits[i >> 3] &= (uint8_t)~(1 << (i & 7));
+        }
+      }
+      break;
+    default:
+      for (size_t i = first; i < first + length; ++i) {
+        plane->buffer[i] = value;
+      }
+      break;
+  }
+}
+
+static void fill_plane(plane_t *plane, int value) {
+  size_t length = (size_t)plane->width * (size_t)plane->height;
+  if (plane->type == PLANE_BIT && plane->offset == 0 &&
+      is_plane_contiguous(plane)) {
+    // only whole bytes are set at once, since the last byte of a view may
+    // also hold elements of its parent
+    size_t whole = length & ~(size_t)7;
+    memset(plane->bits, value != 0 ? 0xFF : 0, whole / 8);
+    fill_stored_values(plane, whole, length - whole, value);
+  } else if (is_plane_contiguous(plane)) {
+    fill_stored_values(plane, plane->offset, length, value);
+  } else {
+    for (int y = 0; y < plane->height; ++y) {
+      fill_stored_values(plane, plane->offset + (size_t)y * plane->stride,
+                         plane->width, value);
+    }
+  }
+}
+
+size_t get_plane_buffer_size(plane_type_t type, size_t length) {
+  switch (type) {
+    case PLANE_U16:
+      return length * sizeof(uint16_t);
+    case PLANE_U8:
+      return length;
+    case PLANE_BIT:
+      return (length + 7) / 8;
+    default:
+      return length * sizeof(int);
+  }
+}
+
+static void read_stored_values(const plane_t *plane, size_t first,
+                               size_t length, int *values) {
+  switch (plane->type) {
+    case PLANE_U16:
+      for (size_t i = 0; i < length; ++i) {
+        values[i] = plane->u16[first + i];
+      }
+      break;
+    case PLANE_U8:
+      for (size_t i = 0; i < length; ++i) {
+        values[i] = plane->u8[first + i];
+      }
+      break;
+    case PLANE_BIT:
+      for (size_t i = 0; i < length; ++i) {
+        size_t index = first + i;
+        values[i] = (plane->bits[index >> 3] >> (index & 7)) & 1;
+      }
+      break;
+    default:
+      memcpy(values, &plane->buffer[first], sizeof(int) * length);
+      break;
+  }
+}
+
+static void write_stored_values(plane_t *plane, size_t first, size_t length,
+                                const int *values) {
+  switch (plane->type) {
+    case PLANE_U16:
+      for (size_t i = 0; i < length; ++i) {
+        plane->u16[first + i] = (uint16_t)values[i];
+      }
+      break;
+    case PLANE_U8:
+      for (size_t i = 0; i < length; ++i) {
+        plane->u8[first + i] = (uint8_t)values[i];
+      }
+      break;
+    case PLANE_BIT:
+      for (size_t i = 0; i < length; ++i) {
+        size_t index = first + i;
+        if (values[i] != 0) {
+          plane->bits[index >> 3] |= (uint8_t)(1 << (index & 7));
+        } else {
+          plane->bits[index >> 3] &= (uint8_t)~(1 << (index & 7));
+        }
+      }
+      break;
+    default:
+      memcpy(&plane->buffer[first], values, sizeof(int) * length);
+      break;
+  }
+}
+
+void read_plane_values(const plane_t *plane, size_t first, size_t length,
+                       int *values) {
+  if (is_plane_contiguous(plane)) {
+    read_stored_values(plane, plane->offset + first, length, values);
+    return;
+  }
+
+  // a view's rows aren't stored next to each other, so they're read one at a
+  // time
+  while (length > 0) {
+    size_t count = (size_t)plane->width - first % (size_t)plane->width;
+    count = count > length ? length : count;
+    read_stored_values(plane, get_plane_index(plane, first), count, values);
+    first += count;
+    values += count;
+    length -= count;
+  }
+}
+
+void write_plane_values(plane_t *plane, size_t first, size_t length,
+                        const int *values) {
+  if (is_plane_contiguous(plane)) {
+    write_stored_values(plane, plane->offset + first, length, values);
+    return;
+  }
+
+  while (length > 0) {
+    size_t count = (size_t)plane->width - first % (size_t)plane->width;
+    count = count > length ? length : count;
+    write_stored_values(plane, get_plane_index(plane, first), count, values);
+    first += count;
+    values += count;
+    length -= count;
+  }
+}
+
+void copy_plane_elements(plane_t *target, const plane_t *source) {
+  size_t width = (size_t)source->width;
+  size_t length = width * (size_t)source->height;
+  if (target->type == source->type && target->offset == 0 &&
+      source->offset == 0 && is_plane_contiguous(target) &&
+      is_plane_contiguous(source)) {
+    // as with fill_plane, a bit plane's trailing partial byte is copied an
+    // element at a time in case the target is a view
+    size_t whole = source->type == PLANE_BIT ? length & ~(size_t)7 : length;
+    memcpy(target->data, source->data,
+           get_plane_buffer_size(source->type, whole));
+    for (size_t i = whole; i < length; ++i) {
+      set_plane_value(target, i, get_plane_value(source, i));
+    }
+    return;
+  }
+
+  // bits aren't byte-aligned, so bit planes are copied an element at a time
+  size_t element_size = get_plane_buffer_size(source->type, 1);
+  bool same_type = target->type == source->type && source->type != PLANE_BIT;
+  for (size_t row = 0; row < length; row += width) {
+    if (same_type) {
+      memcpy((uint8_t *)target->data +
+                 get_plane_index(target, row) * element_size,
+             (const uint8_t *)source->data +
+                 get_plane_index(source, row) * element_size,
+             element_size * width);
+    } else {
+      for (size_t i = row; i < row + width; ++i) {
+        set_plane_value(target, i, get_plane_value(source, i));
+      }
+    }
+  }
+}
+
+// returns one past the index of the last element the plane stores
+static size_t get_plane_extent(const plane_t *plane) {
+  if (plane->width <= 0 || plane->height <= 0) {
+    return plane->offset;
+  }
+
+  return plane->offset + (size_t)(plane->height - 1) * (size_t)plane->stride +
+         (size_t)plane->width;
+}
+
+bool planes_overlap(const plane_t *a, const plane_t *b) {
+  return a->data == b->data && a->offset < get_plane_extent(b) &&
+         b->offset < get_plane_extent(a);
+}
+
+int *copy_plane_ints(lua_State *L, const plane_t *plane) {
+  size_t length = (size_t)plane->width * (size_t)plane->height;
+  int *ints = malloc(sizeof(int) * length);
+  if (ints == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate a copy of the plane's elements");
+    return NULL;
+  }
+
+  read_plane_values(plane, 0, length, ints);
+
+  return ints;
+}
+
+int *acquire_plane_ints(lua_State *L, const plane_t *plane) {
+  if (plane->type == PLANE_I32 && is_plane_contiguous(plane)) {
+    return &plane->buffer[plane->offset];
+  }
+
+  return copy_plane_ints(L, plane);
+}
+
+void release_plane_ints(plane_t *plane, int *ints, bool modified) {
+  if (ints == NULL ||
+      (plane->type == PLANE_I32 && ints == &plane->buffer[plane->offset])) {
+    return;
+  }
+
+  if (modified) {
+    write_plane_values(plane, 0, (size_t)plane->width * (size_t)plane->height,
+                       ints);
+  }
+
+  free(ints);
+}
+
+bool is_plane(lua_State *L, int index) {
+  if (!lua_istable(L, index) || !lua_getmetatable(L, index)) {
+    return false;
+  }
+
+  luaL_getmetatable(L, TBL_PLANE_META);
+  bool result = lua_rawequal(L, -1, -2);
+  lua_pop(L, 2);
+
+  return result;
+}
+
+plane_t *get_plane(lua_State *L, int index) {
   lua_getfield(L, index, FIELD_PLANE_DATA);
   if (!lua_isuserdata(L, -1)) {
     LOG_SCRIPT_ERROR(L,
@@ -117,7 +413,7 @@ static int plane_at(lua_State *L) {
 
   plane_t *plane = get_plane(L, 1);
 
-  lua_pushinteger(L, try_get(x, y, plane->width, plane->height, plane->buffer));
+  lua_pushinteger(L, try_get(x, y, plane));
 
   lua_insert(L, 1);
   lua_settop(L, 1);
@@ -133,15 +429,11 @@ static int plane_fill(lua_State *L) {
   lua_settop(L, 2);
 
   plane_t *plane = get_plane(L, 1);
-  size_t buffer_len = plane->width * plane->height;
 
   if (lua_isnumber(L, 2)) {
-    int value = lua_tointeger(L, 2);
-    for (int i = 0; i < buffer_len; ++i) {
-      plane->buffer[i] = value;
-    }
+    fill_plane(plane, (int)lua_tointeger(L, 2));
   } else if (lua_isfunction(L, 2)) {
-    apply_func_to_buffer(L, 2, plane->width, plane->height, plane->buffer);
+    apply_func_to_buffer(L, 2, plane);
   }
 
   // return the plane
@@ -160,7 +452,8 @@ static int plane_set(lua_State *L) {
   int y = luaL_checkinteger(L, 3);
 
   plane_t *plane = get_plane(L, 1);
-  plane->buffer[y * plane->width + x] = lua_tointeger(L, 4);
+  set_plane_value(plane, (size_t)y * plane->width + x,
+                  (int)lua_tointeger(L, 4));
 
   // return the plane
   lua_settop(L, 1);
@@ -168,14 +461,13 @@ static int plane_set(lua_State *L) {
   return 1;
 }
 
-static plane_t *push_new_plane(int width, int height, size_t *len,
-                               lua_State *L) {
-  // ensure dimensions are sane
-  if (width <= 0 || height <= 0) {
-    LOG_SCRIPT_ERROR(L, "Invalid plane dimensions (%d, %d)", width, height);
-    return NULL;
-  }
+plane_t *push_new_plane(int width, int height, size_t *len, lua_State *L) {
+  return push_new_typed_plane(width, height, PLANE_I32, len, L);
+}
 
+// pushes a plane table without a buffer
+static plane_t *push_plane_table(int width, int height, plane_type_t type,
+                                 lua_State *L) {
   // wrap the userdata in a table so that we can assign __index metamethods
   lua_newtable(L);
   luaL_setmetatable(L, TBL_PLANE_META);
@@ -190,12 +482,28 @@ static plane_t *push_new_plane(int width, int height, size_t *len,
   plane_t *plane = lua_newuserdata(L, sizeof(plane_t));
   plane->width = width;
   plane->height = height;
+  plane->type = type;
+  plane->offset = 0;
+  plane->stride = width;
 
   // store the plane data in the wrapper table
   lua_setfield(L, -2, FIELD_PLANE_DATA);
 
+  return plane;
+}
+
+plane_t *push_new_typed_plane(int width, int height, plane_type_t type,
+                              size_t *len, lua_State *L) {
+  // ensure dimensions are sane
+  if (width <= 0 || height <= 0) {
+    LOG_SCRIPT_ERROR(L, "Invalid plane dimensions (%d, %d)", width, height);
+    return NULL;
+  }
+
+  plane_t *plane = push_plane_table(width, height, type, L);
+
   size_t buffer_len = (size_t)width * (size_t)height;
-  plane->buffer = lua_newuserdata(L, buffer_len * sizeof(int));
+  plane->data = lua_newuserdata(L, get_plane_buffer_size(type, buffer_len));
 
   if (plane->buffer == NULL) {
     // if something went wrong, log a stack trace and bail
@@ -229,23 +537,47 @@ static int plane_sub(lua_State *L) {
     return 0;
   }
 
-  plane_t *target = push_new_plane(target_width, target_height, NULL, L);
+  plane_t *target = push_new_typed_plane(target_width, target_height,
+                                         source->type, NULL, L);
 
   if (target == NULL) {
     // error should already be logged by previous call
     return 0;
   }
 
-  for (int x = 0; x < target_width; ++x) {
-    for (int y = 0; y < target_height; ++y) {
-      target->buffer[y * target_width + x] =
-          try_get(source_x + x, source_y + y, source->width, source->height,
-                  source->buffer);
+  // anything outside of the source plane is zero, so clear the target and
+  // then copy in the rows of the region that overlap it
+  memset(target->data, 0,
+         get_plane_buffer_size(target->type, (size_t)target_width *
+                                                 (size_t)target_height));
+
+  int first_x = source_x < 0 ? -source_x : 0;
+  int first_y = source_y < 0 ? -source_y : 0;
+  int last_x = source->width - source_x;
+  int last_y = source->height - source_y;
+  last_x = last_x > target_width ? target_width : last_x;
+  last_y = last_y > target_height ? target_height : last_y;
+
+  // bits aren't byte-aligned, so bit planes are copied an element at a time
+  size_t element_size = get_plane_buffer_size(source->type, 1);
+  for (int y = first_y; y < last_y && first_x < last_x; ++y) {
+    size_t target_offset = (size_t)y * target_width + first_x;
+    size_t source_offset =
+        (size_t)(source_y + y) * source->width + source_x + first_x;
+    if (source->type == PLANE_BIT) {
+      for (int x = first_x; x < last_x; ++x) {
+        set_plane_value(target, target_offset++,
+                        get_plane_value(source, source_offset++));
+      }
+    } else {
+      memcpy((uint8_t *)target->data + target_offset * element_size,
+             (const uint8_t *)source->data +
+                 get_plane_index(source, source_offset) * element_size,
+             element_size * (size_t)(last_x - first_x));
     }
   }
 
-  lua_settop(L, 1);
-
+  // return the new plane
   return 1;
 }
 
@@ -259,20 +591,58 @@ static int plane_copy(lua_State *L) {
     return 0;
   }
 
-  plane_t *copy = push_new_plane(source->width, source->height, NULL, L);
+  size_t length;
+  plane_t *copy = push_new_typed_plane(source->width, source->height,
+                                       source->type, &length, L);
   if (copy == NULL) {
     LOG_SCRIPT_ERROR(L, "Failed to copy plane buffer");
     return 0;
   }
 
-  memcpy(copy->buffer, source->buffer,
-         sizeof(int) * source->width * source->height);
+  // copies of views have their own elements
+  copy_plane_elements(copy, source);
 
+  // return the copy
+  lua_insert(L, 1);
   lua_settop(L, 1);
 
   return 1;
 }
 
+// plane:view(x, y, w, h)
+static int plane_view(lua_State *L) {
+  lua_settop(L, 5);
+
+  int x = (int)luaL_checkinteger(L, 2);
+  int y = (int)luaL_checkinteger(L, 3);
+  int width = (int)luaL_checkinteger(L, 4);
+  int height = (int)luaL_checkinteger(L, 5);
+
+  plane_t *source = get_plane(L, 1);
+  if (source == NULL) {
+    return 0;
+  }
+
+  if (width <= 0 || height <= 0 || x < 0 || y < 0 ||
+      x > source->width - width || y > source->height - height) {
+    LOG_SCRIPT_ERROR(L, "View (%d, %d, %d, %d) is outside of the plane (%dx%d)",
+                     x, y, width, height, source->width, source->height);
+    return 0;
+  }
+
+  plane_t *view = push_plane_table(width, height, source->type, L);
+  view->data = source->data;
+  view->offset = get_plane_index(source, (size_t)y * source->width + x);
+  view->stride = source->stride;
+
+  // the view holds a reference to its parent's buffer, keeping it alive for
+  // as long as the view is
+  lua_getfield(L, 1, FIELD_PLANE_BUFFER);
+  lua_setfield(L, -2, FIELD_PLANE_BUFFER);
+
+  return 1;
+}
+
 static size_t store_at_offset(uint8_t *buffer, size_t offset, int value) {
   // store the provided integer in a buffer at offset, return the next available
   // offset
@@ -292,218 +662,573 @@ static int read_from_offset(uint8_t *buffer, size_t *offset) {
   return value;
 }
 
-// plane.decode(<base64>)
-static int plane_decode(lua_State *L) {
-  lua_settop(L, 1);
+typedef struct encode_context_t {
+  const plane_t *plane;
+  size_t length;
+  uint8_t *data;
+  size_t slot_size;
+  bool *failed;
+} encode_context_t;
+
+// a plane string, of which only the trailer has been decoded
+typedef struct encoded_plane_t {
+  const char *text;
+  size_t text_length;
+  size_t data_size;
+  int width, height;
+  plane_type_t type;
+  uint32_t maxbit, version;
+} encoded_plane_t;
+
+typedef struct encoded_block_t {
+  size_t offset;
+  uint32_t format, size;
+} encoded_block_t;
+
+typedef struct decode_context_t {
+  const encoded_plane_t *encoded;
+  const encoded_block_t *blocks;
+  size_t length;
+  plane_t *plane;
+  bool *failed;
+} decode_context_t;
+
+static inline size_t get_encode_block_length(size_t length, int block) {
+  size_t remaining = length - (size_t)block * ENCODE_BLOCK_LENGTH;
+  return remaining < ENCODE_BLOCK_LENGTH ? remaining : ENCODE_BLOCK_LENGTH;
+}
 
-  const char *encoded = luaL_checkstring(L, 1);
-  if (encoded == NULL) {
+// whether the codecs can read and write a plane's elements where they are,
+// rather than widening and narrowing them a block at a time
+static inline bool is_plane_codec_direct(const plane_t *plane) {
+  return plane->type == PLANE_I32 && is_plane_contiguous(plane);
+}
+
+// each block is compressed into its own worst-case slot, so that they can be
+// compressed in parallel and packed together afterwards
+static void encode_blocks(void *context, int first, int last) {
+  encode_context_t *encode = (encode_context_t *)context;
+  const plane_t *plane = encode->plane;
+
+  // the codecs work on 32-bit values, so each block of a narrower plane is
+  // widened into a buffer of this thread's on its way to being compressed
+  bool direct = is_plane_codec_direct(plane);
+  int *scratch = direct ? NULL : malloc(sizeof(int) * ENCODE_BLOCK_LENGTH);
+
+  for (int block = first; block < last; ++block) {
+    size_t start = (size_t)block * ENCODE_BLOCK_LENGTH;
+    size_t length = get_encode_block_length(encode->length, block);
+    const int *values = scratch;
+    if (direct) {
+      values = &plane->buffer[plane->offset + start];
+    } else if (scratch != NULL) {
+      read_plane_values(plane, start, length, scratch);
+    } else {
+      encode->failed[block] = true;
+      continue;
+    }
+
+    uint8_t *slot = &encode->data[(size_t)block * encode->slot_size];
+    uint32_t format;
+    size_t size = compress_block(values, length,
+                                 &slot[ENCODE_BLOCK_HEADER_SIZE], &format);
+
+    memset(slot, 0, ENCODE_BLOCK_HEADER_SIZE);
+    size_t offset = store_at_offset(slot, 0, (int)format);
+    store_at_offset(slot, offset, (int)size);
+  }
+
+  free(scratch);
+}
+
+// the value of each base-64 character, or -1 if it isn't one.  padding has
+// no value, and only appears where no bytes are read.
+static const int8_t base64_values[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, 0,  -1, -1,
+    -1, 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+
+// returns the number of bytes held by `length` characters of base-64
+static size_t get_base64_size(const char *text, size_t length) {
+  while (length > 0 && text[length - 1] == '=') {
+    --length;
+  }
+
+  return length / 4 * 3 + (length % 4 > 1 ? length % 4 - 1 : 0);
+}
+
+// decodes `size` bytes starting `offset` bytes into a plane string, without
+// decoding any more of the string than is needed for them
+static bool read_encoded_bytes(const encoded_plane_t *encoded, size_t offset,
+                               size_t size, uint8_t *out) {
+  const uint8_t *text = (const uint8_t *)encoded->text;
+  size_t position = offset / 3 * 4;
+  size_t skip = offset % 3;
+
+  while (size > 0) {
+    uint32_t group = 0;
+    for (size_t i = position; i < position + 4; ++i) {
+      int value = i < encoded->text_length ? base64_values[text[i]] : 0;
+      if (value < 0) {
+        return false;
+      }
+
+      group = group << 6 | (uint32_t)value;
+    }
+
+    for (size_t i = skip; i < 3 && size > 0; ++i, --size) {
+      *out++ = (group >> (16 - 8 * i)) & 0xFF;
+    }
+
+    position += 4;
+    skip = 0;
+  }
+
+  return true;
+}
+
+// reads the trailer of the plane string at `index`, returning false if it
+// isn't valid
+static bool read_encoded_plane(lua_State *L, int index,
+                               encoded_plane_t *encoded) {
+  encoded->text = luaL_checklstring(L, index, &encoded->text_length);
+  if (encoded->text == NULL) {
     LOG_SCRIPT_ERROR(L, "Invalid encoded plane string");
-    return 0;
+    return false;
   }
 
-  int buffer_size;
-  uint8_t *buffer = base64_dec_malloc((char *)encoded, &buffer_size);
-  if (buffer == NULL) {
+  size_t size = get_base64_size(encoded->text, encoded->text_length);
+  uint8_t trailer[ENCODE_TRAILER_SIZE];
+  if (size < ENCODE_TRAILER_SIZE ||
+      !read_encoded_bytes(encoded, size - ENCODE_TRAILER_SIZE,
+                          ENCODE_TRAILER_SIZE, trailer)) {
     LOG_SCRIPT_ERROR(L, "Failed to decode base64 in plane string");
-    return 0;
+    return false;
   }
 
   // pull metadata from the end of the decoded buffer
-  size_t meta_offset = buffer_size - 3 * sizeof(int);
-  int width = read_from_offset(buffer, &meta_offset);
-  int height = read_from_offset(buffer, &meta_offset);
-  uint32_t maxbit = read_from_offset(buffer, &meta_offset);
+  size_t meta_offset = 0;
+  encoded->data_size = size - ENCODE_TRAILER_SIZE;
+  encoded->width = read_from_offset(trailer, &meta_offset);
+  encoded->height = read_from_offset(trailer, &meta_offset);
+  uint32_t format = read_from_offset(trailer, &meta_offset);
+
+  // the element type is stored above the bit width, and is zero (i32) for
+  // planes that were encoded before planes had types.  the version is stored
+  // above that, and is zero for planes that were bitpacked as a whole.
+  encoded->maxbit = format & 0xFF;
+  encoded->type = (plane_type_t)((format >> 8) & 0xFF);
+  encoded->version = format >> 16;
+  if (encoded->type > PLANE_BIT || encoded->version > ENCODE_VERSION) {
+    LOG_SCRIPT_ERROR(L, "Unknown plane format in plane string (%u)", format);
+    return false;
+  }
 
-  log_debug("Decoded plane width: %d, height: %d, maxbit: %d", width, height,
-            maxbit);
+  log_debug("Decoded plane width: %d, height: %d, version: %u, type: %s",
+            encoded->width, encoded->height, encoded->version,
+            plane_type_names[encoded->type]);
 
-  // create a new plane and...
-  size_t uncompressed_length = width * height;
-  plane_t *plane = push_new_plane(width, height, NULL, L);
-  if (plane == NULL) {
-    return 0;
+  return true;
+}
+
+// each thread decodes the base-64 of one block at a time into a buffer small
+// enough to stay in cache, and decompresses it from there
+static void decode_blocks(void *context, int first, int last) {
+  decode_context_t *decode = (decode_context_t *)context;
+  plane_t *plane = decode->plane;
+
+  // blocks of narrower planes are decompressed into a buffer of 32-bit
+  // values, and narrowed into the plane from there
+  bool direct = is_plane_codec_direct(plane);
+  uint8_t *data = malloc(get_block_bound(ENCODE_BLOCK_LENGTH));
+  int *scratch = direct ? NULL : malloc(sizeof(int) * ENCODE_BLOCK_LENGTH);
+  for (int block = first; block < last; ++block) {
+    const encoded_block_t *entry = &decode->blocks[block];
+    size_t start = (size_t)block * ENCODE_BLOCK_LENGTH;
+    size_t length = get_encode_block_length(decode->length, block);
+    int *values = direct ? &plane->buffer[plane->offset + start] : scratch;
+    decode->failed[block] =
+        data == NULL || values == NULL ||
+        !read_encoded_bytes(decode->encoded,
+                            entry->offset + ENCODE_BLOCK_HEADER_SIZE,
+                            entry->size, data) ||
+        !decompress_block(data, entry->size, entry->format, length, values);
+
+    if (!direct && !decode->failed[block]) {
+      write_plane_values(plane, start, length, values);
+    }
   }
 
-  // ...decompress the buffer directly into it
-  if (simdunpack_length((__m128i *)buffer, uncompressed_length,
-                        (uint32_t *)plane->buffer, maxbit) == NULL) {
-    LOG_SCRIPT_ERROR(L, "Failed to decompress plane data");
-    memset(plane->buffer, 0, uncompressed_length * sizeof(int));
+  free(data);
+  free(scratch);
+}
+
+// finds each block in a versioned plane string by reading only their headers,
+// returning false if they don't fit in the string
+static bool find_encoded_blocks(const encoded_plane_t *encoded,
+                                int block_count, encoded_block_t *blocks) {
+  size_t offset = 0;
+  size_t size = encoded->data_size;
+  for (int block = 0; block < block_count; ++block) {
+    uint8_t header[ENCODE_BLOCK_HEADER_SIZE];
+    if (size - offset < ENCODE_BLOCK_HEADER_SIZE ||
+        !read_encoded_bytes(encoded, offset, sizeof(header), header)) {
+      return false;
+    }
+
+    size_t header_offset = 0;
+    blocks[block].offset = offset;
+    blocks[block].format = read_from_offset(header, &header_offset);
+    blocks[block].size = read_from_offset(header, &header_offset);
+    if (blocks[block].size > get_block_bound(ENCODE_BLOCK_LENGTH) ||
+        blocks[block].size > size - offset - ENCODE_BLOCK_HEADER_SIZE) {
+      return false;
+    }
+
+    offset += ENCODE_BLOCK_HEADER_SIZE +
+              (blocks[block].size + ENCODE_BLOCK_ALIGNMENT - 1) /
+                  ENCODE_BLOCK_ALIGNMENT * ENCODE_BLOCK_ALIGNMENT;
+    if (offset > size) {
+      offset = size;
+    }
+  }
+
+  return true;
+}
+
+// decompresses the blocks of a versioned plane string into `plane`
+static bool decode_versioned(const encoded_plane_t *encoded, size_t length,
+                             plane_t *plane) {
+  int block_count =
+      (int)((length + ENCODE_BLOCK_LENGTH - 1) / ENCODE_BLOCK_LENGTH);
+  encoded_block_t *blocks = malloc(sizeof(encoded_block_t) * block_count);
+  bool *failed = calloc((size_t)block_count, sizeof(bool));
+  bool decoded = blocks != NULL && failed != NULL &&
+                 find_encoded_blocks(encoded, block_count, blocks);
+
+  if (decoded) {
+    // blocks are independent, so they're decompressed in parallel, unless
+    // they'd share bytes of a bit plane
+    bool aligned = plane->type != PLANE_BIT ||
+                   (is_plane_contiguous(plane) && plane->offset % 8 == 0);
+    decode_context_t decode = {encoded, blocks, length, plane, failed};
+    parallel_for_rows(block_count, aligned ? 1 : block_count, decode_blocks,
+                      &decode);
+
+    for (int block = 0; block < block_count; ++block) {
+      decoded = decoded && !failed[block];
+    }
   }
 
-  free(buffer);
+  free(blocks);
+  free(failed);
 
-  return 1;
+  return decoded;
 }
 
-static int plane_encode(lua_State *L) {
+// decompresses a plane string from before blocks were versioned, which was
+// bitpacked as a whole
+static bool decode_unversioned(const encoded_plane_t *encoded, size_t length,
+                               int *values) {
 #ifdef __EMSCRIPTEN__
-  LOG_SCRIPT_ERROR("Plane encoding isn't implemented for WASM yet.");
-  return 0;
+  return false;
 #else
-  lua_settop(L, 1);
-
-  plane_t *plane = get_plane(L, 1);
-  if (plane == NULL) {
-    LOG_SCRIPT_ERROR(L, "Invalid plane");
-    return 0;
+  if (encoded->maxbit > 32 ||
+      encoded->data_size <
+          (size_t)simdpack_compressedbytes((int)length, encoded->maxbit)) {
+    return false;
   }
 
-  const uint32_t *planebuf = (uint32_t *)plane->buffer;
-  if (planebuf == NULL) {
-    LOG_SCRIPT_ERROR(L, "Invalid plane buffer");
-    return 0;
-  }
+  uint8_t *data = malloc(encoded->data_size);
+  bool decoded =
+      data != NULL &&
+      read_encoded_bytes(encoded, 0, encoded->data_size, data) &&
+      simdunpack_length((__m128i *)data, length, (uint32_t *)values,
+                        encoded->maxbit) != NULL;
+  free(data);
 
-  const size_t planebuf_length = plane->width * plane->height;
+  return decoded;
+#endif
+}
 
-  // compress the plane's buffer with SIMD magic
-  unsigned int maxbit = maxbits_length(planebuf, planebuf_length);
-  uint8_t *compressed =
-      malloc(simdpack_compressedbytes(planebuf_length, maxbit));
-  if (compressed == NULL) {
-    LOG_SCRIPT_ERROR(L, "Failed to allocate the compressed plane buffer",
-                     maxbit);
-    return 0;
-  }
+// decompresses a plane string into `plane`, which has the string's size.  if
+// it can't be decompressed, the plane is left filled with zeros.
+static bool decode_plane_values(const encoded_plane_t *encoded,
+                                plane_t *plane) {
+  size_t length = (size_t)plane->width * (size_t)plane->height;
+  bool decoded;
+  if (encoded->version > 0) {
+    decoded = decode_versioned(encoded, length, plane);
+  } else {
+    // strings from before blocks were versioned are bitpacked as a whole, so
+    // they're still decompressed in one go
+    bool direct = is_plane_codec_direct(plane);
+    int *values = direct ? &plane->buffer[plane->offset]
+                         : malloc(sizeof(int) * length);
+    decoded = values != NULL && decode_unversioned(encoded, length, values);
+    if (!direct) {
+      if (decoded) {
+        write_plane_values(plane, 0, length, values);
+      }
 
-  __m128i *compressed_end =
-      simdpack_length(planebuf, planebuf_length, (__m128i *)compressed, maxbit);
-  size_t compressed_size =
-      (compressed_end - (__m128i *)compressed) * sizeof(__m128i);
+      free(values);
+    }
+  }
 
-  log_debug(
-      "Plane of size %zu was compressed to %zu bytes (%.1f%% of original)",
-      planebuf_length * sizeof(int), compressed_size,
-      ((float)compressed_size / (float)(planebuf_length * sizeof(int)) *
-       100.0F));
+  if (!decoded) {
+    fill_plane(plane, 0);
+  }
 
-  // resize the compressed buffer to hold only its data plus 3 ints (w, h,
-  // maxbit)
-  size_t buffer_size = compressed_size + 3 * sizeof(int);
-  compressed = realloc(compressed, buffer_size);
+  return decoded;
+}
 
-  // store metadata after the compressed data
-  size_t meta_offset =
-      store_at_offset(compressed, compressed_size, plane->width);
-  meta_offset = store_at_offset(compressed, meta_offset, plane->height);
-  meta_offset = store_at_offset(compressed, meta_offset, maxbit);
+// decompresses a plane string into a plane of the same size and type
+static void decode_plane(lua_State *L, const encoded_plane_t *encoded,
+                         plane_t *plane) {
+  if (!decode_plane_values(encoded, plane)) {
+    LOG_SCRIPT_ERROR(L, "Failed to decompress plane data");
+  }
+}
 
-  char *encoded = base64_enc_malloc(compressed, buffer_size);
-  free(compressed);
+// plane.decode(<base64>)
+static int plane_decode(lua_State *L) {
+  lua_settop(L, 1);
 
-  if (encoded == NULL) {
-    LOG_SCRIPT_ERROR(L, "Failed to base64-encode the plane buffer");
+  encoded_plane_t encoded;
+  if (!read_encoded_plane(L, 1, &encoded)) {
     return 0;
   }
 
-  lua_pushstring(L, encoded);
+  plane_t *plane = push_new_typed_plane(encoded.width, encoded.height,
+                                        encoded.type, NULL, L);
+  if (plane == NULL) {
+    return 0;
+  }
 
-  free(encoded);
+  decode_plane(L, &encoded, plane);
 
   return 1;
-#endif
 }
 
-// plane:blit(x, y, src)
-static int plane_blit(lua_State *L) {
-  lua_settop(L, 4);
-
-  int offset_x = luaL_checkinteger(L, 2);
-  int offset_y = luaL_checkinteger(L, 3);
+// plane:decode_into(<base64>)
+static int plane_decode_into(lua_State *L) {
+  lua_settop(L, 2);
 
-  plane_t *dest = get_plane(L, 1);
-  if (dest == NULL) {
-    LOG_SCRIPT_ERROR(L, "Invalid destination plane");
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
     return 0;
   }
 
-  plane_t *src = get_plane(L, 4);
-  if (src == NULL) {
-    LOG_SCRIPT_ERROR(L, "Invalid source plane");
+  encoded_plane_t encoded;
+  if (!read_encoded_plane(L, 2, &encoded)) {
     return 0;
   }
 
-  for (int x = 0; x < src->width; ++x) {
-    if (x + offset_x < 0 || x + offset_x >= dest->width) {
-      continue;
+  // the plane's buffer is only replaced if the string's elements won't fit
+  // in it as they are
+  if (plane->width != encoded.width || plane->height != encoded.height ||
+      plane->type != encoded.type) {
+    if (encoded.width <= 0 || encoded.height <= 0) {
+      LOG_SCRIPT_ERROR(L, "Invalid plane dimensions (%d, %d)", encoded.width,
+                       encoded.height);
+      return 0;
     }
 
-    for (int y = 0; y < src->height; ++y) {
-      if (y + offset_y < 0 || y + offset_y >= dest->height) {
-        continue;
-      }
+    size_t length = (size_t)encoded.width * (size_t)encoded.height;
+    plane->data =
+        lua_newuserdata(L, get_plane_buffer_size(encoded.type, length));
+    lua_setfield(L, 1, FIELD_PLANE_BUFFER);
 
-      dest->buffer[(y + offset_y) * dest->width + (x + offset_x)] =
-          src->buffer[y * src->width + x];
-    }
+    plane->width = encoded.width;
+    plane->height = encoded.height;
+    plane->type = encoded.type;
+    plane->offset = 0;
+    plane->stride = encoded.width;
+
+    lua_pushinteger(L, plane->width);
+    lua_setfield(L, 1, FIELD_PLANE_WIDTH);
+
+    lua_pushinteger(L, plane->height);
+    lua_setfield(L, 1, FIELD_PLANE_HEIGHT);
   }
 
+  decode_plane(L, &encoded, plane);
+
+  // return the plane
   lua_settop(L, 1);
 
   return 1;
 }
 
-// modes:
-//
-// plane.from(w, h, 4)
-// plane.from(w, h, function(x, y) return x + y end)
-// plane.from({0, 2, 1}, {1, 3, 1}, {3, 1, 0})
-static int plane_from(lua_State *L) {
-  lua_settop(L, 3);
+// compresses and base-64 encodes a plane's elements, returning a string that
+// the caller frees, or NULL if it couldn't be allocated
+static char *encode_plane_values(const plane_t *plane) {
+  const int width = plane->width;
+  const int height = plane->height;
+  const plane_type_t type = plane->type;
+  const size_t length = (size_t)width * (size_t)height;
+  int block_count =
+      (int)((length + ENCODE_BLOCK_LENGTH - 1) / ENCODE_BLOCK_LENGTH);
+
+  // each block is compressed with whichever codec suits its contents best
+  size_t slot_size =
+      ENCODE_BLOCK_HEADER_SIZE + get_block_bound(ENCODE_BLOCK_LENGTH);
+  uint8_t *compressed = malloc(slot_size * block_count + ENCODE_TRAILER_SIZE);
+  bool *failed = calloc((size_t)block_count, sizeof(bool));
+  if (compressed == NULL || failed == NULL) {
+    free(compressed);
+    free(failed);
+    return NULL;
+  }
 
-  if (lua_istable(L, 1)) {
-    // using the list-of-rows signature
-    int rows = lua_gettop(L);
-    int columns = 0;
-    for (int i = 1; i <= rows; ++i) {
-      int len = lua_objlen(L, i);
-      if (len > columns) {
-        columns = len;
-      }
-    }
+  encode_context_t encode = {plane, length, compressed, slot_size, failed};
+  parallel_for_rows(block_count, 1, encode_blocks, &encode);
 
-    if (rows == 0 || columns == 0) {
-      LOG_SCRIPT_ERROR(L, "Invalid plane size; must be at least 1x1");
-      return 0;
-    }
+  bool compressed_all = true;
+  for (int block = 0; block < block_count; ++block) {
+    compressed_all = compressed_all && !failed[block];
+  }
 
-    size_t buffer_len;
-    plane_t *plane = push_new_plane(columns, rows, &buffer_len, L);
-    if (plane == NULL) {
+  free(failed);
+  if (!compressed_all) {
+    free(compressed);
+    return NULL;
+  }
+
+  // pack the blocks together, keeping each one aligned
+  size_t compressed_size = 0;
+  for (int block = 0; block < block_count; ++block) {
+    uint8_t *slot = &compressed[(size_t)block * slot_size];
+    size_t header_offset = sizeof(uint32_t);
+    size_t block_size = (uint32_t)read_from_offset(slot, &header_offset);
+    size_t padded_size = (block_size + ENCODE_BLOCK_ALIGNMENT - 1) /
+                         ENCODE_BLOCK_ALIGNMENT * ENCODE_BLOCK_ALIGNMENT;
+
+    memmove(&compressed[compressed_size], slot,
+            ENCODE_BLOCK_HEADER_SIZE + block_size);
+    compressed_size += ENCODE_BLOCK_HEADER_SIZE + block_size;
+    memset(&compressed[compressed_size], 0, padded_size - block_size);
+    compressed_size += padded_size - block_size;
+  }
+
+  size_t original_size = get_plane_buffer_size(type, length);
+  log_debug(
+      "Plane of size %zu was compressed to %zu bytes (%.1f%% of original)",
+      original_size, compressed_size,
+      ((float)compressed_size / (float)original_size * 100.0F));
+
+  // store metadata after the compressed data
+  size_t buffer_size = compressed_size + ENCODE_TRAILER_SIZE;
+  size_t meta_offset = store_at_offset(compressed, compressed_size, width);
+  meta_offset = store_at_offset(compressed, meta_offset, height);
+  meta_offset = store_at_offset(compressed, meta_offset,
+                                type << 8 | ENCODE_VERSION << 16);
+
+  char *encoded = base64_enc_malloc(compressed, buffer_size);
+  free(compressed);
+
+  return encoded;
+}
+
+static int plane_encode(lua_State *L) {
+  lua_settop(L, 1);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    LOG_SCRIPT_ERROR(L, "Invalid plane");
+    return 0;
+  }
+
+  char *encoded = encode_plane_values(plane);
+  if (encoded == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to encode the plane buffer");
+    return 0;
+  }
+
+  lua_pushstring(L, encoded);
+
+  free(encoded);
+
+  return 1;
+}
+
+// modes:
+//
+// plane.from(w, h, 4 [, type])
+// plane.from(w, h, function(x, y) return x + y end [, type])
+// plane.from({0, 2, 1}, {1, 3, 1}, {3, 1, 0} [, type])
+static int plane_from(lua_State *L) {
+  if (lua_istable(L, 1)) {
+    // using the list-of-rows signature, which may end with the element type
+    int rows = lua_gettop(L);
+    plane_type_t type = PLANE_I32;
+    if (lua_type(L, rows) == LUA_TSTRING) {
+      type = (plane_type_t)luaL_checkoption(L, rows, NULL, plane_type_names);
+      lua_settop(L, --rows);
+    }
+
+    int columns = 0;
+    for (int i = 1; i <= rows; ++i) {
+      int len = lua_objlen(L, i);
+      if (len > columns) {
+        columns = len;
+      }
+    }
+
+    if (rows == 0 || columns == 0) {
+      LOG_SCRIPT_ERROR(L, "Invalid plane size; must be at least 1x1");
+      return 0;
+    }
+
+    plane_t *plane = push_new_typed_plane(columns, rows, type, NULL, L);
+    if (plane == NULL) {
       return 0;
     }
 
-    int width = 0;
+    // rows shorter than the longest one are padded with zeroes
+    fill_plane(plane, 0);
     for (int y = 0; y < rows; ++y) {
       int row_width = lua_objlen(L, y + 1);
       for (int x = 0; x < row_width; ++x) {
         lua_rawgeti(L, y + 1, x + 1);
-        plane->buffer[y * row_width + x] = lua_tonumber(L, -1);
+        set_plane_value(plane, (size_t)y * columns + x,
+                        (int)lua_tointeger(L, -1));
         lua_pop(L, 1);
       }
     }
   } else if (lua_isnumber(L, 1) && lua_isnumber(L, 2)) {
     // using one of the (w, h, ...) signatures
 
+    lua_settop(L, 4);
+
     // fetch plane dimensions from first two arguments
     int width = luaL_checkinteger(L, 1);
     int height = luaL_checkinteger(L, 2);
+    plane_type_t type = (plane_type_t)luaL_checkoption(
+        L, 4, plane_type_names[PLANE_I32], plane_type_names);
 
-    size_t buffer_len;
-    plane_t *plane = push_new_plane(width, height, &buffer_len, L);
+    plane_t *plane = push_new_typed_plane(width, height, type, NULL, L);
     if (plane == NULL) {
       return 0;
     }
 
     if (lua_isnumber(L, 3)) {
-      int value = (int)lua_tointeger(L, 3);
-      for (int i = 0; i < buffer_len; ++i) {
-        plane->buffer[i] = value;
-      }
+      fill_plane(plane, (int)lua_tointeger(L, 3));
     } else if (lua_isfunction(L, 3)) {
-      apply_func_to_buffer(L, 3, plane->width, plane->height, plane->buffer);
+      apply_func_to_buffer(L, 3, plane);
     }
   } else {
     LOG_SCRIPT_ERROR(L,
@@ -523,11 +1248,12 @@ static int plane_find_first(lua_State *L) {
   lua_settop(L, 2);
 
   plane_t *plane = get_plane(L, 1);
-  for (size_t i = 0; i < (size_t)(plane->width * plane->height); ++i) {
+  for (size_t i = 0; i < (size_t)plane->width * plane->height; ++i) {
+    int value = get_plane_value(plane, i);
     lua_pushvalue(L, 2);
     lua_pushinteger(L, (int)(i % plane->width));
     lua_pushinteger(L, (int)(i / plane->width));
-    lua_pushinteger(L, (int)(plane->buffer[i]));
+    lua_pushinteger(L, value);
 
     if (lua_pcall(L, 3, 1, 0) != LUA_OK) {
       LOG_SCRIPT_ERROR(L, "Failed to find first element matching function");
@@ -540,7 +1266,7 @@ static int plane_find_first(lua_State *L) {
       lua_setfield(L, -2, "x");
       lua_pushinteger(L, (int)(i / plane->width));
       lua_setfield(L, -2, "y");
-      lua_pushinteger(L, (int)(plane->buffer[i]));
+      lua_pushinteger(L, value);
       lua_setfield(L, -2, "value");
 
       return 1;
@@ -563,11 +1289,12 @@ static int plane_find_all(lua_State *L) {
   lua_newtable(L);
 
   size_t count = 0;
-  for (size_t i = 0; i < (size_t)(plane->width * plane->height); ++i) {
+  for (size_t i = 0; i < (size_t)plane->width * plane->height; ++i) {
+    int value = get_plane_value(plane, i);
     lua_pushvalue(L, 2);
     lua_pushinteger(L, (int)(i % plane->width));
     lua_pushinteger(L, (int)(i / plane->width));
-    lua_pushinteger(L, (int)(plane->buffer[i]));
+    lua_pushinteger(L, value);
 
     if (lua_pcall(L, 3, 1, 0) != LUA_OK) {
       LOG_SCRIPT_ERROR(L, "Failed to find first element matching function");
@@ -580,7 +1307,7 @@ static int plane_find_all(lua_State *L) {
       lua_setfield(L, -2, "x");
       lua_pushinteger(L, (int)(i / plane->width));
       lua_setfield(L, -2, "y");
-      lua_pushinteger(L, (int)(plane->buffer[i]));
+      lua_pushinteger(L, value);
       lua_setfield(L, -2, "value");
 
       // the result table will be a list, so keys are 1-based indexes
@@ -592,6 +1319,25 @@ static int plane_find_all(lua_State *L) {
 
   return 1;
 }
+
+// writes a plane's elements to a PNG as opaque colors
+static bool write_plane_image(const char *path, int width, int height,
+                              uint32_t *pixels) {
+  size_t pixel_count = (size_t)width * (size_t)height;
+  for (size_t i = 0; i < pixel_count; ++i) {
+    pixels[i] |= 0xFF000000;  // set alpha to 255
+  }
+
+  if (stbi_write_png(path, width, height, 4, pixels,
+                     width * sizeof(uint32_t)) == 0) {
+    return false;
+  }
+
+  log_debug("Exported plane to %s", path);
+
+  return true;
+}
+
 // plane:export('output.png')
 static int plane_export_image(lua_State *L) {
   lua_settop(L, 2);
@@ -602,35 +1348,29 @@ static int plane_export_image(lua_State *L) {
     return 0;
   }
 
-  size_t pixel_count = plane->width * plane->height;
+  size_t pixel_count = (size_t)plane->width * (size_t)plane->height;
   uint32_t *pixels = malloc(pixel_count * sizeof(uint32_t));
-  memcpy(pixels, plane->buffer, pixel_count * sizeof(uint32_t));
-  for (size_t i = 0; i < pixel_count; ++i) {
-    pixels[i] |= 0xFF000000;  // set alpha to 255
+  if (pixels == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate the exported image");
+    return 0;
   }
 
+  read_plane_values(plane, 0, pixel_count, (int *)pixels);
+
   const char *path = luaL_checkstring(L, 2);
 
-  if (stbi_write_png(path, plane->width, plane->height, 4, pixels,
-                     plane->width * sizeof(uint32_t)) == 0) {
+  if (!write_plane_image(path, plane->width, plane->height, pixels)) {
     LOG_SCRIPT_ERROR(L, "Failed to export the plane");
   }
 
-  log_debug("Exported plane to %s", path);
-
   free(pixels);
 
   return 0;
 }
 
-static plane_t *push_plane_from_image(lua_State *L, const char *path) {
-  int width, height, comp;
-  uint8_t *pixels = stbi_load(path, &width, &height, &comp, 4);
-  if (pixels == NULL) {
-    LOG_SCRIPT_ERROR(L, "Failed to import image");
-    return 0;
-  }
-
+// pushes a plane holding the colors of an image loaded by stb_image
+static plane_t *push_plane_from_pixels(lua_State *L, const uint8_t *pixels,
+                                       int width, int height) {
   size_t buffer_len;
   plane_t *plane = push_new_plane(width, height, &buffer_len, L);
 
@@ -642,7 +1382,21 @@ static plane_t *push_plane_from_image(lua_State *L, const char *path) {
     for (size_t i = 0; i < buffer_len; ++i) {
       plane->buffer[i] &= 0x00FFFFFF;  // zero-out the 'alpha'
     }
+  }
 
+  return plane;
+}
+
+static plane_t *push_plane_from_image(lua_State *L, const char *path) {
+  int width, height, comp;
+  uint8_t *pixels = stbi_load(path, &width, &height, &comp, 4);
+  if (pixels == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to import image");
+    return 0;
+  }
+
+  plane_t *plane = push_plane_from_pixels(L, pixels, width, height);
+  if (plane != NULL) {
     log_debug("Imported plane from %s", path);
   }
 
@@ -659,6 +1413,31 @@ static int plane_import_image(lua_State *L) {
   return push_plane_from_image(L, path) != NULL ? 1 : 0;
 }
 
+// the plane to generate from with WFC, which is either imported from the
+// image path at `index` or is the plane there
+static plane_t *get_wfc_tile(lua_State *L, int index) {
+  plane_t *tile;
+  if (lua_isstring(L, index)) {
+    tile = push_plane_from_image(L, lua_tostring(L, index));
+    if (tile == NULL) {
+      LOG_SCRIPT_ERROR(L, "Failed to import WFC tile");
+      return NULL;
+    }
+    lua_replace(L, index);
+  } else if (lua_istable(L, index)) {
+    tile = get_plane(L, index);
+    if (tile == NULL) {
+      LOG_SCRIPT_ERROR(L, "Invalid tile plane");
+      return NULL;
+    }
+  } else {
+    LOG_SCRIPT_ERROR(L, "Invalid WFC source, must be a plane or an image path");
+    return NULL;
+  }
+
+  return tile;
+}
+
 // plane.from_wfc(128, 128, "input.png", [flipx], [flipy], [nrot], [tilew],
 // [tileh]) plane.from_wfc(128, 128, tile_plane)
 static int plane_from_wfc(lua_State *L) {
@@ -672,28 +1451,19 @@ static int plane_from_wfc(lua_State *L) {
   int tile_width = luaL_optint(L, 7, WFC_DEFAULT_TILE_SIZE);
   int tile_height = luaL_optint(L, 8, WFC_DEFAULT_TILE_SIZE);
 
-  // two ways to obtain the tile; either import it from a file path if arg
-  // is a string, or use it directly if the arg is a plane
-  plane_t *tile;
-  if (lua_isstring(L, 3)) {
-    tile = push_plane_from_image(L, lua_tostring(L, 3));
-    if (tile == NULL) {
-      LOG_SCRIPT_ERROR(L, "Failed to import WFC tile");
-      return 0;
-    }
-  } else if (lua_istable(L, 3)) {
-    tile = get_plane(L, 3);
-    if (tile == NULL) {
-      LOG_SCRIPT_ERROR(L, "Invalid tile plane");
-      return 0;
-    }
-  } else {
-    LOG_SCRIPT_ERROR(L, "Invalid WFC source, must be a plane or an image path");
+  plane_t *tile = get_wfc_tile(L, 3);
+  if (tile == NULL) {
+    return 0;
+  }
+
+  // the tile is read as 4-byte pixels
+  int *tile_pixels = acquire_plane_ints(L, tile);
+  if (tile_pixels == NULL) {
     return 0;
   }
 
   // run the WFC iterations
-  struct wfc_image tile_image = {(unsigned char *)tile->buffer, 4, tile->width,
+  struct wfc_image tile_image = {(unsigned char *)tile_pixels, 4, tile->width,
                                  tile->height};
   struct wfc *wfc =
       wfc_overlapping(width, height, &tile_image, tile_width, tile_height, 1,
@@ -720,10 +1490,312 @@ static int plane_from_wfc(lua_State *L) {
   }
 
   wfc_destroy(wfc);
+  release_plane_ints(tile, tile_pixels, false);
 
   return 1;
 }
 
+// a pr.plane.from_wfc_async job, shared between its future and the attempts
+// running on the background threads.  it's freed once none of them need it.
+typedef struct wfc_job_t {
+  atomic_int references;
+  atomic_bool cancelled, done;
+  atomic_int claimed, remaining;
+
+  // the number of cells collapsed so far by each attempt that's running
+  atomic_int *collapsed;
+
+  int width, height, tile_width, tile_height, rotations;
+  bool flip_x, flip_y;
+  unsigned int seed;
+  int attempt_count;
+  struct wfc_image tile;
+
+  // the winning attempt's output, set before `done`
+  struct wfc_image *result;
+} wfc_job_t;
+
+typedef struct wfc_attempt_t {
+  wfc_job_t *job;
+  int index;
+} wfc_attempt_t;
+
+// the Lua side of a job
+typedef struct wfc_future_t {
+  wfc_job_t *job;
+  int result_ref;
+} wfc_future_t;
+
+static void release_wfc_job(wfc_job_t *job) {
+  if (atomic_fetch_sub(&job->references, 1) != 1) {
+    return;
+  }
+
+  if (job->result != NULL) {
+    wfc_img_destroy(job->result);
+  }
+
+  free(job->tile.data);
+  free((void *)job->collapsed);
+  free(job);
+}
+
+// runs an attempt a few cells at a time, so that it can be abandoned once the
+// job is finished or cancelled.  returns whether it was completed.
+static bool step_wfc_attempt(wfc_job_t *job, int index, struct wfc *wfc) {
+  int step = wfc->cell_cnt / WFC_STEP_DIVISOR;
+  step = step > 0 ? step : 1;
+
+  while (!atomic_load(&job->done)) {
+    // wfc_run stops once the total number of collapsed cells reaches its
+    // limit, so stopping short of it means there was nothing left to collapse
+    int limit = wfc->collapsed_cell_cnt + step;
+    if (!wfc_run(wfc, limit)) {
+      return false;
+    }
+
+    atomic_store(&job->collapsed[index], wfc->collapsed_cell_cnt);
+    if (wfc->collapsed_cell_cnt != limit) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void run_wfc_attempt(void *context) {
+  wfc_attempt_t *attempt = (wfc_attempt_t *)context;
+  wfc_job_t *job = attempt->job;
+
+  // attempts that haven't started by the time the job is finished are skipped
+  if (!atomic_load(&job->done)) {
+    struct wfc *wfc = wfc_overlapping(
+        job->width, job->height, &job->tile, job->tile_width, job->tile_height,
+        1, job->flip_x, job->flip_y, job->rotations);
+    if (wfc != NULL) {
+      wfc->seed = job->seed + (unsigned int)attempt->index;
+      wfc_init(wfc);
+
+      bool succeeded = step_wfc_attempt(job, attempt->index, wfc);
+      atomic_store(&job->collapsed[attempt->index], 0);
+
+      // only the first attempt to succeed provides the result
+      if (succeeded && !atomic_load(&job->cancelled) &&
+          atomic_fetch_add(&job->claimed, 1) == 0) {
+        job->result = wfc_output_image(wfc);
+        atomic_store(&job->done, true);
+      }
+
+      wfc_destroy(wfc);
+    }
+  }
+
+  if (atomic_fetch_sub(&job->remaining, 1) == 1) {
+    atomic_store(&job->done, true);
+  }
+
+  release_wfc_job(job);
+  free(attempt);
+}
+
+static wfc_future_t *check_wfc_future(lua_State *L, int index) {
+  return (wfc_future_t *)luaL_checkudata(L, index, TBL_WFC_FUTURE_META);
+}
+
+// plane.from_wfc_async(128, 128, "input.png"|tile_plane, { flipx = false,
+//                      flipy = false, nrot = 0, tilew = 3, tileh = 3,
+//                      attempts = n, seed = n })
+static int plane_from_wfc_async(lua_State *L) {
+  lua_settop(L, 4);
+
+  int width = luaL_checkinteger(L, 1);
+  int height = luaL_checkinteger(L, 2);
+  if (width <= 0 || height <= 0) {
+    LOG_SCRIPT_ERROR(L, "Invalid plane dimensions (%d, %d)", width, height);
+    return 0;
+  }
+
+  if (!lua_isnoneornil(L, 4)) {
+    luaL_checktype(L, 4, LUA_TTABLE);
+  } else {
+    lua_newtable(L);
+    lua_replace(L, 4);
+  }
+
+  plane_t *tile = get_wfc_tile(L, 3);
+  if (tile == NULL) {
+    return 0;
+  }
+
+  // options are read before anything is allocated, since they may raise
+  lua_getfield(L, 4, FIELD_WFC_FLIP_X);
+  bool flip_x = lua_toboolean(L, -1);
+  lua_getfield(L, 4, FIELD_WFC_FLIP_Y);
+  bool flip_y = lua_toboolean(L, -1);
+  lua_getfield(L, 4, FIELD_WFC_ROTATIONS);
+  int rotations = luaL_optint(L, -1, 0);
+  lua_getfield(L, 4, FIELD_WFC_TILE_WIDTH);
+  int tile_width = luaL_optint(L, -1, WFC_DEFAULT_TILE_SIZE);
+  lua_getfield(L, 4, FIELD_WFC_TILE_HEIGHT);
+  int tile_height = luaL_optint(L, -1, WFC_DEFAULT_TILE_SIZE);
+  lua_getfield(L, 4, FIELD_WFC_ATTEMPTS);
+  int attempt_count = luaL_optint(L, -1, get_parallel_thread_count());
+  lua_getfield(L, 4, FIELD_WFC_SEED);
+  unsigned int seed =
+      (unsigned int)luaL_optinteger(L, -1, (lua_Integer)time(NULL));
+  lua_pop(L, 7);
+
+  // as is the future, which is given the job once it's ready
+  wfc_future_t *future = lua_newuserdata(L, sizeof(wfc_future_t));
+  future->job = NULL;
+  future->result_ref = LUA_NOREF;
+  luaL_setmetatable(L, TBL_WFC_FUTURE_META);
+
+  wfc_job_t *job = calloc(1, sizeof(wfc_job_t));
+  if (job == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate the WFC job");
+    return 0;
+  }
+
+  job->width = width;
+  job->height = height;
+  job->flip_x = flip_x;
+  job->flip_y = flip_y;
+  job->rotations = rotations;
+  job->tile_width = tile_width;
+  job->tile_height = tile_height;
+  job->attempt_count = attempt_count < 1 ? 1 : attempt_count;
+  job->seed = seed;
+
+  // the attempts work from their own copy of the tile, since the plane may
+  // change or be collected while they run
+  size_t tile_length = (size_t)tile->width * (size_t)tile->height;
+  job->tile = (struct wfc_image){malloc(sizeof(int) * tile_length), 4,
+                                 tile->width, tile->height};
+  job->collapsed = malloc(sizeof(atomic_int) * (size_t)job->attempt_count);
+  if (job->tile.data == NULL || job->collapsed == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate the WFC job");
+    free(job->tile.data);
+    free((void *)job->collapsed);
+    free(job);
+    return 0;
+  }
+
+  read_plane_values(tile, 0, tile_length, (int *)job->tile.data);
+
+  atomic_init(&job->references, job->attempt_count + 1);
+  atomic_init(&job->remaining, job->attempt_count);
+  for (int i = 0; i < job->attempt_count; ++i) {
+    atomic_init(&job->collapsed[i], 0);
+  }
+
+  future->job = job;
+
+  // each attempt collapses the whole output from its own seed, and where
+  // there are no background threads they're run here in turn
+  for (int i = 0; i < job->attempt_count; ++i) {
+    wfc_attempt_t *attempt = malloc(sizeof(wfc_attempt_t));
+    if (attempt == NULL) {
+      atomic_fetch_sub(&job->remaining, 1);
+      release_wfc_job(job);
+      continue;
+    }
+
+    *attempt = (wfc_attempt_t){job, i};
+    if (!parallel_submit(run_wfc_attempt, attempt)) {
+      run_wfc_attempt(attempt);
+    }
+  }
+
+  return 1;
+}
+
+// future:is_done()
+static int wfc_future_is_done(lua_State *L) {
+  wfc_future_t *future = check_wfc_future(L, 1);
+  lua_pushboolean(L, atomic_load(&future->job->done));
+
+  return 1;
+}
+
+// future:result()
+static int wfc_future_result(lua_State *L) {
+  wfc_future_t *future = check_wfc_future(L, 1);
+  wfc_job_t *job = future->job;
+
+  if (future->result_ref == LUA_NOREF && atomic_load(&job->done) &&
+      !atomic_load(&job->cancelled) && job->result != NULL) {
+    // the plane is made once, and the same one returned from then on
+    size_t buffer_len;
+    plane_t *plane = push_new_plane(job->result->width, job->result->height,
+                                    &buffer_len, L);
+    if (plane == NULL) {
+      return 0;
+    }
+
+    memcpy(plane->buffer, job->result->data, buffer_len * sizeof(int));
+    future->result_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  if (future->result_ref == LUA_NOREF) {
+    // the job is still running, or failed, or was cancelled
+    lua_pushnil(L);
+  } else {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, future->result_ref);
+  }
+
+  return 1;
+}
+
+// future:get_progress()
+static int wfc_future_get_progress(lua_State *L) {
+  wfc_future_t *future = check_wfc_future(L, 1);
+  wfc_job_t *job = future->job;
+
+  // the progress of the attempt that's furthest along, as of its last step
+  double progress = 0.0;
+  if (atomic_load(&job->done)) {
+    progress = 1.0;
+  } else {
+    double cells = (double)job->width * (double)job->height;
+    for (int i = 0; i < job->attempt_count; ++i) {
+      double collapsed = atomic_load(&job->collapsed[i]) / cells;
+      progress = collapsed > progress ? collapsed : progress;
+    }
+  }
+
+  lua_pushnumber(L, progress > 1.0 ? 1.0 : progress);
+
+  return 1;
+}
+
+// future:cancel()
+static int wfc_future_cancel(lua_State *L) {
+  wfc_future_t *future = check_wfc_future(L, 1);
+
+  // attempts that are already running stop at the end of their current step
+  if (!atomic_load(&future->job->done)) {
+    atomic_store(&future->job->cancelled, true);
+    atomic_store(&future->job->done, true);
+  }
+
+  return 0;
+}
+
+static int wfc_future_gc(lua_State *L) {
+  wfc_future_t *future = check_wfc_future(L, 1);
+  if (future->job != NULL) {
+    atomic_store(&future->job->cancelled, true);
+    atomic_store(&future->job->done, true);
+    release_wfc_job(future->job);
+    future->job = NULL;
+  }
+
+  luaL_unref(L, LUA_REGISTRYINDEX, future->result_ref);
+
+  return 0;
+}
+
 static int plane_get_size(lua_State *L) {
   lua_settop(L, 1);
 
@@ -739,14 +1811,309 @@ static int plane_get_size(lua_State *L) {
   return 2;
 }
 
+// plane:get_type()
+static int plane_get_type(lua_State *L) {
+  lua_settop(L, 1);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  lua_pushstring(L, plane_type_names[plane->type]);
+
+  return 1;
+}
+
+// plane:convert("i32"|"u16"|"u8"|"bit")
+static int plane_convert(lua_State *L) {
+  lua_settop(L, 2);
+
+  plane_t *source = get_plane(L, 1);
+  if (source == NULL) {
+    return 0;
+  }
+
+  plane_type_t type =
+      (plane_type_t)luaL_checkoption(L, 2, NULL, plane_type_names);
+
+  size_t length;
+  plane_t *target =
+      push_new_typed_plane(source->width, source->height, type, &length, L);
+  if (target == NULL) {
+    return 0;
+  }
+
+  int values[CONVERT_CHUNK_SIZE];
+  for (size_t i = 0; i < length; i += CONVERT_CHUNK_SIZE) {
+    size_t count =
+        length - i < CONVERT_CHUNK_SIZE ? length - i : CONVERT_CHUNK_SIZE;
+    read_plane_values(source, i, count, values);
+    write_plane_values(target, i, count, values);
+  }
+
+  return 1;
+}
+
+// background versions of plane:encode, plane.decode, plane.import and
+// plane:export for pr.jobs.submit, which work on copies of their arguments
+
+// copies a plane's elements into a new contiguous plane of the same type,
+// which the caller frees, returning false if it couldn't be allocated
+static bool copy_plane_detached(const plane_t *plane, plane_t *copy) {
+  *copy = (plane_t){.width = plane->width,
+                    .height = plane->height,
+                    .type = plane->type,
+                    .stride = plane->width};
+  copy->data = malloc(get_plane_buffer_size(
+      plane->type, (size_t)plane->width * (size_t)plane->height));
+  if (copy->data == NULL) {
+    return false;
+  }
+
+  copy_plane_elements(copy, plane);
+
+  return true;
+}
+
+typedef struct encode_job_t {
+  plane_t plane;
+  char *encoded;
+} encode_job_t;
+
+// pr.jobs.submit('encode', {plane})
+static bool prepare_encode_job(lua_State *L, int index, void *state) {
+  encode_job_t *job = (encode_job_t *)state;
+
+  plane_t *plane = get_plane(L, index);
+  if (plane == NULL) {
+    return false;
+  }
+
+  if (!copy_plane_detached(plane, &job->plane)) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate a copy of the plane's elements");
+    return false;
+  }
+
+  return true;
+}
+
+static void run_encode_job(void *state) {
+  encode_job_t *job = (encode_job_t *)state;
+  job->encoded = encode_plane_values(&job->plane);
+}
+
+static int finish_encode_job(lua_State *L, void *state) {
+  encode_job_t *job = (encode_job_t *)state;
+  if (job->encoded == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to encode the plane buffer");
+    return 0;
+  }
+
+  lua_pushstring(L, job->encoded);
+
+  return 1;
+}
+
+static void destroy_encode_job(lua_State *L, void *state) {
+  encode_job_t *job = (encode_job_t *)state;
+  (void)L;
+  free(job->plane.data);
+  free(job->encoded);
+}
+
+const job_op_t plane_encode_job = {
+    FUNC_PLANE_ENCODE,  sizeof(encode_job_t), prepare_encode_job,
+    run_encode_job,     finish_encode_job,    destroy_encode_job};
+
+typedef struct decode_job_t {
+  encoded_plane_t encoded;
+  char *text;
+  plane_t plane;
+  bool decoded;
+} decode_job_t;
+
+// pr.jobs.submit('decode', {<base64>})
+static bool prepare_decode_job(lua_State *L, int index, void *state) {
+  decode_job_t *job = (decode_job_t *)state;
+  if (!read_encoded_plane(L, index, &job->encoded)) {
+    return false;
+  }
+
+  if (job->encoded.width <= 0 || job->encoded.height <= 0) {
+    LOG_SCRIPT_ERROR(L, "Invalid plane dimensions (%d, %d)",
+                     job->encoded.width, job->encoded.height);
+    return false;
+  }
+
+  // the string may be collected before the job runs
+  job->text = malloc(job->encoded.text_length);
+  if (job->text == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate a copy of the plane string");
+    return false;
+  }
+
+  memcpy(job->text, job->encoded.text, job->encoded.text_length);
+  job->encoded.text = job->text;
+
+  return true;
+}
+
+static void run_decode_job(void *state) {
+  decode_job_t *job = (decode_job_t *)state;
+
+  // the string is decompressed into a buffer of the plane's own type, which
+  // is copied into the new plane once the job is finished
+  size_t length = (size_t)job->encoded.width * (size_t)job->encoded.height;
+  job->plane = (plane_t){.width = job->encoded.width,
+                         .height = job->encoded.height,
+                         .type = job->encoded.type,
+                         .stride = job->encoded.width};
+  job->plane.data = malloc(get_plane_buffer_size(job->plane.type, length));
+  job->decoded = job->plane.data != NULL &&
+                 decode_plane_values(&job->encoded, &job->plane);
+}
+
+static int finish_decode_job(lua_State *L, void *state) {
+  decode_job_t *job = (decode_job_t *)state;
+  if (job->plane.data == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate the decompressed plane buffer");
+    return 0;
+  }
+
+  plane_t *plane = push_new_typed_plane(job->encoded.width, job->encoded.height,
+                                        job->encoded.type, NULL, L);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  if (!job->decoded) {
+    LOG_SCRIPT_ERROR(L, "Failed to decompress plane data");
+  }
+
+  copy_plane_elements(plane, &job->plane);
+
+  return 1;
+}
+
+static void destroy_decode_job(lua_State *L, void *state) {
+  decode_job_t *job = (decode_job_t *)state;
+  (void)L;
+  free(job->text);
+  free(job->plane.data);
+}
+
+const job_op_t plane_decode_job = {
+    FUNC_PLANE_DECODE,  sizeof(decode_job_t), prepare_decode_job,
+    run_decode_job,     finish_decode_job,    destroy_decode_job};
+
+typedef struct image_job_t {
+  char *path;
+  uint8_t *pixels;
+  int width, height;
+  bool written;
+} image_job_t;
+
+// pr.jobs.submit('import', {path})
+static bool prepare_import_job(lua_State *L, int index, void *state) {
+  image_job_t *job = (image_job_t *)state;
+  job->path = strdup(luaL_checkstring(L, index));
+
+  return job->path != NULL;
+}
+
+static void run_import_job(void *state) {
+  image_job_t *job = (image_job_t *)state;
+
+  int comp;
+  job->pixels = stbi_load(job->path, &job->width, &job->height, &comp, 4);
+}
+
+static int finish_import_job(lua_State *L, void *state) {
+  image_job_t *job = (image_job_t *)state;
+  if (job->pixels == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to import image %s", job->path);
+    return 0;
+  }
+
+  if (push_plane_from_pixels(L, job->pixels, job->width, job->height) ==
+      NULL) {
+    return 0;
+  }
+
+  log_debug("Imported plane from %s", job->path);
+
+  return 1;
+}
+
+static void destroy_import_job(lua_State *L, void *state) {
+  image_job_t *job = (image_job_t *)state;
+  (void)L;
+  free(job->path);
+  stbi_image_free(job->pixels);
+}
+
+const job_op_t plane_import_job = {
+    FUNC_PLANE_IMPORT, sizeof(image_job_t), prepare_import_job,
+    run_import_job,    finish_import_job,   destroy_import_job};
+
+// pr.jobs.submit('export', {plane, path})
+static bool prepare_export_job(lua_State *L, int index, void *state) {
+  image_job_t *job = (image_job_t *)state;
+
+  plane_t *plane = get_plane(L, index);
+  if (plane == NULL) {
+    return false;
+  }
+
+  job->path = strdup(luaL_checkstring(L, index + 1));
+  job->pixels = (uint8_t *)copy_plane_ints(L, plane);
+  job->width = plane->width;
+  job->height = plane->height;
+
+  return job->path != NULL && job->pixels != NULL;
+}
+
+static void run_export_job(void *state) {
+  image_job_t *job = (image_job_t *)state;
+  job->written = write_plane_image(job->path, job->width, job->height,
+                                   (uint32_t *)job->pixels);
+}
+
+static int finish_export_job(lua_State *L, void *state) {
+  image_job_t *job = (image_job_t *)state;
+  if (!job->written) {
+    LOG_SCRIPT_ERROR(L, "Failed to export the plane to %s", job->path);
+  }
+
+  lua_pushboolean(L, job->written);
+
+  return 1;
+}
+
+static void destroy_export_job(lua_State *L, void *state) {
+  image_job_t *job = (image_job_t *)state;
+  (void)L;
+  free(job->path);
+  free(job->pixels);
+}
+
+const job_op_t plane_export_job = {
+    FUNC_PLANE_EXPORT, sizeof(image_job_t), prepare_export_job,
+    run_export_job,    finish_export_job,   destroy_export_job};
+
 void add_plane(lua_State *L) {
   // initialize library table
-  luaL_Reg create_methods[] = {{FUNC_PLANE_FROM, plane_from},
-                               {FUNC_PLANE_FROM_WFC, plane_from_wfc},
-                               {FUNC_PLANE_IMPORT, plane_import_image},
-                               {FUNC_PLANE_DECODE, plane_decode},
-                               {NULL, NULL}};
+  luaL_Reg create_methods[] = {
+      {FUNC_PLANE_FROM, plane_from},
+      {FUNC_PLANE_FROM_WFC, plane_from_wfc},
+      {FUNC_PLANE_FROM_WFC_ASYNC, plane_from_wfc_async},
+      {FUNC_PLANE_IMPORT, plane_import_image},
+      {FUNC_PLANE_DECODE, plane_decode},
+      {NULL, NULL}};
   luaL_newlib(L, create_methods);
+  add_chunked_plane(L, lua_gettop(L));
+  add_plane_files(L, lua_gettop(L));
   lua_setfield(L, 1, TBL_PLANE);
 
   // initialize metatable
@@ -758,14 +2125,38 @@ void add_plane(lua_State *L) {
                                 {FUNC_PLANE_SUB, plane_sub},
                                 {FUNC_PLANE_COPY, plane_copy},
                                 {FUNC_PLANE_ENCODE, plane_encode},
+                                {FUNC_PLANE_DECODE_INTO, plane_decode_into},
                                 {FUNC_PLANE_EXPORT, plane_export_image},
                                 {FUNC_PLANE_GETSIZE, plane_get_size},
-                                {FUNC_PLANE_BLIT, plane_blit},
+                                {FUNC_PLANE_GETTYPE, plane_get_type},
+                                {FUNC_PLANE_CONVERT, plane_convert},
+                                {FUNC_PLANE_VIEW, plane_view},
                                 {FUNC_PLANE_FIND_FIRST, plane_find_first},
                                 {FUNC_PLANE_FIND_ALL, plane_find_all},
                                 {NULL, NULL}};
     luaL_newlib(L, index_methods);
+    add_plane_ops(L, lua_gettop(L));
+    add_plane_filters(L, lua_gettop(L));
+    add_plane_regions(L, lua_gettop(L));
+    add_plane_paths(L, lua_gettop(L));
+    add_plane_fov(L, lua_gettop(L));
+    add_plane_file_methods(L, lua_gettop(L));
     lua_setfield(L, -2, "__index");
     lua_pop(L, 1);
   }
+
+  if (luaL_newmetatable(L, TBL_WFC_FUTURE_META)) {
+    luaL_Reg future_methods[] = {
+        {FUNC_WFC_FUTURE_ISDONE, wfc_future_is_done},
+        {FUNC_WFC_FUTURE_RESULT, wfc_future_result},
+        {FUNC_WFC_FUTURE_GETPROGRESS, wfc_future_get_progress},
+        {FUNC_WFC_FUTURE_CANCEL, wfc_future_cancel},
+        {NULL, NULL}};
+    luaL_newlib(L, future_methods);
+    lua_setfield(L, -2, "__index");
+
+    lua_pushcfunction(L, wfc_future_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_pop(L, 1);
 }
@@ -0,0 +1,463 @@
+#include "script/plane_codec.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef __EMSCRIPTEN__
+#include <simdbitpacking.h>
+#include <simdcomp.h>
+#endif
+
+#define RLE_RUN_SIZE (2 * sizeof(uint32_t))
+
+// grouped blocks store a bit width for each group of this many values
+#define GROUP_SIZE 128
+
+// codecs are chosen by measuring at most this many groups spread across the
+// block
+#define SAMPLE_GROUPS 8
+
+#define DICTIONARY_MAX_VALUES 256
+#define DICTIONARY_SLOTS 512
+
+typedef struct dictionary_t {
+  uint32_t values[DICTIONARY_MAX_VALUES];
+  uint32_t keys[DICTIONARY_SLOTS];
+  int16_t indexes[DICTIONARY_SLOTS];
+  size_t count;
+} dictionary_t;
+
+typedef struct estimate_t {
+  size_t rle, grouped, grouped_delta, dictionary;
+} estimate_t;
+
+static inline void store_u32(uint8_t *out, uint32_t value) {
+  out[0] = value & 0xFF;
+  out[1] = (value >> 8) & 0xFF;
+  out[2] = (value >> 16) & 0xFF;
+  out[3] = (value >> 24) & 0xFF;
+}
+
+static inline uint32_t load_u32(const uint8_t *in) {
+  return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 |
+         (uint32_t)in[3] << 24;
+}
+
+// maps small negative differences to small positive numbers, so that they
+// pack into as few bits as small positive ones
+static inline uint32_t zigzag(uint32_t delta) {
+  return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+static inline uint32_t unzigzag(uint32_t value) {
+  return (value >> 1) ^ (0U - (value & 1));
+}
+
+static inline uint32_t bit_width(uint32_t value) {
+  uint32_t bits = 0;
+  while (value != 0) {
+    ++bits;
+    value >>= 1;
+  }
+
+  return bits;
+}
+
+static inline size_t get_group_count(size_t length) {
+  return (length + GROUP_SIZE - 1) / GROUP_SIZE;
+}
+
+// the widths are padded so that the packed groups after them start on a
+// 16-byte boundary relative to the block
+static inline size_t get_widths_size(size_t length) {
+  return (get_group_count(length) + 15) / 16 * 16;
+}
+
+static inline size_t get_group_length(size_t length, size_t group) {
+  size_t remaining = length - group * GROUP_SIZE;
+  return remaining < GROUP_SIZE ? remaining : GROUP_SIZE;
+}
+
+size_t get_block_bound(size_t length) {
+  // raw values are always a candidate, so nothing larger is ever chosen
+  return length * sizeof(uint32_t);
+}
+
+static void clear_dictionary(dictionary_t *dictionary) {
+  dictionary->count = 0;
+  for (size_t i = 0; i < DICTIONARY_SLOTS; ++i) {
+    dictionary->indexes[i] = -1;
+  }
+}
+
+// returns the index of `value` in the dictionary, adding it if necessary, or
+// -1 if the dictionary is full
+static int add_to_dictionary(dictionary_t *dictionary, uint32_t value) {
+  size_t slot = (value * 0x9E3779B1U) >> (32 - 9);
+  while (dictionary->indexes[slot] >= 0) {
+    if (dictionary->keys[slot] == value) {
+      return dictionary->indexes[slot];
+    }
+
+    slot = (slot + 1) & (DICTIONARY_SLOTS - 1);
+  }
+
+  if (dictionary->count == DICTIONARY_MAX_VALUES) {
+    return -1;
+  }
+
+  dictionary->keys[slot] = value;
+  dictionary->indexes[slot] = (int16_t)dictionary->count;
+  dictionary->values[dictionary->count] = value;
+
+  return (int)dictionary->count++;
+}
+
+static size_t compress_raw(const uint32_t *values, size_t length,
+                           uint8_t *out) {
+  for (size_t i = 0; i < length; ++i) {
+    store_u32(&out[i * sizeof(uint32_t)], values[i]);
+  }
+
+  return length * sizeof(uint32_t);
+}
+
+static size_t count_runs(const uint32_t *values, size_t length) {
+  size_t runs = length > 0 ? 1 : 0;
+  for (size_t i = 1; i < length; ++i) {
+    runs += values[i] != values[i - 1];
+  }
+
+  return runs;
+}
+
+static size_t compress_rle(const uint32_t *values, size_t length,
+                           uint8_t *out) {
+  size_t size = 0;
+  for (size_t i = 0; i < length;) {
+    size_t run = 1;
+    while (i + run < length && values[i + run] == values[i]) {
+      ++run;
+    }
+
+    store_u32(&out[size], (uint32_t)run);
+    store_u32(&out[size + sizeof(uint32_t)], values[i]);
+    size += RLE_RUN_SIZE;
+    i += run;
+  }
+
+  return size;
+}
+
+#ifndef __EMSCRIPTEN__
+// finds the bit width of each group, returning the size of the grouped block
+static size_t measure_groups(const uint32_t *values, size_t length,
+                             uint8_t *widths) {
+  size_t size = get_widths_size(length);
+  for (size_t group = 0; group < get_group_count(length); ++group) {
+    size_t group_length = get_group_length(length, group);
+    widths[group] =
+        (uint8_t)maxbits_length(&values[group * GROUP_SIZE], group_length);
+    size += (size_t)simdpack_compressedbytes((int)group_length,
+                                             widths[group]);
+  }
+
+  return size;
+}
+
+static size_t pack_groups(const uint32_t *values, size_t length,
+                          const uint8_t *widths, uint8_t *out) {
+  size_t widths_size = get_widths_size(length);
+  size_t groups = get_group_count(length);
+  memcpy(out, widths, groups);
+  memset(&out[groups], 0, widths_size - groups);
+
+  __m128i *packed = (__m128i *)&out[widths_size];
+  for (size_t group = 0; group < groups; ++group) {
+    packed = simdpack_length(&values[group * GROUP_SIZE],
+                             get_group_length(length, group), packed,
+                             widths[group]);
+  }
+
+  return (size_t)((uint8_t *)packed - out);
+}
+
+static bool unpack_groups(const uint8_t *in, size_t size, size_t length,
+                          uint32_t *values) {
+  size_t offset = get_widths_size(length);
+  if (offset > size) {
+    return false;
+  }
+
+  for (size_t group = 0; group < get_group_count(length); ++group) {
+    size_t group_length = get_group_length(length, group);
+    uint32_t width = in[group];
+    if (width > 32) {
+      return false;
+    }
+
+    size_t packed_size =
+        (size_t)simdpack_compressedbytes((int)group_length, width);
+    if (packed_size > size - offset) {
+      return false;
+    }
+
+    simdunpack_length((const __m128i *)&in[offset], group_length,
+                      &values[group * GROUP_SIZE], width);
+    offset += packed_size;
+  }
+
+  return true;
+}
+
+// estimates the size of each codec from a few groups spread across the block
+static void estimate_codecs(const uint32_t *values, size_t length,
+                            estimate_t *estimate) {
+  size_t groups = get_group_count(length);
+  size_t stride = groups > SAMPLE_GROUPS ? groups / SAMPLE_GROUPS : 1;
+
+  dictionary_t dictionary;
+  clear_dictionary(&dictionary);
+  bool dictionary_full = false;
+
+  size_t sampled = 0, runs = 0, packed = 0, deltas = 0;
+  for (size_t group = 0; group < groups; group += stride) {
+    size_t first = group * GROUP_SIZE;
+    size_t group_length = get_group_length(length, group);
+    uint32_t previous = first > 0 ? values[first - 1] : 0;
+    uint32_t bits = 0, delta_bits = 0;
+    for (size_t i = first; i < first + group_length; ++i) {
+      runs += i == 0 || values[i] != previous;
+      bits |= values[i];
+      delta_bits |= zigzag(values[i] - previous);
+      previous = values[i];
+      dictionary_full =
+          dictionary_full || add_to_dictionary(&dictionary, values[i]) < 0;
+    }
+
+    packed += (size_t)simdpack_compressedbytes((int)group_length,
+                                               bit_width(bits));
+    deltas += (size_t)simdpack_compressedbytes((int)group_length,
+                                               bit_width(delta_bits));
+    sampled += group_length;
+  }
+
+  // scale the sample up to the whole block
+  size_t widths_size = get_widths_size(length);
+  estimate->rle = runs * RLE_RUN_SIZE * length / sampled;
+  estimate->grouped = widths_size + packed * length / sampled;
+  estimate->grouped_delta = widths_size + deltas * length / sampled;
+
+  size_t index_bits =
+      dictionary.count > 1 ? bit_width((uint32_t)dictionary.count - 1) : 0;
+  estimate->dictionary =
+      dictionary_full ? SIZE_MAX
+                      : sizeof(uint32_t) * (1 + dictionary.count) +
+                            widths_size + (length * index_bits + 7) / 8;
+}
+
+// replaces each value with its index in the dictionary, returning false if
+// there are too many distinct values
+static bool build_dictionary(const uint32_t *values, size_t length,
+                             dictionary_t *dictionary, uint32_t *indexes) {
+  clear_dictionary(dictionary);
+  for (size_t i = 0; i < length; ++i) {
+    int index = add_to_dictionary(dictionary, values[i]);
+    if (index < 0) {
+      return false;
+    }
+
+    indexes[i] = (uint32_t)index;
+  }
+
+  return true;
+}
+
+// compresses the block with one of the grouped codecs, returning zero if that
+// wouldn't be any smaller than storing it raw
+static size_t compress_grouped(const uint32_t *values, size_t length,
+                               block_codec_t codec, uint32_t *scratch,
+                               uint8_t *widths, uint8_t *out) {
+  dictionary_t dictionary;
+
+  const uint32_t *packed = values;
+  size_t header_size = 0;
+  if (codec == BLOCK_GROUPED_DELTA) {
+    uint32_t previous = 0;
+    for (size_t i = 0; i < length; ++i) {
+      scratch[i] = zigzag(values[i] - previous);
+      previous = values[i];
+    }
+    packed = scratch;
+  } else if (codec == BLOCK_DICTIONARY) {
+    if (!build_dictionary(values, length, &dictionary, scratch)) {
+      return 0;
+    }
+    packed = scratch;
+    header_size = sizeof(uint32_t) * (1 + dictionary.count);
+  }
+
+  size_t size = header_size + measure_groups(packed, length, widths);
+  if (size >= length * sizeof(uint32_t)) {
+    return 0;
+  }
+
+  if (codec == BLOCK_DICTIONARY) {
+    store_u32(out, (uint32_t)dictionary.count);
+    for (size_t i = 0; i < dictionary.count; ++i) {
+      store_u32(&out[sizeof(uint32_t) * (i + 1)], dictionary.values[i]);
+    }
+  }
+
+  return header_size +
+         pack_groups(packed, length, widths, &out[header_size]);
+}
+#endif
+
+size_t compress_block(const int *values, size_t length, uint8_t *out,
+                      uint32_t *format) {
+  const uint32_t *in = (const uint32_t *)values;
+  size_t raw_size = length * sizeof(uint32_t);
+  if (length == 0) {
+    *format = BLOCK_FORMAT(BLOCK_RAW, 0);
+    return 0;
+  }
+
+#ifndef __EMSCRIPTEN__
+  estimate_t estimate;
+  estimate_codecs(in, length, &estimate);
+
+  // the grouped codecs are tried in order of their estimated size, before
+  // falling back to runs or raw values
+  block_codec_t codecs[3] = {BLOCK_GROUPED, BLOCK_GROUPED_DELTA,
+                             BLOCK_DICTIONARY};
+  size_t sizes[3] = {estimate.grouped, estimate.grouped_delta,
+                     estimate.dictionary};
+  for (int i = 1; i < 3; ++i) {
+    for (int j = i; j > 0 && sizes[j] < sizes[j - 1]; --j) {
+      size_t size = sizes[j];
+      sizes[j] = sizes[j - 1];
+      sizes[j - 1] = size;
+      block_codec_t codec = codecs[j];
+      codecs[j] = codecs[j - 1];
+      codecs[j - 1] = codec;
+    }
+  }
+
+  if (sizes[0] < estimate.rle && sizes[0] < raw_size) {
+    uint32_t *scratch = malloc(sizeof(uint32_t) * length +
+                               get_group_count(length));
+    size_t size = 0;
+    for (int i = 0; i < 3 && scratch != NULL && size == 0; ++i) {
+      if (sizes[i] < raw_size) {
+        size = compress_grouped(in, length, codecs[i], scratch,
+                                (uint8_t *)&scratch[length], out);
+        *format = BLOCK_FORMAT(codecs[i], 0);
+      }
+    }
+
+    free(scratch);
+    if (size > 0) {
+      return size;
+    }
+  }
+#endif
+
+  size_t rle_size = count_runs(in, length) * RLE_RUN_SIZE;
+  if (rle_size < raw_size) {
+    *format = BLOCK_FORMAT(BLOCK_RLE, 0);
+    return compress_rle(in, length, out);
+  }
+
+  *format = BLOCK_FORMAT(BLOCK_RAW, 0);
+  return compress_raw(in, length, out);
+}
+
+bool decompress_block(const uint8_t *in, size_t size, uint32_t format,
+                      size_t length, int *values) {
+  uint32_t *out = (uint32_t *)values;
+
+  switch (BLOCK_FORMAT_CODEC(format)) {
+    case BLOCK_RAW:
+      if (size != length * sizeof(uint32_t)) {
+        return false;
+      }
+
+      for (size_t i = 0; i < length; ++i) {
+        out[i] = load_u32(&in[i * sizeof(uint32_t)]);
+      }
+      return true;
+    case BLOCK_RLE: {
+      if (size % RLE_RUN_SIZE != 0) {
+        return false;
+      }
+
+      size_t filled = 0;
+      for (size_t offset = 0; offset < size; offset += RLE_RUN_SIZE) {
+        size_t run = load_u32(&in[offset]);
+        uint32_t value = load_u32(&in[offset + sizeof(uint32_t)]);
+        if (run > length - filled) {
+          return false;
+        }
+
+        for (size_t i = 0; i < run; ++i) {
+          out[filled++] = value;
+        }
+      }
+      return filled == length;
+    }
+#ifndef __EMSCRIPTEN__
+    case BLOCK_PACKED:
+    case BLOCK_DELTA: {
+      uint32_t bits = BLOCK_FORMAT_BITS(format);
+      if (bits > 32 ||
+          size < (size_t)simdpack_compressedbytes((int)length, bits)) {
+        return false;
+      }
+
+      simdunpack_length((const __m128i *)in, length, out, bits);
+      if (BLOCK_FORMAT_CODEC(format) == BLOCK_DELTA) {
+        uint32_t previous = 0;
+        for (size_t i = 0; i < length; ++i) {
+          previous += unzigzag(out[i]);
+          out[i] = previous;
+        }
+      }
+      return true;
+    }
+    case BLOCK_GROUPED:
+      return unpack_groups(in, size, length, out);
+    case BLOCK_GROUPED_DELTA: {
+      if (!unpack_groups(in, size, length, out)) {
+        return false;
+      }
+
+      uint32_t previous = 0;
+      for (size_t i = 0; i < length; ++i) {
+        previous += unzigzag(out[i]);
+        out[i] = previous;
+      }
+      return true;
+    }
+    case BLOCK_DICTIONARY: {
+      uint32_t count = size >= sizeof(uint32_t) ? load_u32(in) : 0;
+      size_t header_size = sizeof(uint32_t) * (1 + (size_t)count);
+      if (count == 0 || count > DICTIONARY_MAX_VALUES || header_size > size ||
+          !unpack_groups(&in[header_size], size - header_size, length, out)) {
+        return false;
+      }
+
+      for (size_t i = 0; i < length; ++i) {
+        if (out[i] >= count) {
+          return false;
+        }
+        out[i] = load_u32(&in[sizeof(uint32_t) * (1 + out[i])]);
+      }
+      return true;
+    }
+#endif
+    default:
+      // bitpacked blocks can't be read without simdcomp
+      return false;
+  }
+}
@@ -0,0 +1,872 @@
+#include <lauxlib.h>
+#include <log.h>
+#include <lua.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "script/environment.h"
+#include "script/jobs.h"
+#include "script/parallel.h"
+#include "script/plane.h"
+#include "script/plane_codec.h"
+
+#define TBL_PLANE_FILE_META "procyon_plane_file_meta"
+
+#define FUNC_PLANE_SAVE "save"
+#define FUNC_PLANE_LOAD "load"
+#define FUNC_PLANE_OPEN "open"
+#define FUNC_PLANE_FILE_READ "read"
+#define FUNC_PLANE_FILE_AT "at"
+#define FUNC_PLANE_FILE_GETSIZE "get_size"
+#define FUNC_PLANE_FILE_GETTYPE "get_type"
+#define FUNC_PLANE_FILE_CLOSE "close"
+
+// A plane file begins with a header:
+//
+//   "PRPL", version, width, height, type, block rows, block count, 0
+//
+// followed by an index entry for each block of rows:
+//
+//   offset (64 bits), size, format
+//
+// and then the compressed blocks themselves, each starting on a 16-byte
+// boundary.  Every field is a little-endian 32-bit integer unless noted.
+#define PLANE_FILE_MAGIC "PRPL"
+#define PLANE_FILE_VERSION 1
+#define PLANE_FILE_HEADER_SIZE 32
+#define PLANE_FILE_ENTRY_SIZE 16
+#define PLANE_FILE_ALIGNMENT 16
+
+// blocks are made up of whole rows, with about this many elements in each
+#define PLANE_FILE_BLOCK_ELEMENTS 16384
+
+// the longest message describing why a file couldn't be read
+#define PLANE_FILE_ERROR_SIZE 128
+
+// room for the ".<process>.<counter>.tmp" suffix of temporary save files
+#define PLANE_FILE_TEMP_SUFFIX_SIZE 32
+
+typedef struct block_entry_t {
+  uint64_t offset;
+  uint32_t size, format;
+} block_entry_t;
+
+typedef struct plane_file_t {
+  const uint8_t *data;
+  size_t size;
+  int width, height;
+  plane_type_t type;
+  int block_rows, block_count;
+  block_entry_t *entries;
+
+  // the most recently decompressed block, for file:at()
+  int cached_block;
+  int *cached_values;
+} plane_file_t;
+
+typedef struct compressed_block_t {
+  uint8_t *data;
+  size_t size;
+  uint32_t format;
+} compressed_block_t;
+
+typedef struct save_context_t {
+  const int *values;
+  int width, height, block_rows;
+  compressed_block_t *blocks;
+} save_context_t;
+
+typedef struct read_context_t {
+  const plane_file_t *file;
+  int *values;
+  int x, y, width, height;
+  int first_block;
+  bool *failed;
+} read_context_t;
+
+// tells apart the temporary files of saves running at the same time
+static atomic_uint temp_file_counter;
+
+static inline void store_u32(uint8_t *out, uint32_t value) {
+  out[0] = value & 0xFF;
+  out[1] = (value >> 8) & 0xFF;
+  out[2] = (value >> 16) & 0xFF;
+  out[3] = (value >> 24) & 0xFF;
+}
+
+static inline uint32_t load_u32(const uint8_t *in) {
+  return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 |
+         (uint32_t)in[3] << 24;
+}
+
+static inline int get_block_rows(int width) {
+  return width >= PLANE_FILE_BLOCK_ELEMENTS ? 1
+                                            : PLANE_FILE_BLOCK_ELEMENTS / width;
+}
+
+static inline int get_block_height(const plane_file_t *file, int block) {
+  int remaining = file->height - block * file->block_rows;
+  return remaining < file->block_rows ? remaining : file->block_rows;
+}
+
+static const uint8_t *map_file(const char *path, size_t *size) {
+#ifdef _WIN32
+  HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (handle == INVALID_HANDLE_VALUE) {
+    return NULL;
+  }
+
+  LARGE_INTEGER file_size = {0};
+  HANDLE mapping = NULL;
+  if (GetFileSizeEx(handle, &file_size) && file_size.QuadPart > 0) {
+    mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+  }
+
+  // the view stays valid once the handles are closed
+  const uint8_t *data = NULL;
+  if (mapping != NULL) {
+    data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+  }
+  CloseHandle(handle);
+
+  *size = (size_t)file_size.QuadPart;
+  return data;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat info = {0};
+  void *data = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+
+  *size = (size_t)info.st_size;
+  return data == MAP_FAILED ? NULL : data;
+#endif
+}
+
+static void unmap_file(const uint8_t *data, size_t size) {
+#ifdef _WIN32
+  (void)size;
+  UnmapViewOfFile(data);
+#else
+  munmap((void *)data, size);
+#endif
+}
+
+// reads and validates the header and index of a mapped file, describing what's
+// wrong with it in `error` if it isn't valid
+static bool read_plane_file(plane_file_t *file, char *error) {
+  const uint8_t *data = file->data;
+  if (file->size < PLANE_FILE_HEADER_SIZE ||
+      memcmp(data, PLANE_FILE_MAGIC, 4) != 0) {
+    snprintf(error, PLANE_FILE_ERROR_SIZE, "Not a plane file");
+    return false;
+  }
+
+  uint32_t version = load_u32(&data[4]);
+  if (version != PLANE_FILE_VERSION) {
+    snprintf(error, PLANE_FILE_ERROR_SIZE,
+             "Unsupported plane file version (%u)", version);
+    return false;
+  }
+
+  file->width = (int)load_u32(&data[8]);
+  file->height = (int)load_u32(&data[12]);
+  file->type = (plane_type_t)load_u32(&data[16]);
+  file->block_rows = (int)load_u32(&data[20]);
+  file->block_count = (int)load_u32(&data[24]);
+  if (file->width <= 0 || file->height <= 0 || file->type > PLANE_BIT ||
+      file->block_rows <= 0 ||
+      file->block_count !=
+          (file->height + file->block_rows - 1) / file->block_rows) {
+    snprintf(error, PLANE_FILE_ERROR_SIZE, "Invalid plane file header");
+    return false;
+  }
+
+  size_t index_end = PLANE_FILE_HEADER_SIZE +
+                     (size_t)file->block_count * PLANE_FILE_ENTRY_SIZE;
+  if (index_end > file->size) {
+    snprintf(error, PLANE_FILE_ERROR_SIZE, "Invalid plane file index");
+    return false;
+  }
+
+  file->entries = malloc(sizeof(block_entry_t) * (size_t)file->block_count);
+  if (file->entries == NULL) {
+    snprintf(error, PLANE_FILE_ERROR_SIZE,
+             "Failed to allocate the plane file index");
+    return false;
+  }
+
+  for (int i = 0; i < file->block_count; ++i) {
+    const uint8_t *entry =
+        &data[PLANE_FILE_HEADER_SIZE + (size_t)i * PLANE_FILE_ENTRY_SIZE];
+    block_entry_t *block = &file->entries[i];
+    block->offset = (uint64_t)load_u32(entry) |
+                    (uint64_t)load_u32(&entry[4]) << 32;
+    block->size = load_u32(&entry[8]);
+    block->format = load_u32(&entry[12]);
+    if (block->offset < index_end || block->offset > file->size ||
+        block->size > file->size - block->offset) {
+      snprintf(error, PLANE_FILE_ERROR_SIZE,
+               "Block %d of the plane file is out of bounds", i);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool decompress_file_block(const plane_file_t *file, int block,
+                                  int *values) {
+  const block_entry_t *entry = &file->entries[block];
+  return decompress_block(&file->data[entry->offset], entry->size,
+                          entry->format,
+                          (size_t)get_block_height(file, block) * file->width,
+                          values);
+}
+
+static void close_plane_file(plane_file_t *file) {
+  if (file->data != NULL) {
+    unmap_file(file->data, file->size);
+  }
+
+  free(file->entries);
+  free(file->cached_values);
+  memset(file, 0, sizeof(plane_file_t));
+}
+
+static plane_file_t *check_plane_file(lua_State *L, int index) {
+  plane_file_t *file =
+      (plane_file_t *)luaL_checkudata(L, index, TBL_PLANE_FILE_META);
+  if (file->data == NULL) {
+    LOG_SCRIPT_ERROR(L, "The plane file has been closed");
+    return NULL;
+  }
+
+  return file;
+}
+
+// pushes a handle to the plane file at `path`, which stays mapped (with its
+// blocks only being read as they're needed) until it's closed
+static plane_file_t *push_plane_file(lua_State *L, const char *path) {
+  plane_file_t *file = lua_newuserdata(L, sizeof(plane_file_t));
+  memset(file, 0, sizeof(plane_file_t));
+  file->cached_block = -1;
+  luaL_setmetatable(L, TBL_PLANE_FILE_META);
+
+  file->data = map_file(path, &file->size);
+  if (file->data == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to open the plane file %s", path);
+    return NULL;
+  }
+
+  char error[PLANE_FILE_ERROR_SIZE];
+  if (!read_plane_file(file, error)) {
+    LOG_SCRIPT_ERROR(L, "%s", error);
+    close_plane_file(file);
+    return NULL;
+  }
+
+  return file;
+}
+
+static void compress_blocks(void *context, int first, int last) {
+  save_context_t *save = (save_context_t *)context;
+
+  for (int block = first; block < last; ++block) {
+    int y = block * save->block_rows;
+    int rows = save->height - y < save->block_rows ? save->height - y
+                                                   : save->block_rows;
+    size_t length = (size_t)rows * save->width;
+
+    compressed_block_t *compressed = &save->blocks[block];
+    compressed->data = malloc(get_block_bound(length));
+    if (compressed->data != NULL) {
+      compressed->size =
+          compress_block(&save->values[(size_t)y * save->width], length,
+                         compressed->data, &compressed->format);
+    }
+  }
+}
+
+// creates a new file alongside `path`, storing its name in `temp_path`
+static FILE *open_temp_file(const char *path, char *temp_path, size_t size) {
+  unsigned counter = atomic_fetch_add(&temp_file_counter, 1);
+#ifdef _WIN32
+  snprintf(temp_path, size, "%s.%lu.%u.tmp", path,
+           (unsigned long)GetCurrentProcessId(), counter);
+  return fopen(temp_path, "wb");
+#else
+  snprintf(temp_path, size, "%s.%ld.%u.tmp", path, (long)getpid(), counter);
+  int fd = open(temp_path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  FILE *file = fdopen(fd, "wb");
+  if (file == NULL) {
+    close(fd);
+    remove(temp_path);
+  }
+
+  return file;
+#endif
+}
+
+static bool replace_file(const char *temp_path, const char *path) {
+#ifdef _WIN32
+  return MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  return rename(temp_path, path) == 0;
+#endif
+}
+
+// writes the file to a temporary one first, which then replaces `path`, so
+// that a failed save leaves the previous one intact and files opened with
+// plane.open keep reading what they were opened with
+static bool write_plane_file(const char *path, int width, int height,
+                             plane_type_t type, int block_rows,
+                             int block_count,
+                             const compressed_block_t *blocks) {
+  size_t temp_size = strlen(path) + PLANE_FILE_TEMP_SUFFIX_SIZE;
+  char *temp_path = malloc(temp_size);
+  if (temp_path == NULL) {
+    return false;
+  }
+
+  FILE *file = open_temp_file(path, temp_path, temp_size);
+  if (file == NULL) {
+    free(temp_path);
+    return false;
+  }
+
+  uint8_t header[PLANE_FILE_HEADER_SIZE] = {0};
+  memcpy(header, PLANE_FILE_MAGIC, 4);
+  store_u32(&header[4], PLANE_FILE_VERSION);
+  store_u32(&header[8], (uint32_t)width);
+  store_u32(&header[12], (uint32_t)height);
+  store_u32(&header[16], (uint32_t)type);
+  store_u32(&header[20], (uint32_t)block_rows);
+  store_u32(&header[24], (uint32_t)block_count);
+  bool written = fwrite(header, sizeof(header), 1, file) == 1;
+
+  // blocks are laid out in order after the index
+  uint64_t offset = PLANE_FILE_HEADER_SIZE +
+                    (uint64_t)block_count * PLANE_FILE_ENTRY_SIZE;
+  for (int i = 0; i < block_count && written; ++i) {
+    offset = (offset + PLANE_FILE_ALIGNMENT - 1) /
+             PLANE_FILE_ALIGNMENT * PLANE_FILE_ALIGNMENT;
+
+    uint8_t entry[PLANE_FILE_ENTRY_SIZE];
+    store_u32(entry, (uint32_t)offset);
+    store_u32(&entry[4], (uint32_t)(offset >> 32));
+    store_u32(&entry[8], (uint32_t)blocks[i].size);
+    store_u32(&entry[12], blocks[i].format);
+    written = fwrite(entry, sizeof(entry), 1, file) == 1;
+
+    offset += blocks[i].size;
+  }
+
+  static const uint8_t padding[PLANE_FILE_ALIGNMENT] = {0};
+  for (int i = 0; i < block_count && written; ++i) {
+    long position = ftell(file);
+    size_t pad = (size_t)(-position) % PLANE_FILE_ALIGNMENT;
+    written = position >= 0 && fwrite(padding, 1, pad, file) == pad &&
+              fwrite(blocks[i].data, 1, blocks[i].size, file) ==
+                  blocks[i].size;
+  }
+
+  written = fclose(file) == 0 && written && replace_file(temp_path, path);
+  if (!written) {
+    remove(temp_path);
+  }
+
+  free(temp_path);
+
+  return written;
+}
+
+// compresses a plane's elements and writes them to `path`, setting
+// `allocated` to whether there was memory enough to compress them
+static bool save_plane_file(const char *path, const int *values, int width,
+                            int height, plane_type_t type, bool *allocated) {
+  int block_rows = get_block_rows(width);
+  int block_count = (height + block_rows - 1) / block_rows;
+  compressed_block_t *blocks =
+      calloc((size_t)block_count, sizeof(compressed_block_t));
+  *allocated = blocks != NULL;
+  if (blocks == NULL) {
+    return false;
+  }
+
+  // blocks are compressed independently, so they're spread across threads
+  save_context_t save = {values, width, height, block_rows, blocks};
+  parallel_for_rows(block_count, 1, compress_blocks, &save);
+
+  for (int i = 0; i < block_count; ++i) {
+    *allocated = *allocated && blocks[i].data != NULL;
+  }
+
+  bool saved = *allocated && write_plane_file(path, width, height, type,
+                                              block_rows, block_count, blocks);
+
+  for (int i = 0; i < block_count; ++i) {
+    free(blocks[i].data);
+  }
+  free(blocks);
+
+  return saved;
+}
+
+// plane:save(path)
+static int plane_save(lua_State *L) {
+  lua_settop(L, 2);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  const char *path = luaL_checkstring(L, 2);
+
+  const int *values = acquire_plane_ints(L, plane);
+  if (values == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate the plane file blocks");
+    return 0;
+  }
+
+  bool allocated;
+  bool saved = save_plane_file(path, values, plane->width, plane->height,
+                               plane->type, &allocated);
+  release_plane_ints(plane, (int *)values, false);
+
+  if (!allocated) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate the plane file blocks");
+  } else if (!saved) {
+    LOG_SCRIPT_ERROR(L, "Failed to write the plane file %s", path);
+  } else {
+    log_debug("Saved plane to %s", path);
+  }
+
+  lua_pushboolean(L, saved);
+
+  return 1;
+}
+
+static void decompress_blocks(void *context, int first, int last) {
+  read_context_t *read = (read_context_t *)context;
+  const plane_file_t *file = read->file;
+
+  int *scratch = NULL;
+  for (int i = first; i < last; ++i) {
+    int block = read->first_block + i;
+    int block_y = block * file->block_rows;
+    int block_height = get_block_height(file, block);
+
+    // blocks that fit the region exactly are decompressed in place
+    bool whole = read->x == 0 && read->width == file->width &&
+                 block_y >= read->y &&
+                 block_y + block_height <= read->y + read->height;
+    if (whole) {
+      int *values = &read->values[(size_t)(block_y - read->y) * read->width];
+      read->failed[i] = !decompress_file_block(file, block, values);
+      continue;
+    }
+
+    if (scratch == NULL) {
+      scratch = malloc(sizeof(int) * (size_t)file->block_rows * file->width);
+      if (scratch == NULL) {
+        read->failed[i] = true;
+        continue;
+      }
+    }
+
+    if (!decompress_file_block(file, block, scratch)) {
+      read->failed[i] = true;
+      continue;
+    }
+
+    // otherwise, copy out the part of each row that's within the region
+    int first_row = read->y > block_y ? read->y - block_y : 0;
+    int last_row = read->y + read->height - block_y;
+    last_row = last_row < block_height ? last_row : block_height;
+    int first_x = read->x < 0 ? 0 : read->x;
+    int last_x = read->x + read->width;
+    last_x = last_x < file->width ? last_x : file->width;
+    for (int row = first_row; row < last_row && first_x < last_x; ++row) {
+      memcpy(&read->values[(size_t)(block_y + row - read->y) * read->width +
+                           first_x - read->x],
+             &scratch[(size_t)row * file->width + first_x],
+             sizeof(int) * (size_t)(last_x - first_x));
+    }
+  }
+
+  free(scratch);
+}
+
+// reads the region of the file with its top-left corner at (x, y) into
+// `values`, decompressing only the blocks that overlap it.  returns false if
+// a block couldn't be decompressed, setting `failed_block` to it, or to -1 if
+// the blocks' results couldn't be allocated.
+static bool read_file_region(const plane_file_t *file, int x, int y,
+                             int width, int height, int *values,
+                             int *failed_block) {
+  // anything outside of the file is zero
+  memset(values, 0, sizeof(int) * (size_t)width * height);
+
+  int first_y = y < 0 ? 0 : y;
+  int last_y = y + height < file->height ? y + height : file->height;
+  int first_block = first_y / file->block_rows;
+  int last_block = first_y < last_y ? (last_y - 1) / file->block_rows + 1
+                                    : first_block;
+  if (x >= file->width || x + width <= 0) {
+    last_block = first_block;
+  }
+
+  int block_count = last_block - first_block;
+  bool *failed = calloc(block_count > 0 ? (size_t)block_count : 1,
+                        sizeof(bool));
+  if (failed == NULL) {
+    *failed_block = -1;
+    return false;
+  }
+
+  read_context_t read = {file,   values,      x,     y, width,
+                         height, first_block, failed};
+  parallel_for_rows(block_count, 1, decompress_blocks, &read);
+
+  bool valid = true;
+  for (int i = 0; i < block_count && valid; ++i) {
+    if (failed[i]) {
+      *failed_block = first_block + i;
+      valid = false;
+    }
+  }
+
+  free(failed);
+
+  return valid;
+}
+
+static void log_region_error(lua_State *L, int failed_block) {
+  if (failed_block < 0) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate the plane file blocks");
+  } else {
+    LOG_SCRIPT_ERROR(L, "Failed to decompress block %d of the plane file",
+                     failed_block);
+  }
+}
+
+// pushes a plane holding the region of the file with its top-left corner at
+// (x, y)
+static plane_t *push_file_region(lua_State *L, const plane_file_t *file,
+                                 int x, int y, int width, int height) {
+  plane_t *plane = push_new_typed_plane(width, height, file->type, NULL, L);
+  if (plane == NULL) {
+    return NULL;
+  }
+
+  int *values = acquire_plane_ints(L, plane);
+  if (values == NULL) {
+    return NULL;
+  }
+
+  int failed_block;
+  bool valid =
+      read_file_region(file, x, y, width, height, values, &failed_block);
+  if (!valid) {
+    log_region_error(L, failed_block);
+  }
+
+  release_plane_ints(plane, values, valid);
+
+  return valid ? plane : NULL;
+}
+
+// plane.load(path)
+static int plane_load(lua_State *L) {
+  lua_settop(L, 1);
+
+  const char *path = luaL_checkstring(L, 1);
+  plane_file_t *file = push_plane_file(L, path);
+  if (file == NULL) {
+    return 0;
+  }
+
+  plane_t *plane =
+      push_file_region(L, file, 0, 0, file->width, file->height);
+  close_plane_file(file);
+
+  return plane != NULL ? 1 : 0;
+}
+
+// plane.open(path)
+static int plane_open(lua_State *L) {
+  lua_settop(L, 1);
+
+  const char *path = luaL_checkstring(L, 1);
+  return push_plane_file(L, path) != NULL ? 1 : 0;
+}
+
+// file:read([x, y, w, h])
+static int plane_file_read(lua_State *L) {
+  lua_settop(L, 5);
+
+  plane_file_t *file = check_plane_file(L, 1);
+  if (file == NULL) {
+    return 0;
+  }
+
+  int x = (int)luaL_optinteger(L, 2, 0);
+  int y = (int)luaL_optinteger(L, 3, 0);
+  int width = (int)luaL_optinteger(L, 4, file->width);
+  int height = (int)luaL_optinteger(L, 5, file->height);
+
+  return push_file_region(L, file, x, y, width, height) != NULL ? 1 : 0;
+}
+
+// file:at(x, y)
+static int plane_file_at(lua_State *L) {
+  lua_settop(L, 3);
+
+  plane_file_t *file = check_plane_file(L, 1);
+  if (file == NULL) {
+    return 0;
+  }
+
+  int x = (int)luaL_checkinteger(L, 2);
+  int y = (int)luaL_checkinteger(L, 3);
+  if (x < 0 || x >= file->width || y < 0 || y >= file->height) {
+    lua_pushinteger(L, 0);
+    return 1;
+  }
+
+  // only the block holding the element is decompressed, and it's kept for
+  // the next call
+  int block = y / file->block_rows;
+  if (block != file->cached_block) {
+    if (file->cached_values == NULL) {
+      file->cached_values =
+          malloc(sizeof(int) * (size_t)file->block_rows * file->width);
+    }
+
+    file->cached_block = -1;
+    if (file->cached_values == NULL ||
+        !decompress_file_block(file, block, file->cached_values)) {
+      LOG_SCRIPT_ERROR(L, "Failed to decompress block %d of the plane file",
+                       block);
+      return 0;
+    }
+
+    file->cached_block = block;
+  }
+
+  size_t index = (size_t)(y - block * file->block_rows) * file->width + x;
+  lua_pushinteger(L, file->cached_values[index]);
+
+  return 1;
+}
+
+// file:get_size()
+static int plane_file_get_size(lua_State *L) {
+  plane_file_t *file = check_plane_file(L, 1);
+  if (file == NULL) {
+    return 0;
+  }
+
+  lua_pushinteger(L, file->width);
+  lua_pushinteger(L, file->height);
+
+  return 2;
+}
+
+// file:get_type()
+static int plane_file_get_type(lua_State *L) {
+  plane_file_t *file = check_plane_file(L, 1);
+  if (file == NULL) {
+    return 0;
+  }
+
+  lua_pushstring(L, plane_type_names[file->type]);
+
+  return 1;
+}
+
+// file:close()
+static int plane_file_close(lua_State *L) {
+  close_plane_file(
+      (plane_file_t *)luaL_checkudata(L, 1, TBL_PLANE_FILE_META));
+
+  return 0;
+}
+
+// background versions of plane:save and plane.load for pr.jobs.submit
+
+typedef struct plane_file_job_t {
+  char *path;
+  int *values;
+  int width, height;
+  plane_type_t type;
+  bool allocated, succeeded;
+  int failed_block;
+  char error[PLANE_FILE_ERROR_SIZE];
+} plane_file_job_t;
+
+// pr.jobs.submit('save', {plane, path})
+static bool prepare_save_job(lua_State *L, int index, void *state) {
+  plane_file_job_t *job = (plane_file_job_t *)state;
+
+  plane_t *plane = get_plane(L, index);
+  if (plane == NULL) {
+    return false;
+  }
+
+  job->path = strdup(luaL_checkstring(L, index + 1));
+  job->values = copy_plane_ints(L, plane);
+  job->width = plane->width;
+  job->height = plane->height;
+  job->type = plane->type;
+
+  return job->path != NULL && job->values != NULL;
+}
+
+static void run_save_job(void *state) {
+  plane_file_job_t *job = (plane_file_job_t *)state;
+  job->succeeded = save_plane_file(job->path, job->values, job->width,
+                                   job->height, job->type, &job->allocated);
+}
+
+static int finish_save_job(lua_State *L, void *state) {
+  plane_file_job_t *job = (plane_file_job_t *)state;
+  if (!job->allocated) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate the plane file blocks");
+  } else if (!job->succeeded) {
+    LOG_SCRIPT_ERROR(L, "Failed to write the plane file %s", job->path);
+  } else {
+    log_debug("Saved plane to %s", job->path);
+  }
+
+  lua_pushboolean(L, job->succeeded);
+
+  return 1;
+}
+
+// pr.jobs.submit('load', {path})
+static bool prepare_load_job(lua_State *L, int index, void *state) {
+  plane_file_job_t *job = (plane_file_job_t *)state;
+  job->path = strdup(luaL_checkstring(L, index));
+
+  return job->path != NULL;
+}
+
+static void run_load_job(void *state) {
+  plane_file_job_t *job = (plane_file_job_t *)state;
+
+  plane_file_t file = {0};
+  file.data = map_file(job->path, &file.size);
+  if (file.data == NULL) {
+    snprintf(job->error, PLANE_FILE_ERROR_SIZE,
+             "Failed to open the plane file %s", job->path);
+    return;
+  }
+
+  if (read_plane_file(&file, job->error)) {
+    job->width = file.width;
+    job->height = file.height;
+    job->type = file.type;
+    job->values =
+        malloc(sizeof(int) * (size_t)file.width * (size_t)file.height);
+    job->allocated = job->values != NULL;
+    job->succeeded =
+        job->allocated && read_file_region(&file, 0, 0, file.width,
+                                           file.height, job->values,
+                                           &job->failed_block);
+  }
+
+  close_plane_file(&file);
+}
+
+static int finish_load_job(lua_State *L, void *state) {
+  plane_file_job_t *job = (plane_file_job_t *)state;
+  if (job->error[0] != '\0') {
+    LOG_SCRIPT_ERROR(L, "%s", job->error);
+    return 0;
+  }
+
+  if (!job->succeeded) {
+    log_region_error(L, job->allocated ? job->failed_block : -1);
+    return 0;
+  }
+
+  plane_t *plane =
+      push_new_typed_plane(job->width, job->height, job->type, NULL, L);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  write_plane_values(plane, 0, (size_t)job->width * (size_t)job->height,
+                     job->values);
+
+  return 1;
+}
+
+static void destroy_plane_file_job(lua_State *L, void *state) {
+  plane_file_job_t *job = (plane_file_job_t *)state;
+  (void)L;
+  free(job->path);
+  free(job->values);
+}
+
+const job_op_t plane_save_job = {
+    FUNC_PLANE_SAVE, sizeof(plane_file_job_t), prepare_save_job,
+    run_save_job,    finish_save_job,          destroy_plane_file_job};
+
+const job_op_t plane_load_job = {
+    FUNC_PLANE_LOAD, sizeof(plane_file_job_t), prepare_load_job,
+    run_load_job,    finish_load_job,          destroy_plane_file_job};
+
+void add_plane_file_methods(lua_State *L, int index) {
+  lua_pushcfunction(L, plane_save);
+  lua_setfield(L, index, FUNC_PLANE_SAVE);
+}
+
+void add_plane_files(lua_State *L, int index) {
+  lua_pushcfunction(L, plane_load);
+  lua_setfield(L, index, FUNC_PLANE_LOAD);
+
+  lua_pushcfunction(L, plane_open);
+  lua_setfield(L, index, FUNC_PLANE_OPEN);
+
+  if (luaL_newmetatable(L, TBL_PLANE_FILE_META)) {
+    luaL_Reg index_methods[] = {{FUNC_PLANE_FILE_READ, plane_file_read},
+                                {FUNC_PLANE_FILE_AT, plane_file_at},
+                                {FUNC_PLANE_FILE_GETSIZE, plane_file_get_size},
+                                {FUNC_PLANE_FILE_GETTYPE, plane_file_get_type},
+                                {FUNC_PLANE_FILE_CLOSE, plane_file_close},
+                                {NULL, NULL}};
+    luaL_newlib(L, index_methods);
+    lua_setfield(L, -2, "__index");
+
+    lua_pushcfunction(L, plane_file_close);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_pop(L, 1);
+}
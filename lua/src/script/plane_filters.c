@@ -0,0 +1,503 @@
+#include <ctype.h>
+#include <lauxlib.h>
+#include <limits.h>
+#include <log.h>
+#include <lua.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "script/environment.h"
+#include "script/parallel.h"
+#include "script/plane.h"
+
+#define FUNC_PLANE_STEP_AUTOMATON "step_automaton"
+#define FUNC_PLANE_CONVOLVE "convolve"
+#define FIELD_FILTER_BIRTH "birth"
+#define FIELD_FILTER_SURVIVE "survive"
+#define FIELD_FILTER_NEIGHBORHOOD "neighborhood"
+#define FIELD_FILTER_EDGES "edges"
+#define FIELD_FILTER_STEPS "steps"
+#define FIELD_FILTER_ALIVE "alive"
+#define FIELD_FILTER_DIVISOR "divisor"
+#define FIELD_FILTER_BIAS "bias"
+
+// rows are split across threads in bands of at least this many
+#define FILTER_MIN_ROWS 16
+
+// the largest kernel dimension accepted by plane:convolve
+#define MAX_KERNEL_SIZE 63
+
+typedef enum edge_mode_t { EDGE_CLAMP, EDGE_WRAP, EDGE_ZERO } edge_mode_t;
+
+static const char *const edge_mode_names[] = {"clamp", "wrap", "zero", NULL};
+
+typedef enum neighborhood_t { MOORE, VON_NEUMANN } neighborhood_t;
+
+static const char *const neighborhood_names[] = {"moore", "von_neumann",
+                                                 NULL};
+
+// Filters work on copies of the plane surrounded by a border of padding
+// cells, filled in according to the edge mode after every step, so that the
+// per-cell loops don't have to handle edges themselves.  Two such buffers are
+// swapped between steps.
+typedef struct padded_t {
+  int *buffers[2];
+  int width, height;
+  int pad_x, pad_y, stride;
+  int current;
+} padded_t;
+
+typedef struct automaton_t {
+  padded_t *padded;
+  uint16_t birth, survive;
+  neighborhood_t neighborhood;
+} automaton_t;
+
+typedef struct convolution_t {
+  padded_t *padded;
+  const int *kernel;
+  int kernel_width, kernel_height;
+  int divisor, bias;
+} convolution_t;
+
+static int map_edge(int index, int length, edge_mode_t edges) {
+  switch (edges) {
+    case EDGE_WRAP:
+      return ((index % length) + length) % length;
+    case EDGE_CLAMP:
+      return index < 0 ? 0 : (index >= length ? length - 1 : index);
+    default:
+      return index >= 0 && index < length ? index : -1;
+  }
+}
+
+static inline int *padded_row(padded_t *padded, int buffer, int y) {
+  return &padded->buffers[buffer][(size_t)(y + padded->pad_y) * padded->stride +
+                                  padded->pad_x];
+}
+
+static void fill_padding(padded_t *padded, int buffer, edge_mode_t edges) {
+  // pad each row horizontally, then copy whole (padded) rows vertically so
+  // that the corners are filled in as well
+  for (int y = 0; y < padded->height; ++y) {
+    int *row = padded_row(padded, buffer, y);
+    for (int x = -padded->pad_x; x < 0; ++x) {
+      int source = map_edge(x, padded->width, edges);
+      row[x] = source < 0 ? 0 : row[source];
+    }
+
+    for (int x = padded->width; x < padded->width + padded->pad_x; ++x) {
+      int source = map_edge(x, padded->width, edges);
+      row[x] = source < 0 ? 0 : row[source];
+    }
+  }
+
+  for (int y = -padded->pad_y; y < padded->height + padded->pad_y; ++y) {
+    if (y >= 0 && y < padded->height) {
+      continue;
+    }
+
+    int *row = padded_row(padded, buffer, y) - padded->pad_x;
+    int source = map_edge(y, padded->height, edges);
+    if (source < 0) {
+      memset(row, 0, sizeof(int) * padded->stride);
+    } else {
+      memcpy(row, padded_row(padded, buffer, source) - padded->pad_x,
+             sizeof(int) * padded->stride);
+    }
+  }
+}
+
+static bool create_padded(padded_t *padded, const plane_t *plane, int pad_x,
+                          int pad_y) {
+  padded->width = plane->width;
+  padded->height = plane->height;
+  padded->pad_x = pad_x;
+  padded->pad_y = pad_y;
+  padded->stride = plane->width + 2 * pad_x;
+  padded->current = 0;
+
+  size_t length = (size_t)padded->stride * (size_t)(plane->height + 2 * pad_y);
+  padded->buffers[0] = malloc(sizeof(int) * length);
+  padded->buffers[1] = malloc(sizeof(int) * length);
+
+  return padded->buffers[0] != NULL && padded->buffers[1] != NULL;
+}
+
+static void destroy_padded(padded_t *padded) {
+  free(padded->buffers[0]);
+  free(padded->buffers[1]);
+}
+
+static void step_automaton_rows(void *context, int first, int last) {
+  const automaton_t *automaton = (const automaton_t *)context;
+  padded_t *padded = automaton->padded;
+  int width = padded->width;
+
+  for (int y = first; y < last; ++y) {
+    const int *restrict up = padded_row(padded, padded->current, y - 1);
+    const int *restrict row = padded_row(padded, padded->current, y);
+    const int *restrict down = padded_row(padded, padded->current, y + 1);
+    int *restrict out = padded_row(padded, !padded->current, y);
+
+    if (automaton->neighborhood == MOORE) {
+      for (int x = 0; x < width; ++x) {
+        int neighbors = up[x - 1] + up[x] + up[x + 1] + row[x - 1] +
+                        row[x + 1] + down[x - 1] + down[x] + down[x + 1];
+        int rule = row[x] ? automaton->survive : automaton->birth;
+        out[x] = (rule >> neighbors) & 1;
+      }
+    } else {
+      for (int x = 0; x < width; ++x) {
+        int neighbors = up[x] + row[x - 1] + row[x + 1] + down[x];
+        int rule = row[x] ? automaton->survive : automaton->birth;
+        out[x] = (rule >> neighbors) & 1;
+      }
+    }
+  }
+}
+
+static void convolve_rows(void *context, int first, int last) {
+  const convolution_t *convolution = (const convolution_t *)context;
+  padded_t *padded = convolution->padded;
+  int width = padded->width;
+  int half_w = convolution->kernel_width / 2;
+  int half_h = convolution->kernel_height / 2;
+
+  for (int y = first; y < last; ++y) {
+    int *restrict out = padded_row(padded, !padded->current, y);
+    for (int x = 0; x < width; ++x) {
+      out[x] = 0;
+    }
+
+    // accumulate one kernel tap at a time across the whole row, which keeps
+    // the inner loop simple enough to be vectorized
+    for (int ky = 0; ky < convolution->kernel_height; ++ky) {
+      const int *restrict row =
+          padded_row(padded, padded->current, y + ky - half_h);
+      for (int kx = 0; kx < convolution->kernel_width; ++kx) {
+        unsigned weight =
+            (unsigned)convolution->kernel[ky * convolution->kernel_width + kx];
+        if (weight == 0) {
+          continue;
+        }
+
+        const int *restrict source = &row[kx - half_w];
+        for (int x = 0; x < width; ++x) {
+          out[x] = (int)((unsigned)out[x] + weight * (unsigned)source[x]);
+        }
+      }
+    }
+
+    int divisor = convolution->divisor;
+    int bias = convolution->bias;
+    if (divisor != 1 || bias != 0) {
+      // divided in 64 bits, since INT_MIN / -1 overflows (and traps)
+      for (int x = 0; x < width; ++x) {
+        long long value =
+            (long long)(int)((unsigned)out[x] + (unsigned)bias) / divisor;
+        out[x] = value > INT_MAX ? INT_MAX : (int)value;
+      }
+    }
+  }
+}
+
+// runs `steps` steps of a filter, leaving the result in the current buffer
+static void run_filter(padded_t *padded, int steps, edge_mode_t edges,
+                       parallel_rows_fn func, void *context) {
+  for (int i = 0; i < steps; ++i) {
+    fill_padding(padded, padded->current, edges);
+    parallel_for_rows(padded->height, FILTER_MIN_ROWS, func, context);
+    padded->current = !padded->current;
+  }
+}
+
+// parses a rule in the form "B3/S23"
+static bool parse_rule_string(const char *rule, uint16_t *birth,
+                              uint16_t *survive) {
+  uint16_t *target = NULL;
+  for (const char *c = rule; *c != '\0'; ++c) {
+    if (toupper(*c) == 'B') {
+      target = birth;
+    } else if (toupper(*c) == 'S') {
+      target = survive;
+    } else if (*c >= '0' && *c <= '8' && target != NULL) {
+      *target |= 1 << (*c - '0');
+    } else if (*c != '/') {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool get_rule_counts(lua_State *L, int index, const char *field,
+                            uint16_t *counts) {
+  lua_getfield(L, index, field);
+  bool result = lua_istable(L, -1) || lua_isnil(L, -1);
+  if (lua_istable(L, -1)) {
+    int length = (int)lua_objlen(L, -1);
+    for (int i = 1; i <= length; ++i) {
+      lua_rawgeti(L, -1, i);
+      if (lua_type(L, -1) != LUA_TNUMBER) {
+        const char *message =
+            lua_pushfstring(L, "%s counts must be numbers", field);
+        luaL_argerror(L, index, message);
+      }
+
+      int count = (int)lua_tointeger(L, -1);
+      if (count < 0 || count > 8) {
+        result = false;
+      } else {
+        *counts |= 1 << count;
+      }
+      lua_pop(L, 1);
+    }
+  }
+  lua_pop(L, 1);
+
+  return result;
+}
+
+static int get_int_option(lua_State *L, int index, const char *field,
+                          int fallback) {
+  if (!lua_istable(L, index)) {
+    return fallback;
+  }
+
+  lua_getfield(L, index, field);
+  int value = (int)luaL_optinteger(L, -1, fallback);
+  lua_pop(L, 1);
+
+  return value;
+}
+
+static int get_enum_option(lua_State *L, int index, const char *field,
+                           const char *const names[]) {
+  if (!lua_istable(L, index)) {
+    return 0;
+  }
+
+  lua_getfield(L, index, field);
+  int value = luaL_checkoption(L, -1, names[0], names);
+  lua_pop(L, 1);
+
+  return value;
+}
+
+// plane:step_automaton("B3/S23" [, { neighborhood = "moore"|"von_neumann",
+//                                    edges = "clamp"|"wrap"|"zero",
+//                                    steps = 1, alive = 1 }])
+// plane:step_automaton({ birth = { 3 }, survive = { 2, 3 } } [, { ... }])
+static int plane_step_automaton(lua_State *L) {
+  lua_settop(L, 3);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  automaton_t automaton = {0};
+  bool valid_rule = false;
+  if (lua_type(L, 2) == LUA_TSTRING) {
+    valid_rule =
+        parse_rule_string(lua_tostring(L, 2), &automaton.birth,
+                          &automaton.survive);
+  } else if (lua_istable(L, 2)) {
+    valid_rule =
+        get_rule_counts(L, 2, FIELD_FILTER_BIRTH, &automaton.birth) &&
+        get_rule_counts(L, 2, FIELD_FILTER_SURVIVE, &automaton.survive);
+  }
+
+  if (!valid_rule) {
+    LOG_SCRIPT_ERROR(L, "Invalid automaton rule; expected a string such as "
+                        "\"B3/S23\" or a table of birth and survive counts");
+    return 0;
+  }
+
+  automaton.neighborhood = (neighborhood_t)get_enum_option(
+      L, 3, FIELD_FILTER_NEIGHBORHOOD, neighborhood_names);
+  edge_mode_t edges =
+      (edge_mode_t)get_enum_option(L, 3, FIELD_FILTER_EDGES, edge_mode_names);
+  int steps = get_int_option(L, 3, FIELD_FILTER_STEPS, 1);
+  int alive = get_int_option(L, 3, FIELD_FILTER_ALIVE, 1);
+
+  padded_t padded;
+  if (!create_padded(&padded, plane, 1, 1)) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate automaton buffers");
+    destroy_padded(&padded);
+    return 0;
+  }
+
+  // cells are either alive (1) or dead (0) while the automaton runs
+  for (int y = 0; y < plane->height; ++y) {
+    int *row = padded_row(&padded, 0, y);
+    read_plane_values(plane, (size_t)y * plane->width, plane->width, row);
+    for (int x = 0; x < plane->width; ++x) {
+      row[x] = row[x] != 0;
+    }
+  }
+
+  automaton.padded = &padded;
+  run_filter(&padded, steps, edges, step_automaton_rows, &automaton);
+
+  for (int y = 0; y < plane->height; ++y) {
+    int *row = padded_row(&padded, padded.current, y);
+    for (int x = 0; x < plane->width; ++x) {
+      row[x] = row[x] ? alive : 0;
+    }
+    write_plane_values(plane, (size_t)y * plane->width, plane->width, row);
+  }
+
+  destroy_padded(&padded);
+
+  // return the plane
+  lua_settop(L, 1);
+
+  return 1;
+}
+
+static bool is_kernel_size_valid(int width, int height) {
+  return width > 0 && height > 0 && width <= MAX_KERNEL_SIZE &&
+         height <= MAX_KERNEL_SIZE;
+}
+
+// reads a kernel given either as a plane or as a list of rows
+static int *get_kernel(lua_State *L, int index, int *width, int *height) {
+  if (is_plane(L, index)) {
+    plane_t *plane = get_plane(L, index);
+    if (plane == NULL) {
+      return NULL;
+    }
+
+    *width = plane->width;
+    *height = plane->height;
+    if (!is_kernel_size_valid(*width, *height)) {
+      return NULL;
+    }
+
+    size_t length = (size_t)plane->width * (size_t)plane->height;
+    int *kernel = malloc(sizeof(int) * length);
+    if (kernel != NULL) {
+      read_plane_values(plane, 0, length, kernel);
+    }
+
+    return kernel;
+  }
+
+  *height = (int)lua_objlen(L, index);
+  *width = 0;
+  for (int y = 1; y <= *height; ++y) {
+    lua_rawgeti(L, index, y);
+    int length = lua_istable(L, -1) ? (int)lua_objlen(L, -1) : 0;
+    *width = length > *width ? length : *width;
+    lua_pop(L, 1);
+  }
+
+  if (!is_kernel_size_valid(*width, *height)) {
+    return NULL;
+  }
+
+  // missing elements in shorter rows are zero
+  int *kernel = calloc((size_t)*width * (size_t)*height, sizeof(int));
+  if (kernel == NULL) {
+    return NULL;
+  }
+
+  for (int y = 0; y < *height; ++y) {
+    lua_rawgeti(L, index, y + 1);
+    int length = lua_istable(L, -1) ? (int)lua_objlen(L, -1) : 0;
+    for (int x = 0; x < length; ++x) {
+      lua_rawgeti(L, -1, x + 1);
+      kernel[y * *width + x] = (int)lua_tointeger(L, -1);
+      lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+  }
+
+  return kernel;
+}
+
+// plane:convolve({{ 1, 2, 1 }, { 2, 4, 2 }, { 1, 2, 1 }} [, { divisor = 16,
+//                bias = 0, edges = "clamp"|"wrap"|"zero", steps = 1 }])
+static int plane_convolve(lua_State *L) {
+  lua_settop(L, 3);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  luaL_checktype(L, 2, LUA_TTABLE);
+
+  // options are read first, since invalid ones raise errors
+  convolution_t convolution = {0};
+  convolution.divisor = get_int_option(L, 3, FIELD_FILTER_DIVISOR, 1);
+  convolution.bias = get_int_option(L, 3, FIELD_FILTER_BIAS, 0);
+  edge_mode_t edges =
+      (edge_mode_t)get_enum_option(L, 3, FIELD_FILTER_EDGES, edge_mode_names);
+  int steps = get_int_option(L, 3, FIELD_FILTER_STEPS, 1);
+
+  if (convolution.divisor == 0) {
+    LOG_SCRIPT_ERROR(L, "The kernel divisor can't be zero");
+    return 0;
+  }
+
+  int *kernel = get_kernel(L, 2, &convolution.kernel_width,
+                           &convolution.kernel_height);
+  if (kernel == NULL) {
+    LOG_SCRIPT_ERROR(L, "Invalid kernel; expected a plane or a list of rows "
+                        "of at most %d elements",
+                     MAX_KERNEL_SIZE);
+    return 0;
+  }
+
+  if (convolution.kernel_width % 2 == 0 ||
+      convolution.kernel_height % 2 == 0) {
+    LOG_SCRIPT_ERROR(L, "Kernel dimensions must be odd (%dx%d)",
+                     convolution.kernel_width, convolution.kernel_height);
+    free(kernel);
+    return 0;
+  }
+
+  convolution.kernel = kernel;
+
+  padded_t padded;
+  if (!create_padded(&padded, plane, convolution.kernel_width / 2,
+                     convolution.kernel_height / 2)) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate convolution buffers");
+    destroy_padded(&padded);
+    free(kernel);
+    return 0;
+  }
+
+  for (int y = 0; y < plane->height; ++y) {
+    read_plane_values(plane, (size_t)y * plane->width, plane->width,
+                      padded_row(&padded, 0, y));
+  }
+
+  convolution.padded = &padded;
+  run_filter(&padded, steps, edges, convolve_rows, &convolution);
+
+  for (int y = 0; y < plane->height; ++y) {
+    write_plane_values(plane, (size_t)y * plane->width, plane->width,
+                       padded_row(&padded, padded.current, y));
+  }
+
+  destroy_padded(&padded);
+  free(kernel);
+
+  // return the plane
+  lua_settop(L, 1);
+
+  return 1;
+}
+
+void add_plane_filters(lua_State *L, int index) {
+  lua_pushcfunction(L, plane_step_automaton);
+  lua_setfield(L, index, FUNC_PLANE_STEP_AUTOMATON);
+
+  lua_pushcfunction(L, plane_convolve);
+  lua_setfield(L, index, FUNC_PLANE_CONVOLVE);
+}
@@ -0,0 +1,377 @@
+#include <lauxlib.h>
+#include <log.h>
+#include <lua.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "script/environment.h"
+#include "script/parallel.h"
+#include "script/plane.h"
+
+#define FUNC_PLANE_FOV "fov"
+#define FUNC_PLANE_LIGHT_MAP "light_map"
+
+// lights are split between threads in groups of at least this many, since
+// each thread needs its own buffers the size of the plane
+#define LIGHT_MIN_SOURCES 4
+#define LIGHT_MAX_BANDS 16
+#define LIGHT_MIN_ROWS 16
+
+typedef struct light_t {
+  int x, y, radius, intensity;
+} light_t;
+
+// The state of a single shadowcasting pass.  Without `stamps`, visible cells
+// are set to 1 in `out`; with them, the light's brightness at each visible
+// cell is added to `out` instead, and `stamps` ensures that cells on the
+// boundaries between octants are only lit once per light.
+typedef struct fov_t {
+  const plane_t *map;
+  int width, height;
+  int opaque;
+  int origin_x, origin_y, radius;
+  int *out;
+  unsigned *stamps;
+  unsigned stamp;
+  int intensity;
+} fov_t;
+
+typedef struct light_map_t {
+  const plane_t *map;
+  int opaque;
+  const light_t *lights;
+  int light_count;
+  int bands;
+  int **partials;
+  unsigned **stamps;
+  int *out;
+} light_map_t;
+
+// transforms from octant-relative coordinates to plane coordinates
+static const int octants[8][4] = {
+    {1, 0, 0, 1},  {0, 1, 1, 0},  {0, -1, 1, 0}, {-1, 0, 0, 1},
+    {-1, 0, 0, -1}, {0, -1, -1, 0}, {0, 1, -1, 0}, {1, 0, 0, -1},
+};
+
+static inline bool is_opaque(const fov_t *fov, int x, int y) {
+  // nothing can be seen beyond the edges of the plane
+  return x < 0 || x >= fov->width || y < 0 || y >= fov->height ||
+         get_plane_value(fov->map, (size_t)y * fov->width + x) == fov->opaque;
+}
+
+static inline void light_cell(fov_t *fov, int x, int y, int dx, int dy) {
+  if (x < 0 || x >= fov->width || y < 0 || y >= fov->height) {
+    return;
+  }
+
+  size_t index = (size_t)y * fov->width + x;
+  if (fov->stamps == NULL) {
+    fov->out[index] = 1;
+    return;
+  }
+
+  if (fov->stamps[index] == fov->stamp) {
+    return;
+  }
+  fov->stamps[index] = fov->stamp;
+
+  // brightness falls off linearly, reaching zero just past the radius
+  double distance = sqrt((double)(dx * dx + dy * dy));
+  int amount =
+      (int)floor(fov->intensity * (1.0 - distance / (fov->radius + 1)) + 0.5);
+  fov->out[index] = (int)((unsigned)fov->out[index] + (unsigned)amount);
+}
+
+// Scans one octant outward from `row`, between the slopes `start` and `end`,
+// recursing to scan the parts of the next rows that aren't hidden whenever an
+// opaque cell splits the visible span.
+static void cast_light(fov_t *fov, int row, double start, double end,
+                       const int *octant) {
+  if (start < end) {
+    return;
+  }
+
+  int radius_squared = fov->radius * fov->radius;
+  double next_start = start;
+  for (int distance = row; distance <= fov->radius; ++distance) {
+    bool blocked = false;
+    int dy = -distance;
+    for (int dx = -distance; dx <= 0; ++dx) {
+      double left_slope = (dx - 0.5) / (dy + 0.5);
+      double right_slope = (dx + 0.5) / (dy - 0.5);
+      if (start < right_slope) {
+        continue;
+      }
+
+      if (end > left_slope) {
+        break;
+      }
+
+      int x = fov->origin_x + dx * octant[0] + dy * octant[1];
+      int y = fov->origin_y + dx * octant[2] + dy * octant[3];
+      if (dx * dx + dy * dy <= radius_squared) {
+        light_cell(fov, x, y, dx, dy);
+      }
+
+      bool opaque = is_opaque(fov, x, y);
+      if (blocked) {
+        if (opaque) {
+          next_start = right_slope;
+        } else {
+          blocked = false;
+          start = next_start;
+        }
+      } else if (opaque && distance < fov->radius) {
+        blocked = true;
+        cast_light(fov, distance + 1, start, left_slope, octant);
+        next_start = right_slope;
+      }
+    }
+
+    if (blocked) {
+      break;
+    }
+  }
+}
+
+static void compute_fov(fov_t *fov) {
+  light_cell(fov, fov->origin_x, fov->origin_y, 0, 0);
+  for (int i = 0; i < 8; ++i) {
+    cast_light(fov, 1, 1.0, 0.0, octants[i]);
+  }
+}
+
+static bool check_output_plane(lua_State *L, const plane_t *map,
+                               const plane_t *out) {
+  if (out->width != map->width || out->height != map->height) {
+    LOG_SCRIPT_ERROR(L, "The output plane must be the same size (%dx%d)",
+                     map->width, map->height);
+    return false;
+  }
+
+  if (out->buffer == map->buffer) {
+    LOG_SCRIPT_ERROR(L, "The output plane must not be the plane being read");
+    return false;
+  }
+
+  return true;
+}
+
+// out = plane:fov(x, y, radius, opaque_value [, out])
+static int plane_fov(lua_State *L) {
+  lua_settop(L, 6);
+
+  plane_t *map = get_plane(L, 1);
+  if (map == NULL) {
+    return 0;
+  }
+
+  fov_t fov = {.map = map,
+               .width = map->width,
+               .height = map->height,
+               .origin_x = (int)luaL_checkinteger(L, 2),
+               .origin_y = (int)luaL_checkinteger(L, 3),
+               .radius = (int)luaL_checkinteger(L, 4),
+               .opaque = (int)luaL_checkinteger(L, 5)};
+
+  plane_t *out = NULL;
+  if (lua_isnil(L, 6)) {
+    out = push_new_plane(map->width, map->height, NULL, L);
+  } else {
+    out = get_plane(L, 6);
+    lua_pushvalue(L, 6);
+  }
+
+  if (out == NULL || !check_output_plane(L, map, out)) {
+    return 0;
+  }
+
+  fov.out = acquire_plane_ints(L, out);
+  if (fov.out == NULL) {
+    return 0;
+  }
+
+  memset(fov.out, 0, sizeof(int) * (size_t)map->width * (size_t)map->height);
+  if (fov.radius >= 0 && fov.origin_x >= 0 && fov.origin_x < fov.width &&
+      fov.origin_y >= 0 && fov.origin_y < fov.height) {
+    compute_fov(&fov);
+  }
+
+  release_plane_ints(out, fov.out, true);
+
+  return 1;
+}
+
+static void light_sources(void *context, int first, int last) {
+  light_map_t *light_map = (light_map_t *)context;
+
+  for (int band = first; band < last; ++band) {
+    fov_t fov = {.map = light_map->map,
+                 .width = light_map->map->width,
+                 .height = light_map->map->height,
+                 .opaque = light_map->opaque,
+                 .out = light_map->partials[band],
+                 .stamps = light_map->stamps[band]};
+
+    int begin = (int)((long long)light_map->light_count * band /
+                      light_map->bands);
+    int end = (int)((long long)light_map->light_count * (band + 1) /
+                    light_map->bands);
+    for (int i = begin; i < end; ++i) {
+      const light_t *light = &light_map->lights[i];
+      if (light->radius < 0 || light->x < 0 || light->x >= fov.width ||
+          light->y < 0 || light->y >= fov.height) {
+        continue;
+      }
+
+      // every light in the band has its own stamp, starting at 1
+      fov.stamp = (unsigned)(i - begin) + 1;
+      fov.origin_x = light->x;
+      fov.origin_y = light->y;
+      fov.radius = light->radius;
+      fov.intensity = light->intensity;
+      compute_fov(&fov);
+    }
+  }
+}
+
+static void merge_light_rows(void *context, int first, int last) {
+  light_map_t *light_map = (light_map_t *)context;
+
+  size_t begin = (size_t)first * light_map->map->width;
+  size_t end = (size_t)last * light_map->map->width;
+  int *restrict out = light_map->out;
+  for (int band = 1; band < light_map->bands; ++band) {
+    const int *restrict partial = light_map->partials[band];
+    for (size_t i = begin; i < end; ++i) {
+      out[i] = (int)((unsigned)out[i] + (unsigned)partial[i]);
+    }
+  }
+}
+
+static bool read_lights(lua_State *L, int index, light_t **lights,
+                        int *count) {
+  *count = (int)lua_objlen(L, index);
+  *lights = malloc(sizeof(light_t) * (*count > 0 ? *count : 1));
+  if (*lights == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate lights");
+    return false;
+  }
+
+  for (int i = 0; i < *count; ++i) {
+    lua_rawgeti(L, index, i + 1);
+    if (!lua_istable(L, -1)) {
+      LOG_SCRIPT_ERROR(L, "Light %d must be a table of {x, y, radius}", i + 1);
+      lua_pop(L, 1);
+      return false;
+    }
+
+    lua_rawgeti(L, -1, 1);
+    lua_rawgeti(L, -2, 2);
+    lua_rawgeti(L, -3, 3);
+    lua_rawgeti(L, -4, 4);
+
+    light_t *light = &(*lights)[i];
+    light->x = (int)lua_tointeger(L, -4);
+    light->y = (int)lua_tointeger(L, -3);
+    light->radius = (int)lua_tointeger(L, -2);
+
+    // by default, brightness drops by one with each cell from the light
+    light->intensity = lua_isnumber(L, -1) ? (int)lua_tointeger(L, -1)
+                                           : light->radius + 1;
+
+    lua_pop(L, 5);
+  }
+
+  return true;
+}
+
+// out = plane:light_map({{x, y, radius [, intensity]}, ...}, opaque_value
+//                       [, out])
+static int plane_light_map(lua_State *L) {
+  lua_settop(L, 4);
+
+  plane_t *map = get_plane(L, 1);
+  if (map == NULL) {
+    return 0;
+  }
+
+  luaL_checktype(L, 2, LUA_TTABLE);
+  int opaque = (int)luaL_checkinteger(L, 3);
+
+  plane_t *out = NULL;
+  if (lua_isnil(L, 4)) {
+    out = push_new_plane(map->width, map->height, NULL, L);
+  } else {
+    out = get_plane(L, 4);
+    lua_pushvalue(L, 4);
+  }
+
+  if (out == NULL || !check_output_plane(L, map, out)) {
+    return 0;
+  }
+
+  light_t *lights = NULL;
+  int light_count = 0;
+  if (!read_lights(L, 2, &lights, &light_count)) {
+    free(lights);
+    return 0;
+  }
+
+  int *out_buffer = acquire_plane_ints(L, out);
+  if (out_buffer == NULL) {
+    free(lights);
+    return 0;
+  }
+
+  size_t length = (size_t)map->width * (size_t)map->height;
+  memset(out_buffer, 0, sizeof(int) * length);
+
+  // each band of lights is accumulated separately and then summed, with the
+  // first band going straight into the output plane
+  int bands = (light_count + LIGHT_MIN_SOURCES - 1) / LIGHT_MIN_SOURCES;
+  int max_bands = get_parallel_thread_count();
+  max_bands = max_bands > LIGHT_MAX_BANDS ? LIGHT_MAX_BANDS : max_bands;
+  bands = bands > max_bands ? max_bands : (bands < 1 ? 1 : bands);
+
+  int *partials[LIGHT_MAX_BANDS];
+  unsigned *stamps[LIGHT_MAX_BANDS];
+  bool allocated = true;
+  for (int i = 0; i < bands; ++i) {
+    partials[i] = i == 0 ? out_buffer : calloc(length, sizeof(int));
+    stamps[i] = calloc(length, sizeof(unsigned));
+    allocated = allocated && partials[i] != NULL && stamps[i] != NULL;
+  }
+
+  if (allocated) {
+    light_map_t light_map = {map,   opaque,   lights, light_count,
+                             bands, partials, stamps, out_buffer};
+    parallel_for_rows(bands, 1, light_sources, &light_map);
+    if (bands > 1) {
+      parallel_for_rows(map->height, LIGHT_MIN_ROWS, merge_light_rows,
+                        &light_map);
+    }
+  } else {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate light map buffers");
+  }
+
+  for (int i = 0; i < bands; ++i) {
+    if (i > 0) {
+      free(partials[i]);
+    }
+    free(stamps[i]);
+  }
+  free(lights);
+  release_plane_ints(out, out_buffer, allocated);
+
+  return allocated ? 1 : 0;
+}
+
+void add_plane_fov(lua_State *L, int index) {
+  lua_pushcfunction(L, plane_fov);
+  lua_setfield(L, index, FUNC_PLANE_FOV);
+
+  lua_pushcfunction(L, plane_light_map);
+  lua_setfield(L, index, FUNC_PLANE_LIGHT_MAP);
+}
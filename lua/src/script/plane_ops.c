@@ -0,0 +1,765 @@
+#include <lauxlib.h>
+#include <limits.h>
+#include <log.h>
+#include <lua.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "script/environment.h"
+#include "script/plane.h"
+
+#define FUNC_PLANE_ADD "add"
+#define FUNC_PLANE_SUBTRACT "subtract"
+#define FUNC_PLANE_MUL "mul"
+#define FUNC_PLANE_CLAMP "clamp"
+#define FUNC_PLANE_THRESHOLD "threshold"
+#define FUNC_PLANE_REMAP "remap"
+#define FUNC_PLANE_SELECT "select"
+#define FUNC_PLANE_MIN "min"
+#define FUNC_PLANE_MAX "max"
+#define FUNC_PLANE_SUM "sum"
+#define FUNC_PLANE_HISTOGRAM "histogram"
+#define FUNC_PLANE_BLIT "blit"
+#define FIELD_BLIT_MODE "mode"
+#define FIELD_BLIT_TRANSPARENT "transparent"
+#define FIELD_BLIT_MASK "mask"
+
+// lookup tables are stored densely, so limit the range of keys they can have
+#define PLANE_LUT_MAX_RANGE 65536
+
+// histograms of planes with a wider range of values than this are counted by
+// sorting a copy of the plane rather than with a table of counters
+#define HISTOGRAM_MAX_DENSE_RANGE (1 << 20)
+
+static const char *const blit_mode_names[] = {"copy", "max", "min",
+                                              "add",  "xor", NULL};
+
+typedef void (*scalar_op_t)(int *restrict, size_t, int);
+typedef void (*plane_op_t)(int *restrict, const int *restrict, size_t);
+
+// these kernels are kept branch-free so that the compiler can vectorize them;
+// arithmetic is done on unsigned values so that overflow wraps around
+#define DEFINE_ARITHMETIC_OP(name, op)                                    \
+  static void name##_by_scalar(int *restrict buffer, size_t length,       \
+                               int value) {                               \
+    for (size_t i = 0; i < length; ++i) {                                 \
+      buffer[i] = (int)((unsigned)buffer[i] op (unsigned)value);          \
+    }                                                                     \
+  }                                                                       \
+  static void name##_by_plane(int *restrict buffer,                       \
+                              const int *restrict other, size_t length) { \
+    for (size_t i = 0; i < length; ++i) {                                 \
+      buffer[i] = (int)((unsigned)buffer[i] op (unsigned)other[i]);       \
+    }                                                                     \
+  }
+
+DEFINE_ARITHMETIC_OP(add, +)
+DEFINE_ARITHMETIC_OP(subtract, -)
+DEFINE_ARITHMETIC_OP(mul, *)
+
+static void select_scalar(int *restrict buffer, const int *restrict mask,
+                          size_t length, int value) {
+  for (size_t i = 0; i < length; ++i) {
+    buffer[i] = mask[i] != 0 ? value : buffer[i];
+  }
+}
+
+static void select_plane(int *restrict buffer, const int *restrict mask,
+                         const int *restrict other, size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    buffer[i] = mask[i] != 0 ? other[i] : buffer[i];
+  }
+}
+
+// combines a row of source cells onto a row of destination cells, leaving any
+// that are masked out or transparent as they were
+#define BLIT_ROW(expr)                                  \
+  for (size_t i = 0; i < length; ++i) {                 \
+    int s = src[i];                                     \
+    int d = dest[i];                                    \
+    bool keep = (mask == NULL || mask[i] != 0) &&       \
+                (!has_transparent || s != transparent); \
+    dest[i] = keep ? (expr) : d;                        \
+  }
+
+void blit_row(int *restrict dest, const int *restrict src,
+              const int *restrict mask, size_t length,
+              const blit_options_t *options) {
+  bool has_transparent = options->has_transparent;
+  int transparent = options->transparent;
+  switch (options->mode) {
+    case BLIT_MAX:
+      BLIT_ROW(s > d ? s : d);
+      break;
+    case BLIT_MIN:
+      BLIT_ROW(s < d ? s : d);
+      break;
+    case BLIT_ADD:
+      BLIT_ROW((int)((unsigned)s + (unsigned)d));
+      break;
+    case BLIT_XOR:
+      BLIT_ROW(s ^ d);
+      break;
+    default:
+      BLIT_ROW(s);
+      break;
+  }
+}
+
+bool plane_lut_find(const plane_lut_t *lut, int key, int *value) {
+  int index = key - lut->min;
+  if (index < 0 || index >= lut->length || !lut->present[index]) {
+    return false;
+  }
+
+  *value = lut->values[index];
+  return true;
+}
+
+bool read_plane_lut(lua_State *L, int index, plane_lut_value_fn get_value,
+                    plane_lut_t *lut) {
+  memset(lut, 0, sizeof(plane_lut_t));
+
+  // find the range of keys first so that the table can be stored densely
+  int min = INT_MAX;
+  int max = INT_MIN;
+  lua_pushnil(L);
+  while (lua_next(L, index) != 0) {
+    if (lua_type(L, -2) != LUA_TNUMBER) {
+      LOG_SCRIPT_ERROR(L, "Plane lookup table keys must be integers");
+      lua_pop(L, 2);
+      return false;
+    }
+
+    int key = (int)lua_tointeger(L, -2);
+    min = key < min ? key : min;
+    max = key > max ? key : max;
+    lua_pop(L, 1);
+  }
+
+  if (min > max) {
+    // the table is empty, so nothing will be looked up
+    return true;
+  }
+
+  if ((long long)max - min >= PLANE_LUT_MAX_RANGE) {
+    LOG_SCRIPT_ERROR(L, "Plane lookup table keys span too wide a range (%d)",
+                     PLANE_LUT_MAX_RANGE);
+    return false;
+  }
+
+  lut->min = min;
+  lut->length = max - min + 1;
+  lut->values = malloc(sizeof(int) * lut->length);
+  lut->present = calloc(lut->length, sizeof(bool));
+  if (lut->values == NULL || lut->present == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate a plane lookup table");
+    return false;
+  }
+
+  lua_pushnil(L);
+  while (lua_next(L, index) != 0) {
+    int key = (int)lua_tointeger(L, -2) - min;
+    lut->present[key] = get_value(L, lua_gettop(L), &lut->values[key]);
+    lua_pop(L, 1);
+  }
+
+  return true;
+}
+
+void free_plane_lut(plane_lut_t *lut) {
+  free(lut->values);
+  free(lut->present);
+  memset(lut, 0, sizeof(plane_lut_t));
+}
+
+static plane_t *get_operand_plane(lua_State *L, int index,
+                                  const plane_t *plane) {
+  plane_t *other = get_plane(L, index);
+  if (other != NULL &&
+      (other->width != plane->width || other->height != plane->height)) {
+    LOG_SCRIPT_ERROR(L, "Plane sizes differ (%dx%d and %dx%d)", plane->width,
+                     plane->height, other->width, other->height);
+    return NULL;
+  }
+
+  return other;
+}
+
+// the kernels assume that their buffers don't alias, so an operand sharing
+// elements with the plane being modified is copied first
+static int *acquire_operand_ints(lua_State *L, const plane_t *operand,
+                                 const plane_t *plane) {
+  if (planes_overlap(operand, plane)) {
+    return copy_plane_ints(L, operand);
+  }
+
+  return acquire_plane_ints(L, operand);
+}
+
+static int apply_arithmetic(lua_State *L, scalar_op_t scalar_op,
+                            plane_op_t plane_op) {
+  lua_settop(L, 2);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  plane_t *other = NULL;
+  if (is_plane(L, 2)) {
+    other = get_operand_plane(L, 2, plane);
+    if (other == NULL) {
+      return 0;
+    }
+  } else if (!lua_isnumber(L, 2)) {
+    LOG_SCRIPT_ERROR(L, "Expected a number or a plane");
+    return 0;
+  }
+
+  int *buffer = acquire_plane_ints(L, plane);
+  if (buffer == NULL) {
+    return 0;
+  }
+
+  size_t length = (size_t)plane->width * (size_t)plane->height;
+  if (other == NULL) {
+    scalar_op(buffer, length, (int)lua_tointeger(L, 2));
+  } else {
+    int *other_buffer = acquire_operand_ints(L, other, plane);
+    if (other_buffer != NULL) {
+      plane_op(buffer, other_buffer, length);
+      release_plane_ints(other, other_buffer, false);
+    }
+  }
+
+  release_plane_ints(plane, buffer, true);
+
+  // return the plane
+  lua_settop(L, 1);
+
+  return 1;
+}
+
+// plane:add(n), plane:add(other)
+static int plane_add(lua_State *L) {
+  return apply_arithmetic(L, add_by_scalar, add_by_plane);
+}
+
+// plane:subtract(n), plane:subtract(other)
+static int plane_subtract(lua_State *L) {
+  return apply_arithmetic(L, subtract_by_scalar, subtract_by_plane);
+}
+
+// plane:mul(n), plane:mul(other)
+static int plane_mul(lua_State *L) {
+  return apply_arithmetic(L, mul_by_scalar, mul_by_plane);
+}
+
+// plane:clamp(min, max)
+static int plane_clamp(lua_State *L) {
+  lua_settop(L, 3);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  int min = (int)luaL_checkinteger(L, 2);
+  int max = (int)luaL_checkinteger(L, 3);
+
+  int *restrict buffer = acquire_plane_ints(L, plane);
+  if (buffer == NULL) {
+    return 0;
+  }
+
+  size_t length = (size_t)plane->width * (size_t)plane->height;
+  for (size_t i = 0; i < length; ++i) {
+    int value = buffer[i] < min ? min : buffer[i];
+    buffer[i] = value > max ? max : value;
+  }
+
+  release_plane_ints(plane, buffer, true);
+
+  lua_settop(L, 1);
+
+  return 1;
+}
+
+// plane:threshold(n [, below [, above]])
+static int plane_threshold(lua_State *L) {
+  lua_settop(L, 4);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  int threshold = (int)luaL_checkinteger(L, 2);
+  int below = (int)luaL_optinteger(L, 3, 0);
+  int above = (int)luaL_optinteger(L, 4, 1);
+
+  int *restrict buffer = acquire_plane_ints(L, plane);
+  if (buffer == NULL) {
+    return 0;
+  }
+
+  size_t length = (size_t)plane->width * (size_t)plane->height;
+  for (size_t i = 0; i < length; ++i) {
+    buffer[i] = buffer[i] >= threshold ? above : below;
+  }
+
+  release_plane_ints(plane, buffer, true);
+
+  lua_settop(L, 1);
+
+  return 1;
+}
+
+static bool get_integer_value(lua_State *L, int index, int *value) {
+  if (lua_type(L, index) != LUA_TNUMBER) {
+    return false;
+  }
+
+  *value = (int)lua_tointeger(L, index);
+  return true;
+}
+
+// plane:remap({[from] = to, ...})
+static int plane_remap(lua_State *L) {
+  lua_settop(L, 2);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  luaL_checktype(L, 2, LUA_TTABLE);
+
+  plane_lut_t lut;
+  if (!read_plane_lut(L, 2, get_integer_value, &lut)) {
+    free_plane_lut(&lut);
+    return 0;
+  }
+
+  int *buffer = acquire_plane_ints(L, plane);
+  if (buffer == NULL) {
+    free_plane_lut(&lut);
+    return 0;
+  }
+
+  // values without an entry in the table are left as they are
+  size_t length = (size_t)plane->width * (size_t)plane->height;
+  for (size_t i = 0; i < length; ++i) {
+    unsigned index = (unsigned)buffer[i] - (unsigned)lut.min;
+    if (index < (unsigned)lut.length && lut.present[index]) {
+      buffer[i] = lut.values[index];
+    }
+  }
+
+  release_plane_ints(plane, buffer, true);
+  free_plane_lut(&lut);
+
+  lua_settop(L, 1);
+
+  return 1;
+}
+
+// plane:select(mask, n), plane:select(mask, other)
+static int plane_select(lua_State *L) {
+  lua_settop(L, 3);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  plane_t *mask = get_operand_plane(L, 2, plane);
+  if (mask == NULL) {
+    return 0;
+  }
+
+  size_t length = (size_t)plane->width * (size_t)plane->height;
+
+  plane_t *other = NULL;
+  if (is_plane(L, 3)) {
+    other = get_operand_plane(L, 3, plane);
+    if (other == NULL) {
+      return 0;
+    }
+  } else if (!lua_isnumber(L, 3)) {
+    LOG_SCRIPT_ERROR(L, "Expected a number or a plane");
+    return 0;
+  }
+
+  if (other == plane) {
+    // selecting cells from the plane itself leaves it unchanged
+    lua_settop(L, 1);
+    return 1;
+  }
+
+  int *buffer = acquire_plane_ints(L, plane);
+  if (buffer == NULL) {
+    return 0;
+  }
+
+  int *mask_buffer = acquire_operand_ints(L, mask, plane);
+  int *other_buffer =
+      other == NULL ? NULL : acquire_operand_ints(L, other, plane);
+  if (mask_buffer != NULL && other != NULL && other_buffer != NULL) {
+    select_plane(buffer, mask_buffer, other_buffer, length);
+  } else if (mask_buffer != NULL && other == NULL) {
+    select_scalar(buffer, mask_buffer, length, (int)lua_tointeger(L, 3));
+  }
+
+  release_plane_ints(mask, mask_buffer, false);
+
+  if (other != NULL) {
+    release_plane_ints(other, other_buffer, false);
+  }
+
+  release_plane_ints(plane, buffer, true);
+
+  lua_settop(L, 1);
+
+  return 1;
+}
+
+static int reduce_extreme(lua_State *L, bool maximum) {
+  lua_settop(L, 1);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  int *restrict buffer = acquire_plane_ints(L, plane);
+  if (buffer == NULL) {
+    return 0;
+  }
+
+  size_t length = (size_t)plane->width * (size_t)plane->height;
+  int result = buffer[0];
+  if (maximum) {
+    for (size_t i = 1; i < length; ++i) {
+      result = buffer[i] > result ? buffer[i] : result;
+    }
+  } else {
+    for (size_t i = 1; i < length; ++i) {
+      result = buffer[i] < result ? buffer[i] : result;
+    }
+  }
+
+  release_plane_ints(plane, buffer, false);
+  lua_pushinteger(L, result);
+
+  return 1;
+}
+
+// plane:min()
+static int plane_min(lua_State *L) { return reduce_extreme(L, false); }
+
+// plane:max()
+static int plane_max(lua_State *L) { return reduce_extreme(L, true); }
+
+// plane:sum()
+static int plane_sum(lua_State *L) {
+  lua_settop(L, 1);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  int *restrict buffer = acquire_plane_ints(L, plane);
+  if (buffer == NULL) {
+    return 0;
+  }
+
+  size_t length = (size_t)plane->width * (size_t)plane->height;
+  int64_t sum = 0;
+  for (size_t i = 0; i < length; ++i) {
+    sum += buffer[i];
+  }
+
+  release_plane_ints(plane, buffer, false);
+
+  lua_pushnumber(L, (lua_Number)sum);
+
+  return 1;
+}
+
+static int compare_ints(const void *a, const void *b) {
+  int first = *(const int *)a;
+  int second = *(const int *)b;
+  return (first > second) - (first < second);
+}
+
+// plane:histogram()
+// { [value] = count, ... }
+static int plane_histogram(lua_State *L) {
+  lua_settop(L, 1);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  int *buffer = acquire_plane_ints(L, plane);
+  if (buffer == NULL) {
+    return 0;
+  }
+
+  size_t length = (size_t)plane->width * (size_t)plane->height;
+
+  int min = buffer[0];
+  int max = buffer[0];
+  for (size_t i = 1; i < length; ++i) {
+    min = buffer[i] < min ? buffer[i] : min;
+    max = buffer[i] > max ? buffer[i] : max;
+  }
+
+  lua_newtable(L);
+
+  if ((long long)max - min < HISTOGRAM_MAX_DENSE_RANGE) {
+    size_t range = (size_t)((long long)max - min + 1);
+    unsigned *counts = calloc(range, sizeof(unsigned));
+    if (counts == NULL) {
+      LOG_SCRIPT_ERROR(L, "Failed to allocate histogram counters");
+      release_plane_ints(plane, buffer, false);
+      return 0;
+    }
+
+    for (size_t i = 0; i < length; ++i) {
+      ++counts[buffer[i] - min];
+    }
+
+    for (size_t i = 0; i < range; ++i) {
+      if (counts[i] > 0) {
+        lua_pushinteger(L, (lua_Integer)counts[i]);
+        lua_rawseti(L, -2, (int)(min + (long long)i));
+      }
+    }
+
+    free(counts);
+  } else {
+    int *sorted = malloc(sizeof(int) * length);
+    if (sorted == NULL) {
+      LOG_SCRIPT_ERROR(L, "Failed to allocate a copy of the plane");
+      release_plane_ints(plane, buffer, false);
+      return 0;
+    }
+
+    memcpy(sorted, buffer, sizeof(int) * length);
+    qsort(sorted, length, sizeof(int), compare_ints);
+
+    size_t start = 0;
+    for (size_t i = 1; i <= length; ++i) {
+      if (i == length || sorted[i] != sorted[start]) {
+        lua_pushinteger(L, (lua_Integer)(i - start));
+        lua_rawseti(L, -2, sorted[start]);
+        start = i;
+      }
+    }
+
+    free(sorted);
+  }
+
+  release_plane_ints(plane, buffer, false);
+
+  return 1;
+}
+
+bool get_blit_options(lua_State *L, int index, const plane_t *src,
+                      blit_options_t *options) {
+  options->mode = BLIT_COPY;
+  options->has_transparent = false;
+  options->transparent = 0;
+  options->mask = NULL;
+  if (!lua_istable(L, index)) {
+    return true;
+  }
+
+  lua_getfield(L, index, FIELD_BLIT_MODE);
+  options->mode = (blit_mode_t)luaL_checkoption(
+      L, -1, blit_mode_names[BLIT_COPY], blit_mode_names);
+
+  lua_getfield(L, index, FIELD_BLIT_TRANSPARENT);
+  options->has_transparent = lua_isnumber(L, -1);
+  options->transparent = (int)lua_tointeger(L, -1);
+
+  lua_getfield(L, index, FIELD_BLIT_MASK);
+  if (!lua_isnil(L, -1)) {
+    options->mask = get_operand_plane(L, lua_gettop(L), src);
+    if (options->mask == NULL) {
+      lua_pop(L, 3);
+      return false;
+    }
+  }
+
+  lua_pop(L, 3);
+
+  return true;
+}
+
+// replaces `*plane` with a contiguous copy of its elements, returning the
+// copy's buffer
+static void *copy_blit_operand(lua_State *L, plane_t **plane, plane_t *copy) {
+  size_t length = (size_t)(*plane)->width * (size_t)(*plane)->height;
+  void *data = malloc(get_plane_buffer_size((*plane)->type, length));
+  if (data == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate a copy of the plane");
+    return NULL;
+  }
+
+  *copy = **plane;
+  copy->data = data;
+  copy->offset = 0;
+  copy->stride = copy->width;
+  copy_plane_elements(copy, *plane);
+  *plane = copy;
+
+  return data;
+}
+
+// plane:blit(x, y, src [, { mode = "copy"|"max"|"min"|"add"|"xor",
+//                            transparent = n, mask = plane }])
+static int plane_blit(lua_State *L) {
+  lua_settop(L, 5);
+
+  int offset_x = luaL_checkinteger(L, 2);
+  int offset_y = luaL_checkinteger(L, 3);
+
+  plane_t *dest = get_plane(L, 1);
+  if (dest == NULL) {
+    LOG_SCRIPT_ERROR(L, "Invalid destination plane");
+    return 0;
+  }
+
+  plane_t *src = get_plane(L, 4);
+  if (src == NULL) {
+    LOG_SCRIPT_ERROR(L, "Invalid source plane");
+    return 0;
+  }
+
+  blit_options_t options;
+  if (!get_blit_options(L, 5, src, &options)) {
+    return 0;
+  }
+
+  plane_t *mask = options.mask;
+
+  // clip the source to the destination's bounds
+  int first_x = offset_x < 0 ? -offset_x : 0;
+  int first_y = offset_y < 0 ? -offset_y : 0;
+  int last_x = dest->width - offset_x;
+  int last_y = dest->height - offset_y;
+  last_x = last_x > src->width ? src->width : last_x;
+  last_y = last_y > src->height ? src->height : last_y;
+
+  if (first_x >= last_x || first_y >= last_y) {
+    lua_settop(L, 1);
+    return 1;
+  }
+
+  // rows are copied forwards, so blitting a plane onto itself (or masking
+  // it with itself, or with a view sharing its elements) needs a copy
+  plane_t src_copy, mask_copy;
+  void *copies[2] = {NULL, NULL};
+  if (src->data == dest->data) {
+    copies[0] = copy_blit_operand(L, &src, &src_copy);
+  }
+
+  if (mask != NULL && mask->data == dest->data) {
+    copies[1] = copy_blit_operand(L, &mask, &mask_copy);
+  }
+
+  if ((src == &src_copy && copies[0] == NULL) ||
+      (mask == &mask_copy && copies[1] == NULL)) {
+    free(copies[0]);
+    free(copies[1]);
+    return 0;
+  }
+
+  // rows of the same type can be copied directly, and rows of ints can be
+  // combined in place; anything else is widened to ints and narrowed again
+  size_t length = (size_t)(last_x - first_x);
+  bool direct_copy = options.mode == BLIT_COPY && !options.has_transparent &&
+                     mask == NULL && src->type == dest->type &&
+                     dest->type != PLANE_BIT;
+  bool widen = dest->type != PLANE_I32 || src->type != PLANE_I32 ||
+               (mask != NULL && mask->type != PLANE_I32);
+  int *rows = NULL;
+  if (!direct_copy && widen) {
+    rows = malloc(sizeof(int) * length * 3);
+    if (rows == NULL) {
+      LOG_SCRIPT_ERROR(L, "Failed to allocate blit rows");
+      free(copies[0]);
+      free(copies[1]);
+      return 0;
+    }
+  }
+
+  size_t element_size = get_plane_buffer_size(dest->type, 1);
+  for (int y = first_y; y < last_y; ++y) {
+    size_t src_offset = (size_t)y * src->width + first_x;
+    size_t dest_offset =
+        (size_t)(offset_y + y) * dest->width + offset_x + first_x;
+    if (direct_copy) {
+      memcpy((uint8_t *)dest->data +
+                 get_plane_index(dest, dest_offset) * element_size,
+             (const uint8_t *)src->data +
+                 get_plane_index(src, src_offset) * element_size,
+             element_size * length);
+    } else if (rows == NULL) {
+      const int *mask_row =
+          mask == NULL ? NULL
+                       : &mask->buffer[get_plane_index(mask, src_offset)];
+      blit_row(&dest->buffer[get_plane_index(dest, dest_offset)],
+               &src->buffer[get_plane_index(src, src_offset)], mask_row,
+               length, &options);
+    } else {
+      int *dest_row = rows;
+      int *src_row = rows + length;
+      int *mask_row = mask == NULL ? NULL : rows + 2 * length;
+      read_plane_values(dest, dest_offset, length, dest_row);
+      read_plane_values(src, src_offset, length, src_row);
+      if (mask_row != NULL) {
+        read_plane_values(mask, src_offset, length, mask_row);
+      }
+
+      blit_row(dest_row, src_row, mask_row, length, &options);
+      write_plane_values(dest, dest_offset, length, dest_row);
+    }
+  }
+
+  free(rows);
+  free(copies[0]);
+  free(copies[1]);
+
+  lua_settop(L, 1);
+
+  return 1;
+}
+
+void add_plane_ops(lua_State *L, int index) {
+  luaL_Reg methods[] = {{FUNC_PLANE_ADD, plane_add},
+                        {FUNC_PLANE_SUBTRACT, plane_subtract},
+                        {FUNC_PLANE_MUL, plane_mul},
+                        {FUNC_PLANE_CLAMP, plane_clamp},
+                        {FUNC_PLANE_THRESHOLD, plane_threshold},
+                        {FUNC_PLANE_REMAP, plane_remap},
+                        {FUNC_PLANE_SELECT, plane_select},
+                        {FUNC_PLANE_MIN, plane_min},
+                        {FUNC_PLANE_MAX, plane_max},
+                        {FUNC_PLANE_SUM, plane_sum},
+                        {FUNC_PLANE_HISTOGRAM, plane_histogram},
+                        {FUNC_PLANE_BLIT, plane_blit},
+                        {NULL, NULL}};
+
+  for (luaL_Reg *method = methods; method->name != NULL; ++method) {
+    lua_pushcfunction(L, method->func);
+    lua_setfield(L, index, method->name);
+  }
+}
@@ -0,0 +1,651 @@
+#include <lauxlib.h>
+#include <limits.h>
+#include <log.h>
+#include <lua.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "script/environment.h"
+#include "script/jobs.h"
+#include "script/plane.h"
+
+#define FUNC_PLANE_DIJKSTRA_MAP "dijkstra_map"
+#define FUNC_PLANE_ASTAR "astar"
+#define FIELD_PATH_DIAGONAL "diagonal"
+#define FIELD_PATH_DIAGONAL_COST "diagonal_cost"
+#define FIELD_PATH_UNREACHABLE "unreachable"
+#define FIELD_PATH_LIMIT "limit"
+#define FIELD_PATH_MIN_COST "min_cost"
+#define FIELD_PATH_PATH "path"
+
+#define DEFAULT_UNREACHABLE -1
+#define DEFAULT_DIAGONAL_COST 1.0
+
+typedef struct heap_node_t {
+  int priority;
+  int distance;
+  int index;
+} heap_node_t;
+
+typedef struct path_options_t {
+  bool diagonal;
+  double diagonal_cost;
+  int unreachable, limit, min_cost;
+} path_options_t;
+
+// Buffers for pathfinding, which are grown as needed.  Distances and parents
+// are only valid for cells whose stamp matches the current generation, which
+// saves clearing them between queries.
+typedef struct path_scratch_t {
+  int *distances, *parents;
+  unsigned *stamps;
+  size_t capacity;
+  unsigned generation;
+  heap_node_t *heap;
+  size_t heap_length, heap_capacity;
+} path_scratch_t;
+
+// the buffers shared by every query on the main thread, which are never
+// freed, so that repeated queries don't allocate
+static path_scratch_t shared_scratch;
+
+static const int neighbor_x[] = {1, -1, 0, 0, 1, 1, -1, -1};
+static const int neighbor_y[] = {0, 0, 1, -1, 1, -1, 1, -1};
+
+static bool reserve_scratch(path_scratch_t *scratch, size_t cells) {
+  if (cells > scratch->capacity) {
+    int *distances = realloc(scratch->distances, sizeof(int) * cells);
+    if (distances != NULL) {
+      scratch->distances = distances;
+    }
+
+    int *parents = realloc(scratch->parents, sizeof(int) * cells);
+    if (parents != NULL) {
+      scratch->parents = parents;
+    }
+
+    unsigned *stamps = realloc(scratch->stamps, sizeof(unsigned) * cells);
+    if (stamps != NULL) {
+      scratch->stamps = stamps;
+    }
+
+    if (distances == NULL || parents == NULL || stamps == NULL) {
+      return false;
+    }
+
+    // stamps in the new space must not match any generation
+    memset(&scratch->stamps[scratch->capacity], 0,
+           sizeof(unsigned) * (cells - scratch->capacity));
+    scratch->capacity = cells;
+  }
+
+  if (++scratch->generation == 0) {
+    memset(scratch->stamps, 0, sizeof(unsigned) * scratch->capacity);
+    scratch->generation = 1;
+  }
+
+  scratch->heap_length = 0;
+
+  return true;
+}
+
+static bool heap_push(path_scratch_t *scratch, int priority, int distance,
+                      int index) {
+  if (scratch->heap_length == scratch->heap_capacity) {
+    size_t capacity =
+        scratch->heap_capacity == 0 ? 1024 : scratch->heap_capacity * 2;
+    heap_node_t *heap = realloc(scratch->heap, sizeof(heap_node_t) * capacity);
+    if (heap == NULL) {
+      return false;
+    }
+
+    scratch->heap = heap;
+    scratch->heap_capacity = capacity;
+  }
+
+  heap_node_t *heap = scratch->heap;
+  size_t i = scratch->heap_length++;
+  heap_node_t node = {priority, distance, index};
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (heap[parent].priority <= priority) {
+      break;
+    }
+
+    heap[i] = heap[parent];
+    i = parent;
+  }
+  heap[i] = node;
+
+  return true;
+}
+
+static heap_node_t heap_pop(path_scratch_t *scratch) {
+  heap_node_t *heap = scratch->heap;
+  heap_node_t top = heap[0];
+  heap_node_t last = heap[--scratch->heap_length];
+
+  size_t length = scratch->heap_length;
+  size_t i = 0;
+  while (true) {
+    size_t child = i * 2 + 1;
+    if (child >= length) {
+      break;
+    }
+
+    if (child + 1 < length && heap[child + 1].priority < heap[child].priority) {
+      ++child;
+    }
+
+    if (heap[child].priority >= last.priority) {
+      break;
+    }
+
+    heap[i] = heap[child];
+    i = child;
+  }
+
+  if (length > 0) {
+    heap[i] = last;
+  }
+
+  return top;
+}
+
+static void get_path_options(lua_State *L, int index,
+                             path_options_t *options) {
+  options->diagonal = false;
+  options->diagonal_cost = DEFAULT_DIAGONAL_COST;
+  options->unreachable = DEFAULT_UNREACHABLE;
+  options->limit = INT_MAX;
+  options->min_cost = 1;
+
+  if (!lua_istable(L, index)) {
+    return;
+  }
+
+  lua_getfield(L, index, FIELD_PATH_DIAGONAL);
+  options->diagonal = lua_toboolean(L, -1);
+
+  lua_getfield(L, index, FIELD_PATH_DIAGONAL_COST);
+  options->diagonal_cost = luaL_optnumber(L, -1, DEFAULT_DIAGONAL_COST);
+
+  lua_getfield(L, index, FIELD_PATH_UNREACHABLE);
+  options->unreachable = (int)luaL_optinteger(L, -1, DEFAULT_UNREACHABLE);
+
+  lua_getfield(L, index, FIELD_PATH_LIMIT);
+  options->limit = (int)luaL_optinteger(L, -1, INT_MAX);
+
+  lua_getfield(L, index, FIELD_PATH_MIN_COST);
+  options->min_cost = (int)luaL_optinteger(L, -1, 1);
+
+  lua_pop(L, 5);
+}
+
+// the cost of stepping onto `index` in direction `direction`, or -1 if it
+// can't be entered
+static inline int get_step_cost(const plane_t *costs, int index,
+                                int direction, const path_options_t *options) {
+  int cost = costs == NULL ? 1 : get_plane_value(costs, index);
+  if (cost < 0) {
+    return -1;
+  }
+
+  return direction < 4 ? cost
+                       : (int)lround((double)cost * options->diagonal_cost);
+}
+
+// records the distance of a goal, keeping the shortest if a cell is given
+// more than once
+static void set_goal(int *buffer, int width, int height, int x, int y,
+                     int distance) {
+  if (x < 0 || x >= width || y < 0 || y >= height) {
+    return;
+  }
+
+  int index = y * width + x;
+  buffer[index] = distance < buffer[index] ? distance : buffer[index];
+}
+
+// fills `buffer` with the distance of each goal given at `index`, and
+// INT_MAX everywhere else
+static bool get_goals(lua_State *L, int index, int width, int height,
+                      int *buffer) {
+  plane_t *goals = NULL;
+  if (is_plane(L, index)) {
+    goals = get_plane(L, index);
+    if (goals == NULL || goals->width != width || goals->height != height) {
+      LOG_SCRIPT_ERROR(L, "The goal plane must be the same size (%dx%d)",
+                       width, height);
+      return false;
+    }
+  } else {
+    luaL_checktype(L, index, LUA_TTABLE);
+  }
+
+  size_t length = (size_t)width * (size_t)height;
+  for (size_t i = 0; i < length; ++i) {
+    buffer[i] = INT_MAX;
+  }
+
+  if (goals != NULL) {
+    for (size_t i = 0; i < length; ++i) {
+      if (get_plane_value(goals, i) != 0) {
+        buffer[i] = 0;
+      }
+    }
+  } else {
+    int count = (int)lua_objlen(L, index);
+    for (int i = 1; i <= count; ++i) {
+      lua_rawgeti(L, index, i);
+      lua_rawgeti(L, -1, 1);
+      lua_rawgeti(L, -2, 2);
+      lua_rawgeti(L, -3, 3);
+      set_goal(buffer, width, height, (int)lua_tointeger(L, -3),
+               (int)lua_tointeger(L, -2), (int)lua_tointeger(L, -1));
+      lua_pop(L, 4);
+    }
+  }
+
+  return true;
+}
+
+// spreads distances out from the goals in `buffer`, and then marks the cells
+// that couldn't be reached.  returns false if the queue couldn't be grown.
+static bool spread_distances(path_scratch_t *scratch, int *buffer, int width,
+                             int height, const plane_t *costs,
+                             const path_options_t *options) {
+  size_t length = (size_t)width * (size_t)height;
+  bool valid = true;
+  for (size_t i = 0; i < length && valid; ++i) {
+    if (buffer[i] != INT_MAX) {
+      valid = heap_push(scratch, buffer[i], buffer[i], (int)i);
+    }
+  }
+
+  int directions = options->diagonal ? 8 : 4;
+  while (scratch->heap_length > 0 && valid) {
+    heap_node_t node = heap_pop(scratch);
+    if (node.distance > buffer[node.index]) {
+      // a shorter route to this cell was already found
+      continue;
+    }
+
+    int x = node.index % width;
+    int y = node.index / width;
+    for (int d = 0; d < directions && valid; ++d) {
+      int nx = x + neighbor_x[d];
+      int ny = y + neighbor_y[d];
+      if (nx < 0 || nx >= width || ny < 0 || ny >= height) {
+        continue;
+      }
+
+      int neighbor = ny * width + nx;
+      int cost = get_step_cost(costs, neighbor, d, options);
+      if (cost < 0) {
+        continue;
+      }
+
+      long long distance = (long long)node.distance + cost;
+      if (distance < buffer[neighbor] && distance <= options->limit) {
+        buffer[neighbor] = (int)distance;
+        valid = heap_push(scratch, (int)distance, (int)distance, neighbor);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < length; ++i) {
+    buffer[i] = buffer[i] == INT_MAX ? options->unreachable : buffer[i];
+  }
+
+  return valid;
+}
+
+// reads the cost plane given to dist:dijkstra_map at `index`, which may be nil
+static bool get_dijkstra_costs(lua_State *L, int index,
+                               const plane_t *distances,
+                               const plane_t **costs) {
+  *costs = NULL;
+  if (lua_isnoneornil(L, index)) {
+    return true;
+  }
+
+  *costs = get_plane(L, index);
+  if (*costs == NULL) {
+    return false;
+  }
+
+  if ((*costs)->width != distances->width ||
+      (*costs)->height != distances->height) {
+    LOG_SCRIPT_ERROR(L, "The cost plane must be the same size (%dx%d)",
+                     distances->width, distances->height);
+    return false;
+  }
+
+  return true;
+}
+
+// dist:dijkstra_map({{x, y [, distance]}, ...} | goal_plane [, cost_plane
+//                   [, { diagonal = false, diagonal_cost = 1,
+//                        unreachable = -1, limit = n }]])
+static int plane_dijkstra_map(lua_State *L) {
+  lua_settop(L, 4);
+
+  plane_t *distances = get_plane(L, 1);
+  if (distances == NULL) {
+    return 0;
+  }
+
+  const plane_t *costs;
+  if (!get_dijkstra_costs(L, 3, distances, &costs)) {
+    return 0;
+  }
+
+  path_options_t options;
+  get_path_options(L, 4, &options);
+
+  if (!reserve_scratch(&shared_scratch, 0)) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate pathfinding buffers");
+    return 0;
+  }
+
+  // distances are accumulated in the plane itself, unless it's too narrow to
+  // hold them in the meantime
+  int *buffer = acquire_plane_ints(L, distances);
+  if (buffer == NULL) {
+    return 0;
+  }
+
+  if (!get_goals(L, 2, distances->width, distances->height, buffer)) {
+    release_plane_ints(distances, buffer, false);
+    return 0;
+  }
+
+  if (!spread_distances(&shared_scratch, buffer, distances->width,
+                        distances->height, costs, &options)) {
+    LOG_SCRIPT_ERROR(L, "Failed to grow the pathfinding queue");
+  }
+
+  release_plane_ints(distances, buffer, true);
+
+  // return the distance plane
+  lua_settop(L, 1);
+
+  return 1;
+}
+
+static inline int estimate_cost(int x0, int y0, int x1, int y1,
+                                const path_options_t *options) {
+  int dx = abs(x1 - x0);
+  int dy = abs(y1 - y0);
+  if (!options->diagonal) {
+    return options->min_cost * (dx + dy);
+  }
+
+  // a diagonal step never costs less than this, nor more than the two
+  // orthogonal steps it replaces, so the estimate can't be too high
+  int diagonal = (int)floor(options->min_cost * options->diagonal_cost);
+  diagonal = diagonal > 2 * options->min_cost ? 2 * options->min_cost
+                                               : diagonal;
+  int shorter = dx < dy ? dx : dy;
+  int longer = dx < dy ? dy : dx;
+  return diagonal * shorter + options->min_cost * (longer - shorter);
+}
+
+// path, cost = costs:astar(x0, y0, x1, y1 [, { diagonal = false,
+//                          diagonal_cost = 1, min_cost = 1, path = {} }])
+// path = { x0, y0, x, y, ..., x1, y1 }
+static int plane_astar(lua_State *L) {
+  lua_settop(L, 6);
+
+  plane_t *costs = get_plane(L, 1);
+  if (costs == NULL) {
+    return 0;
+  }
+
+  int x0 = (int)luaL_checkinteger(L, 2);
+  int y0 = (int)luaL_checkinteger(L, 3);
+  int x1 = (int)luaL_checkinteger(L, 4);
+  int y1 = (int)luaL_checkinteger(L, 5);
+
+  path_options_t options;
+  get_path_options(L, 6, &options);
+
+  int width = costs->width;
+  int height = costs->height;
+  if (x0 < 0 || x0 >= width || y0 < 0 || y0 >= height || x1 < 0 ||
+      x1 >= width || y1 < 0 || y1 >= height) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  if (!reserve_scratch(&shared_scratch, (size_t)width * (size_t)height)) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate pathfinding buffers");
+    return 0;
+  }
+
+  int *distances = shared_scratch.distances;
+  int *parents = shared_scratch.parents;
+  unsigned *stamps = shared_scratch.stamps;
+  unsigned generation = shared_scratch.generation;
+
+  int start = y0 * width + x0;
+  int goal = y1 * width + x1;
+  distances[start] = 0;
+  parents[start] = -1;
+  stamps[start] = generation;
+
+  bool valid = heap_push(&shared_scratch,
+                         estimate_cost(x0, y0, x1, y1, &options), 0, start);
+  bool found = false;
+  int directions = options.diagonal ? 8 : 4;
+  while (shared_scratch.heap_length > 0 && valid) {
+    heap_node_t node = heap_pop(&shared_scratch);
+    if (node.distance > distances[node.index]) {
+      continue;
+    }
+
+    if (node.index == goal) {
+      found = true;
+      break;
+    }
+
+    int x = node.index % width;
+    int y = node.index / width;
+    for (int d = 0; d < directions && valid; ++d) {
+      int nx = x + neighbor_x[d];
+      int ny = y + neighbor_y[d];
+      if (nx < 0 || nx >= width || ny < 0 || ny >= height) {
+        continue;
+      }
+
+      int neighbor = ny * width + nx;
+      int cost = get_step_cost(costs, neighbor, d, &options);
+      if (cost < 0) {
+        continue;
+      }
+
+      long long distance = (long long)node.distance + cost;
+      long long priority =
+          distance + estimate_cost(nx, ny, x1, y1, &options);
+      if (priority > INT_MAX || distance > options.limit) {
+        continue;
+      }
+
+      if (stamps[neighbor] != generation || distance < distances[neighbor]) {
+        stamps[neighbor] = generation;
+        distances[neighbor] = (int)distance;
+        parents[neighbor] = node.index;
+        valid = heap_push(&shared_scratch, (int)priority, (int)distance,
+                          neighbor);
+      }
+    }
+  }
+
+  if (!valid) {
+    LOG_SCRIPT_ERROR(L, "Failed to grow the pathfinding queue");
+    return 0;
+  }
+
+  if (!found) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  // the path is filled into the caller's table if one was given, so that it
+  // can be reused between queries
+  int steps = 0;
+  for (int index = goal; index != -1; index = parents[index]) {
+    ++steps;
+  }
+
+  if (lua_istable(L, 6)) {
+    lua_getfield(L, 6, FIELD_PATH_PATH);
+  } else {
+    lua_pushnil(L);
+  }
+
+  if (lua_istable(L, -1)) {
+    int previous_length = (int)lua_objlen(L, -1);
+    for (int i = steps * 2 + 1; i <= previous_length; ++i) {
+      lua_pushnil(L);
+      lua_rawseti(L, -2, i);
+    }
+  } else {
+    lua_pop(L, 1);
+    lua_createtable(L, steps * 2, 0);
+  }
+
+  // walk back from the goal, filling the list from its end
+  int position = steps * 2;
+  for (int index = goal; index != -1; index = parents[index]) {
+    lua_pushinteger(L, index / width);
+    lua_rawseti(L, -2, position--);
+    lua_pushinteger(L, index % width);
+    lua_rawseti(L, -2, position--);
+  }
+
+  lua_pushinteger(L, distances[goal]);
+
+  return 2;
+}
+
+// In the background, dist:dijkstra_map works on copies of its planes with
+// buffers of its own, and the distances are only copied into the plane once
+// they're finished.  The plane is kept alive by a reference until then.
+typedef struct dijkstra_map_job_t {
+  path_scratch_t scratch;
+  path_options_t options;
+  int width, height;
+  int *buffer, *cost_values;
+  plane_t costs;
+  int plane_ref;
+  bool valid;
+} dijkstra_map_job_t;
+
+// pr.jobs.submit('dijkstra_map', {dist, goals [, cost_plane [, options]]})
+static bool prepare_dijkstra_map_job(lua_State *L, int index, void *state) {
+  dijkstra_map_job_t *job = (dijkstra_map_job_t *)state;
+  job->plane_ref = LUA_NOREF;
+
+  plane_t *distances = get_plane(L, index);
+  const plane_t *costs;
+  if (distances == NULL ||
+      !get_dijkstra_costs(L, index + 2, distances, &costs)) {
+    return false;
+  }
+
+  get_path_options(L, index + 3, &job->options);
+
+  job->width = distances->width;
+  job->height = distances->height;
+  job->buffer =
+      malloc(sizeof(int) * (size_t)distances->width * distances->height);
+  if (job->buffer == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate pathfinding buffers");
+    return false;
+  }
+
+  if (!get_goals(L, index + 1, job->width, job->height, job->buffer)) {
+    return false;
+  }
+
+  if (costs != NULL) {
+    job->cost_values = copy_plane_ints(L, costs);
+    if (job->cost_values == NULL) {
+      return false;
+    }
+
+    job->costs.buffer = job->cost_values;
+    job->costs.width = job->width;
+    job->costs.height = job->height;
+    job->costs.type = PLANE_I32;
+    job->costs.offset = 0;
+    job->costs.stride = job->width;
+  }
+
+  lua_pushvalue(L, index);
+  job->plane_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  return true;
+}
+
+static void run_dijkstra_map_job(void *state) {
+  dijkstra_map_job_t *job = (dijkstra_map_job_t *)state;
+  job->valid = spread_distances(
+      &job->scratch, job->buffer, job->width, job->height,
+      job->cost_values != NULL ? &job->costs : NULL, &job->options);
+}
+
+static int finish_dijkstra_map_job(lua_State *L, void *state) {
+  dijkstra_map_job_t *job = (dijkstra_map_job_t *)state;
+  if (!job->valid) {
+    LOG_SCRIPT_ERROR(L, "Failed to grow the pathfinding queue");
+  }
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, job->plane_ref);
+  plane_t *distances = get_plane(L, -1);
+  if (distances == NULL) {
+    return 0;
+  }
+
+  // the plane may have been given a new buffer while the job was running
+  if (distances->width != job->width || distances->height != job->height) {
+    LOG_SCRIPT_ERROR(L, "The plane was resized before its map was finished");
+    return 0;
+  }
+
+  write_plane_values(distances, 0, (size_t)job->width * (size_t)job->height,
+                     job->buffer);
+
+  // return the distance plane
+  return 1;
+}
+
+static void destroy_dijkstra_map_job(lua_State *L, void *state) {
+  dijkstra_map_job_t *job = (dijkstra_map_job_t *)state;
+  if (L != NULL) {
+    luaL_unref(L, LUA_REGISTRYINDEX, job->plane_ref);
+  }
+
+  free(job->buffer);
+  free(job->cost_values);
+  free(job->scratch.distances);
+  free(job->scratch.parents);
+  free(job->scratch.stamps);
+  free(job->scratch.heap);
+}
+
+const job_op_t plane_dijkstra_map_job = {
+    FUNC_PLANE_DIJKSTRA_MAP, sizeof(dijkstra_map_job_t),
+    prepare_dijkstra_map_job, run_dijkstra_map_job,
+    finish_dijkstra_map_job, destroy_dijkstra_map_job};
+
+void add_plane_paths(lua_State *L, int index) {
+  lua_pushcfunction(L, plane_dijkstra_map);
+  lua_setfield(L, index, FUNC_PLANE_DIJKSTRA_MAP);
+
+  lua_pushcfunction(L, plane_astar);
+  lua_setfield(L, index, FUNC_PLANE_ASTAR);
+}
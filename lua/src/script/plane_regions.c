@@ -0,0 +1,361 @@
+#include <lauxlib.h>
+#include <limits.h>
+#include <log.h>
+#include <lua.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "script/environment.h"
+#include "script/plane.h"
+
+#define FUNC_PLANE_FLOOD_FILL "flood_fill"
+#define FUNC_PLANE_LABEL_COMPONENTS "label_components"
+#define FIELD_REGION_DIAGONAL "diagonal"
+#define FIELD_COMPONENT_SIZE "size"
+#define FIELD_COMPONENT_X "x"
+#define FIELD_COMPONENT_Y "y"
+#define FIELD_COMPONENT_WIDTH "width"
+#define FIELD_COMPONENT_HEIGHT "height"
+
+typedef struct seed_t {
+  int x, y;
+} seed_t;
+
+typedef struct component_t {
+  int size;
+  int min_x, min_y, max_x, max_y;
+} component_t;
+
+static bool get_diagonal_option(lua_State *L, int index) {
+  if (!lua_istable(L, index)) {
+    return false;
+  }
+
+  lua_getfield(L, index, FIELD_REGION_DIAGONAL);
+  bool diagonal = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+
+  return diagonal;
+}
+
+static bool push_seed(seed_t **seeds, size_t *count, size_t *capacity, int x,
+                      int y) {
+  if (*count == *capacity) {
+    size_t new_capacity = *capacity * 2;
+    seed_t *resized = realloc(*seeds, sizeof(seed_t) * new_capacity);
+    if (resized == NULL) {
+      return false;
+    }
+
+    *seeds = resized;
+    *capacity = new_capacity;
+  }
+
+  (*seeds)[(*count)++] = (seed_t){x, y};
+  return true;
+}
+
+// plane:flood_fill(x, y, value [, { diagonal = false }])
+static int plane_flood_fill(lua_State *L) {
+  lua_settop(L, 5);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  int start_x = (int)luaL_checkinteger(L, 2);
+  int start_y = (int)luaL_checkinteger(L, 3);
+  int value = (int)luaL_checkinteger(L, 4);
+  bool diagonal = get_diagonal_option(L, 5);
+
+  int width = plane->width;
+  int height = plane->height;
+
+  size_t filled = 0;
+  if (start_x < 0 || start_x >= width || start_y < 0 || start_y >= height) {
+    lua_settop(L, 1);
+    lua_pushinteger(L, 0);
+    return 2;
+  }
+
+  // the region is made up of connected cells equal to the starting one, and
+  // the fill value is compared as it will be stored
+  int target = get_plane_value(plane, (size_t)start_y * width + start_x);
+  value = narrow_plane_value(plane->type, value);
+  if (target == value) {
+    lua_settop(L, 1);
+    lua_pushinteger(L, 0);
+    return 2;
+  }
+
+  int *buffer = acquire_plane_ints(L, plane);
+  if (buffer == NULL) {
+    return 0;
+  }
+
+  size_t count = 0;
+  size_t capacity = 64;
+  seed_t *seeds = malloc(sizeof(seed_t) * capacity);
+  if (seeds == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate the flood fill stack");
+    release_plane_ints(plane, buffer, false);
+    return 0;
+  }
+
+  seeds[count++] = (seed_t){start_x, start_y};
+
+  // fill one horizontal span at a time, seeding the spans above and below it
+  bool failed = false;
+  while (count > 0 && !failed) {
+    seed_t seed = seeds[--count];
+    int *row = &buffer[(size_t)seed.y * width];
+    if (row[seed.x] != target) {
+      continue;
+    }
+
+    int left = seed.x;
+    while (left > 0 && row[left - 1] == target) {
+      --left;
+    }
+
+    int right = seed.x;
+    while (right < width - 1 && row[right + 1] == target) {
+      ++right;
+    }
+
+    for (int x = left; x <= right; ++x) {
+      row[x] = value;
+    }
+    filled += (size_t)(right - left + 1);
+
+    // diagonal connections reach one cell past either end of the span
+    int first = left - (diagonal && left > 0 ? 1 : 0);
+    int last = right + (diagonal && right < width - 1 ? 1 : 0);
+    for (int dy = -1; dy <= 1 && !failed; dy += 2) {
+      int y = seed.y + dy;
+      if (y < 0 || y >= height) {
+        continue;
+      }
+
+      const int *adjacent = &buffer[(size_t)y * width];
+      for (int x = first; x <= last && !failed; ++x) {
+        // only the first cell of each run needs to be seeded
+        if (adjacent[x] == target &&
+            (x == first || adjacent[x - 1] != target)) {
+          failed = !push_seed(&seeds, &count, &capacity, x, y);
+        }
+      }
+    }
+  }
+
+  free(seeds);
+  release_plane_ints(plane, buffer, true);
+
+  if (failed) {
+    LOG_SCRIPT_ERROR(L, "Failed to grow the flood fill stack");
+  }
+
+  lua_settop(L, 1);
+  lua_pushinteger(L, (lua_Integer)filled);
+
+  return 2;
+}
+
+static int find_root(int *parents, int label) {
+  int root = label;
+  while (parents[root] != root) {
+    root = parents[root];
+  }
+
+  // compress the path so that later lookups are quicker
+  while (parents[label] != root) {
+    int next = parents[label];
+    parents[label] = root;
+    label = next;
+  }
+
+  return root;
+}
+
+static int merge_labels(int *parents, int first, int second) {
+  int first_root = find_root(parents, first);
+  int second_root = find_root(parents, second);
+
+  // the smaller label becomes the root, so that roots are always found
+  // before the labels that point to them during the second pass
+  if (first_root < second_root) {
+    parents[second_root] = first_root;
+    return first_root;
+  }
+
+  parents[first_root] = second_root;
+  return second_root;
+}
+
+// labels, components = plane:label_components(value [, { diagonal = false }])
+// components = {{ size = n, x = n, y = n, width = n, height = n }, ...}
+static int plane_label_components(lua_State *L) {
+  lua_settop(L, 3);
+
+  plane_t *plane = get_plane(L, 1);
+  if (plane == NULL) {
+    return 0;
+  }
+
+  int value = (int)luaL_checkinteger(L, 2);
+  bool diagonal = get_diagonal_option(L, 3);
+
+  int width = plane->width;
+  int height = plane->height;
+
+  plane_t *labels = push_new_plane(width, height, NULL, L);
+  if (labels == NULL) {
+    return 0;
+  }
+
+  int *buffer = acquire_plane_ints(L, plane);
+  if (buffer == NULL) {
+    return 0;
+  }
+
+  // new labels are only given to cells whose left neighbor is background, so
+  // there are at most this many (plus the background label)
+  size_t max_labels = (size_t)height * (size_t)((width + 1) / 2) + 1;
+  int *parents = malloc(sizeof(int) * max_labels);
+  if (parents == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate component labels");
+    release_plane_ints(plane, buffer, false);
+    return 0;
+  }
+
+  // first pass: give each cell the lowest label of its already-visited
+  // neighbors, recording which labels turn out to be connected
+  int next_label = 1;
+  parents[0] = 0;
+  for (int y = 0; y < height; ++y) {
+    const int *row = &buffer[(size_t)y * width];
+    int *label_row = &labels->buffer[(size_t)y * width];
+    const int *above = y > 0 ? label_row - width : NULL;
+
+    for (int x = 0; x < width; ++x) {
+      if (row[x] != value) {
+        label_row[x] = 0;
+        continue;
+      }
+
+      int neighbors[4];
+      int neighbor_count = 0;
+      if (x > 0 && label_row[x - 1] != 0) {
+        neighbors[neighbor_count++] = label_row[x - 1];
+      }
+
+      if (above != NULL) {
+        if (above[x] != 0) {
+          neighbors[neighbor_count++] = above[x];
+        }
+
+        if (diagonal && x > 0 && above[x - 1] != 0) {
+          neighbors[neighbor_count++] = above[x - 1];
+        }
+
+        if (diagonal && x < width - 1 && above[x + 1] != 0) {
+          neighbors[neighbor_count++] = above[x + 1];
+        }
+      }
+
+      if (neighbor_count == 0) {
+        parents[next_label] = next_label;
+        label_row[x] = next_label++;
+        continue;
+      }
+
+      int label = neighbors[0];
+      for (int i = 1; i < neighbor_count; ++i) {
+        if (neighbors[i] != label) {
+          label = merge_labels(parents, label, neighbors[i]);
+        }
+      }
+      label_row[x] = label;
+    }
+  }
+
+  // second pass: number the root labels consecutively, relabel every cell
+  // with its root's number, and gather the size and bounds of each component
+  int *final_labels = malloc(sizeof(int) * (size_t)next_label);
+  component_t *components = malloc(sizeof(component_t) * (size_t)next_label);
+  release_plane_ints(plane, buffer, false);
+  if (final_labels == NULL || components == NULL) {
+    LOG_SCRIPT_ERROR(L, "Failed to allocate component labels");
+    free(parents);
+    free(final_labels);
+    free(components);
+    return 0;
+  }
+
+  int component_count = 0;
+  final_labels[0] = 0;
+  for (int label = 1; label < next_label; ++label) {
+    int root = find_root(parents, label);
+    if (root == label) {
+      final_labels[label] = ++component_count;
+      components[component_count - 1] = (component_t){0, INT_MAX, INT_MAX, -1,
+                                                      -1};
+    } else {
+      final_labels[label] = final_labels[root];
+    }
+  }
+
+  for (int y = 0; y < height; ++y) {
+    int *label_row = &labels->buffer[(size_t)y * width];
+    for (int x = 0; x < width; ++x) {
+      if (label_row[x] == 0) {
+        continue;
+      }
+
+      label_row[x] = final_labels[label_row[x]];
+      component_t *component = &components[label_row[x] - 1];
+      ++component->size;
+      component->min_x = x < component->min_x ? x : component->min_x;
+      component->max_x = x > component->max_x ? x : component->max_x;
+      component->min_y = y < component->min_y ? y : component->min_y;
+      component->max_y = y;
+    }
+  }
+
+  lua_createtable(L, component_count, 0);
+  for (int i = 0; i < component_count; ++i) {
+    lua_createtable(L, 0, 5);
+
+    lua_pushinteger(L, components[i].size);
+    lua_setfield(L, -2, FIELD_COMPONENT_SIZE);
+
+    lua_pushinteger(L, components[i].min_x);
+    lua_setfield(L, -2, FIELD_COMPONENT_X);
+
+    lua_pushinteger(L, components[i].min_y);
+    lua_setfield(L, -2, FIELD_COMPONENT_Y);
+
+    lua_pushinteger(L, components[i].max_x - components[i].min_x + 1);
+    lua_setfield(L, -2, FIELD_COMPONENT_WIDTH);
+
+    lua_pushinteger(L, components[i].max_y - components[i].min_y + 1);
+    lua_setfield(L, -2, FIELD_COMPONENT_HEIGHT);
+
+    lua_rawseti(L, -2, i + 1);
+  }
+
+  free(parents);
+  free(final_labels);
+  free(components);
+
+  return 2;
+}
+
+void add_plane_regions(lua_State *L, int index) {
+  lua_pushcfunction(L, plane_flood_fill);
+  lua_setfield(L, index, FUNC_PLANE_FLOOD_FILL);
+
+  lua_pushcfunction(L, plane_label_components);
+  lua_setfield(L, index, FUNC_PLANE_LABEL_COMPONENTS);
+}
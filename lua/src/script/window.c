@@ -3,10 +3,13 @@
 #include <lauxlib.h>
 #include <log.h>
 #include <lua.h>
+#include <string.h>
 
 #include "procyon.h"
 #include "script.h"
 #include "script/environment.h"
+#include "script/input.h"
+#include "script/jobs.h"
 
 #define TBL_WINDOW "window"
 
@@ -26,6 +29,37 @@
 #define FUNC_RESET_SCALE "reset_scale"
 #define FUNC_SET_FULLSCREEN "set_fullscreen"
 #define FUNC_SET_WINDOWED "set_windowed"
+#define FUNC_SET_GC_MODE "set_gc_mode"
+#define FUNC_GET_STATS "get_stats"
+#define FIELD_STATS_DRAW "draw_ms"
+#define FIELD_STATS_GC_MODE "gc_mode"
+#define FIELD_STATS_GC_BUDGET "gc_budget_ms"
+#define FIELD_STATS_GC_PAUSE "gc_pause_ms"
+#define FIELD_STATS_GC_MAX_PAUSE "gc_max_pause_ms"
+#define FIELD_STATS_GC_CYCLES "gc_cycles"
+#define FIELD_STATS_GC_OVERRUNS "gc_overruns"
+#define FIELD_STATS_HEAP "heap_kb"
+
+#define DEFAULT_GC_BUDGET_MS 1.0
+
+// the amount of allocation, in kilobytes, that each step of the collector
+// makes up for
+#define GC_STEP_KB 16
+
+// a budgeted collection cycle starts once the heap has grown to this
+// percentage of its size after the last cycle, and is finished regardless of
+// the budget once it grows to the limit
+#define GC_START_PERCENT 150
+#define GC_LIMIT_PERCENT 300
+
+// the automatic collector's defaults in LuaJIT, and the pause used in
+// incremental mode to start each cycle as soon as the last one finishes
+#define GC_DEFAULT_PAUSE 200
+#define GC_DEFAULT_STEPMUL 200
+#define GC_INCREMENTAL_PAUSE 100
+
+static const char *const gc_mode_names[] = {"budgeted", "incremental", "full",
+                                            "manual", NULL};
 
 static int close_window(lua_State *L) {
   lua_getfield(L, LUA_REGISTRYINDEX, GLOBAL_WINDOW_PTR);
@@ -98,30 +132,165 @@ static int set_window_title(lua_State *L) {
   return 0;
 }
 
+static void set_gc_limits(lua_State *L, script_gc_t *gc) {
+  long long heap = lua_gc(L, LUA_GCCOUNT, 0);
+  gc->start_kb = (int)(heap * GC_START_PERCENT / 100);
+  gc->limit_kb = (int)(heap * GC_LIMIT_PERCENT / 100);
+}
+
+// sets the automatic collector up for the mode, which only runs in budgeted
+// mode when it's stepped between frames
+static void apply_gc_mode(lua_State *L, script_gc_t *gc) {
+  if (gc->mode == SCRIPT_GC_BUDGETED) {
+    lua_gc(L, LUA_GCSTOP, 0);
+    set_gc_limits(L, gc);
+    gc->idle = true;
+  } else {
+    lua_gc(L, LUA_GCRESTART, 0);
+  }
+
+  lua_gc(L, LUA_GCSETPAUSE, gc->mode == SCRIPT_GC_INCREMENTAL
+                                ? GC_INCREMENTAL_PAUSE
+                                : GC_DEFAULT_PAUSE);
+  lua_gc(L, LUA_GCSETSTEPMUL, GC_DEFAULT_STEPMUL);
+}
+
+// steps the collector until the frame's budget is spent or the cycle is
+// finished.  cycles only start once the heap has grown enough since the last
+// one, and one that's fallen behind is finished regardless of the budget.
+static void step_gc(lua_State *L, script_gc_t *gc, double start) {
+  int heap = lua_gc(L, LUA_GCCOUNT, 0);
+  if (gc->idle && heap < gc->start_kb) {
+    return;
+  }
+
+  bool overrun = heap >= gc->limit_kb;
+  bool finished = false;
+  gc->idle = false;
+  do {
+    finished = lua_gc(L, LUA_GCSTEP, GC_STEP_KB) != 0;
+  } while (!finished &&
+           (overrun || procy_get_time() - start < gc->budget));
+
+  // stepping re-arms the automatic collector, which stays off in this mode
+  lua_gc(L, LUA_GCSTOP, 0);
+
+  if (finished) {
+    ++gc->cycles;
+    gc->idle = true;
+    set_gc_limits(L, gc);
+  }
+
+  if (overrun) {
+    ++gc->overruns;
+  }
+}
+
+// collects garbage between frames as the mode calls for, and records how long
+// it took
+static void collect_frame_garbage(lua_State *L, script_gc_t *gc,
+                                  bool high_fps) {
+  double start = procy_get_time();
+
+  switch (gc->mode) {
+    case SCRIPT_GC_BUDGETED:
+      step_gc(L, gc, start);
+      break;
+    case SCRIPT_GC_FULL:
+      // a full collection every frame is only made when frames are few
+      if (!high_fps) {
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        ++gc->cycles;
+      }
+      break;
+    default:
+      // the automatic collector runs as the script allocates, or the script
+      // collects garbage itself
+      break;
+  }
+
+  gc->pause = procy_get_time() - start;
+  gc->max_pause = gc->pause > gc->max_pause ? gc->pause : gc->max_pause;
+}
+
+// pr.window.set_gc_mode("budgeted"|"incremental"|"full"|"manual"
+//                       [, budget_ms])
+static int set_window_gc_mode(lua_State *L) {
+  lua_settop(L, 2);
+
+  int mode = luaL_checkoption(L, 1, NULL, gc_mode_names);
+  double budget = luaL_optnumber(L, 2, DEFAULT_GC_BUDGET_MS);
+  if (budget < 0.0) {
+    LOG_SCRIPT_ERROR(L, "Invalid garbage collection budget (%f ms)", budget);
+    return 0;
+  }
+
+  lua_getfield(L, LUA_REGISTRYINDEX, GLOBAL_ENV_PTR);
+  script_env_t *env = (script_env_t *)lua_touserdata(L, -1);
+
+  env->gc.mode = (script_gc_mode_t)mode;
+  env->gc.budget = budget / 1000.0;
+  apply_gc_mode(L, &env->gc);
+
+  return 0;
+}
+
+// pr.window.get_stats()
+static int get_window_stats(lua_State *L) {
+  lua_getfield(L, LUA_REGISTRYINDEX, GLOBAL_ENV_PTR);
+  script_env_t *env = (script_env_t *)lua_touserdata(L, -1);
+  const script_gc_t *gc = &env->gc;
+
+  lua_newtable(L);
+  lua_pushnumber(L, env->draw_time * 1000.0);
+  lua_setfield(L, -2, FIELD_STATS_DRAW);
+  lua_pushstring(L, gc_mode_names[gc->mode]);
+  lua_setfield(L, -2, FIELD_STATS_GC_MODE);
+  lua_pushnumber(L, gc->budget * 1000.0);
+  lua_setfield(L, -2, FIELD_STATS_GC_BUDGET);
+  lua_pushnumber(L, gc->pause * 1000.0);
+  lua_setfield(L, -2, FIELD_STATS_GC_PAUSE);
+  lua_pushnumber(L, gc->max_pause * 1000.0);
+  lua_setfield(L, -2, FIELD_STATS_GC_MAX_PAUSE);
+  lua_pushinteger(L, (lua_Integer)gc->cycles);
+  lua_setfield(L, -2, FIELD_STATS_GC_CYCLES);
+  lua_pushinteger(L, (lua_Integer)gc->overruns);
+  lua_setfield(L, -2, FIELD_STATS_GC_OVERRUNS);
+  lua_pushinteger(L, lua_gc(L, LUA_GCCOUNT, 0));
+  lua_setfield(L, -2, FIELD_STATS_HEAP);
+
+  return 1;
+}
+
 // called from the main window loop by way of script_env_t.on_draw
 static void perform_draw(procy_state_t *const state, double seconds) {
-  lua_State *L = ((script_env_t *)state->data)->L;
+  script_env_t *env = (script_env_t *)state->data;
+  lua_State *L = env->L;
+
+  // background jobs that have finished are handed back before the frame is
+  // drawn, so that on_draw sees their results
+  complete_jobs(L);
+
+  // as are the input events received since the last frame
+  dispatch_input(L);
 
   push_library_table(L);
   lua_getfield(L, -1, TBL_WINDOW);
   lua_getfield(L, -1, FUNC_ON_DRAW);
   if (lua_isfunction(L, -1)) {
+    double start = procy_get_time();
     lua_pushnumber(L, seconds);
     if (lua_pcall(L, 1, 0, 0) == LUA_ERRRUN) {
       LOG_SCRIPT_ERROR(L, "Error calling %s.%s: %s", TBL_WINDOW, FUNC_ON_DRAW,
                        lua_tostring(L, -1));
     }
-
-    // check whether the window is in "high fps" mode and, if it is NOT, run the
-    // Lua garbage collector
-    lua_getfield(L, LUA_REGISTRYINDEX, GLOBAL_WINDOW_PTR);
-    procy_window_t *window = (procy_window_t *)lua_touserdata(L, -1);
-
-    if (!window->high_fps) {
-      lua_gc(L, LUA_GCCOLLECT, 0);
-    }
+    env->draw_time = procy_get_time() - start;
   }
 
+  // garbage is collected after the frame's script has run, rather than
+  // whenever it happens to allocate
+  collect_frame_garbage(L, &env->gc, env->window->high_fps);
+
   lua_pop(L, lua_gettop(L));
 }
 
@@ -138,15 +307,14 @@ static void handle_window_resized(procy_state_t *const state, int w, int h) {
       LOG_SCRIPT_ERROR(L, "Error calling %s.%s: %s", TBL_WINDOW, FUNC_ON_RESIZE,
                        lua_tostring(L, -1));
     }
-
-    lua_gc(L, LUA_GCCOLLECT, 0);
   }
 
   lua_pop(L, lua_gettop(L));
 }
 
 static void handle_window_loaded(procy_state_t *const state) {
-  lua_State *L = ((script_env_t *)state->data)->L;
+  script_env_t *env = (script_env_t *)state->data;
+  lua_State *L = env->L;
 
   push_library_table(L);
   lua_getfield(L, -1, TBL_WINDOW);
@@ -158,7 +326,10 @@ static void handle_window_loaded(procy_state_t *const state) {
     }
   }
 
+  // whatever was left over from loading is collected before the first frame,
+  // after which the collector runs as its mode calls for
   lua_gc(L, LUA_GCCOLLECT, 0);
+  apply_gc_mode(L, &env->gc);
 
   lua_pop(L, lua_gettop(L));
 }
@@ -241,6 +412,11 @@ static int set_window_windowed(lua_State *L) {
 }
 
 void add_window(lua_State *L, script_env_t *env) {
+  memset(&env->gc, 0, sizeof(script_gc_t));
+  env->gc.mode = SCRIPT_GC_BUDGETED;
+  env->gc.budget = DEFAULT_GC_BUDGET_MS / 1000.0;
+  env->draw_time = 0.0;
+
   env->state->on_draw = perform_draw;
   env->state->on_resize = handle_window_resized;
   env->state->on_load = handle_window_loaded;
@@ -259,6 +435,8 @@ void add_window(lua_State *L, script_env_t *env) {
                         {FUNC_SET_TITLE, set_window_title},
                         {FUNC_SET_FULLSCREEN, set_window_fullscreen},
                         {FUNC_SET_WINDOWED, set_window_windowed},
+                        {FUNC_SET_GC_MODE, set_window_gc_mode},
+                        {FUNC_GET_STATS, get_window_stats},
                         {NULL, NULL}};
   luaL_newlib(L, methods);
   lua_setfield(L, 1, TBL_WINDOW);
@@ -5,7 +5,7 @@ uniform sampler2DArray u_GlyphTexture;
 in vec2 f_TexCoords;
 flat in int f_ForeColor;
 flat in int f_BackColor;
-in float f_Bold;
+flat in float f_Layer;
 in float f_Depth;
 
 void main(void) {
@@ -18,7 +18,7 @@ void main(void) {
       ((f_BackColor & 0xFF00) >> 8) / 255.0,
       ((f_BackColor & 0xFF)) / 255.0);
 
-  float value = floor(texture(u_GlyphTexture, vec3(f_TexCoords, f_Bold)).r);
+  float value = floor(texture(u_GlyphTexture, vec3(f_TexCoords, f_Layer)).r);
   gl_FragColor = vec4(mix(bg, fg, value), 1.0);
   gl_FragDepth = f_Depth;
 }
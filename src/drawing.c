@@ -1,9 +1,12 @@
 #include "drawing.h"
 
 #include <limits.h>
+#include <stdio.h>
 #include <string.h>
 
+#include "glyph_cache.h"
 #include "log.h"
+#include "shader/glyph.h"
 #include "shader/sprite.h"
 #include "window.h"
 
@@ -19,6 +22,8 @@ typedef procy_draw_op_line_t draw_op_line_t;
 
 #define PROCY_MAX_DRAW_STRING_LENGTH 256
 
+#define UTF8_REPLACEMENT_CHAR 0xFFFD
+
 static void draw_string_chars(window_t *window, int x, int y, int z, bool bold,
                               color_t fg, color_t bg, const char *contents) {
   int glyph_size;
@@ -33,6 +38,164 @@ static void draw_string_chars(window_t *window, int x, int y, int z, bool bold,
   }
 }
 
+static void draw_string_utf8_chars(window_t *window, int x, int y, int z,
+                                   bool bold, color_t fg, color_t bg,
+                                   const char *contents) {
+  int glyph_size;
+  procy_get_glyph_size(window, &glyph_size, NULL);
+
+  const size_t length = strnlen(contents, PROCY_MAX_DRAW_STRING_LENGTH);
+  draw_op_text_t op;
+  uint32_t codepoint;
+  for (size_t i = 0; i < length; x += glyph_size) {
+    i += procy_decode_utf8(&contents[i], length - i, &codepoint);
+    op = procy_create_draw_op_codepoint_colored(x, y, z, fg, bg, codepoint,
+                                                bold);
+    procy_append_draw_op_text(window, &op);
+  }
+}
+
+size_t procy_decode_utf8(const char *contents, size_t length,
+                         uint32_t *codepoint) {
+  const unsigned char *s = (const unsigned char *)contents;
+
+  // determine the sequence length and payload of the leading byte
+  size_t count;
+  uint32_t value;
+  uint32_t min;
+  if (s[0] < 0x80) {
+    *codepoint = s[0];
+    return 1;
+  } else if ((s[0] & 0xE0) == 0xC0) {
+    count = 2;
+    value = s[0] & 0x1F;
+    min = 0x80;
+  } else if ((s[0] & 0xF0) == 0xE0) {
+    count = 3;
+    value = s[0] & 0x0F;
+    min = 0x800;
+  } else if ((s[0] & 0xF8) == 0xF0) {
+    count = 4;
+    value = s[0] & 0x07;
+    min = 0x10000;
+  } else {
+    *codepoint = UTF8_REPLACEMENT_CHAR;
+    return 1;
+  }
+
+  if (count > length) {
+    *codepoint = UTF8_REPLACEMENT_CHAR;
+    return 1;
+  }
+
+  for (size_t i = 1; i < count; ++i) {
+    if ((s[i] & 0xC0) != 0x80) {
+      *codepoint = UTF8_REPLACEMENT_CHAR;
+      return 1;
+    }
+    value = (value << 6) | (s[i] & 0x3F);
+  }
+
+  // reject overlong encodings, surrogates and out-of-range values
+  if (value < min || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) {
+    *codepoint = UTF8_REPLACEMENT_CHAR;
+    return 1;
+  }
+
+  *codepoint = value;
+  return count;
+}
+
+procy_text_cursor_t procy_create_text_cursor(const char *contents,
+                                             size_t length, bool utf8,
+                                             color_t color,
+                                             color_t background) {
+  procy_text_cursor_t cursor = {.contents = contents,
+                                .length = length,
+                                .utf8 = utf8,
+                                .color = color,
+                                .background = background};
+  return cursor;
+}
+
+bool procy_next_text_glyph(procy_text_cursor_t *cursor, uint32_t *codepoint) {
+  const char *contents = cursor->contents;
+  const size_t length = cursor->length;
+  size_t i = cursor->position;
+  while (i < length && contents[i] == '%' && i < length - 1) {
+    // inline modifiers aren't drawn, and so don't take up a column
+    if (contents[i + 1] == 'b') {
+      cursor->bold = !cursor->bold;
+      i += 2;
+    } else if (contents[i + 1] == 'i') {
+      color_t tmp = cursor->color;
+      cursor->color = cursor->background;
+      cursor->background = tmp;
+      i += 2;
+    } else {
+      // escape a following '%' by skipping only the current one
+      if (contents[i + 1] == '%') {
+        ++i;
+      }
+      break;
+    }
+  }
+
+  if (i >= length) {
+    cursor->position = length;
+    return false;
+  }
+
+  if (cursor->utf8) {
+    i += procy_decode_utf8(&contents[i], length - i, codepoint);
+  } else {
+    *codepoint = procy_cp437_to_codepoint((unsigned char)contents[i++]);
+  }
+
+  cursor->position = i;
+  return true;
+}
+
+bool procy_load_glyph_font_mem(window_t *window, const unsigned char *buffer,
+                               size_t length) {
+  if (!procy_set_glyph_shader_font(window->shaders.glyph, buffer, length)) {
+    log_error("Failed to load a glyph font from an in-memory buffer");
+    return false;
+  }
+
+  log_debug("Loaded a glyph font from an in-memory buffer %zu bytes in length",
+            length);
+  return true;
+}
+
+bool procy_load_glyph_font(window_t *window, const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    log_error("Failed to open font file \"%s\"", path);
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  const long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  unsigned char *buffer = length > 0 ? malloc(length) : NULL;
+  bool loaded = buffer != NULL &&
+                fread(buffer, 1, length, file) == (size_t)length &&
+                procy_load_glyph_font_mem(window, buffer, length);
+  fclose(file);
+
+  if (buffer != NULL) {
+    free(buffer);
+  }
+
+  if (!loaded) {
+    log_error("Failed to load glyph font from \"%s\"", path);
+  }
+
+  return loaded;
+}
+
 procy_sprite_shader_program_t *procy_load_sprite_shader(window_t *window,
                                                         const char *path) {
   procy_sprite_shader_program_t *shader = procy_create_sprite_shader(path);
@@ -113,6 +276,33 @@ void procy_draw_string_bold(window_t *window, int x, int y, int z,
   draw_string_chars(window, x, y, z, true, color, background, contents);
 }
 
+void procy_draw_string_utf8(window_t *window, int x, int y, int z,
+                            color_t color, color_t background,
+                            const char *contents) {
+  draw_string_utf8_chars(window, x, y, z, false, color, background, contents);
+}
+
+void procy_draw_string_utf8_bold(window_t *window, int x, int y, int z,
+                                 color_t color, color_t background,
+                                 const char *contents) {
+  draw_string_utf8_chars(window, x, y, z, true, color, background, contents);
+}
+
+void procy_draw_codepoint(window_t *window, int x, int y, int z, color_t color,
+                          color_t background, uint32_t codepoint) {
+  draw_op_text_t op = procy_create_draw_op_codepoint_colored(
+      x, y, z, color, background, codepoint, false);
+  procy_append_draw_op_text(window, &op);
+}
+
+void procy_draw_codepoint_bold(window_t *window, int x, int y, int z,
+                               color_t color, color_t background,
+                               uint32_t codepoint) {
+  draw_op_text_t op = procy_create_draw_op_codepoint_colored(
+      x, y, z, color, background, codepoint, true);
+  procy_append_draw_op_text(window, &op);
+}
+
 void procy_draw_rect(window_t *window, int x, int y, int z, int width,
                      int height, color_t color) {
   draw_op_rect_t op = procy_create_draw_op_rect(x, y, z, width, height, color);
@@ -142,7 +332,18 @@ draw_op_text_t procy_create_draw_op_char_colored(int x, int y, int z,
                                                  color_t color,
                                                  color_t background, char c,
                                                  bool bold) {
-  draw_op_text_t op = {color, background, x, y, z, c, bold};
+  // single bytes are always treated as CP437
+  draw_op_text_t op = {color, background, x, y, z,
+                       procy_cp437_to_codepoint((unsigned char)c), bold};
+  return op;
+}
+
+draw_op_text_t procy_create_draw_op_codepoint_colored(int x, int y, int z,
+                                                      color_t color,
+                                                      color_t background,
+                                                      uint32_t codepoint,
+                                                      bool bold) {
+  draw_op_text_t op = {color, background, x, y, z, codepoint, bold};
   return op;
 }
 
@@ -0,0 +1,394 @@
+#include "glyph_cache.h"
+
+#include <limits.h>
+#include <log.h>
+#include <math.h>
+#include <stb_ds.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include <stb_truetype.h>
+
+typedef procy_glyph_cache_t glyph_cache_t;
+typedef procy_glyph_slot_t glyph_slot_t;
+typedef procy_glyph_lookup_t glyph_lookup_t;
+
+#define GLYPH_LAYER_REGULAR 0
+#define GLYPH_LAYER_BOLD 1
+#define GLYPH_MISSING_CELL '?'
+#define GLYPH_KEY_BOLD 0x80000000U
+#define GLYPH_ASCII_COUNT 128
+#define NO_SLOT -1
+
+// the glyph shader only draws fully-covered texels, so anti-aliased coverage
+// is rounded to either on or off
+#define COVERAGE_THRESHOLD 128
+
+// Unicode equivalents of each CP437 character
+static const uint16_t CP437_CODEPOINTS[256] = {
+    0x0000, 0x263A, 0x263B, 0x2665, 0x2666, 0x2663, 0x2660, 0x2022, 0x25D8,
+    0x25CB, 0x25D9, 0x2642, 0x2640, 0x266A, 0x266B, 0x263C, 0x25BA, 0x25C4,
+    0x2195, 0x203C, 0x00B6, 0x00A7, 0x25AC, 0x21A8, 0x2191, 0x2193, 0x2192,
+    0x2190, 0x221F, 0x2194, 0x25B2, 0x25BC, 0x0020, 0x0021, 0x0022, 0x0023,
+    0x0024, 0x0025, 0x0026, 0x0027, 0x0028, 0x0029, 0x002A, 0x002B, 0x002C,
+    0x002D, 0x002E, 0x002F, 0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035,
+    0x0036, 0x0037, 0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E,
+    0x003F, 0x0040, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
+    0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F, 0x0050,
+    0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057, 0x0058, 0x0059,
+    0x005A, 0x005B, 0x005C, 0x005D, 0x005E, 0x005F, 0x0060, 0x0061, 0x0062,
+    0x0063, 0x0064, 0x0065, 0x0066, 0x0067, 0x0068, 0x0069, 0x006A, 0x006B,
+    0x006C, 0x006D, 0x006E, 0x006F, 0x0070, 0x0071, 0x0072, 0x0073, 0x0074,
+    0x0075, 0x0076, 0x0077, 0x0078, 0x0079, 0x007A, 0x007B, 0x007C, 0x007D,
+    0x007E, 0x2302, 0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5,
+    0x00E7, 0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+    0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9, 0x00FF,
+    0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192, 0x00E1, 0x00ED,
+    0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA, 0x00BF, 0x2310, 0x00AC,
+    0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB, 0x2591, 0x2592, 0x2593, 0x2502,
+    0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255D,
+    0x255C, 0x255B, 0x2510, 0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C,
+    0x255E, 0x255F, 0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C,
+    0x2567, 0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B,
+    0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580, 0x03B1,
+    0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4, 0x03A6, 0x0398,
+    0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229, 0x2261, 0x00B1, 0x2265,
+    0x2264, 0x2320, 0x2321, 0x00F7, 0x2248, 0x00B0, 0x2219, 0x00B7, 0x221A,
+    0x207F, 0x00B2, 0x25A0, 0x00A0};
+
+static void lru_unlink(glyph_cache_t *cache, int slot) {
+  glyph_slot_t *s = &cache->slots[slot];
+
+  if (s->prev != NO_SLOT) {
+    cache->slots[s->prev].next = s->next;
+  } else {
+    cache->lru_head = s->next;
+  }
+
+  if (s->next != NO_SLOT) {
+    cache->slots[s->next].prev = s->prev;
+  } else {
+    cache->lru_tail = s->prev;
+  }
+}
+
+static void lru_push_front(glyph_cache_t *cache, int slot) {
+  glyph_slot_t *s = &cache->slots[slot];
+  s->prev = NO_SLOT;
+  s->next = cache->lru_head;
+
+  if (cache->lru_head != NO_SLOT) {
+    cache->slots[cache->lru_head].prev = slot;
+  }
+
+  cache->lru_head = slot;
+  if (cache->lru_tail == NO_SLOT) {
+    cache->lru_tail = slot;
+  }
+}
+
+static void touch_slot(glyph_cache_t *cache, int slot) {
+  cache->slots[slot].frame = cache->frame;
+  if (cache->lru_head != slot) {
+    lru_unlink(cache, slot);
+    lru_push_front(cache, slot);
+  }
+}
+
+static void get_slot_location(glyph_cache_t *cache, int slot, int *layer,
+                              int *cell) {
+  *layer = cache->first_layer + slot / PROCY_GLYPHS_PER_PAGE;
+  *cell = slot % PROCY_GLYPHS_PER_PAGE;
+}
+
+static void reset_glyphs(glyph_cache_t *cache) {
+  hmfree(cache->glyphs);
+  ++cache->generation;
+
+  for (int i = 0; i < cache->slot_count; ++i) {
+    cache->slots[i].occupied = false;
+  }
+}
+
+static bool rasterize_glyph(glyph_cache_t *cache, uint32_t codepoint,
+                            bool bold) {
+  stbtt_fontinfo *font = cache->font;
+  if (font == NULL || stbtt_FindGlyphIndex(font, (int)codepoint) == 0) {
+    return false;
+  }
+
+  const int gw = cache->glyph_width;
+  const int gh = cache->glyph_height;
+
+  int advance;
+  int bearing;
+  stbtt_GetCodepointHMetrics(font, (int)codepoint, &advance, &bearing);
+
+  // shrink glyphs that are wider than a cell (e.g. CJK) so that they fit
+  float scale = cache->scale;
+  if (advance > 0 && (float)advance * scale > (float)gw) {
+    scale = (float)gw / (float)advance;
+  }
+
+  // center the glyph within its cell
+  const float font_height = (float)(cache->ascent - cache->descent) * scale;
+  const int baseline = (int)roundf((float)cache->ascent * scale +
+                                   ((float)gh - font_height) / 2.0F);
+  const int offset_x = (int)roundf(((float)gw - (float)advance * scale) / 2.0F);
+
+  int x0;
+  int y0;
+  int x1;
+  int y1;
+  stbtt_GetCodepointBitmapBox(font, (int)codepoint, scale, scale, &x0, &y0,
+                              &x1, &y1);
+
+  memset(cache->bitmap, 0, (size_t)gw * gh);
+
+  const int w = x1 - x0;
+  const int h = y1 - y0;
+  if (w <= 0 || h <= 0) {
+    // whitespace
+    return true;
+  }
+
+  arrsetlen(cache->scratch, w * h);
+  stbtt_MakeCodepointBitmap(font, cache->scratch, w, h, w, scale, scale,
+                            (int)codepoint);
+
+  // copy the glyph into its cell, clipping anything that falls outside of it
+  for (int y = 0; y < h; ++y) {
+    const int cell_y = baseline + y0 + y;
+    if (cell_y < 0 || cell_y >= gh) {
+      continue;
+    }
+
+    for (int x = 0; x < w; ++x) {
+      const int cell_x = offset_x + x0 + x;
+      if (cell_x < 0 || cell_x >= gw ||
+          cache->scratch[y * w + x] < COVERAGE_THRESHOLD) {
+        continue;
+      }
+
+      unsigned char *row = &cache->bitmap[cell_y * gw];
+      row[cell_x] = UCHAR_MAX;
+
+      // TrueType fonts have no bold variant here, so thicken the strokes
+      if (bold && cell_x + 1 < gw) {
+        row[cell_x + 1] = UCHAR_MAX;
+      }
+    }
+  }
+
+  return true;
+}
+
+glyph_cache_t *procy_create_glyph_cache(int glyph_width, int glyph_height,
+                                        int pages, int first_layer) {
+  glyph_cache_t *cache = calloc(1, sizeof(glyph_cache_t));
+  if (cache == NULL) {
+    log_error("Failed to allocate memory for the glyph cache");
+    return NULL;
+  }
+
+  cache->glyph_width = glyph_width;
+  cache->glyph_height = glyph_height;
+  cache->first_layer = first_layer;
+  cache->slot_count = pages * PROCY_GLYPHS_PER_PAGE;
+  cache->slots = calloc(cache->slot_count, sizeof(glyph_slot_t));
+  cache->bitmap = calloc((size_t)glyph_width * glyph_height, 1);
+  if (cache->slots == NULL || cache->bitmap == NULL) {
+    log_error("Failed to allocate memory for the glyph cache");
+    procy_destroy_glyph_cache(cache);
+    return NULL;
+  }
+
+  // every slot starts out in the LRU list so that empty ones are used first
+  cache->lru_head = NO_SLOT;
+  cache->lru_tail = NO_SLOT;
+  for (int i = cache->slot_count - 1; i >= 0; --i) {
+    lru_push_front(cache, i);
+  }
+
+  // map the Unicode equivalents of non-ASCII CP437 characters onto the
+  // built-in glyphs
+  for (int c = 0; c < 256; ++c) {
+    if (CP437_CODEPOINTS[c] >= GLYPH_ASCII_COUNT) {
+      hmput(cache->cp437, CP437_CODEPOINTS[c], c);
+    }
+  }
+
+  return cache;
+}
+
+void procy_destroy_glyph_cache(glyph_cache_t *cache) {
+  if (cache == NULL) {
+    return;
+  }
+
+  hmfree(cache->glyphs);
+  hmfree(cache->cp437);
+  arrfree(cache->scratch);
+
+  if (cache->slots != NULL) {
+    free(cache->slots);
+  }
+
+  if (cache->bitmap != NULL) {
+    free(cache->bitmap);
+  }
+
+  if (cache->font != NULL) {
+    free(cache->font);
+  }
+
+  if (cache->font_data != NULL) {
+    free(cache->font_data);
+  }
+
+  free(cache);
+}
+
+bool procy_set_glyph_cache_font(glyph_cache_t *cache,
+                                const unsigned char *buffer, size_t length) {
+  // stb_truetype reads from the buffer lazily, so keep a copy around
+  unsigned char *data = malloc(length);
+  stbtt_fontinfo *font = malloc(sizeof(stbtt_fontinfo));
+  if (data == NULL || font == NULL) {
+    log_error("Failed to allocate memory for a font");
+    free(data);
+    free(font);
+    return false;
+  }
+
+  memcpy(data, buffer, length);
+
+  const int offset = stbtt_GetFontOffsetForIndex(data, 0);
+  if (offset < 0 || !stbtt_InitFont(font, data, offset)) {
+    log_error("Failed to parse font data (%zu bytes)", length);
+    free(data);
+    free(font);
+    return false;
+  }
+
+  if (cache->font != NULL) {
+    free(cache->font);
+  }
+
+  if (cache->font_data != NULL) {
+    free(cache->font_data);
+  }
+
+  cache->font = font;
+  cache->font_data = data;
+  cache->scale = stbtt_ScaleForPixelHeight(font, (float)cache->glyph_height);
+
+  int line_gap;
+  stbtt_GetFontVMetrics(font, &cache->ascent, &cache->descent, &line_gap);
+
+  reset_glyphs(cache);
+
+  log_debug("Loaded a glyph font with %d glyphs", font->numGlyphs);
+
+  return true;
+}
+
+void procy_glyph_cache_begin_frame(glyph_cache_t *cache) {
+  ++cache->frame;
+  cache->stats.hits = 0;
+  cache->stats.misses = 0;
+  cache->stats.evictions = 0;
+  cache->stats.upload_bytes = 0;
+}
+
+glyph_lookup_t procy_glyph_cache_get(glyph_cache_t *cache, uint32_t codepoint,
+                                     bool bold, int *layer, int *cell,
+                                     bool *evicted_in_use) {
+  *evicted_in_use = false;
+  *layer = bold ? GLYPH_LAYER_BOLD : GLYPH_LAYER_REGULAR;
+
+  if (codepoint < GLYPH_ASCII_COUNT) {
+    *cell = (int)codepoint;
+    return PROCY_GLYPH_FOUND;
+  }
+
+  ptrdiff_t index = hmgeti(cache->cp437, codepoint);
+  if (index >= 0) {
+    *cell = cache->cp437[index].value;
+    return PROCY_GLYPH_FOUND;
+  }
+
+  // invalid codepoints would collide with the bold flag in the key, and
+  // remembering each of them as missing would let the table grow unbounded
+  if (codepoint > PROCY_MAX_CODEPOINT) {
+    *cell = GLYPH_MISSING_CELL;
+    return PROCY_GLYPH_MISSING;
+  }
+
+  const uint32_t key = codepoint | (bold ? GLYPH_KEY_BOLD : 0);
+  index = hmgeti(cache->glyphs, key);
+  if (index >= 0 && cache->glyphs[index].value == NO_SLOT) {
+    // already known to be missing from the font
+    *cell = GLYPH_MISSING_CELL;
+    return PROCY_GLYPH_MISSING;
+  }
+
+  if (index >= 0) {
+    const int slot = cache->glyphs[index].value;
+    touch_slot(cache, slot);
+    get_slot_location(cache, slot, layer, cell);
+
+    ++cache->stats.hits;
+    ++cache->stats.total_hits;
+    return PROCY_GLYPH_FOUND;
+  }
+
+  ++cache->stats.misses;
+  ++cache->stats.total_misses;
+
+  if (cache->slot_count == 0 || !rasterize_glyph(cache, codepoint, bold)) {
+    hmput(cache->glyphs, key, NO_SLOT);
+    *cell = GLYPH_MISSING_CELL;
+    return PROCY_GLYPH_MISSING;
+  }
+
+  // take over the least-recently used slot
+  const int slot = cache->lru_tail;
+  glyph_slot_t *s = &cache->slots[slot];
+  if (s->occupied) {
+    hmdel(cache->glyphs, s->key);
+    *evicted_in_use = s->frame == cache->frame;
+    ++cache->stats.evictions;
+    ++cache->generation;
+  }
+
+  s->key = key;
+  s->occupied = true;
+  touch_slot(cache, slot);
+  hmput(cache->glyphs, key, slot);
+  get_slot_location(cache, slot, layer, cell);
+
+  cache->stats.upload_bytes +=
+      (size_t)cache->glyph_width * cache->glyph_height;
+
+  return PROCY_GLYPH_RASTERIZED;
+}
+
+void procy_glyph_cache_touch(glyph_cache_t *cache, int layer, int cell) {
+  const int slot = (layer - cache->first_layer) * PROCY_GLYPHS_PER_PAGE + cell;
+  if (layer < cache->first_layer || slot >= cache->slot_count ||
+      !cache->slots[slot].occupied) {
+    return;
+  }
+
+  touch_slot(cache, slot);
+
+  ++cache->stats.hits;
+  ++cache->stats.total_hits;
+}
+
+uint32_t procy_cp437_to_codepoint(unsigned char c) {
+  return CP437_CODEPOINTS[c];
+}
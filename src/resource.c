@@ -0,0 +1,53 @@
+#include "resource.h"
+
+#include <stb_ds.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gen/embed.h"
+
+typedef procy_embedded_resource_t resource_t;
+
+typedef struct resource_bundle_t {
+  const resource_t *resources;
+  size_t count;
+} resource_bundle_t;
+
+static resource_bundle_t *registered_bundles = NULL;
+
+static int compare_resource_name(const void *name, const void *resource) {
+  return strcmp((const char *)name, ((const resource_t *)resource)->name);
+}
+
+static const resource_t *find_resource(const resource_t *resources,
+                                       size_t count, const char *name) {
+  return bsearch(name, resources, count, sizeof(resource_t),
+                 compare_resource_name);
+}
+
+const resource_t *procy_get_embedded_resource(const char *name) {
+  if (name == NULL) {
+    return NULL;
+  }
+
+  // search newer bundles first so that they can override older ones
+  for (ptrdiff_t i = arrlen(registered_bundles) - 1; i >= 0; --i) {
+    const resource_t *resource = find_resource(
+        registered_bundles[i].resources, registered_bundles[i].count, name);
+    if (resource != NULL) {
+      return resource;
+    }
+  }
+
+  return find_resource(embed_index, embed_count, name);
+}
+
+void procy_register_embedded_resources(const resource_t *resources,
+                                       size_t count) {
+  if (resources == NULL || count == 0) {
+    return;
+  }
+
+  resource_bundle_t bundle = {resources, count};
+  arrpush(registered_bundles, bundle);
+}
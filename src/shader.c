@@ -1,6 +1,15 @@
 #include "shader.h"
 
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
 
 // clang-format off
 #include "opengl.h"
@@ -13,6 +22,30 @@
 
 typedef procy_shader_program_t shader_program_t;
 
+#ifdef _WIN32
+#define SHADER_CACHE_PATH_SEPARATOR '\\'
+#else
+#define SHADER_CACHE_PATH_SEPARATOR '/'
+#endif
+
+#define SHADER_CACHE_DIR_NAME "procyon"
+#define SHADER_CACHE_MAGIC 0x59435250  // "PRCY"
+#define SHADER_CACHE_PATH_MAX 1024
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+// header stored at the beginning of each cached program binary
+typedef struct shader_cache_header_t {
+  uint32_t magic;
+  uint32_t format;
+  uint32_t length;
+} shader_cache_header_t;
+
+// NULL until first use, at which point the default location is resolved
+static char *shader_cache_dir = NULL;
+static bool shader_cache_disabled = false;
+
 static bool compile_shader(const char *data, int shader_type, GLuint *index) {
   *index = glCreateShader(shader_type);
   const GLchar *vert_source[1] = {data};
@@ -41,6 +74,15 @@ static bool compile_shader(const char *data, int shader_type, GLuint *index) {
 bool procy_link_shader_program(unsigned int vert, unsigned int frag,
                                unsigned int *index) {
   *index = glCreateProgram();
+
+#ifndef __EMSCRIPTEN__
+  if (GLAD_GL_ARB_get_program_binary) {
+    // let the driver know that we intend to store the linked binary
+    GL_CHECK(glProgramParameteri(*index, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                                 GL_TRUE));
+  }
+#endif
+
   GL_CHECK(glAttachShader(*index, vert));
   GL_CHECK(glAttachShader(*index, frag));
   GL_CHECK(glLinkProgram(*index));
@@ -91,10 +133,221 @@ void procy_destroy_shader_program(shader_program_t *shader) {
   }
 }
 
+#ifndef __EMSCRIPTEN__
+
+static uint64_t hash_string(uint64_t hash, const char *str) {
+  // FNV-1a, including the null-terminator so that adjacent strings can't
+  // produce the same hash by shifting characters between them
+  do {
+    hash ^= (unsigned char)*str;
+    hash *= FNV_PRIME;
+  } while (*str++ != '\0');
+
+  return hash;
+}
+
+static const char *get_gl_string(GLenum name) {
+  const char *value = (const char *)glGetString(name);
+  return value != NULL ? value : "";
+}
+
+static bool make_cache_dir(char *path) {
+  // create each missing component of the path in turn
+  for (char *sep = path + 1; *sep != '\0'; ++sep) {
+    if (*sep != SHADER_CACHE_PATH_SEPARATOR) {
+      continue;
+    }
+
+    *sep = '\0';
+#ifdef _WIN32
+    int result = _mkdir(path);
+#else
+    int result = mkdir(path, 0755);
+#endif
+    *sep = SHADER_CACHE_PATH_SEPARATOR;
+
+    if (result != 0 && errno != EEXIST) {
+      log_warn("Failed to create shader cache directory \"%s\": %s", path,
+               strerror(errno));
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static const char *get_shader_cache_dir(void) {
+  if (shader_cache_disabled) {
+    return NULL;
+  }
+
+  if (shader_cache_dir == NULL) {
+    // resolve the default per-user cache location
+#ifdef _WIN32
+    const char *root = getenv("LOCALAPPDATA");
+    const char *suffix = "";
+#else
+    const char *root = getenv("XDG_CACHE_HOME");
+    const char *suffix = "";
+    if (root == NULL || *root == '\0') {
+      root = getenv("HOME");
+      suffix = "/.cache";
+    }
+#endif
+
+    if (root == NULL || *root == '\0') {
+      shader_cache_disabled = true;
+      return NULL;
+    }
+
+    size_t length =
+        strlen(root) + strlen(suffix) + strlen(SHADER_CACHE_DIR_NAME) + 2;
+    shader_cache_dir = malloc(length);
+    if (shader_cache_dir == NULL) {
+      return NULL;
+    }
+
+    snprintf(shader_cache_dir, length, "%s%s%c%s", root, suffix,
+             SHADER_CACHE_PATH_SEPARATOR, SHADER_CACHE_DIR_NAME);
+  }
+
+  return shader_cache_dir;
+}
+
+static bool get_cache_path(const char *vert, const char *frag, char *path,
+                           size_t length) {
+  const char *dir = get_shader_cache_dir();
+  if (dir == NULL) {
+    return false;
+  }
+
+  // binaries are only valid for the exact driver that produced them, so key
+  // them by driver identity as well as by shader source
+  uint64_t hash = FNV_OFFSET_BASIS;
+  hash = hash_string(hash, get_gl_string(GL_VENDOR));
+  hash = hash_string(hash, get_gl_string(GL_RENDERER));
+  hash = hash_string(hash, get_gl_string(GL_VERSION));
+  hash = hash_string(hash, vert);
+  hash = hash_string(hash, frag);
+
+  int written = snprintf(path, length, "%s%c%016llx.bin", dir,
+                         SHADER_CACHE_PATH_SEPARATOR, (unsigned long long)hash);
+  return written > 0 && (size_t)written < length;
+}
+
+static bool load_cached_program(const char *path, unsigned int *index) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+
+  shader_cache_header_t header;
+  void *binary = NULL;
+  if (fread(&header, sizeof(header), 1, file) == 1 &&
+      header.magic == SHADER_CACHE_MAGIC && header.length > 0) {
+    binary = malloc(header.length);
+    if (binary != NULL &&
+        fread(binary, 1, header.length, file) != header.length) {
+      free(binary);
+      binary = NULL;
+    }
+  }
+
+  fclose(file);
+
+  if (binary == NULL) {
+    log_debug("Ignoring malformed shader cache file \"%s\"", path);
+    return false;
+  }
+
+  *index = glCreateProgram();
+  glProgramBinary(*index, header.format, binary, (GLsizei)header.length);
+  free(binary);
+
+  // the driver rejects binaries built by a different version of itself, in
+  // which case the program is simply compiled from source again
+  GLint linked;
+  GL_CHECK(glGetProgramiv(*index, GL_LINK_STATUS, &linked));
+  if (linked != GL_TRUE) {
+    log_debug("Cached shader program \"%s\" was rejected by the driver", path);
+    glDeleteProgram(*index);
+    *index = 0;
+    return false;
+  }
+
+  log_debug("Loaded shader program from cache \"%s\"", path);
+
+  return true;
+}
+
+static void store_cached_program(const char *path, unsigned int index) {
+  GLint length = 0;
+  GL_CHECK(glGetProgramiv(index, GL_PROGRAM_BINARY_LENGTH, &length));
+  if (length <= 0) {
+    return;
+  }
+
+  void *binary = malloc(length);
+  if (binary == NULL) {
+    return;
+  }
+
+  GLenum format;
+  GL_CHECK(glGetProgramBinary(index, length, &length, &format, binary));
+
+  char *dir = strdup(path);
+  bool ready = dir != NULL && make_cache_dir(dir);
+  free(dir);
+
+  FILE *file = ready ? fopen(path, "wb") : NULL;
+  if (file == NULL) {
+    log_debug("Failed to write shader cache file \"%s\"", path);
+  } else {
+    shader_cache_header_t header = {SHADER_CACHE_MAGIC, format,
+                                    (uint32_t)length};
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(binary, 1, length, file);
+    fclose(file);
+
+    log_debug("Stored shader program in cache \"%s\" (%d bytes)", path,
+              length);
+  }
+
+  free(binary);
+}
+
+#endif
+
+void procy_set_shader_cache_dir(const char *path) {
+  free(shader_cache_dir);
+  shader_cache_dir = path != NULL ? strdup(path) : NULL;
+  shader_cache_disabled = path == NULL;
+}
+
 bool procy_compile_and_link_shader(procy_shader_program_t *program,
                                    const char *vert, const char *frag) {
-  return procy_compile_frag_shader(frag, &program->fragment) &&
-         procy_compile_vert_shader(vert, &program->vertex) &&
-         procy_link_shader_program(program->vertex, program->fragment,
-                                   &program->program);
+#ifndef __EMSCRIPTEN__
+  char path[SHADER_CACHE_PATH_MAX];
+  bool cacheable = GLAD_GL_ARB_get_program_binary &&
+                   get_cache_path(vert, frag, path, sizeof(path));
+
+  if (cacheable && load_cached_program(path, &program->program)) {
+    return true;
+  }
+#endif
+
+  if (!procy_compile_frag_shader(frag, &program->fragment) ||
+      !procy_compile_vert_shader(vert, &program->vertex) ||
+      !procy_link_shader_program(program->vertex, program->fragment,
+                                 &program->program)) {
+    return false;
+  }
+
+#ifndef __EMSCRIPTEN__
+  if (cacheable) {
+    store_cached_program(path, program->program);
+  }
+#endif
+
+  return true;
 }
@@ -5,8 +5,7 @@
 #include <GLFW/glfw3.h>
 // clang-format on
 
-#include "gen/frame_frag.h"
-#include "gen/frame_vert.h"
+#include "gen/embed.h"
 #include "shader/error.h"
 #include "window.h"
 
@@ -2,24 +2,22 @@
 
 #include "shader.h"
 
-#define STB_IMAGE_IMPLEMENTATION
-#define STBI_FAILURE_USERMSG
-#include <stb_image.h>
-
 // clang-format off
 #include "opengl.h"
 #include <GLFW/glfw3.h>
 // clang-format on
 
 #include <log.h>
+#include <math.h>
 #include <stb_ds.h>
+#include <string.h>
 
 #include "drawing.h"
-#include "gen/glyph_frag.h"
-#include "gen/glyph_vert.h"
-#include "gen/tileset.h"
-#include "gen/tileset_bold.h"
+#include "gen/embed.h"
+#include "gen/glyph_atlas.h"
+#include "glyph_cache.h"
 #include "shader/error.h"
+#include "text_run.h"
 #include "window.h"
 
 typedef procy_window_t window_t;
@@ -27,13 +25,14 @@ typedef procy_shader_program_t shader_program_t;
 typedef procy_glyph_shader_program_t glyph_shader_program_t;
 typedef procy_color_t color_t;
 typedef procy_draw_op_text_t draw_op_text_t;
+typedef procy_draw_op_text_run_t draw_op_text_run_t;
 
 #pragma pack(0)
-typedef struct glyph_vertex_t {
+typedef struct procy_glyph_vertex_t {
   float x, y, z, u, v;
   int forecolor;
   int backcolor;
-  float bold;
+  float layer;
 } glyph_vertex_t;
 #pragma pack(1)
 
@@ -43,11 +42,15 @@ typedef struct glyph_vertex_t {
 #define ATTR_GLYPH_TEXCOORDS 1
 #define ATTR_GLYPH_FORECOLOR 2
 #define ATTR_GLYPH_BACKCOLOR 3
-#define ATTR_GLYPH_BOLD 4
+#define ATTR_GLYPH_LAYER 4
 
 // size of the glyph texture in terms of number of glyphs per side
-#define GLYPH_WIDTH_COUNT 16
-#define GLYPH_HEIGHT_COUNT 16
+#define GLYPH_WIDTH_COUNT PROCY_GLYPH_PAGE_CELLS
+#define GLYPH_HEIGHT_COUNT PROCY_GLYPH_PAGE_CELLS
+
+// number of texture layers holding glyphs rasterized at runtime
+#define GLYPH_CACHE_PAGES 4
+#define GLYPH_ASCII_COUNT 128
 
 #define VERTICES_PER_GLYPH 4
 #define INDICES_PER_GLYPH 6
@@ -76,9 +79,9 @@ static void enable_shader_attributes(shader_program_t *program) {
       ATTR_GLYPH_BACKCOLOR, 1, GL_INT, sizeof(glyph_vertex_t),
       (void *)(5 * sizeof(float) + sizeof(int))));  // NOLINT
 
-  GL_CHECK(glEnableVertexAttribArray(ATTR_GLYPH_BOLD));
+  GL_CHECK(glEnableVertexAttribArray(ATTR_GLYPH_LAYER));
   GL_CHECK(glVertexAttribPointer(
-      ATTR_GLYPH_BOLD, 1, GL_FLOAT, GL_FALSE, sizeof(glyph_vertex_t),
+      ATTR_GLYPH_LAYER, 1, GL_FLOAT, GL_FALSE, sizeof(glyph_vertex_t),
       (void *)(5 * sizeof(float) + 2 * sizeof(int))));  // NOLINT
 }
 
@@ -87,78 +90,45 @@ static void load_glyph_font(glyph_shader_program_t *shader) {
     GL_CHECK(glDeleteTextures(1, &shader->font_texture));
   }
 
-  int components;
-  unsigned char *bitmap_thin = stbi_load_from_memory(
-      embed_tileset, sizeof(embed_tileset) / sizeof(unsigned char),
-      &shader->texture_bounds.width, &shader->texture_bounds.height,
-      &components, 1);
-  unsigned char *bitmap_bold = stbi_load_from_memory(
-      embed_tileset_bold, sizeof(embed_tileset_bold) / sizeof(unsigned char),
-      &shader->texture_bounds.width, &shader->texture_bounds.height,
-      &components, 1);
-
-  if (bitmap_thin == NULL || bitmap_bold == NULL ||
-      shader->texture_bounds.width < 0 || shader->texture_bounds.height < 0) {
-    log_error("Failed to read glyph texture");
-    const char *msg = stbi_failure_reason();
-    if (msg != NULL) {
-      log_error("STBI failure message: %s", msg);
-    }
-  } else {
-    // compute glyph screen- and texture-space bounds
-    shader->glyph_bounds.width =
-        shader->texture_bounds.width / GLYPH_WIDTH_COUNT;
-    shader->glyph_bounds.height =
-        shader->texture_bounds.height / GLYPH_HEIGHT_COUNT;
-    shader->glyph_bounds.tex_width =
-        (float)shader->glyph_bounds.width / (float)shader->texture_bounds.width;
-    shader->glyph_bounds.tex_height = (float)shader->glyph_bounds.height /
-                                      (float)shader->texture_bounds.height;
-
-    // copy both bitmap buffers into a single location
-    size_t bitmap_size =
-        (size_t)shader->texture_bounds.width * shader->texture_bounds.height;
-    if (bitmap_size != 0) {
-      unsigned char *combined_buffer =
-          malloc(sizeof(unsigned char) * bitmap_size * 2);
-      if (combined_buffer != NULL) {
-        memcpy(combined_buffer, bitmap_thin, bitmap_size);
-        memcpy(&combined_buffer[bitmap_size], bitmap_bold, bitmap_size);
-
-        // create font texture array from bitmaps
-        GL_CHECK(glGenTextures(1, &shader->font_texture));
-
-        GL_CHECK(glBindTexture(GL_TEXTURE_2D_ARRAY, shader->font_texture));
-        GL_CHECK(glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RED,
-                              shader->texture_bounds.width,
-                              shader->texture_bounds.height, 2, 0, GL_RED,
-                              GL_UNSIGNED_BYTE, combined_buffer));
-
-        free(combined_buffer);
-
-        GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
-                                 GL_NEAREST));
-        GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER,
-                                 GL_NEAREST));
-
-        log_debug("Combined glyph bitmap size: %zu", bitmap_size * 2);
-        log_debug("Glyph texture ID: %u", shader->font_texture);
-      } else {
-        log_error(
-            "Failed to allocate enough memory for combined glyph texture");
-      }
-    } else {
-      log_error("Glyph texture size is zero!");
-    }
-  }
+  // the atlas is decoded at build time, with the regular and bold layers
+  // stored back-to-back, so it can be uploaded as-is; the layers after them
+  // are filled in by the glyph cache
+  shader->texture_bounds.width = embed_glyph_atlas_width;
+  shader->texture_bounds.height = embed_glyph_atlas_height;
 
-  if (bitmap_thin != NULL) {
-    stbi_image_free(bitmap_thin);
-  }
+  // compute glyph screen- and texture-space bounds
+  shader->glyph_bounds.width = shader->texture_bounds.width / GLYPH_WIDTH_COUNT;
+  shader->glyph_bounds.height =
+      shader->texture_bounds.height / GLYPH_HEIGHT_COUNT;
+  shader->glyph_bounds.tex_width =
+      (float)shader->glyph_bounds.width / (float)shader->texture_bounds.width;
+  shader->glyph_bounds.tex_height =
+      (float)shader->glyph_bounds.height / (float)shader->texture_bounds.height;
 
-  if (bitmap_bold != NULL) {
-    stbi_image_free(bitmap_bold);
-  }
+  // create font texture array from bitmaps
+  GL_CHECK(glGenTextures(1, &shader->font_texture));
+
+  GL_CHECK(glBindTexture(GL_TEXTURE_2D_ARRAY, shader->font_texture));
+  GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+  GL_CHECK(glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8,
+                        shader->texture_bounds.width,
+                        shader->texture_bounds.height,
+                        embed_glyph_atlas_layers + GLYPH_CACHE_PAGES, 0,
+                        GL_RED, GL_UNSIGNED_BYTE, NULL));
+  GL_CHECK(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+                           shader->texture_bounds.width,
+                           shader->texture_bounds.height,
+                           embed_glyph_atlas_layers, GL_RED, GL_UNSIGNED_BYTE,
+                           &embed_glyph_atlas[0]));
+  GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+
+  GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                           GL_NEAREST));
+  GL_CHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER,
+                           GL_NEAREST));
+
+  log_debug("Glyph atlas size: %zu", sizeof(embed_glyph_atlas));
+  log_debug("Glyph texture ID: %u", shader->font_texture);
 }
 
 static void draw_glyph_batch(shader_program_t *program,
@@ -215,6 +185,10 @@ glyph_shader_program_t *procy_create_glyph_shader() {
   // load font texture and codepoints
   load_glyph_font(shader);
 
+  shader->cache = procy_create_glyph_cache(
+      shader->glyph_bounds.width, shader->glyph_bounds.height,
+      GLYPH_CACHE_PAGES, embed_glyph_atlas_layers);
+
   if (procy_compile_and_link_shader(program, (char *)&embed_glyph_vert[0],
                                     (char *)&embed_glyph_frag[0])) {
     shader->u_ortho =
@@ -233,11 +207,21 @@ glyph_shader_program_t *procy_create_glyph_shader() {
   return shader;
 }
 
-static void compute_glyph_vertices(glyph_shader_program_t *shader,
-                                   draw_op_text_t *op, glyph_vertex_t *vertices,
-                                   window_t *window) {
-  unsigned char c = op->character;
+static void upload_glyph(glyph_shader_program_t *shader, int layer, int cell) {
+  const int gw = shader->glyph_bounds.width;
+  const int gh = shader->glyph_bounds.height;
 
+  GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+  GL_CHECK(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0,
+                           (cell % GLYPH_WIDTH_COUNT) * gw,
+                           (cell / GLYPH_WIDTH_COUNT) * gh, layer, gw, gh, 1,
+                           GL_RED, GL_UNSIGNED_BYTE, shader->cache->bitmap));
+  GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+}
+
+static void compute_glyph_vertices(glyph_shader_program_t *shader,
+                                   draw_op_text_t *op, int layer, int cell,
+                                   glyph_vertex_t *vertices) {
   float gw = (float)shader->glyph_bounds.width;
   float gh = (float)shader->glyph_bounds.height;
   float tw = shader->glyph_bounds.tex_width;
@@ -249,28 +233,180 @@ static void compute_glyph_vertices(glyph_shader_program_t *shader,
   float z = (float)op->z;
 
   // texture coordinates
-  float tx = (float)(c % GLYPH_WIDTH_COUNT) * (float)gw /
+  float tx = (float)(cell % GLYPH_WIDTH_COUNT) * (float)gw /
              (float)shader->texture_bounds.width;
-  float ty = floorf((float)c / (float)GLYPH_HEIGHT_COUNT) * (float)gh /
+  float ty = floorf((float)cell / (float)GLYPH_HEIGHT_COUNT) * (float)gh /
              (float)shader->texture_bounds.height;
 
-  // colors + bold
+  // colors + texture layer
   int fg = op->color.value;
   int bg = op->background.value;
-  float bold = op->bold ? 1.0F : 0.0F;
+  float l = (float)layer;
 
-  vertices[0] = (glyph_vertex_t){x, y, z, tx, ty, fg, bg, bold};
-  vertices[1] = (glyph_vertex_t){x + gw, y, z, tx + tw, ty, fg, bg, bold};
-  vertices[2] = (glyph_vertex_t){x, y + gh, z, tx, ty + th, fg, bg, bold};
+  vertices[0] = (glyph_vertex_t){x, y, z, tx, ty, fg, bg, l};
+  vertices[1] = (glyph_vertex_t){x + gw, y, z, tx + tw, ty, fg, bg, l};
+  vertices[2] = (glyph_vertex_t){x, y + gh, z, tx, ty + th, fg, bg, l};
   vertices[3] =
-      (glyph_vertex_t){x + gw, y + gh, z, tx + tw, ty + th, fg, bg, bold};
+      (glyph_vertex_t){x + gw, y + gh, z, tx + tw, ty + th, fg, bg, l};
 }
 
-void procy_draw_glyph_shader(glyph_shader_program_t *shader, window_t *window,
-                             draw_op_text_t *draw_ops) {
+// finds the texture layer and cell of an op's glyph, uploading it first if it
+// had to be rasterized.  Returns false if that evicted a glyph already drawn
+// this frame.
+static bool resolve_glyph(glyph_shader_program_t *shader, draw_op_text_t *op,
+                          long *batch_index, int *layer, int *cell) {
+  procy_glyph_cache_t *cache = shader->cache;
+
+  // ASCII maps directly onto the built-in regular (0) and bold (1) layers;
+  // anything else goes through the glyph cache
+  *layer = op->bold ? 1 : 0;
+  *cell = (int)op->codepoint;
+  if (op->codepoint >= GLYPH_ASCII_COUNT && cache == NULL) {
+    *cell = '?';
+  } else if (op->codepoint >= GLYPH_ASCII_COUNT) {
+    bool evicted_in_use = false;
+    if (procy_glyph_cache_get(cache, op->codepoint, op->bold, layer, cell,
+                              &evicted_in_use) == PROCY_GLYPH_RASTERIZED) {
+      // glyphs waiting in the current batch may still refer to the cell
+      // that's about to be overwritten, so draw them first
+      if (evicted_in_use && *batch_index >= 0) {
+        draw_glyph_batch(&shader->program, shader->vertex_batch_buffer,
+                         shader->index_batch_buffer, *batch_index + 1);
+        *batch_index = -1;
+      }
+
+      upload_glyph(shader, *layer, *cell);
+    }
+
+    return !evicted_in_use;
+  }
+
+  return true;
+}
+
+// copies a glyph's 4 vertices into the batch buffer, offset by the given
+// position
+static void batch_vertices(glyph_shader_program_t *shader,
+                           const glyph_vertex_t *vertices, float x, float y,
+                           float z, long *batch_index) {
   glyph_vertex_t *vertex_batch = shader->vertex_batch_buffer;
   unsigned short *index_batch = shader->index_batch_buffer;
 
+  ++*batch_index;
+
+  size_t vert_index = (size_t)*batch_index * VERTICES_PER_GLYPH;
+  for (int i = 0; i < VERTICES_PER_GLYPH; ++i) {
+    glyph_vertex_t *vertex = &vertex_batch[vert_index + i];
+    *vertex = vertices[i];
+    vertex->x += x;
+    vertex->y += y;
+    vertex->z += z;
+  }
+
+  // specify the indices of the vertices in the order they're to be drawn
+  unsigned short temp_index_buffer[] = {vert_index,     vert_index + 1,
+                                        vert_index + 2, vert_index + 1,
+                                        vert_index + 3, vert_index + 2};
+  memcpy(&index_batch[*batch_index * INDICES_PER_GLYPH], temp_index_buffer,
+         sizeof(temp_index_buffer));
+
+  // if we've reached the end of the current batch, draw it and reset the
+  // index
+  if (*batch_index == DRAW_BATCH_SIZE - 1) {
+    draw_glyph_batch(&shader->program, vertex_batch, index_batch,
+                     *batch_index + 1);
+    *batch_index = -1;
+  }
+}
+
+static void batch_glyph(glyph_shader_program_t *shader, draw_op_text_t *op,
+                        long *batch_index) {
+  int layer;
+  int cell;
+  resolve_glyph(shader, op, batch_index, &layer, &cell);
+
+  glyph_vertex_t vertices[VERTICES_PER_GLYPH];
+  compute_glyph_vertices(shader, op, layer, cell, &vertices[0]);
+  batch_vertices(shader, &vertices[0], 0.0F, 0.0F, 0.0F, batch_index);
+}
+
+static bool is_text_run_built(glyph_shader_program_t *shader,
+                              procy_text_run_t *run) {
+  return arrlen(run->vertices) == arrlen(run->glyphs) * VERTICES_PER_GLYPH &&
+         (shader->cache == NULL ||
+          run->generation == shader->cache->generation);
+}
+
+// looks up each of the run's glyphs and builds its geometry relative to the
+// run's origin, batching it at the same time
+static void build_text_run(glyph_shader_program_t *shader,
+                           procy_text_run_t *run, float x, float y, float z,
+                           long *batch_index) {
+  const int gw = shader->glyph_bounds.width;
+  const int count = (int)arrlen(run->glyphs);
+  arrsetlen(run->vertices, count * VERTICES_PER_GLYPH);
+  arrsetlen(run->cached_cells, 0);
+
+  bool complete = true;
+  for (int i = 0; i < count; ++i) {
+    draw_op_text_t op = run->glyphs[i];
+    op.x *= gw;
+    op.y = 0;
+    op.z = 0;
+
+    int layer;
+    int cell;
+    complete &= resolve_glyph(shader, &op, batch_index, &layer, &cell);
+    if (layer >= embed_glyph_atlas_layers) {
+      arrput(run->cached_cells, layer * PROCY_GLYPHS_PER_PAGE + cell);
+    }
+
+    glyph_vertex_t *vertices = &run->vertices[i * VERTICES_PER_GLYPH];
+    compute_glyph_vertices(shader, &op, layer, cell, vertices);
+    batch_vertices(shader, vertices, x, y, z, batch_index);
+  }
+
+  if (shader->cache != NULL) {
+    run->generation = shader->cache->generation;
+  }
+
+  // a glyph drawn this frame was evicted, which may have been one of the
+  // run's own, so build it again next time
+  if (!complete) {
+    arrsetlen(run->vertices, 0);
+  }
+}
+
+static void batch_text_run(glyph_shader_program_t *shader,
+                           draw_op_text_run_t *run_op, long *batch_index) {
+  procy_text_run_t *run = run_op->run;
+  const float x = (float)run_op->x;
+  const float y = (float)run_op->y;
+  const float z = (float)run_op->z;
+
+  // runs are rebuilt only after they've changed or glyphs have been evicted
+  // from the cache, since one of those may have been theirs
+  if (!is_text_run_built(shader, run)) {
+    build_text_run(shader, run, x, y, z, batch_index);
+    return;
+  }
+
+  // keep the run's cached glyphs from being evicted while it's queued
+  for (int i = 0; i < arrlen(run->cached_cells); ++i) {
+    const int cell = run->cached_cells[i];
+    procy_glyph_cache_touch(shader->cache, cell / PROCY_GLYPHS_PER_PAGE,
+                            cell % PROCY_GLYPHS_PER_PAGE);
+  }
+
+  for (int i = 0; i < arrlen(run->glyphs); ++i) {
+    batch_vertices(shader, &run->vertices[i * VERTICES_PER_GLYPH], x, y, z,
+                   batch_index);
+  }
+}
+
+void procy_draw_glyph_shader(glyph_shader_program_t *shader, window_t *window,
+                             draw_op_text_t *draw_ops,
+                             draw_op_text_run_t *run_ops) {
   shader_program_t *program = &shader->program;
   GL_CHECK(glUseProgram(program->program));
 
@@ -283,44 +419,26 @@ void procy_draw_glyph_shader(glyph_shader_program_t *shader, window_t *window,
 
   enable_shader_attributes(program);
 
-  // glyph vertex dimensions and u/v coordinates will be the same for every
-  // glyph drawn, so compute them just once
+  if (shader->cache != NULL) {
+    procy_glyph_cache_begin_frame(shader->cache);
+  }
 
   long batch_index = -1;
   while (arrlen(draw_ops) > 0) {
     draw_op_text_t op = arrpop(draw_ops);
+    batch_glyph(shader, &op, &batch_index);
+  }
 
-    ++batch_index;
-
-    size_t vert_index = (size_t)batch_index * VERTICES_PER_GLYPH;
-
-    // compute the glyph's 4 vertices
-    glyph_vertex_t temp_vertex_buffer[VERTICES_PER_GLYPH];
-    compute_glyph_vertices(shader, &op, &temp_vertex_buffer[0], window);
-
-    // specify the indices of the vertices in the order they're to be drawn
-    unsigned short temp_index_buffer[] = {vert_index,     vert_index + 1,
-                                        vert_index + 2, vert_index + 1,
-                                        vert_index + 3, vert_index + 2};
-
-    // copy vertices and indices to the batch buffer
-    memcpy(&vertex_batch[vert_index], temp_vertex_buffer,
-           sizeof(temp_vertex_buffer));
-    memcpy(&index_batch[batch_index * INDICES_PER_GLYPH], temp_index_buffer,
-           sizeof(temp_index_buffer));
-
-    // if we've reached the end of the current batch, draw it and reset the
-    // index
-    if (batch_index == DRAW_BATCH_SIZE - 1) {
-      draw_glyph_batch(program, vertex_batch, index_batch, batch_index + 1);
-      batch_index = -1;
-    }
+  while (arrlen(run_ops) > 0) {
+    draw_op_text_run_t run_op = arrpop(run_ops);
+    batch_text_run(shader, &run_op, &batch_index);
+    procy_release_text_run(run_op.run);
   }
 
   // if there are any remaining glyphs in the batch buffer, draw them
   if (batch_index >= 0) {
-    draw_glyph_batch(program, &vertex_batch[0], &index_batch[0],
-                     batch_index + 1);
+    draw_glyph_batch(program, shader->vertex_batch_buffer,
+                     shader->index_batch_buffer, batch_index + 1);
   }
 
   glUseProgram(0);
@@ -336,9 +454,16 @@ void procy_get_glyph_bounds(glyph_shader_program_t *shader, int *width,
   }
 }
 
+bool procy_set_glyph_shader_font(glyph_shader_program_t *shader,
+                                 const unsigned char *buffer, size_t length) {
+  return shader->cache != NULL &&
+         procy_set_glyph_cache_font(shader->cache, buffer, length);
+}
+
 void procy_destroy_glyph_shader(glyph_shader_program_t *shader) {
   if (shader != NULL) {
     procy_destroy_shader_program(&shader->program);
+    procy_destroy_glyph_cache(shader->cache);
 
     // delete font texture
     if (glIsTexture(shader->font_texture)) {
@@ -9,8 +9,7 @@
 #include <stb_ds.h>
 
 #include "drawing.h"
-#include "gen/line_frag.h"
-#include "gen/line_vert.h"
+#include "gen/embed.h"
 #include "shader.h"
 #include "shader/error.h"
 #include "window.h"
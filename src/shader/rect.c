@@ -10,8 +10,7 @@
 #include <string.h>
 
 #include "drawing.h"
-#include "gen/rect_frag.h"
-#include "gen/rect_vert.h"
+#include "gen/embed.h"
 #include "shader/error.h"
 #include "window.h"
 
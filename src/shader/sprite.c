@@ -5,6 +5,7 @@
 #include <stb_ds.h>
 #include <string.h>
 
+#define STB_IMAGE_IMPLEMENTATION
 #define STBI_FAILURE_USERMSG
 #include <stb_image.h>
 
@@ -14,8 +15,7 @@
 // clang-format on
 
 #include "drawing.h"
-#include "gen/sprite_frag.h"
-#include "gen/sprite_vert.h"
+#include "gen/embed.h"
 #include "shader/error.h"
 #include "window.h"
 
@@ -44,6 +44,49 @@ typedef struct sprite_vertex_t {
 #define INDICES_PER_SPRITE 6
 #define DRAW_BATCH_SIZE 4096
 
+// every sprite shader renders with the same program and only differs by its
+// texture, so the program is compiled once and shared between all of them
+static unsigned int shared_program = 0;
+static unsigned int shared_u_ortho = 0;
+static int shared_program_refs = 0;
+
+static bool acquire_sprite_program(sprite_shader_program_t *shader) {
+  if (shared_program_refs == 0) {
+    shader_program_t compiled = {0};
+    if (!procy_compile_and_link_shader(&compiled, (char *)&embed_sprite_vert[0],
+                                       (char *)&embed_sprite_frag[0])) {
+      return false;
+    }
+
+    shared_program = compiled.program;
+    shared_u_ortho = GL_CHECK(glGetUniformLocation(shared_program, "u_Ortho"));
+  }
+
+  ++shared_program_refs;
+  shader->program.program = shared_program;
+  shader->u_ortho = shared_u_ortho;
+
+  return true;
+}
+
+static void release_sprite_program(sprite_shader_program_t *shader) {
+  if (shader->program.program == 0) {
+    return;
+  }
+
+  // detach the shared program so that it isn't deleted along with the rest of
+  // this shader's resources
+  shader->program.program = 0;
+
+  if (--shared_program_refs == 0) {
+    if (glIsProgram(shared_program)) {
+      glDeleteProgram(shared_program);
+    }
+
+    shared_program = 0;
+  }
+}
+
 static void enable_shader_attributes(shader_program_t *program) {
   GL_CHECK(glBindVertexArray(program->vao));
   GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, program->vbo[VBO_SPRITE_POSITION]));
@@ -192,10 +235,8 @@ sprite_shader_program_t *procy_create_sprite_shader_mem(unsigned char *contents,
   program->vbo = malloc(sizeof(unsigned short) * program->vbo_count);
   GL_CHECK(glGenBuffers((int)program->vbo_count, program->vbo));
 
-  if (procy_compile_and_link_shader(program, (char *)&embed_sprite_vert[0],
-                                    (char *)&embed_sprite_frag[0])) {
-    sprite_shader->u_ortho =
-        GL_CHECK(glGetUniformLocation(program->program, "u_Ortho"));
+  if (!acquire_sprite_program(sprite_shader)) {
+    log_error("Failed to build the sprite shader program");
   }
 
   return sprite_shader;
@@ -318,6 +359,7 @@ void procy_draw_sprite_shader(procy_sprite_shader_program_t *shader,
 
 void procy_destroy_sprite_shader(sprite_shader_program_t *shader) {
   if (shader != NULL) {
+    release_sprite_program(shader);
     procy_destroy_shader_program(&shader->program);
 
     // delete font texture
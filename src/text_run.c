@@ -0,0 +1,125 @@
+#include "text_run.h"
+
+#include <log.h>
+#include <stb_ds.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drawing.h"
+#include "window.h"
+
+typedef procy_text_run_t text_run_t;
+typedef procy_draw_op_text_t draw_op_text_t;
+typedef procy_draw_op_text_run_t draw_op_text_run_t;
+typedef procy_color_t color_t;
+
+static void parse_text_run(text_run_t *run) {
+  arrsetlen(run->glyphs, 0);
+
+  // have the geometry rebuilt the next time the run is drawn; the vertex type
+  // is private to the glyph shader, so its array is dropped rather than reused
+  arrfree(run->vertices);
+  arrsetlen(run->cached_cells, 0);
+
+  procy_text_cursor_t cursor =
+      procy_create_text_cursor(run->contents, strlen(run->contents),
+                               run->utf8, run->color, run->background);
+  int column = 0;
+  uint32_t codepoint;
+  while (procy_next_text_glyph(&cursor, &codepoint)) {
+    draw_op_text_t op = procy_create_draw_op_codepoint_colored(
+        column++, 0, 0, cursor.color, cursor.background, codepoint,
+        cursor.bold);
+    arrput(run->glyphs, op);
+  }
+
+  run->columns = column;
+}
+
+static void free_text_run(text_run_t *run) {
+  arrfree(run->glyphs);
+  arrfree(run->vertices);
+  arrfree(run->cached_cells);
+
+  if (run->contents != NULL) {
+    free(run->contents);
+  }
+
+  free(run);
+}
+
+text_run_t *procy_create_text_run(const char *contents, color_t color,
+                                  color_t background, bool utf8) {
+  text_run_t *run = calloc(1, sizeof(text_run_t));
+  if (run == NULL) {
+    log_error("Failed to allocate memory for a text run");
+    return NULL;
+  }
+
+  run->utf8 = utf8;
+  run->color = color;
+  run->background = background;
+  run->contents = strdup(contents);
+  if (run->contents == NULL) {
+    log_error("Failed to allocate memory for a text run");
+    free(run);
+    return NULL;
+  }
+
+  parse_text_run(run);
+
+  return run;
+}
+
+bool procy_set_text_run(text_run_t *run, const char *contents, color_t color,
+                        color_t background) {
+  if (strcmp(run->contents, contents) == 0 &&
+      procy_colors_equal(&run->color, &color) &&
+      procy_colors_equal(&run->background, &background)) {
+    return false;
+  }
+
+  char *copy = strdup(contents);
+  if (copy == NULL) {
+    log_error("Failed to allocate memory for a text run");
+    return false;
+  }
+
+  free(run->contents);
+  run->contents = copy;
+  run->color = color;
+  run->background = background;
+
+  parse_text_run(run);
+
+  return true;
+}
+
+void procy_draw_text_run(struct procy_window_t *window, text_run_t *run,
+                         int x, int y, int z) {
+  if (run == NULL || run->destroyed) {
+    return;
+  }
+
+  draw_op_text_run_t op = {run, x, y, z};
+  ++run->pending;
+  procy_append_draw_op_text_run(window, &op);
+}
+
+void procy_destroy_text_run(text_run_t *run) {
+  if (run == NULL) {
+    return;
+  }
+
+  if (run->pending > 0) {
+    run->destroyed = true;
+  } else {
+    free_text_run(run);
+  }
+}
+
+void procy_release_text_run(text_run_t *run) {
+  if (--run->pending <= 0 && run->destroyed) {
+    free_text_run(run);
+  }
+}
@@ -14,6 +14,7 @@
 
 #include "color.h"
 #include "drawing.h"
+#include "glyph_cache.h"
 #include "keys.h"
 #include "mouse.h"
 #include "shader.h"
@@ -24,6 +25,7 @@
 #include "shader/rect.h"
 #include "shader/sprite.h"
 #include "state.h"
+#include "text_run.h"
 
 typedef procy_window_t window_t;
 typedef procy_glyph_shader_program_t glyph_shader_program_t;
@@ -31,6 +33,7 @@ typedef procy_rect_shader_program_t rect_shader_program_t;
 typedef procy_line_shader_program_t line_shader_program_t;
 typedef procy_sprite_shader_program_t sprite_shader_program_t;
 typedef procy_draw_op_text_t draw_op_text_t;
+typedef procy_draw_op_text_run_t draw_op_text_run_t;
 typedef procy_draw_op_rect_t draw_op_rect_t;
 typedef procy_draw_op_sprite_t draw_op_sprite_t;
 typedef procy_draw_op_line_t draw_op_line_t;
@@ -299,6 +302,12 @@ void procy_destroy_window(window_t *window) {
   arrfree(window->draw_ops_text);
   arrfree(window->draw_ops_line);
 
+  // text runs that were never drawn may be waiting to be freed
+  for (int i = 0; i < arrlen(window->draw_ops_text_run); ++i) {
+    procy_release_text_run(window->draw_ops_text_run[i].run);
+  }
+  arrfree(window->draw_ops_text_run);
+
   destroy_shaders(window);
 
   if (window->glfw_win != NULL) {
@@ -317,6 +326,15 @@ void procy_append_draw_op_text(procy_window_t *window, draw_op_text_t *op) {
   arrput(window->draw_ops_text, *op);
 }
 
+void procy_reserve_draw_ops_text(procy_window_t *window, size_t count) {
+  arrsetcap(window->draw_ops_text, arrlenu(window->draw_ops_text) + count);
+}
+
+void procy_append_draw_op_text_run(procy_window_t *window,
+                                   draw_op_text_run_t *op) {
+  arrput(window->draw_ops_text_run, *op);
+}
+
 void procy_append_draw_op_rect(procy_window_t *window, draw_op_rect_t *op) {
   arrput(window->draw_ops_rect, *op);
 }
@@ -359,6 +377,21 @@ void procy_get_glyph_size(procy_window_t *window, int *width, int *height) {
   }
 }
 
+void procy_get_glyph_cache_stats(procy_window_t *window,
+                                 procy_glyph_cache_stats_t *stats) {
+  procy_glyph_cache_t *cache = window->shaders.glyph->cache;
+  if (cache == NULL) {
+    memset(stats, 0, sizeof(procy_glyph_cache_stats_t));
+    return;
+  }
+
+  *stats = cache->stats;
+
+  const unsigned long lookups = stats->total_hits + stats->total_misses;
+  stats->hit_rate =
+      lookups > 0 ? (float)stats->total_hits / (float)lookups : 1.0F;
+}
+
 static void execute_draw_ops(window_t *window) {
   // bind the framebuffer so that all draw ops are drawn to its texture instead
   // of directly to the screen
@@ -366,7 +399,8 @@ static void execute_draw_ops(window_t *window) {
 
   procy_draw_rect_shader(window->shaders.rect, window, window->draw_ops_rect);
   procy_draw_line_shader(window->shaders.line, window, window->draw_ops_line);
-  procy_draw_glyph_shader(window->shaders.glyph, window, window->draw_ops_text);
+  procy_draw_glyph_shader(window->shaders.glyph, window, window->draw_ops_text,
+                          window->draw_ops_text_run);
   draw_sprite_shaders(window);
 
   // un-bind the framebuffer
@@ -432,6 +466,8 @@ void procy_set_high_fps_mode(procy_window_t *window, bool high_fps) {
   window->high_fps = high_fps;
 }
 
+double procy_get_time(void) { return glfwGetTime(); }
+
 void procy_set_window_title(procy_window_t *window, const char *title) {
   glfwSetWindowTitle(window->glfw_win, title);
 }
@@ -0,0 +1,103 @@
+/*
+ * GenAtlas
+ * Small utility for decoding a set of equally-sized images into a single
+ * ready-to-upload texture array, written out as a C header file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+int main(int argc, const char **argv) {
+  if (argc < 4) {
+    fputs("Usage: genatlas <outfile> <name> <layer> [<layer> ...]\n", stderr);
+    return -1;
+  }
+
+  const char *out_path = argv[1];
+  const char *name = argv[2];
+  const int layer_count = argc - 3;
+
+  // decode every layer up-front so that their dimensions can be validated
+  // before anything is written
+  unsigned char **layers = calloc(layer_count, sizeof(unsigned char *));
+  int width = -1;
+  int height = -1;
+  int status = 0;
+  for (int i = 0; i < layer_count; ++i) {
+    const char *in_path = argv[i + 3];
+
+    int layer_w;
+    int layer_h;
+    int components;
+    layers[i] = stbi_load(in_path, &layer_w, &layer_h, &components, 1);
+    if (layers[i] == NULL) {
+      fprintf(stderr, "Failed to decode %s: %s\n", in_path,
+              stbi_failure_reason());
+      status = -1;
+      break;
+    }
+
+    if (i == 0) {
+      width = layer_w;
+      height = layer_h;
+    } else if (layer_w != width || layer_h != height) {
+      fprintf(stderr, "Layer %s is %dx%d, expected %dx%d\n", in_path, layer_w,
+              layer_h, width, height);
+      status = -1;
+      break;
+    }
+  }
+
+  FILE *out_file = status == 0 ? fopen(out_path, "wb+") : NULL;
+  if (out_file != NULL) {
+    const unsigned long layer_size = (unsigned long)width * height;
+
+    // write include-guards, dimensions and declarations
+    fprintf(out_file, "#ifndef %s_H\n", name);
+    fprintf(out_file, "#define %s_H\n", name);
+    fprintf(out_file, "#define %s_width %d\n", name, width);
+    fprintf(out_file, "#define %s_height %d\n", name, height);
+    fprintf(out_file, "#define %s_layers %d\n", name, layer_count);
+    fprintf(out_file, "const unsigned char %s[%lu] = {\n", name,
+            layer_size * layer_count);
+
+    // layers are stored back-to-back, one row of pixels per line
+    for (int i = 0; i < layer_count; ++i) {
+      for (unsigned long p = 0; p < layer_size; ++p) {
+        fprintf(out_file, "0x%02x,%s", layers[i][p],
+                (p + 1) % width == 0 ? "\n" : " ");
+      }
+    }
+
+    fputs("};\n", out_file);
+
+    // terminate include guard
+    fprintf(out_file, "#endif\n");
+
+    fclose(out_file);
+
+    // report results
+    printf("GenAtlas output: %s,\n"
+           "         name: %s\n"
+           "         layers: %d\n"
+           "         size: %dx%d (%lu bytes)\n",
+           out_path, name, layer_count, width, height,
+           layer_size * layer_count);
+  } else if (status == 0) {
+    fprintf(stderr, "Failed to open %s for writing\n", out_path);
+    status = -1;
+  }
+
+  for (int i = 0; i < layer_count; ++i) {
+    if (layers[i] != NULL) {
+      stbi_image_free(layers[i]);
+    }
+  }
+
+  free(layers);
+
+  return status;
+}
@@ -1,22 +1,83 @@
 /*
  * GenHexer
- * Small utility for converting files to C headers
+ * Small utility for converting files to C headers, or for bundling several
+ * files into a single C source file along with an index table
  */
 
+#include <ctype.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-int main(int argc, const char **argv) {
-  if (argc < 4) {
-    fputs("Usage: genhexer <infile> <outfile> <name>\n", stderr);
-    return -1;
-  }
+#define HEX_BYTES_PER_LINE 16
+
+typedef enum { BUNDLE_MODE_HEX, BUNDLE_MODE_ASM, BUNDLE_MODE_EMBED } mode_t_;
+
+typedef struct resource_t {
+  const char *path;
+  const char *name;
+  char *symbol;
+  unsigned long size;
+} resource_t;
+
+static const char *USAGE =
+    "Usage: genhexer <infile> <outfile> <name>\n"
+    "       genhexer --bundle <hex|asm|embed> <bundle> <out.c> <out.h> "
+    "<infile> [<infile> ...]\n";
+
+// writes each byte of a file as a hexadecimal literal followed by a comma,
+// formatting whole lines at once rather than calling fprintf per byte
+static unsigned long write_hex_bytes(FILE *in_file, FILE *out_file,
+                                     bool line_breaks) {
+  static const char digits[] = "0123456789abcdef";
 
-  const char *in_path = argv[1];
-  const char *out_path = argv[2];
-  const char *name = argv[3];
+  unsigned char buffer[4096];
+  const size_t buffer_len = sizeof(buffer) / sizeof(unsigned char);
+
+  // each byte takes up six characters ("0xNN, "), plus a possible newline
+  char line[sizeof(buffer) * 6 + sizeof(buffer) / HEX_BYTES_PER_LINE + 1];
+
+  unsigned long total = 0;
+  size_t read_n = 0;
+  do {
+    read_n = fread(&buffer, sizeof(unsigned char), buffer_len, in_file);
 
+    char *cursor = line;
+    for (size_t i = 0; i < read_n; ++i) {
+      *cursor++ = '0';
+      *cursor++ = 'x';
+      *cursor++ = digits[buffer[i] >> 4];
+      *cursor++ = digits[buffer[i] & 0xF];
+      *cursor++ = ',';
+      if (line_breaks && (total + i + 1) % HEX_BYTES_PER_LINE == 0) {
+        *cursor++ = '\n';
+      } else {
+        *cursor++ = ' ';
+      }
+    }
+
+    fwrite(line, sizeof(char), cursor - line, out_file);
+    total += read_n;
+  } while (read_n == buffer_len);
+
+  return total;
+}
+
+static int write_header(const char *in_path, const char *out_path,
+                        const char *name) {
   FILE *in_file = fopen(in_path, "rb");
+  if (in_file == NULL) {
+    fprintf(stderr, "Failed to open %s\n", in_path);
+    return -1;
+  }
+
   FILE *out_file = fopen(out_path, "wb+");
+  if (out_file == NULL) {
+    fprintf(stderr, "Failed to open %s for writing\n", out_path);
+    fclose(in_file);
+    return -1;
+  }
 
   // get input file size
   fseek(in_file, 0, SEEK_END);
@@ -29,21 +90,9 @@ int main(int argc, const char **argv) {
   // +1 to length to account for null terminator
   fprintf(out_file, "const unsigned char %s[%lu] = { ", name, in_size + 1);
 
-  // allocate a buffer on the stack,
-  unsigned char buffer[4096];
-  const size_t buffer_len = sizeof(buffer) / sizeof(unsigned char);
-
-  // reset cursor position for input file and perform buffered reading
+  // reset cursor position for input file and perform buffered writing
   fseek(in_file, 0, SEEK_SET);
-  size_t read_n = 0;
-  do {
-    read_n = fread(&buffer, sizeof(unsigned char), buffer_len, in_file);
-    for (unsigned long i = 0; i < read_n; ++i) {
-      // write each byte from the file as a hexadecimal-formatted literal
-      // followed by a comma
-      fprintf(out_file, "0x%02x, ", buffer[i]);
-    }
-  } while (read_n == buffer_len);
+  write_hex_bytes(in_file, out_file, false);
 
   // tack a null-terminator onto the end for good measure
   fputs("0x00 };\n", out_file);
@@ -60,4 +109,277 @@ int main(int argc, const char **argv) {
          "         name: %s\n"
          "         size: %lu bytes\n",
          in_path, out_path, name, in_size);
+
+  return 0;
+}
+
+static int compare_resources(const void *a, const void *b) {
+  return strcmp(((const resource_t *)a)->name, ((const resource_t *)b)->name);
+}
+
+static char *make_symbol(const char *bundle, const char *name) {
+  // <bundle>_<name>, with anything that isn't valid in an identifier replaced
+  // by an underscore
+  size_t length = strlen(bundle) + strlen(name) + 2;
+  char *symbol = malloc(length);
+  if (symbol == NULL) {
+    return NULL;
+  }
+
+  snprintf(symbol, length, "%s_%s", bundle, name);
+  for (char *c = symbol; *c != '\0'; ++c) {
+    if (!isalnum((unsigned char)*c)) {
+      *c = '_';
+    }
+  }
+
+  return symbol;
+}
+
+static void write_escaped_path(FILE *out_file, const char *path) {
+  // paths end up inside of string literals, so escape them accordingly
+  for (const char *c = path; *c != '\0'; ++c) {
+    if (*c == '\\' || *c == '"') {
+      fputc('\\', out_file);
+    }
+    fputc(*c, out_file);
+  }
+}
+
+static void write_bundle_asm(FILE *out_file, resource_t *resources,
+                             int count) {
+  // data is pulled in by the assembler with .incbin, so the compiler never
+  // has to parse it
+  fputs("#if defined(__APPLE__)\n"
+        "#define EMBED_SECTION \".const_data\\n\"\n"
+        "#elif defined(_WIN32)\n"
+        "#define EMBED_SECTION \".section .rdata, \\\"dr\\\"\\n\"\n"
+        "#else\n"
+        "#define EMBED_SECTION \".section .rodata\\n\"\n"
+        "#endif\n\n"
+        "#if defined(__APPLE__) || (defined(_WIN32) && !defined(_WIN64))\n"
+        "#define EMBED_SYMBOL(name) \"_\" #name\n"
+        "#else\n"
+        "#define EMBED_SYMBOL(name) #name\n"
+        "#endif\n\n",
+        out_file);
+
+  fputs("__asm__(EMBED_SECTION\n", out_file);
+  for (int i = 0; i < count; ++i) {
+    fprintf(out_file,
+            "        \".global \" EMBED_SYMBOL(%s) \"\\n\"\n"
+            "        \".balign 16\\n\"\n"
+            "        EMBED_SYMBOL(%s) \":\\n\"\n"
+            "        \".incbin \\\"",
+            resources[i].symbol, resources[i].symbol);
+    // the path is written into a string literal within a string literal
+    for (const char *c = resources[i].path; *c != '\0'; ++c) {
+      if (*c == '\\' || *c == '"') {
+        fputs("\\\\\\", out_file);
+      }
+      fputc(*c, out_file);
+    }
+    fputs("\\\"\\n\"\n"
+          "        \".byte 0\\n\"\n",
+          out_file);
+  }
+  fputs("        \".text\\n\");\n\n", out_file);
+
+  for (int i = 0; i < count; ++i) {
+    fprintf(out_file, "extern const unsigned char %s[];\n",
+            resources[i].symbol);
+  }
+}
+
+static int write_bundle_data(FILE *out_file, resource_t *resources, int count,
+                             mode_t_ mode) {
+  for (int i = 0; i < count; ++i) {
+    // +1 to length to account for null terminator
+    fprintf(out_file, "const unsigned char %s[%lu] = {\n", resources[i].symbol,
+            resources[i].size + 1);
+
+    if (mode == BUNDLE_MODE_EMBED) {
+      // the separating comma is only emitted for non-empty files, since an
+      // empty one expands to nothing
+      fputs("#embed \"", out_file);
+      write_escaped_path(out_file, resources[i].path);
+      fputs("\" suffix(,)\n", out_file);
+    } else {
+      FILE *in_file = fopen(resources[i].path, "rb");
+      if (in_file == NULL) {
+        fprintf(stderr, "Failed to open %s\n", resources[i].path);
+        return -1;
+      }
+
+      write_hex_bytes(in_file, out_file, true);
+      fclose(in_file);
+    }
+
+    // tack a null-terminator onto the end for good measure
+    fputs("0x00 };\n\n", out_file);
+  }
+
+  return 0;
+}
+
+static int write_bundle(mode_t_ mode, const char *bundle, const char *source,
+                        const char *header, resource_t *resources, int count) {
+  FILE *out_file = fopen(source, "wb+");
+  if (out_file == NULL) {
+    fprintf(stderr, "Failed to open %s for writing\n", source);
+    return -1;
+  }
+
+  fprintf(out_file,
+          "/* Generated by genhexer; do not edit */\n\n"
+          "#include <stddef.h>\n\n"
+          "#include \"resource.h\"\n\n");
+
+  int status = 0;
+  if (mode == BUNDLE_MODE_ASM) {
+    write_bundle_asm(out_file, resources, count);
+  } else {
+    status = write_bundle_data(out_file, resources, count, mode);
+  }
+
+  // the index is sorted by name so that lookups can use a binary search
+  fprintf(out_file, "\nconst procy_embedded_resource_t %s_index[%d] = {\n",
+          bundle, count);
+  for (int i = 0; i < count; ++i) {
+    fprintf(out_file, "    {\"%s\", %s, %lu},\n", resources[i].name,
+            resources[i].symbol, resources[i].size);
+  }
+  fputs("};\n", out_file);
+  fprintf(out_file, "\nconst size_t %s_count = %d;\n", bundle, count);
+
+  fclose(out_file);
+
+  out_file = fopen(header, "wb+");
+  if (out_file == NULL) {
+    fprintf(stderr, "Failed to open %s for writing\n", header);
+    return -1;
+  }
+
+  // write include-guards and declarations
+  fprintf(out_file, "#ifndef %s_H\n", bundle);
+  fprintf(out_file, "#define %s_H\n\n", bundle);
+  fputs("#include <stddef.h>\n\n", out_file);
+  fputs("#include \"resource.h\"\n\n", out_file);
+  for (int i = 0; i < count; ++i) {
+    fprintf(out_file, "extern const unsigned char %s[];\n",
+            resources[i].symbol);
+    fprintf(out_file, "#define %s_size %lu\n", resources[i].symbol,
+            resources[i].size);
+  }
+  fprintf(out_file,
+          "\nextern const procy_embedded_resource_t %s_index[];\n",
+          bundle);
+  fprintf(out_file, "extern const size_t %s_count;\n\n", bundle);
+
+  // terminate include guard
+  fprintf(out_file, "#endif\n");
+
+  fclose(out_file);
+
+  return status;
+}
+
+static int bundle_main(int argc, const char **argv) {
+  if (argc < 7) {
+    fputs(USAGE, stderr);
+    return -1;
+  }
+
+  mode_t_ mode;
+  if (strcmp(argv[2], "hex") == 0) {
+    mode = BUNDLE_MODE_HEX;
+  } else if (strcmp(argv[2], "asm") == 0) {
+    mode = BUNDLE_MODE_ASM;
+  } else if (strcmp(argv[2], "embed") == 0) {
+    mode = BUNDLE_MODE_EMBED;
+  } else {
+    fprintf(stderr, "Unknown bundle mode \"%s\"\n", argv[2]);
+    return -1;
+  }
+
+  const char *bundle = argv[3];
+  const char *source = argv[4];
+  const char *header = argv[5];
+  const int count = argc - 6;
+
+  resource_t *resources = calloc(count, sizeof(resource_t));
+  if (resources == NULL) {
+    return -1;
+  }
+
+  int status = 0;
+  for (int i = 0; i < count && status == 0; ++i) {
+    resource_t *resource = &resources[i];
+    resource->path = argv[i + 6];
+
+    // resources are looked up by their file name
+    const char *name = strrchr(resource->path, '/');
+#ifdef _WIN32
+    const char *alt_name = strrchr(resource->path, '\\');
+    if (alt_name != NULL && (name == NULL || alt_name > name)) {
+      name = alt_name;
+    }
+#endif
+    resource->name = name != NULL ? name + 1 : resource->path;
+    resource->symbol = make_symbol(bundle, resource->name);
+
+    FILE *in_file = fopen(resource->path, "rb");
+    if (in_file == NULL || resource->symbol == NULL) {
+      fprintf(stderr, "Failed to open %s\n", resource->path);
+      status = -1;
+    } else {
+      fseek(in_file, 0, SEEK_END);
+      resource->size = ftell(in_file);
+    }
+
+    if (in_file != NULL) {
+      fclose(in_file);
+    }
+  }
+
+  if (status == 0) {
+    qsort(resources, count, sizeof(resource_t), compare_resources);
+    status = write_bundle(mode, bundle, source, header, resources, count);
+  }
+
+  if (status == 0) {
+    // report results
+    unsigned long total = 0;
+    for (int i = 0; i < count; ++i) {
+      total += resources[i].size;
+    }
+
+    printf("GenHexer bundle: %s,\n"
+           "         output: %s, %s\n"
+           "         mode: %s\n"
+           "         resources: %d\n"
+           "         size: %lu bytes\n",
+           bundle, source, header, argv[2], count, total);
+  }
+
+  for (int i = 0; i < count; ++i) {
+    free(resources[i].symbol);
+  }
+
+  free(resources);
+
+  return status;
+}
+
+int main(int argc, const char **argv) {
+  if (argc > 1 && strcmp(argv[1], "--bundle") == 0) {
+    return bundle_main(argc, argv);
+  }
+
+  if (argc < 4) {
+    fputs(USAGE, stderr);
+    return -1;
+  }
+
+  return write_header(argv[1], argv[2], argv[3]);
 }